@@ -29,6 +29,7 @@
 #define _GNU_SOURCE
 
 #include <stdbool.h>
+#include <ctype.h>
 #include <getopt.h>
 #include <dirent.h>
 #include <errno.h>
@@ -41,6 +42,8 @@
 #include <locale.h>
 #include <libgen.h>
 #include <glob.h>
+#include <endian.h>
+#include <inttypes.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -77,13 +80,178 @@ typedef struct programOptions {
      * Dump directory.
      */
     char* dumpDir;
+
+    /**
+     * Rows filter (--where), NULL if none.
+     */
+    struct filter* rowFilter;
+
+    /**
+     * Number of hash partitioned output files per collection (0: no sharding).
+     */
+    unsigned int shards;
+
+    /**
+     * Column to hash rows on when sharding.
+     */
+    char* shardKey;
+
+    /**
+     * Output documents are sorted by primary key.
+     */
+    bool sortByPk;
+
+    /**
+     * Sort memory budget (bytes).
+     */
+    size_t sortMemory;
+
+    /**
+     * Temporary files directory (defaults to dump directory).
+     */
+    char* tempDir;
+
+    /**
+     * Documents `_id` is built from the EPF primary key.
+     */
+    bool pkId;
+
+    /**
+     * Columnar cache directory, NULL if none.
+     */
+    char* cacheDir;
+
+    /**
+     * Also write an Arrow IPC file per collection.
+     */
+    bool arrow;
+
+    /**
+     * Rows per Arrow record batch.
+     */
+    size_t arrowBatchRows;
+
+    /**
+     * Also write an NDJSON (relaxed Extended JSON) file per collection.
+     */
+    bool ndjson;
+
+    /**
+     * Invalid UTF-8 strings handling (UTF8_MODE_*).
+     */
+    unsigned char invalidUtf8;
+
+    /**
+     * MongoDB server URI to insert documents into, NULL to write BSON files.
+     */
+    char* mongoUri;
+
+    /**
+     * Connections to MongoDB server.
+     */
+    size_t mongoConnections;
+
+    /**
+     * Previous dump directory to merge EPF files into, NULL if not merging.
+     */
+    char* mergeBase;
+
+    /**
+     * Older incremental EPF files directories, merged before epfDir (NULL terminated).
+     */
+    char** mergeEpf;
+
+    /**
+     * Duplicate primary keys handling (DEDUP_*).
+     */
+    unsigned char dedup;
+
+    /**
+     * Write BSON files through a preallocated mapping instead of stdio.
+     */
+    bool mmapOutput;
+
+    /**
+     * Check EPF files against their .md5 file while reading them.
+     */
+    bool verifyMd5;
+
+    /**
+     * Write a CRC32C of each BSON file (<file>.crc32c).
+     */
+    bool bsonCrc32c;
+
+    /**
+     * Only check EPF files, nothing is written.
+     */
+    bool check;
+
+    /**
+     * Malformed records file path, NULL if none.
+     */
+    char* rejectFile;
+
+    /**
+     * Rejected records count aborting the run (0 : no limit).
+     */
+    unsigned long maxErrors;
+
+    /**
+     * Malformed records log.
+     */
+    struct rejectLog* rejects;
+
+    /**
+     * EPF and BSON files pages are dropped from page cache once used.
+     */
+    bool dropBehind;
+
+    /**
+     * Memory budget (bytes, 0 : no limit).
+     */
+    size_t maxMemory;
+
+    /**
+     * Longest EPF record accepted (bytes, 0 : no limit).
+     */
+    size_t maxRecord;
+
+    /**
+     * Writers buffers size (cache row groups, Arrow record batches and
+     * MongoDB insert batches, bytes, 0 : their defaults).
+     */
+    size_t bufferMemory;
+
+    /**
+     * Per column statistics are written in <collection>.stats.json.
+     */
+    bool stats;
+
+    /**
+     * Entries converted per batch, 0 to convert entries one at a time.
+     */
+    size_t batchRows;
+
+    /**
+     * Filters expressions hash (outputs depend on them).
+     */
+    uint64_t filterHash;
+
+    /**
+     * A run manifest is written in dump directory.
+     */
+    bool manifest;
+
+    /**
+     * Previous dump directory to reuse outputs of unchanged inputs from, NULL if none.
+     */
+    char* reuseDir;
 } programOptions;
 
 
 
 
 extern programOptions*  epf2bsonOptions;
-extern bool             epfRecoverableReadEmpty;
 extern int              errno;
 
 
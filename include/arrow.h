@@ -0,0 +1,188 @@
+/**
+ * Arrow IPC file (Feather v2) writer includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _ARROW_H_INCLUDED_
+#define _ARROW_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "epf.h"
+#include "flatbuffer.h"
+#include "sink.h"
+
+/**
+ * Default rows count per record batch.
+ */
+#define ARROW_BATCH_ROWS            65536
+
+/**
+ * Arrow column of current record batch.
+ *
+ * EPF types map to : INTEGER, BIGINT -> int64, BOOLEAN -> bool,
+ * DECIMAL -> double, DATETIME -> timestamp[ms], VARCHAR, LONGTEXT -> utf8.
+ */
+typedef struct arrowColumn {
+    /**
+     * Field type (EPF_FIELDTYPE_*).
+     */
+    unsigned char fieldType;
+    /**
+     * Validity bitmap (bit set if not null).
+     */
+    unsigned char* validity;
+    /**
+     * Values (int64 / double) or bitmap (bool), unused for utf8.
+     */
+    unsigned char* values;
+    /**
+     * Utf8 offsets (rows + 1).
+     */
+    int32_t* offsets;
+    /**
+     * Utf8 data.
+     */
+    char* data;
+    /**
+     * Utf8 data allocated size.
+     */
+    size_t dataAllocated;
+    /**
+     * Utf8 data used length.
+     */
+    size_t dataLength;
+    /**
+     * Null values count.
+     */
+    int64_t nullCount;
+} arrowColumn;
+
+/**
+ * Written record batch position, for the file footer.
+ */
+typedef struct arrowBlock {
+    /**
+     * Message offset in file.
+     */
+    int64_t offset;
+    /**
+     * Message metadata length (prefix and padding included).
+     */
+    int32_t metaDataLength;
+    /**
+     * Message body length.
+     */
+    int64_t bodyLength;
+} arrowBlock;
+
+/**
+ * Arrow IPC file being written.
+ */
+typedef struct arrowWriter {
+    /**
+     * Output file.
+     */
+    FILE* fp;
+    /**
+     * EPF file description.
+     */
+    EPFFile* file;
+    /**
+     * Columns (fieldsCount).
+     */
+    arrowColumn* columns;
+    /**
+     * Maximum rows per record batch.
+     */
+    size_t batchRows;
+    /**
+     * Strings bytes a record batch is flushed at, 0 for no limit.
+     */
+    size_t batchBytes;
+    /**
+     * Rows in current batch.
+     */
+    size_t rows;
+    /**
+     * Current file position.
+     */
+    int64_t position;
+    /**
+     * Written record batches.
+     */
+    arrowBlock* batches;
+    /**
+     * Written record batches count.
+     */
+    size_t batchesCount;
+    /**
+     * Record batches array allocated size.
+     */
+    size_t batchesAllocated;
+    /**
+     * Metadata builder.
+     */
+    flatBuilder* builder;
+} arrowWriter;
+
+
+/**
+ * Starts writing an Arrow IPC file.
+ *
+ * \param path      Arrow file path.
+ * \param file      EPFFile instance (header parsed).
+ * \param batchRows Maximum rows per record batch.
+ *
+ * \return Arrow writer.
+ */
+arrowWriter* arrowCreate(char* path, EPFFile* file, size_t batchRows);
+
+/**
+ * Appends an entry.
+ *
+ * \param writer Arrow writer.
+ * \param values Typed values (fieldsCount values).
+ */
+void arrowAppend(arrowWriter* writer, EPFValue* values);
+
+/**
+ * Writes last record batch and file footer, then closes file.
+ *
+ * \param writer Arrow writer (destroyed).
+ */
+void arrowClose(arrowWriter* writer);
+
+/**
+ * Creates a sink writing entries to an Arrow file, closing it when done.
+ *
+ * \param writer Arrow writer.
+ *
+ * \return Sink.
+ */
+rowSink* arrowSink(arrowWriter* writer);
+
+
+#endif /* _ARROW_H_INCLUDED_ */
@@ -79,7 +79,7 @@ typedef double  bsonDouble;
 //#define BSON_TYPE_MAXKEY          '\x7F'
 
 /**
- * Bson document.
+ * Bson document, serialized as fields are added.
  */
 typedef struct bsonDocument {
     /**
@@ -87,21 +87,33 @@ typedef struct bsonDocument {
      */
     size_t fieldCount;
     /**
-     * Document field name.
+     * Document field names offsets in buffer.
      */
-    char** fieldNames;
+    size_t* fieldNames;
     /**
      * Document field types.
      */
     bsonByte* fieldTypes;
     /**
-     * Document field values.
+     * Serialized document (size placeholder then fields, no terminator).
      */
-    void** fields;
+    char* buffer;
+    /**
+     * Buffer used length.
+     */
+    size_t length;
+    /**
+     * Buffer allocated size (internal).
+     */
+    size_t _allocated;
     /**
      * Last allocations size (internal).
      */
     size_t _lastAllocationsSize;
+    /**
+     * Memory ran out while building document (cleared by reset).
+     */
+    bool outOfMemory;
 } bsonDocument;
 
 /**
@@ -122,10 +134,17 @@ typedef struct bsonSerializedValue {
 /**
  * Creates a new BSON document.
  *
- * \return Document.
+ * \return Document, NULL if memory could not be allocated.
  */
 bsonDocument* createBsonDocument();
 
+/**
+ * Empties a document to fill it again (keeps its memory).
+ *
+ * \param document Document to reset.
+ */
+void resetBsonDocument(bsonDocument* document);
+
 /**
  * Destroys a bson document instance.
  *
@@ -148,7 +167,9 @@ bool fieldNameExists(bsonDocument* document, char* name);
  *
  * \param document Document to insert into.
  *
- * \return BSON serialized. (`binaryValue` must be free()'d after use).
+ * \return BSON serialized. (`binaryValue` belongs to document and is valid
+ *         until it is modified, reset or destroyed, NULL if memory ran out
+ *         while building document).
  */
 bsonSerializedValue bsonSerialize(bsonDocument* document);
 
@@ -179,7 +200,7 @@ bool bsonAddString(bsonDocument* document, char* name, char* value);
  *
  * \param document Document to insert into.
  * \param name     Value name in document.
- * \param value    Document.
+ * \param value    Document (copied, still owned by caller).
  *
  * \return true on success, false on error.
  */
@@ -190,7 +211,8 @@ bool bsonAddSubDocument(bsonDocument* document, char* name, bsonDocument* value)
  *
  * \param document Document to insert into.
  * \param name     Value name in document.
- * \param value    Document (must be a Document with string numerical index).
+ * \param value    Document (must be a Document with string numerical index,
+ *                 copied, still owned by caller).
  *
  * \return true on success, false on error.
  */
@@ -260,5 +282,30 @@ bool bsonAddInt32(bsonDocument* document, char* name, bsonInt32 value);
  */
 bool bsonAddInt64(bsonDocument* document, char* name, bsonInt64 value);
 
+/**
+ * Finds a top level field of a serialized BSON document.
+ *
+ * \param document Document.
+ * \param length   Document length.
+ * \param name     Field name.
+ * \param type     Filled with field type.
+ *
+ * \return Field value, NULL if not found.
+ */
+const char* bsonFindField(const char* document, size_t length, const char* name, char* type);
+
+/**
+ * Iterates over top level fields of a serialized BSON document.
+ *
+ * \param document Document.
+ * \param length   Document length.
+ * \param position Read position, 4 for first field (updated).
+ * \param name     Filled with field name.
+ * \param type     Filled with field type.
+ *
+ * \return Field value, NULL at document end (or if it is malformed).
+ */
+const char* bsonNextField(const char* document, size_t length, size_t* position, const char** name, char* type);
+
 
 #endif /* _BSON_H_INCLUDED_ */
\ No newline at end of file
@@ -0,0 +1,293 @@
+/**
+ * Columnar binary cache of parsed EPF files includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _CACHE_H_INCLUDED_
+#define _CACHE_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "epf.h"
+
+/**
+ * Cache files magic numbers and format version.
+ */
+#define CACHE_MAGIC                 "EPF2BSNC"
+#define CACHE_TRAILER_MAGIC         "EPF2BSNE"
+#define CACHE_VERSION               2
+
+/**
+ * Trailer size : magic, rows count and rejects offset.
+ */
+#define CACHE_TRAILER_SIZE          24
+
+/**
+ * Row group limits : rows count and strings bytes.
+ */
+#define CACHE_GROUP_ROWS            65536
+#define CACHE_GROUP_BYTES           67108864
+
+/**
+ * Cache file layout (native endianness, every section 8 bytes aligned) :
+ *
+ *  header  : magic, version, fields count, source size and mtime,
+ *            incremental flag, primary key, fields (type, indexed,
+ *            capacity, name).
+ *  groups  : rows count, group length, uint64 entries offsets in EPF file,
+ *            then for each column a null bitmap, fixed width values (int64
+ *            for integers, uint8 for booleans, double for decimals, none for
+ *            varchar, longtext and datetime), uint64 offsets (rows + 1) and a
+ *            blob of 0 terminated raw values, as read from the EPF file.
+ *  rejects : malformed records (offset in EPF file, reason and record
+ *            lengths, reason, record), replayed in EPF file order.
+ *  trailer : trailer magic, total rows count, rejects offset.
+ */
+
+/**
+ * Cache column (in memory while writing, pointers into mapping while reading).
+ */
+typedef struct cacheColumn {
+    /**
+     * Field type (EPF_FIELDTYPE_*).
+     */
+    unsigned char fieldType;
+    /**
+     * Null bitmap (bit set if null).
+     */
+    unsigned char* nulls;
+    /**
+     * Fixed width values.
+     */
+    unsigned char* values;
+    /**
+     * String offsets in blob.
+     */
+    uint64_t* offsets;
+    /**
+     * Strings blob.
+     */
+    char* blob;
+    /**
+     * Blob allocated size (writing only).
+     */
+    size_t blobAllocated;
+    /**
+     * Blob used length (writing only).
+     */
+    size_t blobLength;
+} cacheColumn;
+
+/**
+ * Cache file being written.
+ */
+typedef struct cacheWriter {
+    /**
+     * Final cache path.
+     */
+    char* path;
+    /**
+     * Temporary path, renamed to path on commit.
+     */
+    char* temporaryPath;
+    /**
+     * Temporary file.
+     */
+    FILE* fp;
+    /**
+     * Columns (fieldsCount).
+     */
+    cacheColumn* columns;
+    /**
+     * Columns count.
+     */
+    size_t columnsCount;
+    /**
+     * Entries offsets in EPF file (current group).
+     */
+    uint64_t* entryOffsets;
+    /**
+     * Rows in current group.
+     */
+    size_t groupRows;
+    /**
+     * Malformed records, in rejects section layout.
+     */
+    unsigned char* rejects;
+    /**
+     * Malformed records allocated size.
+     */
+    size_t rejectsAllocated;
+    /**
+     * Malformed records used length.
+     */
+    size_t rejectsLength;
+    /**
+     * Malformed records handler cacheReject forwards to, NULL for none.
+     */
+    epfRejectHandler reject;
+    /**
+     * Forwarded malformed records handler context.
+     */
+    void* rejectContext;
+    /**
+     * Rows written so far.
+     */
+    uint64_t rowsCount;
+    /**
+     * Strings bytes a row group is flushed at (CACHE_GROUP_BYTES by default).
+     */
+    size_t maxGroupBytes;
+} cacheWriter;
+
+/**
+ * Cache file being read.
+ */
+typedef struct cacheReader {
+    /**
+     * EPF file description rebuilt from cache header.
+     */
+    EPFFile* file;
+    /**
+     * File mapping.
+     */
+    unsigned char* mapping;
+    /**
+     * Mapping length.
+     */
+    size_t mappingLength;
+    /**
+     * Next group offset in mapping.
+     */
+    size_t nextGroup;
+    /**
+     * Rejects section offset in mapping (end of groups).
+     */
+    size_t groupsEnd;
+    /**
+     * Next malformed record to replay.
+     */
+    size_t nextReject;
+    /**
+     * Columns of current group.
+     */
+    cacheColumn* columns;
+    /**
+     * Entries offsets in EPF file (current group).
+     */
+    uint64_t* entryOffsets;
+    /**
+     * Rows in current group.
+     */
+    size_t groupRows;
+    /**
+     * Next row in current group.
+     */
+    size_t groupRow;
+    /**
+     * Raw entry handed back to caller.
+     */
+    char** entry;
+    /**
+     * Set when the EPFFile's reject handler asked to stop reading.
+     */
+    bool rejectsExceeded;
+} cacheReader;
+
+
+/**
+ * Opens a cache file, if it exists and matches the EPF source file.
+ *
+ * \param path   Cache file path.
+ * \param source EPF source file stat.
+ *
+ * \return Cache reader, NULL if there is no usable cache.
+ */
+cacheReader* cacheOpen(char* path, struct stat* source);
+
+/**
+ * Gets next cached entry, after replaying the malformed records before it to
+ * the EPFFile's reject handler (lastEntryOffset is set to the entry offset).
+ *
+ * \param reader Cache reader.
+ * \param values Typed values (fieldsCount values).
+ *
+ * \return Raw entry (owned by reader, valid until next call) or NULL at end
+ *         (or if rejectsExceeded is set).
+ */
+char** cacheNext(cacheReader* reader, EPFValue* values);
+
+/**
+ * Closes a cache reader (and destroys its EPFFile).
+ *
+ * \param reader Cache reader.
+ */
+void cacheClose(cacheReader* reader);
+
+/**
+ * Starts writing a cache file.
+ *
+ * \param path   Cache file path.
+ * \param file   EPFFile instance (header parsed).
+ * \param source EPF source file stat.
+ *
+ * \return Cache writer.
+ */
+cacheWriter* cacheCreate(char* path, EPFFile* file, struct stat* source);
+
+/**
+ * Appends an entry to cache.
+ *
+ * \param writer Cache writer.
+ * \param offset Entry offset in EPF file.
+ * \param values Typed values (fieldsCount values).
+ */
+void cacheAppend(cacheWriter* writer, uint64_t offset, EPFValue* values);
+
+/**
+ * Malformed records handler storing records in cache, then forwarding them to
+ * the writer's reject handler.
+ *
+ * \param context Cache writer.
+ * \param offset  Record offset in EPF file.
+ * \param reason  Reason.
+ * \param record  Raw record, record separator excluded.
+ * \param length  Raw record length.
+ *
+ * \return Forwarded handler result, true if none.
+ */
+bool cacheReject(void* context, uint64_t offset, const char* reason, const char* record, size_t length);
+
+/**
+ * Completes cache file and makes it available to next runs.
+ *
+ * \param writer Cache writer (destroyed).
+ */
+void cacheCommit(cacheWriter* writer);
+
+
+#endif /* _CACHE_H_INCLUDED_ */
@@ -0,0 +1,134 @@
+/**
+ * Validation only scan of EPF files includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _CHECK_H_INCLUDED_
+#define _CHECK_H_INCLUDED_
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "epf.h"
+
+/**
+ * Invalid values of a field.
+ */
+typedef struct checkField {
+    /**
+     * Values not matching field type syntax (numbers, booleans, dates).
+     */
+    unsigned long invalid;
+    /**
+     * First entry (1 based) with a value not matching field type syntax, 0 if none.
+     */
+    unsigned long invalidFirstEntry;
+    /**
+     * Strings with invalid UTF-8.
+     */
+    unsigned long invalidUtf8;
+    /**
+     * First entry (1 based) with invalid UTF-8, 0 if none.
+     */
+    unsigned long invalidUtf8FirstEntry;
+    /**
+     * Strings longer than field capacity (characters).
+     */
+    unsigned long tooLong;
+    /**
+     * First entry (1 based) with a string longer than field capacity, 0 if none.
+     */
+    unsigned long tooLongFirstEntry;
+} checkField;
+
+/**
+ * EPF file check report.
+ */
+typedef struct checkReport {
+    /**
+     * Checked file.
+     */
+    EPFFile* file;
+    /**
+     * Entries read.
+     */
+    unsigned long entries;
+    /**
+     * Records with a wrong field count (skipped).
+     */
+    unsigned long badRecords;
+    /**
+     * Entries count declared by the #recordsWritten trailer, -1 if none.
+     */
+    long recordsWritten;
+    /**
+     * Fields reports (fieldsCount).
+     */
+    checkField* fields;
+    /**
+     * Bytes read.
+     */
+    uint64_t bytes;
+    /**
+     * Scan duration (seconds).
+     */
+    double seconds;
+} checkReport;
+
+
+/**
+ * Reads an EPF file up to its end, checking every entry.
+ *
+ * \param file EPFFile instance (header parsed).
+ *
+ * \return Report.
+ */
+checkReport* checkFile(EPFFile* file);
+
+/**
+ * Counts errors found.
+ *
+ * \param report Report.
+ *
+ * \return Invalid records and values count, plus 1 if #recordsWritten is
+ *         missing or does not match entries count.
+ */
+unsigned long checkErrors(checkReport* report);
+
+/**
+ * Shows a report.
+ *
+ * \param report Report.
+ * \param path   EPF file path.
+ */
+void checkPrint(checkReport* report, char* path);
+
+/**
+ * Destroy a report and release memory.
+ *
+ * \param report Report.
+ */
+void checkDestroy(checkReport* report);
+
+
+#endif /* _CHECK_H_INCLUDED_ */
@@ -0,0 +1,218 @@
+/**
+ * Duplicate primary keys detection includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _DEDUP_H_INCLUDED_
+#define _DEDUP_H_INCLUDED_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/**
+ * Deduplication modes.
+ */
+#define DEDUP_NONE                  0
+#define DEDUP_KEEP_FIRST            1
+#define DEDUP_KEEP_LAST             2
+
+/**
+ * Bloom filter bits per key (about 0.2% false positives).
+ */
+#define DEDUP_BLOOM_BITS            16
+
+/**
+ * Bloom filter bits set per key.
+ */
+#define DEDUP_BLOOM_PROBES          7
+
+/**
+ * Rows sampled to estimate the rows count of a file.
+ */
+#define DEDUP_SAMPLE_ROWS           4096
+
+/**
+ * Exact candidate key : scanned, with its last row (keep last mode), or seen
+ * while converting (keep first mode).
+ */
+typedef struct dedupSeen {
+    /**
+     * Key fingerprint (0 for an empty slot).
+     */
+    uint64_t fingerprint;
+    /**
+     * Key offset in keys storage.
+     */
+    size_t offset;
+    /**
+     * Key length.
+     */
+    size_t length;
+    /**
+     * Row of its last occurrence (keep last).
+     */
+    uint64_t row;
+} dedupSeen;
+
+/**
+ * Duplicate primary keys filter.
+ *
+ * A first scan of the file adds every key fingerprint to a blocked Bloom
+ * filter sized from the file size and the average length of sampled rows.
+ * Keys already (maybe) in the filter are kept, exactly, in a fingerprint
+ * set : every key occurring more than once ends up in that set, along with a
+ * few false positives. In keep last mode, their keys are also kept with the
+ * row of their last occurrence (as the sampled rows keys, scanned before the
+ * Bloom filter is sized).
+ *
+ * While converting, rows come in the same order and only candidates, found
+ * with a small Bloom filter of the set as prefilter, may be dropped : all
+ * but the last occurrence (keep last), or the occurrences of a key already
+ * seen, its candidates keys being kept exactly (keep first). Keys are always
+ * compared exactly and entries order is kept.
+ */
+typedef struct dedupFilter {
+    /**
+     * Bloom filter, blocks of 8 words (one cache line).
+     */
+    uint64_t* bloom;
+    /**
+     * Bloom filter blocks count.
+     */
+    size_t bloomBlocks;
+    /**
+     * Candidates fingerprints (open addressing, 0 is empty).
+     */
+    uint64_t* slots;
+    /**
+     * Candidates set capacity (power of 2).
+     */
+    size_t capacity;
+    /**
+     * Candidates count.
+     */
+    size_t count;
+    /**
+     * Deduplication mode (DEDUP_KEEP_*).
+     */
+    unsigned char mode;
+    /**
+     * Fingerprints of sampled rows, until the Bloom filter is sized.
+     */
+    uint64_t* pending;
+    /**
+     * Sampled rows count.
+     */
+    size_t pendingCount;
+    /**
+     * Sampled rows bytes.
+     */
+    uint64_t sampledBytes;
+    /**
+     * Source file size.
+     */
+    uint64_t sourceBytes;
+    /**
+     * Rows scanned.
+     */
+    uint64_t scanned;
+    /**
+     * Rows checked while converting.
+     */
+    uint64_t checked;
+    /**
+     * Exact candidates keys, scanned (keep last) or seen while converting
+     * (keep first), open addressing.
+     */
+    dedupSeen* seen;
+    /**
+     * Exact keys set capacity (power of 2).
+     */
+    size_t seenCapacity;
+    /**
+     * Exact keys count.
+     */
+    size_t seenCount;
+    /**
+     * Exact keys storage.
+     */
+    unsigned char* keys;
+    /**
+     * Exact keys storage used length.
+     */
+    size_t keysLength;
+    /**
+     * Exact keys storage allocated size.
+     */
+    size_t keysAllocated;
+} dedupFilter;
+
+
+/**
+ * Starts scanning a file.
+ *
+ * \param sourceBytes Source file size.
+ * \param mode        Deduplication mode (DEDUP_KEEP_*).
+ *
+ * \return Filter.
+ */
+dedupFilter* dedupInit(uint64_t sourceBytes, unsigned char mode);
+
+/**
+ * Scans a row key.
+ *
+ * \param filter    Filter.
+ * \param key       Encoded primary key.
+ * \param keyLength Encoded primary key length.
+ * \param rowBytes  Raw row length.
+ */
+void dedupScan(dedupFilter* filter, const void* key, size_t keyLength, size_t rowBytes);
+
+/**
+ * Ends scan : keeps the candidates set and its prefilter only.
+ *
+ * \param filter Filter.
+ */
+void dedupScanEnd(dedupFilter* filter);
+
+/**
+ * Tells if a row is to keep (scan ended, rows checked in scan order).
+ *
+ * \param filter    Filter.
+ * \param key       Encoded primary key.
+ * \param keyLength Encoded primary key length.
+ *
+ * \return False if the row is a duplicate to drop.
+ */
+bool dedupKeep(dedupFilter* filter, const void* key, size_t keyLength);
+
+/**
+ * Destroy a filter and release memory.
+ *
+ * \param filter Filter.
+ */
+void dedupDestroy(dedupFilter* filter);
+
+
+#endif /* _DEDUP_H_INCLUDED_ */
@@ -0,0 +1,92 @@
+/**
+ * Checksums (MD5, CRC32C) includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _DIGEST_H_INCLUDED_
+#define _DIGEST_H_INCLUDED_
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/**
+ * MD5 digest length (bytes).
+ */
+#define MD5_DIGEST_LENGTH           16
+
+/**
+ * Incremental MD5 state.
+ */
+typedef struct md5Context {
+    /**
+     * Chaining values.
+     */
+    uint32_t state[4];
+    /**
+     * Bytes hashed so far.
+     */
+    uint64_t length;
+    /**
+     * Pending bytes of an incomplete block.
+     */
+    unsigned char block[64];
+} md5Context;
+
+
+/**
+ * Starts a MD5 digest.
+ *
+ * \param context MD5 state.
+ */
+void md5Init(md5Context* context);
+
+/**
+ * Hashes more bytes.
+ *
+ * \param context MD5 state.
+ * \param data    Data.
+ * \param length  Data length.
+ */
+void md5Update(md5Context* context, const void* data, size_t length);
+
+/**
+ * Ends a MD5 digest.
+ *
+ * \param context MD5 state.
+ * \param digest  Digest (MD5_DIGEST_LENGTH bytes).
+ */
+void md5Final(md5Context* context, unsigned char* digest);
+
+/**
+ * Updates a CRC32C (Castagnoli) checksum.
+ *
+ * \param crc    Checksum of previous bytes (0 to start).
+ * \param data   Data.
+ * \param length Data length.
+ *
+ * \return Checksum.
+ */
+uint32_t crc32cUpdate(uint32_t crc, const void* data, size_t length);
+
+
+#endif /* _DIGEST_H_INCLUDED_ */
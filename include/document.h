@@ -0,0 +1,108 @@
+/**
+ * BSON documents from EPF entries includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _DOCUMENT_H_INCLUDED_
+#define _DOCUMENT_H_INCLUDED_
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "epf.h"
+#include "bson.h"
+
+/**
+ * documentCheckStrings() results.
+ */
+#define DOCUMENT_STRINGS_VALID      0
+#define DOCUMENT_STRINGS_REPAIRED   1
+#define DOCUMENT_STRINGS_REJECTED   -1
+#define DOCUMENT_STRINGS_MEMORY     -2
+
+
+/**
+ * Adds a typed EPF value to a document.
+ *
+ * \param doc       Document to insert into.
+ * \param name      Value name in document.
+ * \param fieldType EPF field type.
+ * \param value     Typed value.
+ *
+ * \return False if field type is unknown.
+ */
+bool documentAddValue(bsonDocument* doc, char* name, unsigned char fieldType, EPFValue* value);
+
+/**
+ * Checks string values are valid UTF-8, repairing them in replace mode.
+ *
+ * \param epfFile   EPF File instance.
+ * \param values    Entry typed values.
+ * \param mode      Invalid strings handling (UTF8_MODE_REPLACE or UTF8_MODE_REJECT).
+ * \param repaired  Buffer receiving repaired strings (grown as needed).
+ * \param allocated Repaired buffer allocated size.
+ *
+ * \return DOCUMENT_STRINGS_* result.
+ */
+int documentCheckStrings(EPFFile* epfFile, EPFValue* values, int mode, char** repaired, size_t* allocated);
+
+/**
+ * Builds the document of an entry.
+ *
+ * \param doc          Document (reset here).
+ * \param id           Document to build composite `_id` into.
+ * \param epfFile      EPF File instance.
+ * \param values       Entry typed values.
+ * \param primaryKeyId Use primary key as `_id` (if any).
+ *
+ * \return False if memory ran out or a field type is unknown.
+ */
+bool documentBuild(bsonDocument* doc, bsonDocument* id, EPFFile* epfFile, EPFValue* values, bool primaryKeyId);
+
+/**
+ * Decodes a document field to a typed value.
+ *
+ * \param fieldType EPF field type.
+ * \param type      BSON field type.
+ * \param field     BSON field value, NULL if missing (null value).
+ * \param value     Filled with typed value (strings point into document).
+ *
+ * \return False if BSON type does not match EPF field type.
+ */
+bool documentDecodeValue(unsigned char fieldType, char type, const char* field, EPFValue* value);
+
+/**
+ * Decodes a document built by documentBuild() back to entry typed values, in
+ * a single pass over its fields.
+ *
+ * \param epfFile  EPF File instance.
+ * \param document Serialized document.
+ * \param length   Document length.
+ * \param values   Filled with typed values (strings point into document).
+ *
+ * \return False if a field type does not match EPF field type.
+ */
+bool documentValues(EPFFile* epfFile, const void* document, size_t length, EPFValue* values);
+
+
+#endif /* _DOCUMENT_H_INCLUDED_ */
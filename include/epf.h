@@ -29,6 +29,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "digest.h"
 
 
 #define EPFSeparator                '\x01'
@@ -41,6 +45,87 @@
 #define EPF_FIELDTYPE_LONGTEXT      6
 #define EPF_FIELDTYPE_DECIMAL       7
 
+/**
+ * Reader status (epfReadHeader(), epfRead()), errors are negative.
+ */
+#define EPF_OK                      0
+#define EPF_EOF                     1
+#define EPF_COMMENT                 2
+#define EPF_SKIPPED                 3
+#define EPF_ERROR_MEMORY            -1
+#define EPF_ERROR_READ              -2
+#define EPF_ERROR_FORMAT            -3
+#define EPF_ERROR_REJECTS           -4
+#define EPF_ERROR_RECORD            -5
+
+/**
+ * Reader options (epfCreate() flags).
+ */
+#define EPF_OPTION_MD5              2
+#define EPF_OPTION_DROP_BEHIND      4
+
+/**
+ * Bytes read between page cache drops (EPF_OPTION_DROP_BEHIND), also read ahead.
+ */
+#define EPF_DROP_WINDOW             16777216
+
+/**
+ * Error message maximum length.
+ */
+#define EPF_ERROR_LENGTH            256
+
+
+/**
+ * Dates cache size (bits of slot index), see epfParseDatetime().
+ */
+#define EPF_DATE_CACHE_BITS         6
+
+/**
+ * Default entries count of a batch, see epfReadBatch().
+ */
+#define EPF_BATCH_ROWS              4096
+
+/**
+ * Default records bytes a batch is cut at.
+ */
+#define EPF_BATCH_BYTES             8388608
+
+
+/**
+ * Dates cache slot : days since the Unix epoch of a "YYYY MM DD" prefix.
+ */
+typedef struct EPFDateSlot {
+    /**
+     * Prefix first 8 bytes ("YYYY MM "), 0 if slot is empty.
+     */
+    uint64_t prefix;
+    /**
+     * Prefix last 2 bytes ("DD").
+     */
+    uint16_t suffix;
+    /**
+     * Days since the Unix epoch.
+     */
+    int64_t epochDay;
+} EPFDateSlot;
+
+/**
+ * Malformed records handler.
+ *
+ * \param context Handler context (EPFFile's rejectContext).
+ * \param offset  Record offset in EPF file.
+ * \param reason  Reason.
+ * \param record  Raw record, record separator excluded.
+ * \param length  Raw record length.
+ *
+ * \return False to stop reading (EPF_ERROR_REJECTS).
+ */
+typedef bool (*epfRejectHandler)(void* context, uint64_t offset, const char* reason, const char* record, size_t length);
+
+/**
+ * Verbose messages handler (printf like).
+ */
+typedef void (*epfMessageHandler)(const char* format, ...);
 
 
 /**
@@ -69,6 +154,10 @@ typedef struct EPFField {
 
 /**
  * EPF File informations.
+ *
+ * A reader only uses its own state, so that readers of different files can
+ * run concurrently in different threads. Errors are returned as status and
+ * never end the process.
  */
 typedef struct EPFFile {
     /**
@@ -79,6 +168,14 @@ typedef struct EPFFile {
      * Field count.
      */
     size_t fieldsCount;
+    /**
+     * Primary key fields indexes, in declaration order.
+     */
+    size_t* primaryKey;
+    /**
+     * Primary key fields count.
+     */
+    size_t primaryKeyCount;
     /**
      * Is incremental export.
      */
@@ -87,6 +184,18 @@ typedef struct EPFFile {
      * EPF file pointer.
      */
     FILE* fp;
+    /**
+     * Reader options (EPF_OPTION_* flags).
+     */
+    int options;
+    /**
+     * Reader status : EPF_OK, or the error which stopped reading.
+     */
+    int status;
+    /**
+     * Error message of status.
+     */
+    char error[EPF_ERROR_LENGTH];
     /**
      * Lines read so far.
      */
@@ -103,26 +212,275 @@ typedef struct EPFFile {
      * File header is parsed and ready to read.
      */
     bool ready;
+    /**
+     * Record buffer, reused from record to record.
+     */
+    char* record;
+    /**
+     * Record buffer allocated size.
+     */
+    size_t recordAllocated;
+    /**
+     * Last record length.
+     */
+    size_t recordLength;
+    /**
+     * Line buffer, for records spanning several lines.
+     */
+    char* line;
+    /**
+     * Line buffer allocated size.
+     */
+    size_t lineAllocated;
+    /**
+     * Entry fields buffer (pointers into record), reused from record to record.
+     */
+    char** entry;
+    /**
+     * Entry fields buffer allocated size.
+     */
+    size_t entryAllocated;
+    /**
+     * MD5 of bytes read so far, NULL if not verifying checksum.
+     */
+    md5Context* md5;
+    /**
+     * Bytes dropped from page cache so far (EPF_OPTION_DROP_BEHIND).
+     */
+    uint64_t droppedOffset;
+    /**
+     * Longest record accepted (EPF_ERROR_RECORD past it), 0 for no limit.
+     */
+    size_t maxRecordLength;
+    /**
+     * Dates cache : rows of a file share a handful of dates.
+     */
+    EPFDateSlot dates[1 << EPF_DATE_CACHE_BITS];
+    /**
+     * Malformed records handler, NULL to skip them silently.
+     */
+    epfRejectHandler reject;
+    /**
+     * Malformed records handler context.
+     */
+    void* rejectContext;
+    /**
+     * Header declarations are reported to this handler, NULL for none.
+     */
+    epfMessageHandler message;
 } EPFFile;
 
 
 /**
- * Read EPF file header to get file infos and return an instance of EPFFile.
+ * EPF typed value.
+ */
+typedef struct EPFValue {
+    /**
+     * Value is null (empty raw value).
+     */
+    bool isNull;
+    /**
+     * Integer value (BIGINT, INTEGER, BOOLEAN as 0/1, DATETIME as UTC milliseconds).
+     */
+    int64_t integer;
+    /**
+     * Decimal value (DECIMAL).
+     */
+    double decimal;
+    /**
+     * String value (VARCHAR, LONGTEXT, DATETIME raw text), not owned.
+     */
+    char* string;
+    /**
+     * String value length.
+     */
+    size_t length;
+} EPFValue;
+
+/**
+ * Batch of entries, converted column by column.
+ *
+ * Records are copied in the batch, raw values are viewed column by column
+ * (value j of field i at i * capacity + j) for conversion, typed values and
+ * raw entries are stored row by row for writers. Only selected entries are
+ * converted (all of them once read, filters may drop some before).
+ */
+typedef struct EPFBatch {
+    /**
+     * Fields count.
+     */
+    size_t fieldsCount;
+    /**
+     * Maximum entries count.
+     */
+    size_t capacity;
+    /**
+     * Records bytes a batch is cut at (a batch holds at least one entry).
+     */
+    size_t maxBytes;
+    /**
+     * Entries count.
+     */
+    size_t rows;
+    /**
+     * Records copies.
+     */
+    char* data;
+    /**
+     * Records copies used length.
+     */
+    size_t dataLength;
+    /**
+     * Records copies allocated size.
+     */
+    size_t dataAllocated;
+    /**
+     * Raw values offsets in data (column major), while reading.
+     */
+    size_t* starts;
+    /**
+     * Raw values (column major).
+     */
+    char** columns;
+    /**
+     * Raw values lengths (column major).
+     */
+    size_t* lengths;
+    /**
+     * Null bitmaps (column major, bit set if null).
+     */
+    unsigned char* nulls;
+    /**
+     * Raw entries (row major, fieldsCount + 1 values, NULL terminated).
+     */
+    char** entries;
+    /**
+     * Typed values (row major, fieldsCount values).
+     */
+    EPFValue* values;
+    /**
+     * Entries start offsets in file.
+     */
+    unsigned long* offsets;
+    /**
+     * Selected entries indexes (increasing).
+     */
+    size_t* selection;
+    /**
+     * Selected entries count.
+     */
+    size_t selected;
+} EPFBatch;
+
+
+/**
+ * Creates a reader of an EPF file.
  *
- * \param fp File pointer to EPF file.
+ * \param fp      File pointer to EPF file (positioned at file start).
+ * \param options Reader options (EPF_OPTION_* flags).
  *
- * \return Parsed data.
+ * \return Reader, NULL if memory could not be allocated.
  */
-EPFFile* epfInit(FILE* fp);
+EPFFile* epfCreate(FILE* fp, int options);
 
 /**
- * Get an entry from collection.
+ * Reads EPF file header (fields, primary key, types, export mode).
  *
  * \param file EPFFile instance.
  *
- * \return Raw entry data (as strings) or null if EOF.
+ * \return EPF_OK or error status (message from epfError()).
  */
-char** epfNextEntry(EPFFile* file);
+int epfReadHeader(EPFFile* file);
+
+/**
+ * Reads next entry.
+ *
+ * \param file  EPFFile instance (header read).
+ * \param entry Raw entry data (as strings, owned by file and valid until next
+ *              read), set if EPF_OK is returned.
+ *
+ * \return EPF_OK, EPF_COMMENT or EPF_SKIPPED (nothing read, go on reading),
+ *         EPF_EOF or error status (message from epfError()).
+ */
+int epfRead(EPFFile* file, char*** entry);
+
+/**
+ * Get last error message.
+ *
+ * \param file EPFFile instance.
+ *
+ * \return Error message, empty if none.
+ */
+const char* epfError(EPFFile* file);
+
+/**
+ * Parses a datetime : "YYYY MM DD" (or "YYYY-MM-DD"), optionally followed by
+ * " HH:MM:SS" (or "THH:MM:SS") and a fraction of second, as UTC.
+ *
+ * \param file         EPFFile instance, whose dates cache is used, NULL for none.
+ * \param raw          Raw value.
+ * \param length       Raw value length.
+ * \param milliseconds Milliseconds since the Unix epoch.
+ *
+ * \return False if value is not a datetime.
+ */
+bool epfParseDatetime(EPFFile* file, const char* raw, size_t length, int64_t* milliseconds);
+
+/**
+ * Converts a raw value to its typed value.
+ *
+ * \param file      EPFFile instance.
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ * \param raw       Raw value.
+ * \param value     Typed value (string points to raw).
+ */
+void epfConvertValue(EPFFile* file, unsigned char fieldType, char* raw, EPFValue* value);
+
+/**
+ * Converts a raw entry to typed values.
+ *
+ * \param file   EPFFile instance.
+ * \param entry  Raw entry as returned by epfRead().
+ * \param values Typed values (fieldsCount values, strings point to entry).
+ */
+void epfConvertEntry(EPFFile* file, char** entry, EPFValue* values);
+
+/**
+ * Creates a batch of entries.
+ *
+ * \param file     EPFFile instance (header parsed).
+ * \param capacity Maximum entries count.
+ * \param maxBytes Records bytes a batch is cut at.
+ *
+ * \return Batch, NULL if memory could not be allocated.
+ */
+EPFBatch* epfBatchCreate(EPFFile* file, size_t capacity, size_t maxBytes);
+
+/**
+ * Reads next entries in a batch (malformed records and comments skipped).
+ *
+ * \param file  EPFFile instance.
+ * \param batch Batch, previous entries are replaced.
+ *
+ * \return EPF_OK (at least one entry read, all selected), EPF_EOF or error
+ *         status (entries read before the error are dropped).
+ */
+int epfReadBatch(EPFFile* file, EPFBatch* batch);
+
+/**
+ * Converts selected batch raw values to typed values, one field at a time.
+ *
+ * \param file  EPFFile instance.
+ * \param batch Batch.
+ */
+void epfConvertBatch(EPFFile* file, EPFBatch* batch);
+
+/**
+ * Destroy a batch and release memory.
+ *
+ * \param batch Batch.
+ */
+void epfBatchDestroy(EPFBatch* batch);
 
 /**
  * Get field type.
@@ -144,6 +502,16 @@ unsigned char epfGetFieldType(EPFFile* file, size_t index);
  */
 size_t epfGetFieldCapacity(EPFFile* file, size_t index);
 
+/**
+ * Get MD5 digest of the whole file (read up to EOF).
+ *
+ * \param file   EPFFile instance.
+ * \param digest Digest (MD5_DIGEST_LENGTH bytes).
+ *
+ * \return False if checksum was not computed (--verify-md5 not set).
+ */
+bool epfDigest(EPFFile* file, unsigned char* digest);
+
 /**
  * Destroy an EPF file object and release memory.
  *
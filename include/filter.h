@@ -0,0 +1,165 @@
+/**
+ * Rows filtering (--where) includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _FILTER_H_INCLUDED_
+#define _FILTER_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "epf.h"
+
+
+/**
+ * Clauses operators.
+ */
+#define FILTER_OP_EQUAL             1
+#define FILTER_OP_NOTEQUAL          2
+#define FILTER_OP_LOWER             3
+#define FILTER_OP_LOWEREQUAL        4
+#define FILTER_OP_GREATER           5
+#define FILTER_OP_GREATEREQUAL      6
+#define FILTER_OP_PREFIX            7
+
+/**
+ * Clauses comparison modes (depends on the bound EPF field type).
+ */
+#define FILTER_COMPARE_BYTES        1
+#define FILTER_COMPARE_INTEGER      2
+#define FILTER_COMPARE_DECIMAL      3
+
+
+/**
+ * Filter clause (`<field><operator><value>[,<value>...]`).
+ */
+typedef struct filterClause {
+    /**
+     * Field name.
+     */
+    char* fieldName;
+    /**
+     * Operator (FILTER_OP_*).
+     */
+    unsigned char operator;
+    /**
+     * Raw values (more than one for IN-lists).
+     */
+    char** values;
+    /**
+     * Raw values lengths.
+     */
+    size_t* valuesLength;
+    /**
+     * Values count.
+     */
+    size_t valuesCount;
+    /**
+     * Values parsed as integers (when comparing integers).
+     */
+    int64_t* integerValues;
+    /**
+     * Values parsed as decimals (when comparing decimals).
+     */
+    double* decimalValues;
+    /**
+     * Field index in currently bound file, -1 if the file has no such field.
+     */
+    long fieldIndex;
+    /**
+     * Comparison mode for currently bound file (FILTER_COMPARE_*).
+     */
+    unsigned char compare;
+} filterClause;
+
+/**
+ * Rows filter, all clauses must match for a row to be kept.
+ */
+typedef struct filter {
+    /**
+     * Clauses.
+     */
+    filterClause** clauses;
+    /**
+     * Clauses count.
+     */
+    size_t clausesCount;
+    /**
+     * At least one clause applies to currently bound file.
+     */
+    bool active;
+} filter;
+
+
+/**
+ * Creates a new, empty (matching everything) filter.
+ *
+ * \return Filter.
+ */
+filter* filterInit();
+
+/**
+ * Parse a filter expression and append its clauses to filter.
+ *
+ * Expression is a `;` separated list of clauses, each clause being
+ * `<field><operator><value>` with operator one of `=`, `!=`, `<`, `<=`,
+ * `>`, `>=` or `^=` (prefix match). `=` and `!=` accept a comma separated
+ * IN-list of values.
+ *
+ * \param rowFilter  Filter instance.
+ * \param expression Filter expression.
+ */
+void filterParse(filter* rowFilter, char* expression);
+
+/**
+ * Bind filter to an EPF file : resolve fields indexes and comparison modes.
+ * Clauses on fields not declared in file are ignored for this file.
+ *
+ * \param rowFilter Filter instance.
+ * \param file      EPFFile instance (header parsed).
+ */
+void filterBind(filter* rowFilter, EPFFile* file);
+
+/**
+ * Tests a raw entry against filter.
+ *
+ * \param rowFilter Filter instance (bound).
+ * \param entry     Raw entry as returned by epfRead() (fields count checked).
+ *
+ * \return True if entry is to keep, false elsewhere.
+ */
+bool filterMatch(filter* rowFilter, char** entry);
+
+/**
+ * Destroy a filter and release memory.
+ *
+ * \param rowFilter Filter instance.
+ */
+void filterDestroy(filter* rowFilter);
+
+
+#endif /* _FILTER_H_INCLUDED_ */
@@ -0,0 +1,179 @@
+/**
+ * Minimal FlatBuffers builder includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _FLATBUFFER_H_INCLUDED_
+#define _FLATBUFFER_H_INCLUDED_
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/**
+ * Maximum fields count of a table.
+ */
+#define FLATBUFFER_MAX_FIELDS       16
+
+/**
+ * FlatBuffers builder.
+ *
+ * The buffer is built back to front, like the reference implementation :
+ * children objects are created before their parents and are referenced by
+ * their offset from the end of the buffer (as returned by creation calls).
+ */
+typedef struct flatBuilder {
+    /**
+     * Buffer, used bytes are at its end.
+     */
+    unsigned char* data;
+    /**
+     * Buffer allocated size.
+     */
+    size_t allocated;
+    /**
+     * Used bytes.
+     */
+    size_t length;
+    /**
+     * Largest alignment seen so far.
+     */
+    size_t minAlign;
+    /**
+     * Current table fields positions (0 if not set).
+     */
+    uint32_t fields[FLATBUFFER_MAX_FIELDS];
+    /**
+     * Current table fields count.
+     */
+    size_t fieldsCount;
+    /**
+     * Used bytes when current table started.
+     */
+    size_t tableStart;
+} flatBuilder;
+
+
+/**
+ * Creates a new builder.
+ *
+ * \return Builder.
+ */
+flatBuilder* fbInit();
+
+/**
+ * Empties a builder to build a new buffer (keeps memory).
+ *
+ * \param builder Builder.
+ */
+void fbReset(flatBuilder* builder);
+
+/**
+ * Creates a string.
+ *
+ * \param builder Builder.
+ * \param string  String.
+ *
+ * \return String offset.
+ */
+uint32_t fbCreateString(flatBuilder* builder, const char* string);
+
+/**
+ * Creates a vector of objects offsets.
+ *
+ * \param builder Builder.
+ * \param offsets Objects offsets.
+ * \param count   Objects count.
+ *
+ * \return Vector offset.
+ */
+uint32_t fbCreateOffsetVector(flatBuilder* builder, uint32_t* offsets, size_t count);
+
+/**
+ * Creates a vector of structs.
+ *
+ * \param builder   Builder.
+ * \param structs   Structs, already laid out little endian.
+ * \param size      Struct size.
+ * \param count     Structs count.
+ * \param alignment Struct alignment.
+ *
+ * \return Vector offset.
+ */
+uint32_t fbCreateStructVector(flatBuilder* builder, const void* structs, size_t size, size_t count, size_t alignment);
+
+/**
+ * Starts a table (no other object can be created until fbEndTable()).
+ *
+ * \param builder Builder.
+ */
+void fbStartTable(flatBuilder* builder);
+
+/**
+ * Adds scalar fields to current table.
+ *
+ * \param builder Builder.
+ * \param field   Field index in schema.
+ * \param value   Value.
+ */
+void fbAddUint8(flatBuilder* builder, size_t field, uint8_t value);
+void fbAddInt16(flatBuilder* builder, size_t field, int16_t value);
+void fbAddInt32(flatBuilder* builder, size_t field, int32_t value);
+void fbAddInt64(flatBuilder* builder, size_t field, int64_t value);
+
+/**
+ * Adds an object reference field to current table.
+ *
+ * \param builder Builder.
+ * \param field   Field index in schema.
+ * \param offset  Object offset.
+ */
+void fbAddOffset(flatBuilder* builder, size_t field, uint32_t offset);
+
+/**
+ * Ends current table.
+ *
+ * \param builder Builder.
+ *
+ * \return Table offset.
+ */
+uint32_t fbEndTable(flatBuilder* builder);
+
+/**
+ * Finishes buffer with its root table.
+ *
+ * \param builder Builder.
+ * \param root    Root table offset.
+ *
+ * \return Finished buffer (builder->length bytes, valid until next builder call).
+ */
+unsigned char* fbFinish(flatBuilder* builder, uint32_t root);
+
+/**
+ * Destroy a builder and release memory.
+ *
+ * \param builder Builder.
+ */
+void fbDestroy(flatBuilder* builder);
+
+
+#endif /* _FLATBUFFER_H_INCLUDED_ */
@@ -0,0 +1,45 @@
+/**
+ * Non cryptographic hashing includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _HASH_H_INCLUDED_
+#define _HASH_H_INCLUDED_
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+
+/**
+ * Hash a byte buffer (64 bits, 8 bytes at a time, not cryptographic).
+ *
+ * \param data   Data to hash.
+ * \param length Data length.
+ * \param seed   Seed, or previous hash to chain several buffers.
+ *
+ * \return Hash.
+ */
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed);
+
+
+#endif /* _HASH_H_INCLUDED_ */
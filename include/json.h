@@ -0,0 +1,119 @@
+/**
+ * NDJSON (MongoDB relaxed Extended JSON) writer includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef _JSON_H_INCLUDED_
+#define _JSON_H_INCLUDED_
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "epf.h"
+#include "output.h"
+#include "sink.h"
+
+/**
+ * Documents bytes buffered before writing them out.
+ */
+#define JSON_BUFFER_BYTES           1048576
+
+/**
+ * NDJSON file being written : one document per line, as MongoDB relaxed
+ * Extended JSON (mongoimport), with the fields of the BSON documents.
+ */
+typedef struct jsonWriter {
+    /**
+     * Output file.
+     */
+    bsonOutput* output;
+    /**
+     * EPF file description.
+     */
+    EPFFile* file;
+    /**
+     * Primary key is written as `_id`.
+     */
+    bool primaryKeyId;
+    /**
+     * Fields names, quoted and escaped, followed by ':' (fieldsCount).
+     */
+    char** names;
+    /**
+     * Fields names lengths (fieldsCount).
+     */
+    size_t* namesLengths;
+    /**
+     * Documents buffer.
+     */
+    char* buffer;
+    /**
+     * Documents buffer used length.
+     */
+    size_t length;
+    /**
+     * Documents buffer allocated size.
+     */
+    size_t allocated;
+} jsonWriter;
+
+
+/**
+ * Starts writing an NDJSON file.
+ *
+ * \param path         NDJSON file path.
+ * \param file         EPFFile instance (header parsed).
+ * \param primaryKeyId Write primary key as `_id` (if any).
+ * \param dropBehind   Drop written pages from page cache.
+ *
+ * \return NDJSON writer.
+ */
+jsonWriter* jsonCreate(char* path, EPFFile* file, bool primaryKeyId, bool dropBehind);
+
+/**
+ * Appends an entry.
+ *
+ * \param writer NDJSON writer.
+ * \param values Typed values (fieldsCount values).
+ */
+void jsonAppend(jsonWriter* writer, EPFValue* values);
+
+/**
+ * Writes buffered documents, then closes file.
+ *
+ * \param writer NDJSON writer (destroyed).
+ */
+void jsonClose(jsonWriter* writer);
+
+/**
+ * Creates a sink writing entries to an NDJSON file, closing it when done.
+ *
+ * \param writer NDJSON writer.
+ *
+ * \return Sink.
+ */
+rowSink* jsonSink(jsonWriter* writer);
+
+
+#endif /* _JSON_H_INCLUDED_ */
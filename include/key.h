@@ -0,0 +1,119 @@
+/**
+ * Primary keys encoding includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _KEY_H_INCLUDED_
+#define _KEY_H_INCLUDED_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "epf.h"
+
+
+/**
+ * Encoded key : bytes whose memcmp() order is the typed order of the
+ * primary key columns (integers and decimals numerically, others bytewise).
+ */
+typedef struct keyBuffer {
+    /**
+     * Encoded key.
+     */
+    unsigned char* data;
+    /**
+     * Encoded key length.
+     */
+    size_t length;
+    /**
+     * Allocated size (internal).
+     */
+    size_t _allocated;
+} keyBuffer;
+
+
+/**
+ * Creates a new key buffer.
+ *
+ * \return Key buffer.
+ */
+keyBuffer* keyInit();
+
+/**
+ * Encodes the primary key of a raw entry (replaces buffer content).
+ *
+ * \param key   Key buffer.
+ * \param file  EPFFile instance.
+ * \param entry Raw entry as returned by epfRead() (fields count checked).
+ */
+void keyEncode(keyBuffer* key, EPFFile* file, char** entry);
+
+/**
+ * Appends a raw field value to an encoded key.
+ *
+ * \param key       Key buffer.
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ * \param value     Raw value (NULL or empty for null).
+ */
+void keyAppendField(keyBuffer* key, unsigned char fieldType, char* value);
+
+/**
+ * Appends a typed field value to an encoded key.
+ *
+ * \param key       Key buffer.
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ * \param value     Typed value.
+ */
+void keyAppendValue(keyBuffer* key, unsigned char fieldType, EPFValue* value);
+
+/**
+ * Encodes the primary key of typed values (replaces buffer content).
+ *
+ * \param key    Key buffer.
+ * \param file   EPFFile instance.
+ * \param values Typed values (fieldsCount values).
+ */
+void keyEncodeValues(keyBuffer* key, EPFFile* file, EPFValue* values);
+
+/**
+ * Compares two encoded keys.
+ *
+ * \param first        First key.
+ * \param firstLength  First key length.
+ * \param second       Second key.
+ * \param secondLength Second key length.
+ *
+ * \return <0, 0, >0 like memcmp().
+ */
+int keyCompare(const void* first, size_t firstLength, const void* second, size_t secondLength);
+
+/**
+ * Destroy a key buffer and release memory.
+ *
+ * \param key Key buffer.
+ */
+void keyDestroy(keyBuffer* key);
+
+
+#endif /* _KEY_H_INCLUDED_ */
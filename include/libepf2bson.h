@@ -0,0 +1,212 @@
+/**
+ * EPF2Bson library : streaming EPF to BSON conversion API.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _LIBEPF2BSON_H_INCLUDED_
+#define _LIBEPF2BSON_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "epf.h"
+#include "bson.h"
+
+/**
+ * Conversion options (epf2bsonOpen*() flags), EPF2BSON_MD5 computes the
+ * source MD5 (epfDigest() on reader->file at EOF), EPF2BSON_DROP_BEHIND
+ * drops source pages from page cache once read.
+ */
+#define EPF2BSON_PRIMARY_KEY_ID     1
+#define EPF2BSON_UTF8_REPLACE       2
+#define EPF2BSON_UTF8_REJECT        4
+#define EPF2BSON_MD5                8
+#define EPF2BSON_DROP_BEHIND        16
+
+/**
+ * Library specific errors (other statuses are EPF_*).
+ */
+#define EPF2BSON_ERROR_OPEN         -10
+#define EPF2BSON_ERROR_DOCUMENT     -11
+#define EPF2BSON_ERROR_SINK         -12
+
+/**
+ * Documents sink.
+ *
+ * \param context  Sink context.
+ * \param document BSON document (only valid during call).
+ * \param length   Document length.
+ *
+ * \return 0 to go on, anything else stops conversion (and is returned by epf2bsonRun()).
+ */
+typedef int (*epf2bsonSink)(void* context, const void* document, size_t length);
+
+/**
+ * EPF source being converted.
+ *
+ * Nothing is shared between readers, nor exits : failures are reported by
+ * status and error message, so several readers can run in parallel threads.
+ */
+typedef struct epf2bsonReader {
+    /**
+     * EPF source (owned, even for file descriptors and buffers).
+     */
+    FILE* fp;
+    /**
+     * EPF reader, NULL until source is opened.
+     */
+    EPFFile* file;
+    /**
+     * Conversion options (EPF2BSON_* flags).
+     */
+    int options;
+    /**
+     * Last status (EPF_OK, EPF_EOF or error).
+     */
+    int status;
+    /**
+     * Last error message.
+     */
+    char error[EPF_ERROR_LENGTH];
+    /**
+     * Current entry typed values.
+     */
+    EPFValue* values;
+    /**
+     * Current document.
+     */
+    bsonDocument* document;
+    /**
+     * Composite `_id` document.
+     */
+    bsonDocument* id;
+    /**
+     * Repaired strings buffer.
+     */
+    char* repaired;
+    /**
+     * Repaired strings buffer allocated size.
+     */
+    size_t repairedAllocated;
+    /**
+     * Documents returned so far.
+     */
+    unsigned long documents;
+    /**
+     * Malformed records skipped so far (bad field count, rejected UTF-8).
+     */
+    unsigned long skipped;
+    /**
+     * Registered sink, NULL if none.
+     */
+    epf2bsonSink sink;
+    /**
+     * Registered sink context.
+     */
+    void* sinkContext;
+} epf2bsonReader;
+
+
+/**
+ * Opens an EPF file and reads its header.
+ *
+ * \param path    EPF file path.
+ * \param options Conversion options (EPF2BSON_* flags).
+ *
+ * \return Reader (check its status, see epf2bsonError()), NULL if memory
+ *         could not be allocated.
+ */
+epf2bsonReader* epf2bsonOpenPath(const char* path, int options);
+
+/**
+ * Opens an EPF file descriptor and reads its header.
+ *
+ * \param fd      File descriptor (duplicated, still owned by caller), positioned at file start.
+ * \param options Conversion options (EPF2BSON_* flags).
+ *
+ * \return Reader (check its status, see epf2bsonError()), NULL if memory
+ *         could not be allocated.
+ */
+epf2bsonReader* epf2bsonOpenFd(int fd, int options);
+
+/**
+ * Opens an EPF file held in memory and reads its header.
+ *
+ * \param data    EPF file content (not copied, must outlive reader).
+ * \param length  Content length.
+ * \param options Conversion options (EPF2BSON_* flags).
+ *
+ * \return Reader (check its status, see epf2bsonError()), NULL if memory
+ *         could not be allocated.
+ */
+epf2bsonReader* epf2bsonOpenBuffer(const void* data, size_t length, int options);
+
+/**
+ * Converts next entry.
+ *
+ * \param reader   Reader.
+ * \param document Filled with BSON document (valid until next call).
+ * \param length   Filled with document length.
+ *
+ * \return EPF_OK, EPF_EOF or error status.
+ */
+int epf2bsonNext(epf2bsonReader* reader, const void** document, size_t* length);
+
+/**
+ * Registers the sink epf2bsonRun() feeds.
+ *
+ * \param reader  Reader.
+ * \param sink    Sink.
+ * \param context Sink context.
+ */
+void epf2bsonSetSink(epf2bsonReader* reader, epf2bsonSink sink, void* context);
+
+/**
+ * Converts all remaining entries into the registered sink.
+ *
+ * \param reader Reader.
+ *
+ * \return EPF_OK once all entries are converted, what the sink returned if
+ *         it stopped conversion, or error status.
+ */
+int epf2bsonRun(epf2bsonReader* reader);
+
+/**
+ * Get last error message.
+ *
+ * \param reader Reader.
+ *
+ * \return Error message, empty if none.
+ */
+const char* epf2bsonError(epf2bsonReader* reader);
+
+/**
+ * Closes source and releases memory.
+ *
+ * \param reader Reader.
+ */
+void epf2bsonClose(epf2bsonReader* reader);
+
+
+#endif /* _LIBEPF2BSON_H_INCLUDED_ */
@@ -0,0 +1,65 @@
+/**
+ * LZ4 block format codec includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _LZ4_H_INCLUDED_
+#define _LZ4_H_INCLUDED_
+
+#include <stdlib.h>
+
+
+/**
+ * Maximum compressed size of a block of given size.
+ *
+ * \param length Uncompressed length.
+ *
+ * \return Compressed size upper bound.
+ */
+size_t lz4CompressBound(size_t length);
+
+/**
+ * Compress a block (LZ4 block format, fast greedy matcher).
+ *
+ * \param source      Data to compress.
+ * \param length      Data length.
+ * \param destination Destination buffer (at least lz4CompressBound(length) bytes).
+ *
+ * \return Compressed length.
+ */
+size_t lz4Compress(const void* source, size_t length, void* destination);
+
+/**
+ * Decompress a block (LZ4 block format).
+ *
+ * \param source            Compressed data.
+ * \param length            Compressed data length.
+ * \param destination       Destination buffer.
+ * \param destinationLength Destination buffer size (exact uncompressed size).
+ *
+ * \return Decompressed length, 0 on corrupted input.
+ */
+size_t lz4Decompress(const void* source, size_t length, void* destination, size_t destinationLength);
+
+
+#endif /* _LZ4_H_INCLUDED_ */
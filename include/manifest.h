@@ -0,0 +1,172 @@
+/**
+ * Run manifest includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _MANIFEST_H_INCLUDED_
+#define _MANIFEST_H_INCLUDED_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+/**
+ * Manifest file name, in dump directory.
+ */
+#define MANIFEST_FILE               "EPF2Bson.manifest"
+
+/**
+ * Manifest format version, to bump when conversion output changes.
+ */
+#define MANIFEST_VERSION            2
+
+/**
+ * Bytes read at once when hashing an input.
+ */
+#define MANIFEST_HASH_CHUNK         1048576
+
+/**
+ * Collection converted during a run.
+ */
+typedef struct manifestEntry {
+    /**
+     * Collection name (EPF file name).
+     */
+    char* collection;
+    /**
+     * Input size.
+     */
+    uint64_t size;
+    /**
+     * Input modification time.
+     */
+    struct timespec mtime;
+    /**
+     * Input content hash (MD5 of the whole file, first 8 bytes).
+     */
+    uint64_t hash;
+    /**
+     * Output files names, in dump directory (NULL terminated).
+     */
+    char** outputs;
+} manifestEntry;
+
+/**
+ * Inputs and outputs of a run.
+ */
+typedef struct runManifest {
+    /**
+     * Hash of the options outputs depend on.
+     */
+    uint64_t settings;
+    /**
+     * Collections.
+     */
+    manifestEntry* entries;
+    /**
+     * Collections count.
+     */
+    size_t count;
+    /**
+     * Collections array allocated size.
+     */
+    size_t allocated;
+} runManifest;
+
+
+/**
+ * Creates an empty manifest.
+ *
+ * \param settings Hash of the options outputs depend on.
+ *
+ * \return Manifest.
+ */
+runManifest* manifestInit(uint64_t settings);
+
+/**
+ * Reads the manifest of a dump.
+ *
+ * \param path Manifest file path.
+ *
+ * \return Manifest, NULL if missing or not readable.
+ */
+runManifest* manifestRead(char* path);
+
+/**
+ * Finds a collection.
+ *
+ * \param manifest   Manifest.
+ * \param collection Collection name.
+ *
+ * \return Collection, NULL if not found.
+ */
+manifestEntry* manifestFind(runManifest* manifest, const char* collection);
+
+/**
+ * Hashes a file content.
+ *
+ * \param path File path.
+ * \param hash Content hash.
+ *
+ * \return False if file could not be read.
+ */
+bool manifestHashFile(const char* path, uint64_t* hash);
+
+/**
+ * Content hash of a file from its MD5 digest (computed while reading it).
+ *
+ * \param digest MD5 digest (MD5_DIGEST_LENGTH bytes).
+ *
+ * \return Content hash.
+ */
+uint64_t manifestDigestHash(const unsigned char* digest);
+
+/**
+ * Adds a collection.
+ *
+ * \param manifest   Manifest.
+ * \param collection Collection name.
+ * \param input      Input stat.
+ * \param hash       Input content hash.
+ * \param outputs    Output files names (NULL terminated), copied.
+ */
+void manifestAdd(runManifest* manifest, const char* collection, struct stat* input, uint64_t hash, char** outputs);
+
+/**
+ * Writes a manifest.
+ *
+ * \param manifest Manifest.
+ * \param path     Manifest file path.
+ */
+void manifestWrite(runManifest* manifest, char* path);
+
+/**
+ * Destroy a manifest and release memory.
+ *
+ * \param manifest Manifest.
+ */
+void manifestDestroy(runManifest* manifest);
+
+
+#endif /* _MANIFEST_H_INCLUDED_ */
@@ -0,0 +1,200 @@
+/**
+ * Incremental feed merge includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _MERGE_H_INCLUDED_
+#define _MERGE_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "epf.h"
+#include "key.h"
+#include "sort.h"
+
+/**
+ * Largest document accepted in a previous dump.
+ */
+#define MERGE_MAX_DOCUMENT          16777216
+
+/**
+ * Merge of a previous full dump with incremental entries.
+ *
+ * The previous dump is a BSON file sorted by primary key (written with
+ * --sort-by-pk) and is read sequentially. Incremental entries are spilled
+ * through an external sorter, whose stable k-way merge of runs gives entries
+ * of equal keys in insertion order : the last one added wins, then replaces
+ * the previous dump document with the same key, if any.
+ */
+typedef struct bsonMerger {
+    /**
+     * Primary key fields names.
+     */
+    char** keyNames;
+    /**
+     * Primary key fields types (EPF_FIELDTYPE_*).
+     */
+    unsigned char* keyTypes;
+    /**
+     * Primary key fields count.
+     */
+    size_t keyCount;
+    /**
+     * EPF file entries are currently added from.
+     */
+    EPFFile* file;
+    /**
+     * Previous dump path.
+     */
+    char* basePath;
+    /**
+     * Previous dump, NULL if none.
+     */
+    FILE* base;
+    /**
+     * Current previous dump document.
+     */
+    unsigned char* baseDocument;
+    /**
+     * Current previous dump document length.
+     */
+    size_t baseLength;
+    /**
+     * Previous dump document buffer allocated size.
+     */
+    size_t baseAllocated;
+    /**
+     * Current previous dump document key.
+     */
+    keyBuffer* baseKey;
+    /**
+     * Previous previous dump document key (to check order).
+     */
+    keyBuffer* lastBaseKey;
+    /**
+     * Current previous dump document is valid.
+     */
+    bool baseValid;
+    /**
+     * Current previous dump document was returned, read next one first.
+     */
+    bool basePending;
+    /**
+     * Incremental entries.
+     */
+    externalSorter* updates;
+    /**
+     * Current incremental entry (valid until next sorterNext()).
+     */
+    sortRecord update;
+    /**
+     * Current incremental entry is valid.
+     */
+    bool updateValid;
+    /**
+     * Incremental entry key buffer.
+     */
+    keyBuffer* key;
+    /**
+     * Last incremental entry of current key (key then document).
+     */
+    unsigned char* latest;
+    /**
+     * Last incremental entry buffer allocated size.
+     */
+    size_t latestAllocated;
+    /**
+     * Reading started.
+     */
+    bool started;
+    /**
+     * Previous dump documents kept.
+     */
+    uint64_t kept;
+    /**
+     * Previous dump documents replaced.
+     */
+    uint64_t replaced;
+    /**
+     * Incremental entries not in previous dump.
+     */
+    uint64_t added;
+    /**
+     * Incremental entries superseded by a later one with the same key.
+     */
+    uint64_t superseded;
+} bsonMerger;
+
+
+/**
+ * Starts a merge.
+ *
+ * \param file         First EPFFile entries are added from (header parsed).
+ * \param basePath     Previous dump BSON file path (may not exist).
+ * \param tempDir      Temporary files directory.
+ * \param memoryBudget Incremental entries sort memory budget (bytes).
+ *
+ * \return Merger.
+ */
+bsonMerger* mergeInit(EPFFile* file, char* basePath, char* tempDir, size_t memoryBudget);
+
+/**
+ * Sets EPF file next entries are added from (same primary key).
+ *
+ * \param merger Merger.
+ * \param file   EPFFile instance (header parsed).
+ */
+void mergeBind(bsonMerger* merger, EPFFile* file);
+
+/**
+ * Adds an incremental entry, it replaces previously added ones with the same key.
+ *
+ * \param merger   Merger.
+ * \param values   Entry typed values.
+ * \param document Serialized BSON document.
+ * \param length   Document length.
+ */
+void mergeAdd(bsonMerger* merger, EPFValue* values, const void* document, size_t length);
+
+/**
+ * Gets next merged document, in key order.
+ *
+ * \param merger Merger.
+ * \param record Record (value is the document, valid until next call).
+ *
+ * \return False when all documents were read.
+ */
+bool mergeNext(bsonMerger* merger, sortRecord* record);
+
+/**
+ * Destroy a merger and release memory.
+ *
+ * \param merger Merger.
+ */
+void mergeDestroy(bsonMerger* merger);
+
+
+#endif /* _MERGE_H_INCLUDED_ */
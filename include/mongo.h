@@ -0,0 +1,192 @@
+/**
+ * MongoDB wire protocol bulk insert sink includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _MONGO_H_INCLUDED_
+#define _MONGO_H_INCLUDED_
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "bson.h"
+
+/**
+ * Default server port and connections count.
+ */
+#define MONGO_DEFAULT_PORT          "27017"
+#define MONGO_CONNECTIONS           4
+
+/**
+ * Insert batches limits (server maxWriteBatchSize and maxMessageSizeBytes,
+ * minus room for the command).
+ */
+#define MONGO_BATCH_DOCUMENTS       100000
+#define MONGO_BATCH_BYTES           47999000
+
+/**
+ * Insert commands sent on a connection before waiting for a reply.
+ */
+#define MONGO_PIPELINE_DEPTH        4
+
+/**
+ * Server connection.
+ */
+typedef struct mongoConnection {
+    /**
+     * Socket.
+     */
+    int socket;
+    /**
+     * Insert commands sent and not acknowledged yet.
+     */
+    size_t inFlight;
+} mongoConnection;
+
+/**
+ * Bulk insert sink.
+ */
+typedef struct mongoSink {
+    /**
+     * Connections.
+     */
+    mongoConnection* connections;
+    /**
+     * Connections count.
+     */
+    size_t connectionsCount;
+    /**
+     * Connection to send next batch on.
+     */
+    size_t nextConnection;
+    /**
+     * Target database.
+     */
+    char* database;
+    /**
+     * Target collection.
+     */
+    char* collection;
+    /**
+     * OP_MSG being built.
+     */
+    char* message;
+    /**
+     * OP_MSG used length.
+     */
+    size_t messageLength;
+    /**
+     * OP_MSG allocated size.
+     */
+    size_t messageAllocated;
+    /**
+     * Documents section offset in message.
+     */
+    size_t sequenceOffset;
+    /**
+     * Bytes an insert batch is sent at (MONGO_BATCH_BYTES by default).
+     */
+    size_t batchBytes;
+    /**
+     * Documents in current batch.
+     */
+    size_t batchDocuments;
+    /**
+     * Last request id.
+     */
+    int32_t requestId;
+    /**
+     * Reply buffer.
+     */
+    char* reply;
+    /**
+     * Reply buffer allocated size.
+     */
+    size_t replyAllocated;
+    /**
+     * Command document (reused).
+     */
+    bsonDocument* command;
+    /**
+     * Documents acknowledged as inserted.
+     */
+    uint64_t inserted;
+    /**
+     * Documents rejected by server (EG: duplicate key).
+     */
+    uint64_t writeErrors;
+} mongoSink;
+
+
+/**
+ * Connects to a MongoDB server.
+ *
+ * \param uri         Server URI (mongodb://host[:port][/...], no authentication).
+ * \param connections Connections to open.
+ *
+ * \return Sink.
+ */
+mongoSink* mongoConnect(char* uri, size_t connections);
+
+/**
+ * Starts inserting into a collection.
+ *
+ * \param sink       Sink.
+ * \param database   Database name.
+ * \param collection Collection name.
+ */
+void mongoStart(mongoSink* sink, char* database, char* collection);
+
+/**
+ * Queues a document for insertion.
+ *
+ * \param sink     Sink.
+ * \param document Serialized BSON document.
+ * \param length   Document length.
+ */
+void mongoInsert(mongoSink* sink, const void* document, size_t length);
+
+/**
+ * Sends last batch and waits for all insertions to be acknowledged.
+ *
+ * \param sink Sink.
+ */
+void mongoFinish(mongoSink* sink);
+
+/**
+ * Creates an ascending index on a field of current collection.
+ *
+ * \param sink  Sink.
+ * \param field Field name.
+ */
+void mongoCreateIndex(mongoSink* sink, char* field);
+
+/**
+ * Closes connections and releases memory.
+ *
+ * \param sink Sink.
+ */
+void mongoClose(mongoSink* sink);
+
+
+#endif /* _MONGO_H_INCLUDED_ */
@@ -0,0 +1,151 @@
+/**
+ * BSON output file includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _OUTPUT_H_INCLUDED_
+#define _OUTPUT_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/**
+ * Output to input size ratio assumed before any output is written.
+ */
+#define OUTPUT_DEFAULT_RATIO        2.0
+
+/**
+ * Mapped window size bounds.
+ */
+#define OUTPUT_MIN_WINDOW           1048576
+#define OUTPUT_MAX_WINDOW           67108864
+
+/**
+ * Written bytes between write-behind steps (drop-behind output).
+ */
+#define OUTPUT_SYNC_WINDOW          16777216
+
+/**
+ * BSON output file.
+ *
+ * Written through stdio, or, when mapped, preallocated with fallocate() from
+ * a size estimate and written through a sliding shared mapping, then
+ * truncated to its written length when closed.
+ */
+typedef struct bsonOutput {
+    /**
+     * File path.
+     */
+    char* path;
+    /**
+     * File (stdio output).
+     */
+    FILE* fp;
+    /**
+     * File descriptor (mapped output), -1 if not mapped.
+     */
+    int fd;
+    /**
+     * Current mapped window.
+     */
+    unsigned char* window;
+    /**
+     * Mapped window size.
+     */
+    size_t windowLength;
+    /**
+     * Current mapped window offset in file.
+     */
+    uint64_t windowOffset;
+    /**
+     * Bytes written.
+     */
+    uint64_t position;
+    /**
+     * Preallocated file size.
+     */
+    uint64_t allocated;
+    /**
+     * CRC32C is computed.
+     */
+    bool checksum;
+    /**
+     * CRC32C of bytes written so far.
+     */
+    uint32_t crc;
+    /**
+     * Written pages are flushed and dropped from page cache as output goes.
+     */
+    bool dropBehind;
+    /**
+     * Bytes whose writeback was started.
+     */
+    uint64_t syncedOffset;
+    /**
+     * Bytes written back and dropped from page cache.
+     */
+    uint64_t droppedOffset;
+} bsonOutput;
+
+
+/**
+ * Creates an output file.
+ *
+ * \param path       File path.
+ * \param mapped     Write through a mapping instead of stdio.
+ * \param checksum   Compute file CRC32C, written in <path>.crc32c on close.
+ * \param dropBehind Write back and drop written pages from page cache as output goes.
+ * \param estimate   Expected file size (mapped output).
+ *
+ * \return Output.
+ */
+bsonOutput* outputOpen(char* path, bool mapped, bool checksum, bool dropBehind, uint64_t estimate);
+
+/**
+ * Updates expected file size, preallocating more if needed.
+ *
+ * \param output   Output.
+ * \param estimate Expected file size.
+ */
+void outputEstimate(bsonOutput* output, uint64_t estimate);
+
+/**
+ * Writes bytes.
+ *
+ * \param output Output.
+ * \param data   Data.
+ * \param length Data length.
+ */
+void outputWrite(bsonOutput* output, const void* data, size_t length);
+
+/**
+ * Closes an output file and releases memory.
+ *
+ * \param output Output (destroyed).
+ */
+void outputClose(bsonOutput* output);
+
+
+#endif /* _OUTPUT_H_INCLUDED_ */
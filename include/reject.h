@@ -0,0 +1,170 @@
+/**
+ * Malformed records quarantine includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _REJECT_H_INCLUDED_
+#define _REJECT_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+/**
+ * Malformed records shown one by one, later ones are only counted.
+ */
+#define REJECT_WARNINGS             10
+
+/**
+ * Record bytes shown in a warning.
+ */
+#define REJECT_WARNING_LENGTH       160
+
+/**
+ * Minimum delay between two summary warnings (seconds).
+ */
+#define REJECT_SUMMARY_DELAY        10
+
+/**
+ * Malformed records log.
+ *
+ * Each rejected record is appended to the reject file (if any) in raw form,
+ * preceded by a "#rejected:<EPF file>:<byte offset>:<reason>" record, both
+ * ending with the EPF record separator. The first REJECT_WARNINGS records are
+ * shown as warnings, then a summary is shown at most every
+ * REJECT_SUMMARY_DELAY seconds. Once more than maxErrors records are
+ * rejected, readers stop with an error. A log may be shared by readers of
+ * different threads.
+ */
+typedef struct rejectLog {
+    /**
+     * Reject file path, NULL if none.
+     */
+    char* path;
+    /**
+     * Reject file, NULL if none.
+     */
+    FILE* fp;
+    /**
+     * EPF file being read.
+     */
+    char* source;
+    /**
+     * Records rejected so far.
+     */
+    unsigned long count;
+    /**
+     * Records of current EPF file rejected so far.
+     */
+    unsigned long sourceCount;
+    /**
+     * Rejected records count aborting the run (0 : no limit).
+     */
+    unsigned long maxErrors;
+    /**
+     * Last summary warning time.
+     */
+    time_t lastSummary;
+    /**
+     * Lock, records are rejected one at a time.
+     */
+    pthread_mutex_t lock;
+} rejectLog;
+
+
+/**
+ * Creates a malformed records log.
+ *
+ * \param path      Reject file path, NULL to only show warnings.
+ * \param maxErrors Rejected records count aborting the run (0 : no limit).
+ *
+ * \return Log.
+ */
+rejectLog* rejectOpen(char* path, unsigned long maxErrors);
+
+/**
+ * Starts logging records of an EPF file.
+ *
+ * \param log    Log.
+ * \param source EPF file path (not copied).
+ */
+void rejectStart(rejectLog* log, char* source);
+
+/**
+ * Rejects a raw record.
+ *
+ * \param log    Log.
+ * \param offset Record offset in EPF file.
+ * \param reason Reason.
+ * \param record Raw record, record separator excluded.
+ * \param length Raw record length.
+ *
+ * \return False if more than maxErrors records are rejected.
+ */
+bool rejectRecord(rejectLog* log, uint64_t offset, const char* reason, const char* record, size_t length);
+
+/**
+ * Rejects a raw record for an EPF reader (epfRejectHandler).
+ *
+ * \param context Log.
+ * \param offset  Record offset in EPF file.
+ * \param reason  Reason.
+ * \param record  Raw record, record separator excluded.
+ * \param length  Raw record length.
+ *
+ * \return False if more than maxErrors records are rejected.
+ */
+bool rejectHandler(void* context, uint64_t offset, const char* reason, const char* record, size_t length);
+
+/**
+ * Rejects an entry (fields are written back with field separators).
+ *
+ * \param log         Log.
+ * \param offset      Entry offset in EPF file.
+ * \param reason      Reason.
+ * \param entry       Entry fields.
+ * \param fieldsCount Fields count.
+ *
+ * \return False if more than maxErrors records are rejected.
+ */
+bool rejectEntry(rejectLog* log, uint64_t offset, const char* reason, char** entry, size_t fieldsCount);
+
+/**
+ * Ends logging records of current EPF file, showing their count.
+ *
+ * \param log Log.
+ */
+void rejectEnd(rejectLog* log);
+
+/**
+ * Closes reject file and release memory.
+ *
+ * \param log Log (destroyed).
+ */
+void rejectClose(rejectLog* log);
+
+
+#endif /* _REJECT_H_INCLUDED_ */
@@ -0,0 +1,108 @@
+/**
+ * Conversion sinks includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef _SINK_H_INCLUDED_
+#define _SINK_H_INCLUDED_
+
+#include <stdlib.h>
+
+#include "epf.h"
+
+/**
+ * Consumes an exported entry.
+ *
+ * \param context Sink state.
+ * \param values  Typed values (fieldsCount values).
+ */
+typedef void (*sinkWriter)(void* context, EPFValue* values);
+
+/**
+ * Finishes output and destroys sink state.
+ *
+ * \param context Sink state.
+ */
+typedef void (*sinkCloser)(void* context);
+
+/**
+ * Output fed by the conversion pass, alongside BSON : every sink consumes
+ * the same converted entries, parsed once.
+ */
+typedef struct rowSink {
+    /**
+     * Sink state.
+     */
+    void* context;
+    /**
+     * Entries consumer.
+     */
+    sinkWriter write;
+    /**
+     * Finisher.
+     */
+    sinkCloser close;
+    /**
+     * Next sink, NULL if last.
+     */
+    struct rowSink* next;
+} rowSink;
+
+
+/**
+ * Creates a sink.
+ *
+ * \param context Sink state.
+ * \param write   Entries consumer.
+ * \param close   Finisher.
+ *
+ * \return Sink.
+ */
+rowSink* sinkCreate(void* context, sinkWriter write, sinkCloser close);
+
+/**
+ * Appends a sink to a list.
+ *
+ * \param sinks Sinks list (NULL if empty).
+ * \param sink  Sink.
+ */
+void sinkAdd(rowSink** sinks, rowSink* sink);
+
+/**
+ * Feeds an exported entry to every sink of a list.
+ *
+ * \param sinks  Sinks list.
+ * \param values Typed values (fieldsCount values).
+ */
+void sinkWrite(rowSink* sinks, EPFValue* values);
+
+/**
+ * Finishes every sink of a list and destroys them.
+ *
+ * \param sinks Sinks list.
+ */
+void sinkClose(rowSink* sinks);
+
+
+#endif /* _SINK_H_INCLUDED_ */
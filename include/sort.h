@@ -0,0 +1,230 @@
+/**
+ * External merge sort includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _SORT_H_INCLUDED_
+#define _SORT_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/**
+ * Uncompressed size of spill runs blocks.
+ */
+#define SORT_BLOCK_SIZE             262144
+
+/**
+ * Maximum runs merged at once : each time as many runs of a level are
+ * spilled, they are merged into one run of next level.
+ */
+#define SORT_MAX_RUNS               64
+
+
+/**
+ * Sorted record (key + value).
+ */
+typedef struct sortRecord {
+    /**
+     * Key (compared with memcmp()).
+     */
+    unsigned char* key;
+    /**
+     * Key length.
+     */
+    uint32_t keyLength;
+    /**
+     * Value.
+     */
+    unsigned char* value;
+    /**
+     * Value length.
+     */
+    uint32_t valueLength;
+} sortRecord;
+
+/**
+ * Spill run : a sorted, LZ4 compressed, temporary file.
+ */
+typedef struct sortRun {
+    /**
+     * Temporary file (already unlinked).
+     */
+    FILE* fp;
+    /**
+     * Current uncompressed block.
+     */
+    unsigned char* block;
+    /**
+     * Current block length.
+     */
+    size_t blockLength;
+    /**
+     * Read position in current block.
+     */
+    size_t blockPosition;
+    /**
+     * Block buffer allocated size.
+     */
+    size_t blockAllocated;
+    /**
+     * Compressed block buffer.
+     */
+    unsigned char* compressed;
+    /**
+     * Compressed block buffer allocated size.
+     */
+    size_t compressedAllocated;
+    /**
+     * Current record (valid while merging).
+     */
+    sortRecord current;
+    /**
+     * Merge level (0 for runs spilled from memory).
+     */
+    unsigned int level;
+} sortRun;
+
+/**
+ * External merge sorter.
+ *
+ * Records are buffered in memory up to the memory budget, then sorted and
+ * spilled as a run in temporary directory. Runs are merged by levels of
+ * SORT_MAX_RUNS, so that each record is rewritten once per level, and reading
+ * merges remaining runs. Sort is stable : records with equal keys come out in
+ * insertion order.
+ */
+typedef struct externalSorter {
+    /**
+     * Temporary files directory.
+     */
+    char* tempDir;
+    /**
+     * Memory budget (bytes).
+     */
+    size_t memoryBudget;
+    /**
+     * In memory records storage.
+     */
+    unsigned char* arena;
+    /**
+     * Used bytes in arena.
+     */
+    size_t arenaLength;
+    /**
+     * Arena allocated size.
+     */
+    size_t arenaAllocated;
+    /**
+     * In memory records.
+     */
+    sortRecord* items;
+    /**
+     * In memory records count.
+     */
+    size_t itemsCount;
+    /**
+     * In memory records allocated count.
+     */
+    size_t itemsAllocated;
+    /**
+     * Next in memory record to read (when nothing was spilled).
+     */
+    size_t nextItem;
+    /**
+     * Spill runs.
+     */
+    sortRun** runs;
+    /**
+     * Spill runs count.
+     */
+    size_t runsCount;
+    /**
+     * Spill runs allocated count.
+     */
+    size_t runsAllocated;
+    /**
+     * Merge heap (runs indexes).
+     */
+    size_t* heap;
+    /**
+     * Merge heap size.
+     */
+    size_t heapCount;
+    /**
+     * Run whose current record was last returned, to advance on next read.
+     */
+    long pendingRun;
+    /**
+     * Runs spilled so far (including intermediate merges).
+     */
+    unsigned long spilledRuns;
+    /**
+     * No more records can be added, reading started.
+     */
+    bool finished;
+} externalSorter;
+
+
+/**
+ * Creates a new external sorter.
+ *
+ * \param tempDir      Temporary files directory.
+ * \param memoryBudget Memory budget (bytes).
+ *
+ * \return Sorter.
+ */
+externalSorter* sorterInit(char* tempDir, size_t memoryBudget);
+
+/**
+ * Adds a record to sorter.
+ *
+ * \param sorter      Sorter instance.
+ * \param key         Key.
+ * \param keyLength   Key length.
+ * \param value       Value.
+ * \param valueLength Value length.
+ */
+void sorterAdd(externalSorter* sorter, const void* key, size_t keyLength, const void* value, size_t valueLength);
+
+/**
+ * Gets next record in key order.
+ *
+ * \param sorter Sorter instance.
+ * \param record Record (valid until next call).
+ *
+ * \return False when all records were read.
+ */
+bool sorterNext(externalSorter* sorter, sortRecord* record);
+
+/**
+ * Destroy a sorter, its temporary files and release memory.
+ *
+ * \param sorter Sorter instance.
+ */
+void sorterDestroy(externalSorter* sorter);
+
+
+#endif /* _SORT_H_INCLUDED_ */
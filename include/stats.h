@@ -0,0 +1,174 @@
+/**
+ * Per column statistics includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _STATS_H_INCLUDED_
+#define _STATS_H_INCLUDED_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "epf.h"
+#include "sink.h"
+
+/**
+ * HyperLogLog registers index bits (4096 registers, about 1.6% error).
+ */
+#define STATS_HLL_BITS              12
+
+/**
+ * HyperLogLog registers count.
+ */
+#define STATS_HLL_REGISTERS         (1 << STATS_HLL_BITS)
+
+/**
+ * Statistics of a field.
+ */
+typedef struct statsColumn {
+    /**
+     * Null values count.
+     */
+    unsigned long nulls;
+    /**
+     * A (finite) value set the range.
+     */
+    bool hasRange;
+    /**
+     * Smallest value (BIGINT, INTEGER, BOOLEAN, DATETIME).
+     */
+    int64_t minInteger;
+    /**
+     * Largest value (BIGINT, INTEGER, BOOLEAN, DATETIME).
+     */
+    int64_t maxInteger;
+    /**
+     * Smallest value (DECIMAL).
+     */
+    double minDecimal;
+    /**
+     * Largest value (DECIMAL).
+     */
+    double maxDecimal;
+    /**
+     * Shortest string (bytes, VARCHAR, LONGTEXT).
+     */
+    size_t minLength;
+    /**
+     * Longest string (bytes, VARCHAR, LONGTEXT).
+     */
+    size_t maxLength;
+    /**
+     * Strings total length (bytes, VARCHAR, LONGTEXT).
+     */
+    uint64_t totalLength;
+    /**
+     * HyperLogLog registers (STATS_HLL_REGISTERS) of values hashes.
+     */
+    unsigned char* registers;
+} statsColumn;
+
+/**
+ * Statistics of a collection, gathered while converting it.
+ */
+typedef struct statsCollector {
+    /**
+     * EPF file description.
+     */
+    EPFFile* file;
+    /**
+     * Columns statistics (fieldsCount).
+     */
+    statsColumn* columns;
+    /**
+     * Entries seen.
+     */
+    unsigned long entries;
+    /**
+     * Collection name, written by sink finisher.
+     */
+    char* collection;
+    /**
+     * JSON file path, written by sink finisher.
+     */
+    char* path;
+} statsCollector;
+
+
+/**
+ * Creates statistics of an EPF file.
+ *
+ * \param file EPFFile instance (header parsed).
+ *
+ * \return Statistics.
+ */
+statsCollector* statsInit(EPFFile* file);
+
+/**
+ * Adds an entry to statistics.
+ *
+ * \param stats  Statistics.
+ * \param values Typed values (fieldsCount values).
+ */
+void statsAdd(statsCollector* stats, EPFValue* values);
+
+/**
+ * Estimates distinct non null values count of a field.
+ *
+ * \param stats Statistics.
+ * \param field Field index.
+ *
+ * \return Estimated distinct values count.
+ */
+unsigned long statsDistinct(statsCollector* stats, size_t field);
+
+/**
+ * Writes statistics as a json file.
+ *
+ * \param stats      Statistics.
+ * \param collection Collection name.
+ * \param path       JSON file path.
+ */
+void statsWrite(statsCollector* stats, char* collection, char* path);
+
+/**
+ * Destroy statistics and release memory.
+ *
+ * \param stats Statistics.
+ */
+void statsDestroy(statsCollector* stats);
+
+/**
+ * Creates a sink gathering statistics, written as a json file when done.
+ *
+ * \param stats      Statistics (destroyed with sink).
+ * \param collection Collection name.
+ * \param path       JSON file path.
+ *
+ * \return Sink.
+ */
+rowSink* statsSink(statsCollector* stats, char* collection, char* path);
+
+
+#endif /* _STATS_H_INCLUDED_ */
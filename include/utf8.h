@@ -0,0 +1,71 @@
+/**
+ * UTF-8 validation and repair includes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _UTF8_H_INCLUDED_
+#define _UTF8_H_INCLUDED_
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * Invalid UTF-8 strings handling modes.
+ */
+#define UTF8_MODE_PASS              0
+#define UTF8_MODE_REPLACE           1
+#define UTF8_MODE_REJECT            2
+
+
+/**
+ * Checks a byte sequence is valid UTF-8.
+ *
+ * \param data   Data.
+ * \param length Data length.
+ *
+ * \return True if valid.
+ */
+bool utf8Validate(const char* data, size_t length);
+
+/**
+ * Maximum repaired length of a byte sequence.
+ *
+ * \param length Data length.
+ *
+ * \return Repaired length upper bound (0 terminator included).
+ */
+size_t utf8RepairBound(size_t length);
+
+/**
+ * Copies a byte sequence, replacing each maximal invalid subpart by U+FFFD.
+ *
+ * \param data   Data.
+ * \param length Data length.
+ * \param output Output buffer (at least utf8RepairBound(length) bytes), 0 terminated.
+ *
+ * \return Repaired length.
+ */
+size_t utf8Repair(const char* data, size_t length, char* output);
+
+
+#endif /* _UTF8_H_INCLUDED_ */
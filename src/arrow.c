@@ -0,0 +1,509 @@
+/**
+ * Arrow IPC file (Feather v2) writer.
+ *
+ * Writes the Arrow IPC file format : magic, schema message, one record
+ * batch message per batch, end of stream marker, then the footer indexing
+ * batches. Metadata is encoded with the built-in FlatBuffers builder, bodies
+ * are plain little endian buffers padded to 8 bytes.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "epf.h"
+#include "flatbuffer.h"
+#include "arrow.h"
+#include "sink.h"
+
+/**
+ * File magic and format constants (see Arrow format Schema.fbs, Message.fbs
+ * and File.fbs).
+ */
+#define ARROW_MAGIC                 "ARROW1"
+#define ARROW_CONTINUATION          0xFFFFFFFF
+#define ARROW_METADATA_V5           4
+#define ARROW_HEADER_SCHEMA         1
+#define ARROW_HEADER_RECORDBATCH    3
+#define ARROW_TYPE_INT              2
+#define ARROW_TYPE_FLOATINGPOINT    3
+#define ARROW_TYPE_UTF8             5
+#define ARROW_TYPE_BOOL             6
+#define ARROW_TYPE_TIMESTAMP        10
+#define ARROW_PRECISION_DOUBLE      2
+#define ARROW_UNIT_MILLISECOND      1
+
+/**
+ * Rounds a size up to 8 bytes.
+ */
+#define ARROW_ALIGN(size)           (((size) + 7) & ~((size_t)7))
+
+/**
+ * Tells if a field type is stored as utf8.
+ *
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ *
+ * \return True for utf8 columns.
+ */
+bool _arrowIsString(unsigned char fieldType) {
+    return((fieldType == EPF_FIELDTYPE_VARCHAR) || (fieldType == EPF_FIELDTYPE_LONGTEXT));
+}
+
+/**
+ * Writes bytes to output, followed by zeros up to 8 bytes alignment.
+ *
+ * \param writer Arrow writer.
+ * \param data   Data.
+ * \param length Data length.
+ */
+void _arrowWrite(arrowWriter* writer, const void* data, size_t length) {
+    static const unsigned char padding[8] = { 0 };
+    size_t padded = ARROW_ALIGN(length);
+
+    if (
+        (length && (fwrite(data, 1, length, writer->fp) != length)) ||
+        ((padded != length) && (fwrite(padding, 1, padded - length, writer->fp) != padded - length))
+    ) {
+        error("Cannot write Arrow file : %s", strerror(errno));
+    }
+    writer->position += padded;
+}
+
+/**
+ * Adds the schema table to builder.
+ *
+ * \param builder Builder.
+ * \param file    EPFFile instance.
+ *
+ * \return Schema table offset.
+ */
+uint32_t _arrowAddSchema(flatBuilder* builder, EPFFile* file) {
+    uint32_t* fields;
+    uint32_t type;
+    uint32_t name;
+    uint32_t children;
+    uint32_t vector;
+    unsigned char fieldType;
+    unsigned char typeType = 0;
+
+    fields = calloc(file->fieldsCount, sizeof(uint32_t));
+    if (!fields) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < file->fieldsCount; i++) {
+        fieldType = epfGetFieldType(file, i);
+        fbStartTable(builder);
+        switch (fieldType) {
+            case EPF_FIELDTYPE_BIGINT :
+            case EPF_FIELDTYPE_INTEGER :
+                typeType = ARROW_TYPE_INT;
+                fbAddInt32(builder, 0, 64);
+                fbAddUint8(builder, 1, 1);
+                break;
+            case EPF_FIELDTYPE_BOOLEAN :
+                typeType = ARROW_TYPE_BOOL;
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                typeType = ARROW_TYPE_FLOATINGPOINT;
+                fbAddInt16(builder, 0, ARROW_PRECISION_DOUBLE);
+                break;
+            case EPF_FIELDTYPE_DATETIME :
+                typeType = ARROW_TYPE_TIMESTAMP;
+                fbAddInt16(builder, 0, ARROW_UNIT_MILLISECOND);
+                break;
+            case EPF_FIELDTYPE_VARCHAR :
+            case EPF_FIELDTYPE_LONGTEXT :
+                typeType = ARROW_TYPE_UTF8;
+                break;
+            default :
+                error("Unknown EPF field type, aborting");
+        }
+        type = fbEndTable(builder);
+        name = fbCreateString(builder, file->fields[i]->fieldName);
+        children = fbCreateOffsetVector(builder, NULL, 0);
+        fbStartTable(builder);
+        fbAddOffset(builder, 0, name);
+        fbAddOffset(builder, 3, type);
+        fbAddOffset(builder, 5, children);
+        fbAddUint8(builder, 1, 1);
+        fbAddUint8(builder, 2, typeType);
+        fields[i] = fbEndTable(builder);
+    }
+    vector = fbCreateOffsetVector(builder, fields, file->fieldsCount);
+    free(fields);
+    fbStartTable(builder);
+    fbAddOffset(builder, 1, vector);
+    fbAddInt16(builder, 0, 0);
+    return(fbEndTable(builder));
+}
+
+/**
+ * Writes an encapsulated message metadata (the body is written by caller).
+ *
+ * \param writer     Arrow writer.
+ * \param headerType Message header type (ARROW_HEADER_*).
+ * \param header     Header table offset in writer builder.
+ * \param bodyLength Message body length.
+ * \param block      Filled with message position, NULL if not needed.
+ */
+void _arrowWriteMessage(arrowWriter* writer, unsigned char headerType, uint32_t header, int64_t bodyLength, arrowBlock* block) {
+    unsigned char* metadata;
+    uint32_t prefix[2];
+
+    fbStartTable(writer->builder);
+    fbAddInt64(writer->builder, 3, bodyLength);
+    fbAddOffset(writer->builder, 2, header);
+    fbAddInt16(writer->builder, 0, ARROW_METADATA_V5);
+    fbAddUint8(writer->builder, 1, headerType);
+    metadata = fbFinish(writer->builder, fbEndTable(writer->builder));
+    if (block) {
+        block->offset = writer->position;
+        block->metaDataLength = sizeof(prefix) + ARROW_ALIGN(writer->builder->length);
+        block->bodyLength = bodyLength;
+    }
+    prefix[0] = htole32(ARROW_CONTINUATION);
+    prefix[1] = htole32(ARROW_ALIGN(writer->builder->length));
+    _arrowWrite(writer, prefix, sizeof(prefix));
+    _arrowWrite(writer, metadata, writer->builder->length);
+    fbReset(writer->builder);
+}
+
+/**
+ * Writes current record batch, if not empty, and resets columns.
+ *
+ * \param writer Arrow writer.
+ */
+void _arrowFlush(arrowWriter* writer) {
+    size_t count = writer->file->fieldsCount;
+    size_t bitmapLength = (writer->rows + 7) / 8;
+    uint64_t* nodes;
+    uint64_t* buffers;
+    const void** bodies;
+    size_t buffersCount = 0;
+    int64_t bodyLength = 0;
+    uint32_t nodesVector;
+    uint32_t buffersVector;
+    uint32_t header;
+
+    if (!writer->rows) {
+        return;
+    }
+    nodes = calloc(count * 2, sizeof(uint64_t));
+    buffers = calloc(count * 3 * 2, sizeof(uint64_t));
+    bodies = calloc(count * 3, sizeof(void*));
+    if (!nodes || !buffers || !bodies) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < count; i++) {
+        arrowColumn* column = &writer->columns[i];
+        size_t lengths[3];
+        const void* data[3];
+        size_t columnBuffers = 2;
+
+        nodes[i * 2] = htole64(writer->rows);
+        nodes[i * 2 + 1] = htole64(column->nullCount);
+        lengths[0] = column->nullCount ? bitmapLength : 0;
+        data[0] = column->validity;
+        if (_arrowIsString(column->fieldType)) {
+            lengths[1] = (writer->rows + 1) * sizeof(int32_t);
+            data[1] = column->offsets;
+            lengths[2] = column->dataLength;
+            data[2] = column->data;
+            columnBuffers = 3;
+        } else if (column->fieldType == EPF_FIELDTYPE_BOOLEAN) {
+            lengths[1] = bitmapLength;
+            data[1] = column->values;
+        } else {
+            lengths[1] = writer->rows * sizeof(int64_t);
+            data[1] = column->values;
+        }
+        for (size_t j = 0; j < columnBuffers; j++) {
+            buffers[buffersCount * 2] = htole64(bodyLength);
+            buffers[buffersCount * 2 + 1] = htole64(lengths[j]);
+            bodies[buffersCount] = data[j];
+            bodyLength += ARROW_ALIGN(lengths[j]);
+            buffersCount++;
+        }
+    }
+    nodesVector = fbCreateStructVector(writer->builder, nodes, 2 * sizeof(uint64_t), count, sizeof(uint64_t));
+    buffersVector = fbCreateStructVector(writer->builder, buffers, 2 * sizeof(uint64_t), buffersCount, sizeof(uint64_t));
+    fbStartTable(writer->builder);
+    fbAddInt64(writer->builder, 0, writer->rows);
+    fbAddOffset(writer->builder, 1, nodesVector);
+    fbAddOffset(writer->builder, 2, buffersVector);
+    header = fbEndTable(writer->builder);
+
+    if (writer->batchesCount == writer->batchesAllocated) {
+        writer->batchesAllocated = writer->batchesAllocated ? writer->batchesAllocated * 2 : 16;
+        writer->batches = realloc(writer->batches, writer->batchesAllocated * sizeof(arrowBlock));
+        if (!writer->batches) {
+            error("Cannot allocate memory");
+        }
+    }
+    _arrowWriteMessage(writer, ARROW_HEADER_RECORDBATCH, header, bodyLength, &writer->batches[writer->batchesCount++]);
+    for (size_t i = 0; i < buffersCount; i++) {
+        _arrowWrite(writer, bodies[i], le64toh(buffers[i * 2 + 1]));
+    }
+    free(nodes);
+    free(buffers);
+    free(bodies);
+
+    for (size_t i = 0; i < count; i++) {
+        arrowColumn* column = &writer->columns[i];
+
+        memset(column->validity, 0, bitmapLength);
+        if (column->fieldType == EPF_FIELDTYPE_BOOLEAN) {
+            memset(column->values, 0, bitmapLength);
+        }
+        column->dataLength = 0;
+        column->nullCount = 0;
+    }
+    writer->rows = 0;
+}
+
+/**
+ * Sink entries consumer : appends an entry.
+ *
+ * \param context Arrow writer.
+ * \param values  Typed values.
+ */
+void _arrowSinkWrite(void* context, EPFValue* values) {
+    arrowAppend(context, values);
+}
+
+/**
+ * Sink finisher : closes file.
+ *
+ * \param context Arrow writer.
+ */
+void _arrowSinkClose(void* context) {
+    arrowClose(context);
+}
+
+
+/**
+ * Starts writing an Arrow IPC file.
+ *
+ * \param path      Arrow file path.
+ * \param file      EPFFile instance (header parsed).
+ * \param batchRows Maximum rows per record batch.
+ *
+ * \return Arrow writer.
+ */
+arrowWriter* arrowCreate(char* path, EPFFile* file, size_t batchRows) {
+    arrowWriter* writer;
+    size_t bitmapLength = (batchRows + 7) / 8;
+
+    writer = calloc(1, sizeof(arrowWriter));
+    if (!writer) {
+        error("Cannot allocate memory");
+    }
+    writer->fp = fopen(path, "w");
+    if (!writer->fp) {
+        error("Could not create file (%s) : %s", strerror(errno), path);
+    }
+    writer->file = file;
+    writer->batchRows = batchRows;
+    writer->builder = fbInit();
+    writer->columns = calloc(file->fieldsCount, sizeof(arrowColumn));
+    if (!writer->columns) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < file->fieldsCount; i++) {
+        arrowColumn* column = &writer->columns[i];
+
+        column->fieldType = epfGetFieldType(file, i);
+        column->validity = calloc(bitmapLength, sizeof(unsigned char));
+        if (_arrowIsString(column->fieldType)) {
+            column->offsets = calloc(batchRows + 1, sizeof(int32_t));
+            column->dataAllocated = 4096;
+            column->data = malloc(column->dataAllocated);
+            column->values = (unsigned char*)column->data;
+        } else if (column->fieldType == EPF_FIELDTYPE_BOOLEAN) {
+            column->values = calloc(bitmapLength, sizeof(unsigned char));
+        } else {
+            column->values = calloc(batchRows, sizeof(int64_t));
+        }
+        if (!column->validity || !column->values) {
+            error("Cannot allocate memory");
+        }
+    }
+    _arrowWrite(writer, ARROW_MAGIC, strlen(ARROW_MAGIC));
+    _arrowWriteMessage(writer, ARROW_HEADER_SCHEMA, _arrowAddSchema(writer->builder, file), 0, NULL);
+    return(writer);
+}
+
+/**
+ * Appends an entry.
+ *
+ * \param writer Arrow writer.
+ * \param values Typed values (fieldsCount values).
+ */
+void arrowAppend(arrowWriter* writer, EPFValue* values) {
+    size_t row;
+    uint64_t bits;
+    size_t batchBytes = 0;
+
+    for (size_t i = 0; i < writer->file->fieldsCount; i++) {
+        arrowColumn* column = &writer->columns[i];
+
+        if (!_arrowIsString(column->fieldType)) {
+            continue;
+        }
+        batchBytes += column->dataLength + (values[i].isNull ? 0 : values[i].length);
+        if (!values[i].isNull && (column->dataLength + values[i].length > INT32_MAX)) {
+            _arrowFlush(writer);
+            batchBytes = 0;
+            break;
+        }
+    }
+    if (writer->batchBytes && writer->rows && (batchBytes > writer->batchBytes)) {
+        _arrowFlush(writer);
+    }
+    row = writer->rows;
+    for (size_t i = 0; i < writer->file->fieldsCount; i++) {
+        arrowColumn* column = &writer->columns[i];
+        EPFValue* value = &values[i];
+
+        if (value->isNull) {
+            column->nullCount++;
+        } else {
+            column->validity[row / 8] |= 1 << (row % 8);
+        }
+        switch (column->fieldType) {
+            case EPF_FIELDTYPE_VARCHAR :
+            case EPF_FIELDTYPE_LONGTEXT :
+                if (!value->isNull) {
+                    if (column->dataLength + value->length > column->dataAllocated) {
+                        while (column->dataLength + value->length > column->dataAllocated) {
+                            column->dataAllocated *= 2;
+                        }
+                        column->data = realloc(column->data, column->dataAllocated);
+                        if (!column->data) {
+                            error("Cannot allocate memory");
+                        }
+                        column->values = (unsigned char*)column->data;
+                    }
+                    memcpy(column->data + column->dataLength, value->string, value->length);
+                    column->dataLength += value->length;
+                }
+                column->offsets[row + 1] = htole32(column->dataLength);
+                break;
+            case EPF_FIELDTYPE_BOOLEAN :
+                if (!value->isNull && value->integer) {
+                    column->values[row / 8] |= 1 << (row % 8);
+                }
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                memcpy(&bits, &value->decimal, sizeof(uint64_t));
+                bits = htole64(value->isNull ? 0 : bits);
+                memcpy(column->values + row * sizeof(uint64_t), &bits, sizeof(uint64_t));
+                break;
+            default :
+                bits = htole64(value->isNull ? 0 : (uint64_t)value->integer);
+                memcpy(column->values + row * sizeof(uint64_t), &bits, sizeof(uint64_t));
+                break;
+        }
+    }
+    if (++writer->rows == writer->batchRows) {
+        _arrowFlush(writer);
+    }
+}
+
+/**
+ * Writes last record batch and file footer, then closes file.
+ *
+ * \param writer Arrow writer (destroyed).
+ */
+void arrowClose(arrowWriter* writer) {
+    unsigned char* footer;
+    unsigned char* blocks;
+    uint32_t endOfStream[2];
+    uint32_t schema;
+    uint32_t dictionaries;
+    uint32_t batches;
+    uint32_t footerLength;
+
+    _arrowFlush(writer);
+    endOfStream[0] = htole32(ARROW_CONTINUATION);
+    endOfStream[1] = 0;
+    _arrowWrite(writer, endOfStream, sizeof(endOfStream));
+
+    blocks = calloc(writer->batchesCount + 1, 24);
+    if (!blocks) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < writer->batchesCount; i++) {
+        int64_t offset = htole64(writer->batches[i].offset);
+        int32_t metaDataLength = htole32(writer->batches[i].metaDataLength);
+        int64_t bodyLength = htole64(writer->batches[i].bodyLength);
+
+        memcpy(blocks + i * 24, &offset, sizeof(int64_t));
+        memcpy(blocks + i * 24 + 8, &metaDataLength, sizeof(int32_t));
+        memcpy(blocks + i * 24 + 16, &bodyLength, sizeof(int64_t));
+    }
+    schema = _arrowAddSchema(writer->builder, writer->file);
+    dictionaries = fbCreateStructVector(writer->builder, NULL, 24, 0, sizeof(int64_t));
+    batches = fbCreateStructVector(writer->builder, blocks, 24, writer->batchesCount, sizeof(int64_t));
+    free(blocks);
+    fbStartTable(writer->builder);
+    fbAddOffset(writer->builder, 1, schema);
+    fbAddOffset(writer->builder, 2, dictionaries);
+    fbAddOffset(writer->builder, 3, batches);
+    fbAddInt16(writer->builder, 0, ARROW_METADATA_V5);
+    footer = fbFinish(writer->builder, fbEndTable(writer->builder));
+    footerLength = htole32(writer->builder->length);
+    if (
+        (fwrite(footer, 1, writer->builder->length, writer->fp) != writer->builder->length) ||
+        (fwrite(&footerLength, 1, sizeof(uint32_t), writer->fp) != sizeof(uint32_t)) ||
+        (fwrite(ARROW_MAGIC, 1, strlen(ARROW_MAGIC), writer->fp) != strlen(ARROW_MAGIC))
+    ) {
+        error("Cannot write Arrow file : %s", strerror(errno));
+    }
+    fclose(writer->fp);
+
+    for (size_t i = 0; i < writer->file->fieldsCount; i++) {
+        arrowColumn* column = &writer->columns[i];
+
+        free(column->validity);
+        if (_arrowIsString(column->fieldType)) {
+            free(column->offsets);
+            free(column->data);
+        } else {
+            free(column->values);
+        }
+    }
+    free(writer->columns);
+    free(writer->batches);
+    fbDestroy(writer->builder);
+    free(writer);
+}
+
+/**
+ * Creates a sink writing entries to an Arrow file, closing it when done.
+ *
+ * \param writer Arrow writer.
+ *
+ * \return Sink.
+ */
+rowSink* arrowSink(arrowWriter* writer) {
+    return(sinkCreate(writer, _arrowSinkWrite, _arrowSinkClose));
+}
@@ -25,219 +25,227 @@
 #define _GNU_SOURCE
 
 #include "EPF2Bson.h"
-#include "error.h"
 #include "bson.h"
 
 
+/**
+ * Makes room in document buffer.
+ *
+ * \param document Document.
+ * \param length   Bytes to append.
+ *
+ * \return false if memory could not be allocated (document is flagged).
+ */
+bool _reserveBuffer(bsonDocument* document, size_t length) {
+    size_t allocated = document->_allocated;
+    char* buffer;
+
+    if (document->outOfMemory) {
+        return(false);
+    }
+    if (document->length + length <= allocated) {
+        return(true);
+    }
+    while (document->length + length > allocated) {
+        allocated = allocated ? allocated * 2 : 256;
+    }
+    buffer = realloc(document->buffer, allocated);
+    if (!buffer) {
+        document->outOfMemory = true;
+        return(false);
+    }
+    document->buffer = buffer;
+    document->_allocated = allocated;
+    return(true);
+}
+
+/**
+ * Appends bytes to document buffer.
+ *
+ * \param document Document.
+ * \param data     Data.
+ * \param length   Data length.
+ */
+void _appendBuffer(bsonDocument* document, const void* data, size_t length) {
+    if (!_reserveBuffer(document, length)) {
+        return;
+    }
+    memcpy(document->buffer + document->length, data, length);
+    document->length += length;
+}
 
 /**
- * Increment field count and realloc if needed.
+ * Increment field count and grow fields arrays if needed.
  *
  * \param document Document to increment.
+ *
+ * \return false if memory could not be allocated (document is flagged).
  */
-void _incrementCount(bsonDocument* document) {
-    document->fieldCount++;
-    if (document->fieldCount >= document->_lastAllocationsSize) {
-        document->_lastAllocationsSize += 100;
-        if (!document->fieldNames) {
-            document->fieldNames = malloc(document->_lastAllocationsSize * sizeof(void*));
-        } else {
-            document->fieldNames = realloc(document->fieldNames, (document->_lastAllocationsSize * sizeof(void*)));
-        }
-        if (!document->fieldNames) {
-            error("Cannot allocate memory for new BSON field");
-        }
-        if (!document->fieldTypes) {
-            document->fieldTypes = malloc(document->_lastAllocationsSize * sizeof(bsonByte));
-        } else {
-            document->fieldTypes = realloc(document->fieldTypes, (document->_lastAllocationsSize * sizeof(bsonByte)));
-        }
-        if (!document->fieldTypes) {
-            error("Cannot allocate memory for new BSON field");
-        }
-        if (!document->fields) {
-            document->fields = malloc(document->_lastAllocationsSize * sizeof(void*));
-        } else {
-            document->fields = realloc(document->fields, (document->_lastAllocationsSize * sizeof(void*)));
+bool _incrementCount(bsonDocument* document) {
+    if (document->fieldCount + 1 >= document->_lastAllocationsSize) {
+        size_t allocations = document->_lastAllocationsSize ? document->_lastAllocationsSize * 2 : 32;
+        size_t* fieldNames;
+        bsonByte* fieldTypes;
+
+        fieldNames = realloc(document->fieldNames, (allocations * sizeof(size_t)));
+        if (!fieldNames) {
+            document->outOfMemory = true;
+            return(false);
         }
-        if (!document->fields) {
-            error("Cannot allocate memory for new BSON field");
+        document->fieldNames = fieldNames;
+        fieldTypes = realloc(document->fieldTypes, (allocations * sizeof(bsonByte)));
+        if (!fieldTypes) {
+            document->outOfMemory = true;
+            return(false);
         }
+        document->fieldTypes = fieldTypes;
+        document->_lastAllocationsSize = allocations;
     }
+    document->fieldCount++;
+    return(true);
 }
 
 /**
- * Appends a new value in field names.
+ * Starts a new field : checks its name and appends its type and name.
  *
- * \param document Document to increment.
- * \param name     New name to append.
+ * \param document Document to insert into.
+ * \param name     Field name.
+ * \param type     Field type (BSON_TYPE_*).
+ *
+ * \return true on success, false on error.
  */
-void _appendFieldName(bsonDocument* document, char* name) {
-    char* copy;
+bool _appendField(bsonDocument* document, char* name, bsonByte type) {
+    if (!*name) {
+        return(false);
+    }
+    if (fieldNameExists(document, name) || !_incrementCount(document)) {
+        return(false);
+    }
+    document->fieldTypes[document->fieldCount - 1] = type;
+    _appendBuffer(document, &type, 1);
+    document->fieldNames[document->fieldCount - 1] = document->length;
+    _appendBuffer(document, name, strlen(name) + 1);
+    return(!document->outOfMemory);
+}
 
-    copy = calloc(strlen(name) + 1, strlen(name));
-    copy = strncpy(copy, name, strlen(name));
-    document->fieldNames[document->fieldCount - 1] = copy;
+/**
+ * Appends a little endian 64 bits value to document buffer.
+ *
+ * \param document Document.
+ * \param value    Value.
+ */
+void _appendInt64(bsonDocument* document, bsonInt64 value) {
+    value = htole64(value);
+    _appendBuffer(document, &value, sizeof(bsonInt64));
 }
 
 /**
- * Serialize a value to BSON.
+ * Reads a little endian int32.
  *
- * \param document Document to increment.
- * \param index    Value index.
+ * \param data Data.
  *
- * \return Serialized value.
+ * \return Value.
  */
-bsonSerializedValue _serializedValue(bsonDocument* document, uint index) {
-    bsonSerializedValue value;
-    bsonSerializedValue subValue;
-    bsonInt32 i32;
-    bsonInt64 i64;
-    char byteValue;
-    bool boolValue;
-
-    switch(document->fieldTypes[index]) {
-        case BSON_TYPE_DOUBLE :
-        case BSON_TYPE_INT64 :
-            value.length = sizeof(bsonInt64);
-            value.binaryValue = calloc(1, value.length);
-            if (!value.binaryValue) {
-                error("Could not allocate memory");
-            }
-            memcpy(value.binaryValue, document->fields[index], value.length);
+bsonInt32 _bsonReadInt32(const char* data) {
+    bsonInt32 value;
+
+    memcpy(&value, data, sizeof(bsonInt32));
+    return(le32toh(value));
+}
+
+/**
+ * Length of a BSON value.
+ *
+ * \param type   Value type.
+ * \param value  Value.
+ * \param length Bytes left in document.
+ *
+ * \return Value length, (size_t)-1 if unknown or truncated.
+ */
+size_t _bsonValueLength(char type, const char* value, size_t length) {
+    size_t valueLength;
+
+    switch (type) {
+        case BSON_TYPE_NULL :
+        case '\x06' :
+        case '\x7F' :
+        case '\xFF' :
+            return(0);
+        case BSON_TYPE_BOOL :
+            valueLength = 1;
             break;
-        case BSON_TYPE_STRING :
-            //(int32) <byte length> <string> \x00
-            i32 = strlen(document->fields[index]) + 1;
-            value.length = 4 + i32;
-            value.binaryValue = calloc(value.length, sizeof(char));
-            if (!value.binaryValue) {
-                error("Could not allocate memory");
-            }
-            i32 = htole32(i32);
-            memcpy(
-                value.binaryValue,
-                &i32,
-                sizeof(bsonInt32)
-            );
-            memcpy(
-                value.binaryValue + sizeof(bsonInt32),
-                document->fields[index],
-                strlen(document->fields[index])
-            );
+        case BSON_TYPE_INT32 :
+            valueLength = 4;
             break;
-        case BSON_TYPE_DOCUMENT :
-        case BSON_TYPE_ARRAY :
-            subValue = bsonSerialize((bsonDocument*)document->fields[index]);
-            value.length = subValue.length;
-            value.binaryValue = calloc(value.length, sizeof(char));
-            if (!value.binaryValue) {
-                error("Could not allocate memory");
-            }
-            memcpy(
-                value.binaryValue,
-                subValue.binaryValue,
-                value.length
-            );
-            free(subValue.binaryValue);
+        case BSON_TYPE_DOUBLE :
+        case BSON_TYPE_INT64 :
+        case BSON_TYPE_UTCDATE :
+        case '\x11' :
+            valueLength = 8;
             break;
         case BSON_TYPE_OBJECTID :
-            value.length = 12;
-            value.binaryValue = malloc(12);
-            if (!value.binaryValue) {
-                error("Could not allocate memory");
-            }
-            memcpy(
-                value.binaryValue,
-                document->fields[index],
-                value.length
-            );
+            valueLength = 12;
             break;
-        case BSON_TYPE_BOOL :
-            value.length = sizeof(char);
-            value.binaryValue = malloc(value.length);
-            if (!value.binaryValue) {
-                error("Could not allocate memory");
-            }
-            memcpy(
-                &boolValue,
-                document->fields[index],
-                sizeof(bool)
-            );
-            if (boolValue) {
-                byteValue = '\x01';
-            } else {
-                byteValue = '\x00';
-            }
-            memcpy(
-                value.binaryValue,
-                &byteValue,
-                value.length
-            );
+        case '\x13' :
+            valueLength = 16;
             break;
-        case BSON_TYPE_UTCDATE:
-            value.length = sizeof(bsonInt64);
-            value.binaryValue = malloc(value.length);
-            if (!value.binaryValue) {
-                error("Could not allocate memory");
+        case BSON_TYPE_STRING :
+        case BSON_TYPE_DOCUMENT :
+        case BSON_TYPE_ARRAY :
+        case '\x05' :
+            if (length < 4) {
+                return((size_t)-1);
             }
-            i64 = htole64((bsonInt64)document->fields[index]);
-            memcpy(
-                value.binaryValue,
-                &i64,
-                value.length
-            );
-            break;
-        case BSON_TYPE_NULL:
-            value.length = 0;
-            value.binaryValue = NULL;
-            break;
-        case BSON_TYPE_INT32 :
-            value.length = sizeof(bsonInt32);
-            value.binaryValue = calloc(1, value.length);
-            if (!value.binaryValue) {
-                error("Could not allocate memory");
+            valueLength = _bsonReadInt32(value);
+            if (type == BSON_TYPE_STRING) {
+                valueLength += 4;
+            } else if (type == '\x05') {
+                valueLength += 5;
             }
-            memcpy(value.binaryValue, document->fields[index], value.length);
             break;
         default :
-            error("Unknown BSON field type (%d) while serializing", document->fieldTypes[index]);
+            return((size_t)-1);
     }
-    return(value);
+    return((valueLength > length) ? (size_t)-1 : valueLength);
 }
 
+
 /**
  * Creates a new BSON document.
  *
- * \return Document.
+ * \return Document, NULL if memory could not be allocated.
  */
 bsonDocument* createBsonDocument() {
     bsonDocument* document;
 
     document = calloc(1, sizeof(bsonDocument));
     if (!document) {
-        error("Cannot allocate memory for new BSON document");
+        return(NULL);
     }
-    document->fieldCount = 0;
-    document->_lastAllocationsSize = 0;
+    resetBsonDocument(document);
     return(document);
 }
 
+/**
+ * Empties a document to fill it again (keeps its memory).
+ *
+ * \param document Document to reset.
+ */
+void resetBsonDocument(bsonDocument* document) {
+    document->fieldCount = 0;
+    document->length = sizeof(bsonInt32);
+    document->outOfMemory = false;
+}
+
 /**
  * Destroys a bson document instance.
  *
  * \param document Document to destroy.
  */
 void destroyBsonDocument(bsonDocument* document) {
-    if (document->fieldCount) {
-        for(int i = 0; i < document->fieldCount; i++) {
-            free(document->fieldNames[i]);
-            free(document->fields[i]);
-        }
-        free(document->fieldNames);
-        free(document->fields);
-        free(document->fieldTypes);
-    }
+    free(document->fieldNames);
+    free(document->fieldTypes);
+    free(document->buffer);
     free(document);
 }
 
@@ -250,84 +258,35 @@ void destroyBsonDocument(bsonDocument* document) {
  * \return True if exists, false elsewhere.
  */
 bool fieldNameExists(bsonDocument* document, char* name) {
-    if (document->fieldNames && document->fieldCount) {
-        for(int i = 0; i < document->fieldCount; i++) {
-            if (!strcmp(document->fieldNames[i], name)) {
-                return(true);
-            }
+    for(size_t i = 0; i < document->fieldCount; i++) {
+        if (!strcmp(document->buffer + document->fieldNames[i], name)) {
+            return(true);
         }
     }
     return(false);
 }
-//CDCCCCCCCCCC1440
+
 /**
  * Serialize document as BSON.
  *
  * \param document Document to insert into.
  *
- * \return BSON serialized. (`binaryValue` must be free()'d after use).
+ * \return BSON serialized. (`binaryValue` belongs to document and is valid
+ *         until it is modified, reset or destroyed, NULL if memory ran out
+ *         while building document).
  */
 bsonSerializedValue bsonSerialize(bsonDocument* document) {
-    char* bson = malloc(1024);
-    size_t allocatedSize = 1024;
-    size_t documentSize = 5;
-    size_t bufferPosition = 4;
-    bsonSerializedValue serializedDocument;
-    bsonSerializedValue value;
-    bsonByte fieldType;
-    bool reallocNeeded = false;
-
-    if (!bson) {
-        error("Could not allocate memory");
-    }
-    if (document->fieldCount) {
-        for(uint i = 0; i < document->fieldCount; i++) {
-            value = _serializedValue(document, i);
-            fieldType = document->fieldTypes[i];
-            documentSize += (1 + strlen(document->fieldNames[i]) + 1 + value.length);
-            while (documentSize >= allocatedSize) {
-                allocatedSize += 1048576;
-                reallocNeeded = true;
-            }
-            if (reallocNeeded) {
-                bson = realloc(bson, allocatedSize);
-                if (!bson) {
-                    error("Could not allocate memory");
-                }
-                reallocNeeded = false;
-            }
-            memcpy(
-                bson + bufferPosition,
-                &fieldType,
-                1
-            );
-            bufferPosition++;
-            memcpy(
-                bson + bufferPosition,
-                document->fieldNames[i],
-                strlen(document->fieldNames[i]) + 1
-            );
-            bufferPosition += (strlen(document->fieldNames[i]) + 1);
-            if (value.length > 0) {
-                memcpy(
-                    bson + bufferPosition,
-                    value.binaryValue,
-                    value.length
-                );
-                bufferPosition += value.length;
-                free(value.binaryValue);
-            }
-        }
-    }
-    documentSize = htole32(documentSize);
-    bson[bufferPosition++] = 0;
-    memcpy(
-        bson,
-        &bufferPosition,
-        sizeof(bsonInt32)
-    );
-    serializedDocument.binaryValue = bson;
-    serializedDocument.length = bufferPosition;
+    bsonSerializedValue serializedDocument = {NULL, 0};
+    bsonInt32 documentSize;
+
+    if (!_reserveBuffer(document, 1)) {
+        return(serializedDocument);
+    }
+    document->buffer[document->length] = 0;
+    documentSize = htole32(document->length + 1);
+    memcpy(document->buffer, &documentSize, sizeof(bsonInt32));
+    serializedDocument.binaryValue = document->buffer;
+    serializedDocument.length = document->length + 1;
     return(serializedDocument);
 }
 
@@ -341,21 +300,14 @@ bsonSerializedValue bsonSerialize(bsonDocument* document) {
  * \return true on success, false on error.
  */
 bool bsonAddDouble(bsonDocument* document, char* name, double value) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
+    bsonInt64 bits;
+
+    if (!_appendField(document, name, BSON_TYPE_DOUBLE)) {
         return(false);
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_DOUBLE;
-    document->fields[document->fieldCount - 1] = malloc(sizeof(double));
-    if (!document->fields[document->fieldCount - 1]) {
-        error("Could not allocate memory");
-    }
-    memcpy(document->fields[document->fieldCount - 1], &value, sizeof(double));
-    return(true);
+    memcpy(&bits, &value, sizeof(double));
+    _appendInt64(document, bits);
+    return(!document->outOfMemory);
 }
 
 /**
@@ -368,21 +320,15 @@ bool bsonAddDouble(bsonDocument* document, char* name, double value) {
  * \return true on success, false on error.
  */
 bool bsonAddString(bsonDocument* document, char* name, char* value) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
+    size_t length = strlen(value) + 1;
+    bsonInt32 i32 = htole32(length);
+
+    if (!_appendField(document, name, BSON_TYPE_STRING)) {
         return(false);
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_STRING;
-    document->fields[document->fieldCount - 1] = calloc(strlen(value) + 1, sizeof(char));
-    if (!document->fields[document->fieldCount - 1]) {
-        error("Could not allocate memory");
-    }
-    document->fields[document->fieldCount - 1] = strncpy(document->fields[document->fieldCount - 1], value, strlen(value));
-    return(true);
+    _appendBuffer(document, &i32, sizeof(bsonInt32));
+    _appendBuffer(document, value, length);
+    return(!document->outOfMemory);
 }
 
 /**
@@ -390,22 +336,19 @@ bool bsonAddString(bsonDocument* document, char* name, char* value) {
  *
  * \param document Document to insert into.
  * \param name     Value name in document.
- * \param value    Document.
+ * \param value    Document (copied, still owned by caller).
  *
  * \return true on success, false on error.
  */
 bool bsonAddSubDocument(bsonDocument* document, char* name, bsonDocument* value) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
+    bsonSerializedValue serialized;
+
+    serialized = bsonSerialize(value);
+    if (!serialized.binaryValue || !_appendField(document, name, BSON_TYPE_DOCUMENT)) {
         return(false);
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_DOCUMENT;
-    document->fields[document->fieldCount - 1] = value;
-    return(true);
+    _appendBuffer(document, serialized.binaryValue, serialized.length);
+    return(!document->outOfMemory);
 }
 
 /**
@@ -413,22 +356,20 @@ bool bsonAddSubDocument(bsonDocument* document, char* name, bsonDocument* value)
  *
  * \param document Document to insert into.
  * \param name     Value name in document.
- * \param value    Document (must be a Document with string numerical index).
+ * \param value    Document (must be a Document with string numerical index,
+ *                 copied, still owned by caller).
  *
  * \return true on success, false on error.
  */
 bool bsonAddArray(bsonDocument* document, char* name, bsonDocument* value) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
+    bsonSerializedValue serialized;
+
+    serialized = bsonSerialize(value);
+    if (!serialized.binaryValue || !_appendField(document, name, BSON_TYPE_ARRAY)) {
         return(false);
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_ARRAY;
-    document->fields[document->fieldCount - 1] = value;
-    return(true);
+    _appendBuffer(document, serialized.binaryValue, serialized.length);
+    return(!document->outOfMemory);
 }
 
 /**
@@ -441,21 +382,11 @@ bool bsonAddArray(bsonDocument* document, char* name, bsonDocument* value) {
  * \return true on success, false on error.
  */
 bool bsonAddDocumentId(bsonDocument* document, char* name, void* value) {
-    if (!strlen(name)) {
+    if (!_appendField(document, name, BSON_TYPE_OBJECTID)) {
         return(false);
     }
-    if (fieldNameExists(document, name)) {
-        return(false);
-    }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_OBJECTID;
-    document->fields[document->fieldCount - 1] = malloc(12);
-    if (!document->fields[document->fieldCount - 1]) {
-        error("Could not allocate memory");
-    }
-    memcpy(document->fields[document->fieldCount - 1], value, 12);
-    return(true);
+    _appendBuffer(document, value, 12);
+    return(!document->outOfMemory);
 }
 
 /**
@@ -468,21 +399,13 @@ bool bsonAddDocumentId(bsonDocument* document, char* name, void* value) {
  * \return true on success, false on error.
  */
 bool bsonAddBool(bsonDocument* document, char* name, bool value) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
+    char byteValue = value ? '\x01' : '\x00';
+
+    if (!_appendField(document, name, BSON_TYPE_BOOL)) {
         return(false);
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_BOOL;
-    document->fields[document->fieldCount - 1] = malloc(sizeof(bool));
-    if (!document->fields[document->fieldCount - 1]) {
-        error("Could not allocate memory");
-    }
-    memcpy(document->fields[document->fieldCount - 1], &value, sizeof(bool));
-    return(true);
+    _appendBuffer(document, &byteValue, 1);
+    return(!document->outOfMemory);
 }
 
 /**
@@ -495,21 +418,11 @@ bool bsonAddBool(bsonDocument* document, char* name, bool value) {
  * \return true on success, false on error.
  */
 bool bsonAddDate(bsonDocument* document, char* name, bsonInt64 value) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
+    if (!_appendField(document, name, BSON_TYPE_UTCDATE)) {
         return(false);
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_UTCDATE;
-    document->fields[document->fieldCount - 1] = malloc(sizeof(bsonInt64));
-    if (!document->fields[document->fieldCount - 1]) {
-        error("Could not allocate memory");
-    }
-    memcpy(document->fields[document->fieldCount - 1], &value, sizeof(bsonInt64));
-    return(true);
+    _appendInt64(document, value);
+    return(!document->outOfMemory);
 }
 
 /**
@@ -521,17 +434,7 @@ bool bsonAddDate(bsonDocument* document, char* name, bsonInt64 value) {
  * \return true on success, false on error.
  */
 bool bsonAddNull(bsonDocument* document, char* name) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
-        return(false);
-    }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_NULL;
-    document->fields[document->fieldCount - 1] = NULL;
-    return(true);
+    return(_appendField(document, name, BSON_TYPE_NULL));
 }
 
 /**
@@ -544,21 +447,12 @@ bool bsonAddNull(bsonDocument* document, char* name) {
  * \return true on success, false on error.
  */
 bool bsonAddInt32(bsonDocument* document, char* name, bsonInt32 value) {
-    if (!strlen(name)) {
-        return(false);
-    }
-    if (fieldNameExists(document, name)) {
+    if (!_appendField(document, name, BSON_TYPE_INT32)) {
         return(false);
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_INT32;
-    document->fields[document->fieldCount - 1] = malloc(sizeof(bsonInt32));
-    if (!document->fields[document->fieldCount - 1]) {
-        error("Could not allocate memory");
-    }
-    memcpy(document->fields[document->fieldCount - 1], &value, sizeof(bsonInt32));
-    return(true);
+    value = htole32(value);
+    _appendBuffer(document, &value, sizeof(bsonInt32));
+    return(!document->outOfMemory);
 }
 
 /**
@@ -571,19 +465,65 @@ bool bsonAddInt32(bsonDocument* document, char* name, bsonInt32 value) {
  * \return true on success, false on error.
  */
 bool bsonAddInt64(bsonDocument* document, char* name, bsonInt64 value) {
-    if (!strlen(name)) {
+    if (!_appendField(document, name, BSON_TYPE_INT64)) {
         return(false);
     }
-    if (fieldNameExists(document, name)) {
-        return(false);
+    _appendInt64(document, value);
+    return(!document->outOfMemory);
+}
+
+/**
+ * Finds a top level field of a BSON document.
+ *
+ * \param document Document.
+ * \param length   Document length.
+ * \param name     Field name.
+ * \param type     Filled with field type.
+ *
+ * \return Field value, NULL if not found.
+ */
+const char* bsonFindField(const char* document, size_t length, const char* name, char* type) {
+    size_t position = 4;
+    const char* fieldName;
+    const char* value;
+
+    while ((value = bsonNextField(document, length, &position, &fieldName, type))) {
+        if (!strcmp(fieldName, name)) {
+            return(value);
+        }
     }
-    _incrementCount(document);
-    _appendFieldName(document, name);
-    document->fieldTypes[document->fieldCount - 1] = BSON_TYPE_INT64;
-    document->fields[document->fieldCount - 1] = malloc(sizeof(bsonInt64));
-    if (!document->fields[document->fieldCount - 1]) {
-        error("Could not allocate memory");
+    return(NULL);
+}
+
+/**
+ * Iterates over top level fields of a serialized BSON document.
+ *
+ * \param document Document.
+ * \param length   Document length.
+ * \param position Read position, 4 for first field (updated).
+ * \param name     Filled with field name.
+ * \param type     Filled with field type.
+ *
+ * \return Field value, NULL at document end (or if it is malformed).
+ */
+const char* bsonNextField(const char* document, size_t length, size_t* position, const char** name, char* type) {
+    size_t valueLength;
+    const char* value;
+
+    if ((*position >= length) || !document[*position]) {
+        return(NULL);
     }
-    memcpy(document->fields[document->fieldCount - 1], &value, sizeof(bsonInt64));
-    return(true);
+    *type = document[(*position)++];
+    *name = document + *position;
+    *position += strnlen(*name, length - *position) + 1;
+    if (*position > length) {
+        return(NULL);
+    }
+    value = document + *position;
+    valueLength = _bsonValueLength(*type, value, length - *position);
+    if (valueLength == (size_t)-1) {
+        return(NULL);
+    }
+    *position += valueLength;
+    return(value);
 }
@@ -0,0 +1,666 @@
+/**
+ * Columnar binary cache of parsed EPF files.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "epf.h"
+#include "cache.h"
+
+#include <sys/mman.h>
+#include <fcntl.h>
+
+/**
+ * Rounds a size up to 8 bytes.
+ */
+#define CACHE_ALIGN(size)           (((size) + 7) & ~((size_t)7))
+
+/**
+ * Fixed value width of a field type.
+ *
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ *
+ * \return Width in bytes, 0 for columns of raw values only.
+ */
+size_t _cacheValueWidth(unsigned char fieldType) {
+    switch (fieldType) {
+        case EPF_FIELDTYPE_BIGINT :
+        case EPF_FIELDTYPE_INTEGER :
+            return(sizeof(int64_t));
+        case EPF_FIELDTYPE_DECIMAL :
+            return(sizeof(double));
+        case EPF_FIELDTYPE_BOOLEAN :
+            return(sizeof(uint8_t));
+        default :
+            return(0);
+    }
+}
+
+/**
+ * Writes to cache file.
+ *
+ * \param writer Cache writer.
+ * \param data   Data.
+ * \param length Data length.
+ */
+void _cacheWrite(cacheWriter* writer, const void* data, size_t length) {
+    if (length && (fwrite(data, 1, length, writer->fp) != length)) {
+        error("Could not write cache file (%s) : %s", strerror(errno), writer->temporaryPath);
+    }
+}
+
+/**
+ * Pads cache file to 8 bytes.
+ *
+ * \param writer Cache writer.
+ */
+void _cachePad(cacheWriter* writer) {
+    const char padding[8] = {0};
+    long position = ftell(writer->fp);
+
+    _cacheWrite(writer, padding, CACHE_ALIGN(position) - position);
+}
+
+/**
+ * Writes current row group and resets columns.
+ *
+ * \param writer Cache writer.
+ */
+void _cacheFlushGroup(cacheWriter* writer) {
+    uint64_t groupHeader[2];
+    size_t rows = writer->groupRows;
+
+    if (!rows) {
+        return;
+    }
+    groupHeader[0] = rows;
+    groupHeader[1] = sizeof(groupHeader) + rows * sizeof(uint64_t);
+    for (size_t i = 0; i < writer->columnsCount; i++) {
+        cacheColumn* column = &writer->columns[i];
+        size_t width = _cacheValueWidth(column->fieldType);
+
+        groupHeader[1] += CACHE_ALIGN((rows + 7) / 8) + CACHE_ALIGN(rows * width);
+        groupHeader[1] += (rows + 1) * sizeof(uint64_t) + CACHE_ALIGN(column->blobLength);
+    }
+    _cacheWrite(writer, groupHeader, sizeof(groupHeader));
+    _cacheWrite(writer, writer->entryOffsets, rows * sizeof(uint64_t));
+    for (size_t i = 0; i < writer->columnsCount; i++) {
+        cacheColumn* column = &writer->columns[i];
+        size_t width = _cacheValueWidth(column->fieldType);
+
+        _cacheWrite(writer, column->nulls, (rows + 7) / 8);
+        _cachePad(writer);
+        if (width) {
+            _cacheWrite(writer, column->values, rows * width);
+            _cachePad(writer);
+        }
+        _cacheWrite(writer, column->offsets, (rows + 1) * sizeof(uint64_t));
+        _cacheWrite(writer, column->blob, column->blobLength);
+        _cachePad(writer);
+        memset(column->nulls, 0, (CACHE_GROUP_ROWS + 7) / 8);
+        column->blobLength = 0;
+    }
+    writer->groupRows = 0;
+}
+
+/**
+ * Reads from cache mapping.
+ *
+ * \param reader   Cache reader.
+ * \param position Read position (updated).
+ * \param data     Destination.
+ * \param length   Length to read.
+ *
+ * \return False if past mapping end.
+ */
+bool _cacheRead(cacheReader* reader, size_t* position, void* data, size_t length) {
+    if ((*position + length) > reader->mappingLength) {
+        return(false);
+    }
+    memcpy(data, reader->mapping + *position, length);
+    *position += length;
+    return(true);
+}
+
+/**
+ * Parses cache header and rebuilds the EPF file description.
+ *
+ * \param reader Cache reader.
+ * \param source EPF source file stat.
+ *
+ * \return False if cache is stale or invalid.
+ */
+bool _cacheReadHeader(cacheReader* reader, struct stat* source) {
+    size_t position = 0;
+    char magic[8];
+    uint32_t version;
+    uint32_t fieldsCount;
+    uint64_t sourceSize;
+    int64_t sourceMtime[2];
+    uint32_t keyInfos[2];
+    EPFFile* file;
+
+    if (
+        !_cacheRead(reader, &position, magic, sizeof(magic)) ||
+        memcmp(magic, CACHE_MAGIC, sizeof(magic)) ||
+        !_cacheRead(reader, &position, &version, sizeof(version)) ||
+        (version != CACHE_VERSION) ||
+        !_cacheRead(reader, &position, &fieldsCount, sizeof(fieldsCount)) ||
+        !fieldsCount ||
+        !_cacheRead(reader, &position, &sourceSize, sizeof(sourceSize)) ||
+        !_cacheRead(reader, &position, sourceMtime, sizeof(sourceMtime)) ||
+        !_cacheRead(reader, &position, keyInfos, sizeof(keyInfos)) ||
+        (keyInfos[1] > fieldsCount)
+    ) {
+        return(false);
+    }
+    if (
+        (sourceSize != (uint64_t)source->st_size) ||
+        (sourceMtime[0] != source->st_mtim.tv_sec) ||
+        (sourceMtime[1] != source->st_mtim.tv_nsec)
+    ) {
+        return(false);
+    }
+    file = calloc(1, sizeof(EPFFile));
+    if (!file) {
+        error("Could not allocate memory");
+    }
+    file->fields = calloc(fieldsCount, sizeof(EPFField*));
+    file->primaryKey = calloc(fieldsCount, sizeof(size_t));
+    if (!file->fields || !file->primaryKey) {
+        error("Could not allocate memory");
+    }
+    reader->file = file;
+    file->fieldsCount = fieldsCount;
+    file->incremental = keyInfos[0];
+    file->primaryKeyCount = keyInfos[1];
+    for (size_t i = 0; i < file->primaryKeyCount; i++) {
+        uint32_t index;
+
+        if (!_cacheRead(reader, &position, &index, sizeof(index)) || (index >= fieldsCount)) {
+            return(false);
+        }
+        file->primaryKey[i] = index;
+    }
+    for (size_t i = 0; i < fieldsCount; i++) {
+        uint32_t fieldInfos[3];
+        EPFField* field;
+
+        field = calloc(1, sizeof(EPFField));
+        if (!field) {
+            error("Could not allocate memory");
+        }
+        file->fields[i] = field;
+        if (!_cacheRead(reader, &position, fieldInfos, sizeof(fieldInfos))) {
+            return(false);
+        }
+        field->fieldType = fieldInfos[0] & 0xFF;
+        field->indexed = (fieldInfos[0] >> 8) & 1;
+        field->capacity = fieldInfos[1];
+        field->fieldName = calloc(fieldInfos[2] + 1, sizeof(char));
+        if (!field->fieldName) {
+            error("Could not allocate memory");
+        }
+        if (!_cacheRead(reader, &position, field->fieldName, fieldInfos[2])) {
+            return(false);
+        }
+    }
+    file->ready = true;
+    reader->nextGroup = CACHE_ALIGN(position);
+    return(true);
+}
+
+/**
+ * Maps next row group columns.
+ *
+ * \param reader Cache reader.
+ *
+ * \return False at end of cache.
+ */
+bool _cacheLoadGroup(cacheReader* reader) {
+    uint64_t groupHeader[2];
+    size_t position = reader->nextGroup;
+    size_t dataEnd = reader->groupsEnd;
+
+    if (position >= dataEnd) {
+        return(false);
+    }
+    if (
+        !_cacheRead(reader, &position, groupHeader, sizeof(groupHeader)) ||
+        (reader->nextGroup + groupHeader[1] > dataEnd) ||
+        (position + groupHeader[0] * sizeof(uint64_t) > dataEnd)
+    ) {
+        error("Corrupted cache file");
+    }
+    reader->groupRows = groupHeader[0];
+    reader->groupRow = 0;
+    reader->entryOffsets = (uint64_t*)(reader->mapping + position);
+    position += reader->groupRows * sizeof(uint64_t);
+    for (size_t i = 0; i < reader->file->fieldsCount; i++) {
+        cacheColumn* column = &reader->columns[i];
+        size_t rows = reader->groupRows;
+        size_t width = _cacheValueWidth(column->fieldType);
+
+        column->nulls = reader->mapping + position;
+        position += CACHE_ALIGN((rows + 7) / 8);
+        column->values = reader->mapping + position;
+        position += CACHE_ALIGN(rows * width);
+        column->offsets = (uint64_t*)(reader->mapping + position);
+        position += (rows + 1) * sizeof(uint64_t);
+        if (position > dataEnd) {
+            error("Corrupted cache file");
+        }
+        column->blob = (char*)(reader->mapping + position);
+        position += CACHE_ALIGN(column->offsets[rows]);
+        if (position > dataEnd) {
+            error("Corrupted cache file");
+        }
+    }
+    reader->nextGroup += groupHeader[1];
+    return(true);
+}
+
+/**
+ * Replays malformed records found before an EPF file offset.
+ *
+ * \param reader Cache reader.
+ * \param offset EPF file offset, UINT64_MAX for all remaining records.
+ *
+ * \return False if the reject handler asked to stop reading.
+ */
+bool _cacheReplayRejects(cacheReader* reader, uint64_t offset) {
+    size_t rejectsEnd = reader->mappingLength - CACHE_TRAILER_SIZE;
+
+    if (!reader->file->reject) {
+        return(true);
+    }
+    while (reader->nextReject < rejectsEnd) {
+        size_t position = reader->nextReject;
+        uint64_t rejectOffset;
+        uint32_t lengths[2];
+        const char* reason;
+
+        if (
+            !_cacheRead(reader, &position, &rejectOffset, sizeof(rejectOffset)) ||
+            !_cacheRead(reader, &position, lengths, sizeof(lengths)) ||
+            !lengths[0] ||
+            (position + lengths[0] + lengths[1] > rejectsEnd)
+        ) {
+            error("Corrupted cache file");
+        }
+        if (rejectOffset >= offset) {
+            break;
+        }
+        reader->nextReject = CACHE_ALIGN(position + lengths[0] + lengths[1]);
+        reason = (const char*)(reader->mapping + position);
+        if (!reader->file->reject(reader->file->rejectContext, rejectOffset, reason, reason + lengths[0], lengths[1])) {
+            reader->rejectsExceeded = true;
+            return(false);
+        }
+    }
+    return(true);
+}
+
+
+/**
+ * Opens a cache file, if it exists and matches the EPF source file.
+ *
+ * \param path   Cache file path.
+ * \param source EPF source file stat.
+ *
+ * \return Cache reader, NULL if there is no usable cache.
+ */
+cacheReader* cacheOpen(char* path, struct stat* source) {
+    cacheReader* reader;
+    struct stat statBuffer;
+    uint64_t rejectsOffset;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return(NULL);
+    }
+    if (fstat(fd, &statBuffer) || (statBuffer.st_size < 32)) {
+        close(fd);
+        return(NULL);
+    }
+    reader = calloc(1, sizeof(cacheReader));
+    if (!reader) {
+        error("Could not allocate memory");
+    }
+    reader->mappingLength = statBuffer.st_size;
+    reader->mapping = mmap(NULL, reader->mappingLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (reader->mapping == MAP_FAILED) {
+        free(reader);
+        return(NULL);
+    }
+    madvise(reader->mapping, reader->mappingLength, MADV_SEQUENTIAL);
+    memcpy(&rejectsOffset, reader->mapping + reader->mappingLength - sizeof(uint64_t), sizeof(uint64_t));
+    reader->groupsEnd = (rejectsOffset > reader->mappingLength - CACHE_TRAILER_SIZE) ? 0 : rejectsOffset;
+    reader->nextReject = reader->groupsEnd;
+    if (
+        memcmp(reader->mapping + reader->mappingLength - CACHE_TRAILER_SIZE, CACHE_TRAILER_MAGIC, 8) ||
+        !_cacheReadHeader(reader, source) ||
+        (reader->nextGroup > reader->groupsEnd)
+    ) {
+        if (epf2bsonOptions->verbose) {
+            message("Cache file is stale or invalid : %s", path);
+        }
+        cacheClose(reader);
+        return(NULL);
+    }
+    reader->columns = calloc(reader->file->fieldsCount, sizeof(cacheColumn));
+    reader->entry = calloc(reader->file->fieldsCount + 1, sizeof(char*));
+    if (!reader->columns || !reader->entry) {
+        error("Could not allocate memory");
+    }
+    for (size_t i = 0; i < reader->file->fieldsCount; i++) {
+        reader->columns[i].fieldType = reader->file->fields[i]->fieldType;
+    }
+    return(reader);
+}
+
+/**
+ * Gets next cached entry.
+ *
+ * \param reader Cache reader.
+ * \param values Typed values (fieldsCount values).
+ *
+ * \return Raw entry (owned by reader, valid until next call) or NULL at end.
+ */
+char** cacheNext(cacheReader* reader, EPFValue* values) {
+    size_t row;
+
+    if ((reader->groupRow >= reader->groupRows) && !_cacheLoadGroup(reader)) {
+        _cacheReplayRejects(reader, UINT64_MAX);
+        return(NULL);
+    }
+    row = reader->groupRow++;
+    if (!_cacheReplayRejects(reader, reader->entryOffsets[row])) {
+        return(NULL);
+    }
+    reader->file->lastEntryOffset = reader->entryOffsets[row];
+    for (size_t i = 0; i < reader->file->fieldsCount; i++) {
+        cacheColumn* column = &reader->columns[i];
+        EPFValue* value = &values[i];
+
+        reader->entry[i] = column->blob + column->offsets[row];
+        value->isNull = column->nulls[row >> 3] & (1 << (row & 7));
+        value->integer = 0;
+        value->decimal = 0;
+        value->string = reader->entry[i];
+        value->length = column->offsets[row + 1] - column->offsets[row] - 1;
+        if (value->isNull) {
+            continue;
+        }
+        switch (column->fieldType) {
+            case EPF_FIELDTYPE_BIGINT :
+            case EPF_FIELDTYPE_INTEGER :
+                memcpy(&value->integer, column->values + (row * sizeof(int64_t)), sizeof(int64_t));
+                break;
+            case EPF_FIELDTYPE_BOOLEAN :
+                value->integer = column->values[row];
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                memcpy(&value->decimal, column->values + (row * sizeof(double)), sizeof(double));
+                break;
+            case EPF_FIELDTYPE_DATETIME :
+                epfConvertValue(reader->file, column->fieldType, reader->entry[i], value);
+                break;
+        }
+    }
+    return(reader->entry);
+}
+
+/**
+ * Closes a cache reader (and destroys its EPFFile).
+ *
+ * \param reader Cache reader.
+ */
+void cacheClose(cacheReader* reader) {
+    if (reader->file) {
+        epfDestroy(reader->file);
+    }
+    munmap(reader->mapping, reader->mappingLength);
+    free(reader->columns);
+    free(reader->entry);
+    free(reader);
+}
+
+/**
+ * Starts writing a cache file.
+ *
+ * \param path   Cache file path.
+ * \param file   EPFFile instance (header parsed).
+ * \param source EPF source file stat.
+ *
+ * \return Cache writer.
+ */
+cacheWriter* cacheCreate(char* path, EPFFile* file, struct stat* source) {
+    cacheWriter* writer;
+    uint32_t version = CACHE_VERSION;
+    uint32_t fieldsCount = file->fieldsCount;
+    uint64_t sourceSize = source->st_size;
+    int64_t sourceMtime[2];
+    uint32_t keyInfos[2];
+
+    writer = calloc(1, sizeof(cacheWriter));
+    if (!writer) {
+        error("Could not allocate memory");
+    }
+    writer->path = strdup(path);
+    writer->temporaryPath = calloc(strlen(path) + 5, sizeof(char));
+    if (!writer->path || !writer->temporaryPath) {
+        error("Could not allocate memory");
+    }
+    strcpy(writer->temporaryPath, path);
+    strcat(writer->temporaryPath, ".tmp");
+    writer->maxGroupBytes = CACHE_GROUP_BYTES;
+    writer->fp = fopen(writer->temporaryPath, "w");
+    if (!writer->fp) {
+        error("Could not create cache file (%s) : %s", strerror(errno), writer->temporaryPath);
+    }
+    sourceMtime[0] = source->st_mtim.tv_sec;
+    sourceMtime[1] = source->st_mtim.tv_nsec;
+    keyInfos[0] = file->incremental;
+    keyInfos[1] = file->primaryKeyCount;
+    _cacheWrite(writer, CACHE_MAGIC, 8);
+    _cacheWrite(writer, &version, sizeof(version));
+    _cacheWrite(writer, &fieldsCount, sizeof(fieldsCount));
+    _cacheWrite(writer, &sourceSize, sizeof(sourceSize));
+    _cacheWrite(writer, sourceMtime, sizeof(sourceMtime));
+    _cacheWrite(writer, keyInfos, sizeof(keyInfos));
+    for (size_t i = 0; i < file->primaryKeyCount; i++) {
+        uint32_t index = file->primaryKey[i];
+
+        _cacheWrite(writer, &index, sizeof(index));
+    }
+    writer->columnsCount = file->fieldsCount;
+    writer->columns = calloc(writer->columnsCount, sizeof(cacheColumn));
+    writer->entryOffsets = malloc(CACHE_GROUP_ROWS * sizeof(uint64_t));
+    if (!writer->columns || !writer->entryOffsets) {
+        error("Could not allocate memory");
+    }
+    for (size_t i = 0; i < file->fieldsCount; i++) {
+        cacheColumn* column = &writer->columns[i];
+        uint32_t fieldInfos[3];
+        size_t width;
+
+        fieldInfos[0] = file->fields[i]->fieldType | (file->fields[i]->indexed ? 0x100 : 0);
+        fieldInfos[1] = file->fields[i]->capacity;
+        fieldInfos[2] = strlen(file->fields[i]->fieldName);
+        _cacheWrite(writer, fieldInfos, sizeof(fieldInfos));
+        _cacheWrite(writer, file->fields[i]->fieldName, fieldInfos[2]);
+        column->fieldType = file->fields[i]->fieldType;
+        column->nulls = calloc((CACHE_GROUP_ROWS + 7) / 8, 1);
+        width = _cacheValueWidth(column->fieldType);
+        if (width) {
+            column->values = malloc(CACHE_GROUP_ROWS * width);
+        }
+        column->offsets = calloc(CACHE_GROUP_ROWS + 1, sizeof(uint64_t));
+        column->blobAllocated = 65536;
+        column->blob = malloc(column->blobAllocated);
+        if (!column->nulls || (width && !column->values) || !column->offsets || !column->blob) {
+            error("Could not allocate memory");
+        }
+    }
+    _cachePad(writer);
+    return(writer);
+}
+
+/**
+ * Appends an entry to cache.
+ *
+ * \param writer Cache writer.
+ * \param offset Entry offset in EPF file.
+ * \param values Typed values (fieldsCount values).
+ */
+void cacheAppend(cacheWriter* writer, uint64_t offset, EPFValue* values) {
+    size_t row = writer->groupRows;
+    size_t groupBytes = 0;
+
+    writer->entryOffsets[row] = offset;
+
+    for (size_t i = 0; i < writer->columnsCount; i++) {
+        cacheColumn* column = &writer->columns[i];
+        EPFValue* value = &values[i];
+        uint8_t boolean;
+
+        if (value->isNull) {
+            column->nulls[row >> 3] |= (1 << (row & 7));
+        }
+        switch (column->fieldType) {
+            case EPF_FIELDTYPE_BIGINT :
+            case EPF_FIELDTYPE_INTEGER :
+                memcpy(column->values + (row * sizeof(int64_t)), &value->integer, sizeof(int64_t));
+                break;
+            case EPF_FIELDTYPE_BOOLEAN :
+                boolean = value->integer ? 1 : 0;
+                column->values[row] = boolean;
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                memcpy(column->values + (row * sizeof(double)), &value->decimal, sizeof(double));
+                break;
+        }
+        //Raw values, even of typed nulls (invalid datetimes), for filters, keys and rejects.
+        column->offsets[row] = column->blobLength;
+        while (column->blobLength + value->length + 1 > column->blobAllocated) {
+            column->blobAllocated *= 2;
+            column->blob = realloc(column->blob, column->blobAllocated);
+            if (!column->blob) {
+                error("Could not allocate memory");
+            }
+        }
+        if (value->length) {
+            memcpy(column->blob + column->blobLength, value->string, value->length);
+            column->blobLength += value->length;
+        }
+        column->blob[column->blobLength++] = 0;
+        column->offsets[row + 1] = column->blobLength;
+        groupBytes += column->blobLength;
+    }
+    writer->groupRows++;
+    writer->rowsCount++;
+    if ((writer->groupRows == CACHE_GROUP_ROWS) || (groupBytes >= writer->maxGroupBytes)) {
+        _cacheFlushGroup(writer);
+    }
+}
+
+/**
+ * Malformed records handler storing records in cache, then forwarding them to
+ * the writer's reject handler.
+ *
+ * \param context Cache writer.
+ * \param offset  Record offset in EPF file.
+ * \param reason  Reason.
+ * \param record  Raw record, record separator excluded.
+ * \param length  Raw record length.
+ *
+ * \return Forwarded handler result, true if none.
+ */
+bool cacheReject(void* context, uint64_t offset, const char* reason, const char* record, size_t length) {
+    cacheWriter* writer = context;
+    uint32_t lengths[2];
+    unsigned char* position;
+    size_t size;
+
+    lengths[0] = strlen(reason) + 1;
+    lengths[1] = length;
+    size = CACHE_ALIGN(sizeof(offset) + sizeof(lengths) + lengths[0] + lengths[1]);
+    while (writer->rejectsLength + size > writer->rejectsAllocated) {
+        writer->rejectsAllocated = writer->rejectsAllocated ? writer->rejectsAllocated * 2 : 4096;
+        writer->rejects = realloc(writer->rejects, writer->rejectsAllocated);
+        if (!writer->rejects) {
+            error("Could not allocate memory");
+        }
+    }
+    position = writer->rejects + writer->rejectsLength;
+    memset(position, 0, size);
+    memcpy(position, &offset, sizeof(offset));
+    position += sizeof(offset);
+    memcpy(position, lengths, sizeof(lengths));
+    position += sizeof(lengths);
+    memcpy(position, reason, lengths[0]);
+    position += lengths[0];
+    memcpy(position, record, lengths[1]);
+    writer->rejectsLength += size;
+    if (writer->reject) {
+        return(writer->reject(writer->rejectContext, offset, reason, record, length));
+    }
+    return(true);
+}
+
+/**
+ * Completes cache file and makes it available to next runs.
+ *
+ * \param writer Cache writer (destroyed).
+ */
+void cacheCommit(cacheWriter* writer) {
+    uint64_t rejectsOffset;
+
+    _cacheFlushGroup(writer);
+    rejectsOffset = ftell(writer->fp);
+    _cacheWrite(writer, writer->rejects, writer->rejectsLength);
+    _cacheWrite(writer, CACHE_TRAILER_MAGIC, 8);
+    _cacheWrite(writer, &writer->rowsCount, sizeof(uint64_t));
+    _cacheWrite(writer, &rejectsOffset, sizeof(uint64_t));
+    if (fclose(writer->fp)) {
+        error("Could not write cache file (%s) : %s", strerror(errno), writer->temporaryPath);
+    }
+    if (rename(writer->temporaryPath, writer->path)) {
+        error("Could not create cache file (%s) : %s", strerror(errno), writer->path);
+    }
+    for (size_t i = 0; i < writer->columnsCount; i++) {
+        free(writer->columns[i].nulls);
+        free(writer->columns[i].values);
+        free(writer->columns[i].offsets);
+        free(writer->columns[i].blob);
+    }
+    free(writer->columns);
+    free(writer->entryOffsets);
+    free(writer->rejects);
+    free(writer->path);
+    free(writer->temporaryPath);
+    free(writer);
+}
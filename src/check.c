@@ -0,0 +1,299 @@
+/**
+ * Validation only scan of EPF files.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "check.h"
+#include "utf8.h"
+#include "reject.h"
+
+#include <math.h>
+
+/**
+ * Checks an integer (BIGINT, INTEGER) : optional sign and digits, 64 bits.
+ *
+ * \param raw    Raw value.
+ * \param length Raw value length.
+ *
+ * \return True if valid.
+ */
+bool _checkInteger(const char* raw, size_t length) {
+    size_t position = (raw[0] == '-') ? 1 : 0;
+
+    if ((position == length) || (length - position > 19)) {
+        return(false);
+    }
+    for (size_t i = position; i < length; i++) {
+        if ((raw[i] < '0') || (raw[i] > '9')) {
+            return(false);
+        }
+    }
+    if (length - position == 19) {
+        errno = 0;
+        strtoll(raw, NULL, 10);
+        return(errno != ERANGE);
+    }
+    return(true);
+}
+
+/**
+ * Checks a decimal : whole value is a finite number.
+ *
+ * \param raw    Raw value.
+ * \param length Raw value length.
+ *
+ * \return True if valid.
+ */
+bool _checkDecimal(const char* raw, size_t length) {
+    char* end;
+    double value;
+
+    if (isspace((unsigned char)raw[0])) {
+        return(false);
+    }
+    value = strtod(raw, &end);
+    return((end == raw + length) && isfinite(value));
+}
+
+/**
+ * Counts UTF-8 characters (valid string).
+ *
+ * \param raw    Raw value.
+ * \param length Raw value length.
+ *
+ * \return Characters count.
+ */
+size_t _checkCharacters(const char* raw, size_t length) {
+    size_t characters = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        if (((unsigned char)raw[i] & 0xC0) != 0x80) {
+            characters++;
+        }
+    }
+    return(characters);
+}
+
+/**
+ * Checks an entry values.
+ *
+ * \param report Report.
+ * \param entry  Raw entry.
+ */
+void _checkEntry(checkReport* report, char** entry) {
+    EPFField* field;
+    checkField* fieldReport;
+    unsigned long* counter;
+    unsigned long* firstEntry;
+    size_t length;
+    int64_t milliseconds;
+
+    for (size_t i = 0; i < report->file->fieldsCount; i++) {
+        field = report->file->fields[i];
+        fieldReport = report->fields + i;
+        length = strlen(entry[i]);
+        if (!length) {
+            continue;
+        }
+        counter = NULL;
+        firstEntry = NULL;
+        switch(field->fieldType) {
+            case EPF_FIELDTYPE_BIGINT :
+            case EPF_FIELDTYPE_INTEGER :
+                if (!_checkInteger(entry[i], length)) {
+                    counter = &fieldReport->invalid;
+                    firstEntry = &fieldReport->invalidFirstEntry;
+                }
+                break;
+            case EPF_FIELDTYPE_BOOLEAN :
+                if ((length != 1) || ((entry[i][0] != '0') && (entry[i][0] != '1'))) {
+                    counter = &fieldReport->invalid;
+                    firstEntry = &fieldReport->invalidFirstEntry;
+                }
+                break;
+            case EPF_FIELDTYPE_DATETIME :
+                if (!epfParseDatetime(NULL, entry[i], length, &milliseconds)) {
+                    counter = &fieldReport->invalid;
+                    firstEntry = &fieldReport->invalidFirstEntry;
+                }
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                if (!_checkDecimal(entry[i], length)) {
+                    counter = &fieldReport->invalid;
+                    firstEntry = &fieldReport->invalidFirstEntry;
+                }
+                break;
+            case EPF_FIELDTYPE_VARCHAR :
+            case EPF_FIELDTYPE_LONGTEXT :
+                if (!utf8Validate(entry[i], length)) {
+                    counter = &fieldReport->invalidUtf8;
+                    firstEntry = &fieldReport->invalidUtf8FirstEntry;
+                } else if (
+                    (field->fieldType == EPF_FIELDTYPE_VARCHAR) &&
+                    (length > field->capacity) &&
+                    (_checkCharacters(entry[i], length) > field->capacity)
+                ) {
+                    counter = &fieldReport->tooLong;
+                    firstEntry = &fieldReport->tooLongFirstEntry;
+                }
+                break;
+        }
+        if (counter) {
+            (*counter)++;
+            if (!*firstEntry) {
+                *firstEntry = report->entries;
+            }
+        }
+    }
+}
+
+
+/**
+ * Reads an EPF file up to its end, checking every entry.
+ *
+ * \param file EPFFile instance (header parsed).
+ *
+ * \return Report.
+ */
+checkReport* checkFile(EPFFile* file) {
+    checkReport* report;
+    char** entry;
+    int status;
+    struct timeval start;
+    struct timeval end;
+
+    report = calloc(1, sizeof(checkReport));
+    if (!report) {
+        error("Cannot allocate memory");
+    }
+    report->fields = calloc(file->fieldsCount, sizeof(checkField));
+    if (!report->fields) {
+        error("Cannot allocate memory");
+    }
+    report->file = file;
+    report->recordsWritten = -1;
+    gettimeofday(&start, NULL);
+    while((status = epfRead(file, &entry)) != EPF_EOF) {
+        if (status == EPF_OK) {
+            report->entries++;
+            _checkEntry(report, entry);
+        } else if (status == EPF_SKIPPED) {
+            report->badRecords++;
+        } else if (status == EPF_COMMENT) {
+            if (!strncmp(file->record, "#recordsWritten:", 16)) {
+                report->recordsWritten = strtol(file->record + 16, NULL, 10);
+            }
+        } else if (status == EPF_ERROR_REJECTS) {
+            error("Too many malformed records (more than %lu)", epf2bsonOptions->rejects->maxErrors);
+        } else if (status == EPF_ERROR_RECORD) {
+            error("%s, out of --max-memory budget", epfError(file));
+        } else {
+            error("%s", epfError(file));
+        }
+    }
+    gettimeofday(&end, NULL);
+    report->bytes = ftell(file->fp);
+    report->seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    return(report);
+}
+
+/**
+ * Counts errors found.
+ *
+ * \param report Report.
+ *
+ * \return Invalid records and values count, plus 1 if #recordsWritten is
+ *         missing or does not match entries count.
+ */
+unsigned long checkErrors(checkReport* report) {
+    unsigned long errors = report->badRecords;
+
+    for (size_t i = 0; i < report->file->fieldsCount; i++) {
+        errors += report->fields[i].invalid + report->fields[i].invalidUtf8 + report->fields[i].tooLong;
+    }
+    if ((report->recordsWritten == -1) || (report->recordsWritten != report->entries + report->badRecords)) {
+        errors++;
+    }
+    return(errors);
+}
+
+/**
+ * Shows a report.
+ *
+ * \param report Report.
+ * \param path   EPF file path.
+ */
+void checkPrint(checkReport* report, char* path) {
+    checkField* fieldReport;
+
+    message(
+        "%s : %'lu entries, %'.1f MB in %.2fs (%'.1f MB/s)",
+        path,
+        report->entries,
+        report->bytes / 1048576.0,
+        report->seconds,
+        report->seconds > 0 ? report->bytes / 1048576.0 / report->seconds : 0.0
+    );
+    if (report->badRecords) {
+        message("  %'lu record(s) with a wrong field count", report->badRecords);
+    }
+    if (report->recordsWritten == -1) {
+        message("  No #recordsWritten trailer, file may be truncated");
+    } else if (report->recordsWritten != report->entries + report->badRecords) {
+        message("  #recordsWritten declares %'ld records, %'lu read", report->recordsWritten, report->entries + report->badRecords);
+    }
+    for (size_t i = 0; i < report->file->fieldsCount; i++) {
+        fieldReport = report->fields + i;
+        if (fieldReport->invalid) {
+            message(
+                "  %s : %'lu invalid value(s), first invalid value at entry %'lu",
+                report->file->fields[i]->fieldName, fieldReport->invalid, fieldReport->invalidFirstEntry
+            );
+        }
+        if (fieldReport->invalidUtf8) {
+            message(
+                "  %s : %'lu invalid UTF-8 string(s), first invalid value at entry %'lu",
+                report->file->fields[i]->fieldName, fieldReport->invalidUtf8, fieldReport->invalidUtf8FirstEntry
+            );
+        }
+        if (fieldReport->tooLong) {
+            message(
+                "  %s : %'lu string(s) longer than %'lu characters, first invalid value at entry %'lu",
+                report->file->fields[i]->fieldName, fieldReport->tooLong,
+                report->file->fields[i]->capacity, fieldReport->tooLongFirstEntry
+            );
+        }
+    }
+    message("  %s", checkErrors(report) ? "FAILED" : "OK");
+}
+
+/**
+ * Destroy a report and release memory.
+ *
+ * \param report Report.
+ */
+void checkDestroy(checkReport* report) {
+    free(report->fields);
+    free(report);
+}
@@ -0,0 +1,371 @@
+/**
+ * Duplicate primary keys detection.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "hash.h"
+#include "dedup.h"
+
+/**
+ * Key fingerprint (never 0, the empty slot marker).
+ *
+ * \param key    Encoded key.
+ * \param length Encoded key length.
+ *
+ * \return Fingerprint.
+ */
+uint64_t _dedupFingerprint(const void* key, size_t length) {
+    uint64_t fingerprint = hashBytes(key, length, 0);
+
+    return(fingerprint ? fingerprint : 1);
+}
+
+/**
+ * Allocates an empty Bloom filter.
+ *
+ * \param filter Filter.
+ * \param keys   Expected keys count.
+ */
+void _dedupBloomInit(dedupFilter* filter, uint64_t keys) {
+    filter->bloomBlocks = (keys * DEDUP_BLOOM_BITS + 511) / 512;
+    if (!filter->bloomBlocks) {
+        filter->bloomBlocks = 1;
+    }
+    filter->bloom = calloc(filter->bloomBlocks * 8, sizeof(uint64_t));
+    if (!filter->bloom) {
+        error("Cannot allocate memory");
+    }
+}
+
+/**
+ * Adds a fingerprint to the Bloom filter.
+ *
+ * The block is chosen with the high bits, the bits of the block with 9 bits
+ * slices of the remixed fingerprint.
+ *
+ * \param filter      Filter.
+ * \param fingerprint Fingerprint.
+ *
+ * \return True if it was (maybe) already there.
+ */
+bool _dedupBloomAdd(dedupFilter* filter, uint64_t fingerprint) {
+    uint64_t* block = filter->bloom + 8 * (((fingerprint >> 32) * filter->bloomBlocks) >> 32);
+    uint64_t bits = fingerprint * 0x9E3779B97F4A7C15ULL;
+    bool present = true;
+
+    for (int i = 0; i < DEDUP_BLOOM_PROBES; i++, bits >>= 9) {
+        uint64_t mask = 1ULL << (bits & 63);
+        size_t word = (bits >> 6) & 7;
+
+        if (!(block[word] & mask)) {
+            present = false;
+            block[word] |= mask;
+        }
+    }
+    return(present);
+}
+
+/**
+ * Tells if a fingerprint may be in the Bloom filter.
+ *
+ * \param filter      Filter.
+ * \param fingerprint Fingerprint.
+ *
+ * \return False if it is not.
+ */
+bool _dedupBloomHas(dedupFilter* filter, uint64_t fingerprint) {
+    uint64_t* block = filter->bloom + 8 * (((fingerprint >> 32) * filter->bloomBlocks) >> 32);
+    uint64_t bits = fingerprint * 0x9E3779B97F4A7C15ULL;
+
+    for (int i = 0; i < DEDUP_BLOOM_PROBES; i++, bits >>= 9) {
+        if (!(block[(bits >> 6) & 7] & (1ULL << (bits & 63)))) {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+/**
+ * Finds a fingerprint slot in candidates set.
+ *
+ * \param filter      Filter.
+ * \param fingerprint Fingerprint.
+ *
+ * \return Slot holding it, or empty slot to store it.
+ */
+uint64_t* _dedupSlot(dedupFilter* filter, uint64_t fingerprint) {
+    size_t mask = filter->capacity - 1;
+    size_t position = fingerprint & mask;
+
+    while (filter->slots[position] && (filter->slots[position] != fingerprint)) {
+        position = (position + 1) & mask;
+    }
+    return(filter->slots + position);
+}
+
+/**
+ * Adds a fingerprint to candidates set.
+ *
+ * \param filter      Filter.
+ * \param fingerprint Fingerprint.
+ */
+void _dedupAddCandidate(dedupFilter* filter, uint64_t fingerprint) {
+    uint64_t* slot;
+
+    if ((filter->count + 1) * 2 > filter->capacity) {
+        uint64_t* slots = filter->slots;
+        size_t capacity = filter->capacity;
+
+        filter->capacity = capacity ? capacity * 2 : 1024;
+        filter->slots = calloc(filter->capacity, sizeof(uint64_t));
+        if (!filter->slots) {
+            error("Cannot allocate memory");
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            if (slots[i]) {
+                *_dedupSlot(filter, slots[i]) = slots[i];
+            }
+        }
+        free(slots);
+    }
+    slot = _dedupSlot(filter, fingerprint);
+    if (!*slot) {
+        *slot = fingerprint;
+        filter->count++;
+    }
+}
+
+/**
+ * Finds a key in exact keys set.
+ *
+ * \param filter      Filter.
+ * \param fingerprint Key fingerprint.
+ * \param key         Encoded primary key.
+ * \param keyLength   Encoded primary key length.
+ * \param added       Set if the key was added, NULL to only look for it.
+ *
+ * \return Key entry, NULL if not found (and not added).
+ */
+dedupSeen* _dedupFindKey(dedupFilter* filter, uint64_t fingerprint, const void* key, size_t keyLength, bool* added) {
+    dedupSeen* seen;
+    size_t mask;
+    size_t position;
+
+    if (!added && !filter->seenCount) {
+        return(NULL);
+    }
+    if ((filter->seenCount + 1) * 2 > filter->seenCapacity) {
+        dedupSeen* previous = filter->seen;
+        size_t capacity = filter->seenCapacity;
+
+        filter->seenCapacity = capacity ? capacity * 2 : 1024;
+        filter->seen = calloc(filter->seenCapacity, sizeof(dedupSeen));
+        if (!filter->seen) {
+            error("Cannot allocate memory");
+        }
+        mask = filter->seenCapacity - 1;
+        for (size_t i = 0; i < capacity; i++) {
+            if (previous[i].fingerprint) {
+                for (position = previous[i].fingerprint & mask; filter->seen[position].fingerprint; position = (position + 1) & mask);
+                filter->seen[position] = previous[i];
+            }
+        }
+        free(previous);
+    }
+    mask = filter->seenCapacity - 1;
+    for (position = fingerprint & mask; filter->seen[position].fingerprint; position = (position + 1) & mask) {
+        seen = &filter->seen[position];
+        if (
+            (seen->fingerprint == fingerprint) &&
+            (seen->length == keyLength) &&
+            !memcmp(filter->keys + seen->offset, key, keyLength)
+        ) {
+            if (added) {
+                *added = false;
+            }
+            return(seen);
+        }
+    }
+    if (!added) {
+        return(NULL);
+    }
+    if (filter->keysLength + keyLength > filter->keysAllocated) {
+        filter->keysAllocated = (filter->keysLength + keyLength) * 2;
+        filter->keys = realloc(filter->keys, filter->keysAllocated);
+        if (!filter->keys) {
+            error("Cannot allocate memory");
+        }
+    }
+    memcpy(filter->keys + filter->keysLength, key, keyLength);
+    seen = &filter->seen[position];
+    seen->fingerprint = fingerprint;
+    seen->offset = filter->keysLength;
+    seen->length = keyLength;
+    seen->row = 0;
+    filter->keysLength += keyLength;
+    filter->seenCount++;
+    *added = true;
+    return(seen);
+}
+
+/**
+ * Sizes the Bloom filter from sampled rows, then adds them.
+ *
+ * \param filter Filter.
+ */
+void _dedupSizeBloom(dedupFilter* filter) {
+    uint64_t keys = filter->pendingCount;
+
+    if (filter->sampledBytes) {
+        keys = filter->sourceBytes * filter->pendingCount / filter->sampledBytes;
+        keys += keys / 4;
+    }
+    if (keys < filter->pendingCount) {
+        keys = filter->pendingCount;
+    }
+    _dedupBloomInit(filter, keys);
+    for (size_t i = 0; i < filter->pendingCount; i++) {
+        if (_dedupBloomAdd(filter, filter->pending[i])) {
+            _dedupAddCandidate(filter, filter->pending[i]);
+        }
+    }
+    free(filter->pending);
+    filter->pending = NULL;
+}
+
+
+/**
+ * Starts scanning a file.
+ *
+ * \param sourceBytes Source file size.
+ * \param mode        Deduplication mode (DEDUP_KEEP_*).
+ *
+ * \return Filter.
+ */
+dedupFilter* dedupInit(uint64_t sourceBytes, unsigned char mode) {
+    dedupFilter* filter;
+
+    filter = calloc(1, sizeof(dedupFilter));
+    if (!filter) {
+        error("Cannot allocate memory");
+    }
+    filter->pending = calloc(DEDUP_SAMPLE_ROWS, sizeof(uint64_t));
+    if (!filter->pending) {
+        error("Cannot allocate memory");
+    }
+    filter->sourceBytes = sourceBytes;
+    filter->mode = mode;
+    return(filter);
+}
+
+/**
+ * Scans a row key.
+ *
+ * \param filter    Filter.
+ * \param key       Encoded primary key.
+ * \param keyLength Encoded primary key length.
+ * \param rowBytes  Raw row length.
+ */
+void dedupScan(dedupFilter* filter, const void* key, size_t keyLength, size_t rowBytes) {
+    uint64_t fingerprint = _dedupFingerprint(key, keyLength);
+    uint64_t row = filter->scanned++;
+    bool added;
+
+    if (filter->pending) {
+        filter->pending[filter->pendingCount++] = fingerprint;
+        filter->sampledBytes += rowBytes;
+        if (filter->pendingCount == DEDUP_SAMPLE_ROWS) {
+            _dedupSizeBloom(filter);
+        }
+    } else if (_dedupBloomAdd(filter, fingerprint)) {
+        _dedupAddCandidate(filter, fingerprint);
+    } else {
+        return;
+    }
+    if (filter->mode == DEDUP_KEEP_LAST) {
+        _dedupFindKey(filter, fingerprint, key, keyLength, &added)->row = row;
+    }
+}
+
+/**
+ * Ends scan : keeps the candidates set and its prefilter only.
+ *
+ * \param filter Filter.
+ */
+void dedupScanEnd(dedupFilter* filter) {
+    if (filter->pending) {
+        _dedupSizeBloom(filter);
+    }
+    free(filter->bloom);
+    _dedupBloomInit(filter, filter->count);
+    for (size_t i = 0; i < filter->capacity; i++) {
+        if (filter->slots[i]) {
+            _dedupBloomAdd(filter, filter->slots[i]);
+        }
+    }
+}
+
+/**
+ * Tells if a row is to keep (scan ended, rows checked in scan order).
+ *
+ * \param filter    Filter.
+ * \param key       Encoded primary key.
+ * \param keyLength Encoded primary key length.
+ *
+ * \return False if the row is a duplicate to drop.
+ */
+bool dedupKeep(dedupFilter* filter, const void* key, size_t keyLength) {
+    uint64_t row = filter->checked++;
+    uint64_t fingerprint;
+    dedupSeen* seen;
+    bool added;
+
+    if (!filter->count) {
+        return(true);
+    }
+    fingerprint = _dedupFingerprint(key, keyLength);
+    if (!_dedupBloomHas(filter, fingerprint) || !*_dedupSlot(filter, fingerprint)) {
+        return(true);
+    }
+    if (filter->mode == DEDUP_KEEP_LAST) {
+        seen = _dedupFindKey(filter, fingerprint, key, keyLength, NULL);
+        return(!seen || (seen->row == row));
+    }
+    _dedupFindKey(filter, fingerprint, key, keyLength, &added);
+    return(added);
+}
+
+/**
+ * Destroy a filter and release memory.
+ *
+ * \param filter Filter.
+ */
+void dedupDestroy(dedupFilter* filter) {
+    free(filter->bloom);
+    free(filter->slots);
+    free(filter->pending);
+    free(filter->seen);
+    free(filter->keys);
+    free(filter);
+}
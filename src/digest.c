@@ -0,0 +1,235 @@
+/**
+ * Checksums (MD5, CRC32C).
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "digest.h"
+
+#define CRC32C_POLYNOMIAL           0x82F63B78
+
+#define MD5_ROTATE(value, bits)     (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+/**
+ * MD5 per round shifts.
+ */
+static const unsigned char md5Shifts[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+/**
+ * MD5 per round constants (floor(abs(sin(i + 1)) * 2^32)).
+ */
+static const uint32_t md5Constants[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+/**
+ * CRC32C tables (slicing by 8), built on first use.
+ */
+static uint32_t crc32cTables[8][256];
+static bool crc32cTablesReady = false;
+
+/**
+ * Hashes a 64 bytes block.
+ *
+ * \param context MD5 state.
+ * \param block   Block.
+ */
+void _md5Block(md5Context* context, const unsigned char* block) {
+    uint32_t words[16];
+    uint32_t a = context->state[0];
+    uint32_t b = context->state[1];
+    uint32_t c = context->state[2];
+    uint32_t d = context->state[3];
+    uint32_t f;
+    uint32_t temp;
+    size_t g;
+
+    memcpy(words, block, 64);
+    for (size_t i = 0; i < 16; i++) {
+        words[i] = le32toh(words[i]);
+    }
+    for (size_t i = 0; i < 64; i++) {
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) & 15;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) & 15;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) & 15;
+        }
+        temp = d;
+        d = c;
+        c = b;
+        f += a + md5Constants[i] + words[g];
+        b += MD5_ROTATE(f, md5Shifts[i]);
+        a = temp;
+    }
+    context->state[0] += a;
+    context->state[1] += b;
+    context->state[2] += c;
+    context->state[3] += d;
+}
+
+/**
+ * Builds CRC32C tables.
+ */
+void _crc32cBuildTables() {
+    uint32_t crc;
+
+    for (size_t i = 0; i < 256; i++) {
+        crc = i;
+        for (size_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        crc32cTables[0][i] = crc;
+    }
+    for (size_t i = 0; i < 256; i++) {
+        crc = crc32cTables[0][i];
+        for (size_t slice = 1; slice < 8; slice++) {
+            crc = (crc >> 8) ^ crc32cTables[0][crc & 0xff];
+            crc32cTables[slice][i] = crc;
+        }
+    }
+    crc32cTablesReady = true;
+}
+
+
+/**
+ * Starts a MD5 digest.
+ *
+ * \param context MD5 state.
+ */
+void md5Init(md5Context* context) {
+    context->state[0] = 0x67452301;
+    context->state[1] = 0xefcdab89;
+    context->state[2] = 0x98badcfe;
+    context->state[3] = 0x10325476;
+    context->length = 0;
+}
+
+/**
+ * Hashes more bytes.
+ *
+ * \param context MD5 state.
+ * \param data    Data.
+ * \param length  Data length.
+ */
+void md5Update(md5Context* context, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    size_t pending = context->length & 63;
+    size_t chunk;
+
+    context->length += length;
+    if (pending) {
+        chunk = 64 - pending;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(context->block + pending, bytes, chunk);
+        bytes += chunk;
+        length -= chunk;
+        if (pending + chunk < 64) {
+            return;
+        }
+        _md5Block(context, context->block);
+    }
+    while (length >= 64) {
+        _md5Block(context, bytes);
+        bytes += 64;
+        length -= 64;
+    }
+    memcpy(context->block, bytes, length);
+}
+
+/**
+ * Ends a MD5 digest.
+ *
+ * \param context MD5 state.
+ * \param digest  Digest (MD5_DIGEST_LENGTH bytes).
+ */
+void md5Final(md5Context* context, unsigned char* digest) {
+    static const unsigned char padding[64] = { 0x80 };
+    uint64_t bits = htole64(context->length * 8);
+    size_t pending = context->length & 63;
+    uint32_t word;
+
+    md5Update(context, padding, (pending < 56) ? 56 - pending : 120 - pending);
+    md5Update(context, &bits, sizeof(uint64_t));
+    for (size_t i = 0; i < 4; i++) {
+        word = htole32(context->state[i]);
+        memcpy(digest + i * 4, &word, 4);
+    }
+}
+
+/**
+ * Updates a CRC32C (Castagnoli) checksum.
+ *
+ * \param crc    Checksum of previous bytes (0 to start).
+ * \param data   Data.
+ * \param length Data length.
+ *
+ * \return Checksum.
+ */
+uint32_t crc32cUpdate(uint32_t crc, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    uint64_t word;
+
+    if (!crc32cTablesReady) {
+        _crc32cBuildTables();
+    }
+    crc = ~crc;
+    while (length >= 8) {
+        memcpy(&word, bytes, 8);
+        word = le64toh(word) ^ crc;
+        crc = crc32cTables[7][word & 0xff] ^
+              crc32cTables[6][(word >> 8) & 0xff] ^
+              crc32cTables[5][(word >> 16) & 0xff] ^
+              crc32cTables[4][(word >> 24) & 0xff] ^
+              crc32cTables[3][(word >> 32) & 0xff] ^
+              crc32cTables[2][(word >> 40) & 0xff] ^
+              crc32cTables[1][(word >> 48) & 0xff] ^
+              crc32cTables[0][word >> 56];
+        bytes += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ crc32cTables[0][(crc ^ *bytes++) & 0xff];
+    }
+    return(~crc);
+}
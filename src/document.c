@@ -0,0 +1,303 @@
+/**
+ * BSON documents from EPF entries.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "EPF2Bson.h"
+#include "document.h"
+#include "utf8.h"
+
+
+/**
+ * Tells if a string value is to repair.
+ *
+ * \param epfFile EPF File instance.
+ * \param values  Entry typed values.
+ * \param i       Field index.
+ *
+ * \return True if field is a non null, invalid UTF-8 string.
+ */
+bool _documentInvalidString(EPFFile* epfFile, EPFValue* values, size_t i) {
+    unsigned char fieldType = epfGetFieldType(epfFile, i);
+
+    return(
+        ((fieldType == EPF_FIELDTYPE_VARCHAR) || (fieldType == EPF_FIELDTYPE_LONGTEXT)) &&
+        !values[i].isNull &&
+        !utf8Validate(values[i].string, values[i].length)
+    );
+}
+
+/**
+ * Adds the `_id` field built from the primary key : the value itself for a
+ * single column key, an embedded document for a composite key.
+ *
+ * \param doc     Document to insert into (should be empty, `_id` comes first).
+ * \param id      Document to build composite keys into (reset here).
+ * \param epfFile EPF File instance.
+ * \param values  Entry typed values.
+ *
+ * \return False if a field type is unknown.
+ */
+bool _documentAddPrimaryKeyId(bsonDocument* doc, bsonDocument* id, EPFFile* epfFile, EPFValue* values) {
+    if (epfFile->primaryKeyCount == 1) {
+        size_t index = epfFile->primaryKey[0];
+
+        return(documentAddValue(doc, "_id", epfGetFieldType(epfFile, index), &values[index]));
+    }
+    resetBsonDocument(id);
+    for (size_t i = 0; i < epfFile->primaryKeyCount; i++) {
+        size_t index = epfFile->primaryKey[i];
+
+        if (!documentAddValue(id, epfFile->fields[index]->fieldName, epfGetFieldType(epfFile, index), &values[index])) {
+            return(false);
+        }
+    }
+    if (id->outOfMemory) {
+        doc->outOfMemory = true;
+    }
+    bsonAddSubDocument(doc, "_id", id);
+    return(true);
+}
+
+
+/**
+ * Adds a typed EPF value to a document.
+ *
+ * \param doc       Document to insert into.
+ * \param name      Value name in document.
+ * \param fieldType EPF field type.
+ * \param value     Typed value.
+ *
+ * \return False if field type is unknown.
+ */
+bool documentAddValue(bsonDocument* doc, char* name, unsigned char fieldType, EPFValue* value) {
+    if (value->isNull) {
+        bsonAddNull(doc, name);
+        return(true);
+    }
+    switch(fieldType) {
+        case EPF_FIELDTYPE_BIGINT :
+        case EPF_FIELDTYPE_INTEGER :
+            if (value->integer >= INT_MIN && value->integer <= INT_MAX) {
+                bsonAddInt32(doc, name, (bsonInt32)value->integer);
+            } else {
+                bsonAddInt64(doc, name, value->integer);
+            }
+            break;
+        case EPF_FIELDTYPE_BOOLEAN :
+            bsonAddBool(doc, name, value->integer != 0);
+            break;
+        case EPF_FIELDTYPE_VARCHAR :
+        case EPF_FIELDTYPE_LONGTEXT :
+            bsonAddString(doc, name, value->string);
+            break;
+        case EPF_FIELDTYPE_DATETIME :
+            bsonAddDate(doc, name, value->integer);
+            break;
+        case EPF_FIELDTYPE_DECIMAL :
+            bsonAddDouble(doc, name, value->decimal);
+            break;
+        case 0:
+        default :
+            return(false);
+    }
+    return(true);
+}
+
+/**
+ * Checks string values are valid UTF-8, repairing them in replace mode.
+ *
+ * \param epfFile   EPF File instance.
+ * \param values    Entry typed values.
+ * \param mode      Invalid strings handling (UTF8_MODE_REPLACE or UTF8_MODE_REJECT).
+ * \param repaired  Buffer receiving repaired strings (grown as needed).
+ * \param allocated Repaired buffer allocated size.
+ *
+ * \return DOCUMENT_STRINGS_* result.
+ */
+int documentCheckStrings(EPFFile* epfFile, EPFValue* values, int mode, char** repaired, size_t* allocated) {
+    size_t needed = 0;
+    size_t position = 0;
+
+    for (size_t i = 0; i < epfFile->fieldsCount; i++) {
+        if (_documentInvalidString(epfFile, values, i)) {
+            needed += utf8RepairBound(values[i].length);
+        }
+    }
+    if (!needed) {
+        return(DOCUMENT_STRINGS_VALID);
+    }
+    if (mode == UTF8_MODE_REJECT) {
+        return(DOCUMENT_STRINGS_REJECTED);
+    }
+    if (needed > *allocated) {
+        char* grown = realloc(*repaired, needed);
+
+        if (!grown) {
+            return(DOCUMENT_STRINGS_MEMORY);
+        }
+        *repaired = grown;
+        *allocated = needed;
+    }
+    for (size_t i = 0; i < epfFile->fieldsCount; i++) {
+        if (_documentInvalidString(epfFile, values, i)) {
+            char* string = *repaired + position;
+
+            values[i].length = utf8Repair(values[i].string, values[i].length, string);
+            values[i].string = string;
+            position += values[i].length + 1;
+        }
+    }
+    return(DOCUMENT_STRINGS_REPAIRED);
+}
+
+/**
+ * Builds the document of an entry.
+ *
+ * \param doc          Document (reset here).
+ * \param id           Document to build composite `_id` into.
+ * \param epfFile      EPF File instance.
+ * \param values       Entry typed values.
+ * \param primaryKeyId Use primary key as `_id` (if any).
+ *
+ * \return False if memory ran out or a field type is unknown.
+ */
+bool documentBuild(bsonDocument* doc, bsonDocument* id, EPFFile* epfFile, EPFValue* values, bool primaryKeyId) {
+    resetBsonDocument(doc);
+    if (primaryKeyId && epfFile->primaryKeyCount && !_documentAddPrimaryKeyId(doc, id, epfFile, values)) {
+        return(false);
+    }
+    for (size_t i = 0; i < epfFile->fieldsCount; i++) {
+        if (!documentAddValue(doc, epfFile->fields[i]->fieldName, epfGetFieldType(epfFile, i), &values[i])) {
+            return(false);
+        }
+    }
+    return(!doc->outOfMemory);
+}
+
+/**
+ * Decodes a document field to a typed value.
+ *
+ * \param fieldType EPF field type.
+ * \param type      BSON field type.
+ * \param field     BSON field value, NULL if missing (null value).
+ * \param value     Filled with typed value (strings point into document).
+ *
+ * \return False if BSON type does not match EPF field type.
+ */
+bool documentDecodeValue(unsigned char fieldType, char type, const char* field, EPFValue* value) {
+    int32_t integer32;
+    int64_t integer64;
+    bool expected;
+
+    memset(value, 0, sizeof(EPFValue));
+    if (!field || (type == BSON_TYPE_NULL)) {
+        value->isNull = true;
+        return(true);
+    }
+    switch (fieldType) {
+        case EPF_FIELDTYPE_BIGINT :
+        case EPF_FIELDTYPE_INTEGER :
+        case EPF_FIELDTYPE_BOOLEAN :
+        case EPF_FIELDTYPE_DATETIME :
+            //Integers kept as such (booleans and dates included).
+            expected = (type == BSON_TYPE_INT32) || (type == BSON_TYPE_INT64) ||
+                (type == BSON_TYPE_BOOL) || (type == BSON_TYPE_UTCDATE);
+            break;
+        case EPF_FIELDTYPE_DECIMAL :
+            expected = (type == BSON_TYPE_DOUBLE);
+            break;
+        case EPF_FIELDTYPE_VARCHAR :
+        case EPF_FIELDTYPE_LONGTEXT :
+            expected = (type == BSON_TYPE_STRING);
+            break;
+        default :
+            expected = false;
+    }
+    if (!expected) {
+        return(false);
+    }
+    switch (type) {
+        case BSON_TYPE_INT32 :
+            memcpy(&integer32, field, sizeof(int32_t));
+            value->integer = (int32_t)le32toh(integer32);
+            break;
+        case BSON_TYPE_INT64 :
+        case BSON_TYPE_UTCDATE :
+            memcpy(&integer64, field, sizeof(int64_t));
+            value->integer = (int64_t)le64toh(integer64);
+            break;
+        case BSON_TYPE_BOOL :
+            value->integer = (*field != 0);
+            break;
+        case BSON_TYPE_DOUBLE :
+            memcpy(&integer64, field, sizeof(int64_t));
+            integer64 = le64toh(integer64);
+            memcpy(&value->decimal, &integer64, sizeof(double));
+            break;
+        case BSON_TYPE_STRING :
+            memcpy(&integer32, field, sizeof(int32_t));
+            value->string = (char*)field + sizeof(int32_t);
+            value->length = le32toh(integer32) - 1;
+            break;
+    }
+    return(true);
+}
+
+/**
+ * Decodes a document built by documentBuild() back to entry typed values, in
+ * a single pass over its fields.
+ *
+ * \param epfFile  EPF File instance.
+ * \param document Serialized document.
+ * \param length   Document length.
+ * \param values   Filled with typed values (strings point into document).
+ *
+ * \return False if a field type does not match EPF field type.
+ */
+bool documentValues(EPFFile* epfFile, const void* document, size_t length, EPFValue* values) {
+    size_t position = 4;
+    size_t next = 0;
+    const char* name;
+    const char* field;
+    char type;
+
+    for (size_t i = 0; i < epfFile->fieldsCount; i++) {
+        documentDecodeValue(epfGetFieldType(epfFile, i), BSON_TYPE_NULL, NULL, &values[i]);
+    }
+    while ((field = bsonNextField(document, length, &position, &name, &type))) {
+        //Fields come in EPF order (missing ones are null), `_id` aside.
+        for (size_t j = 0; j < epfFile->fieldsCount; j++) {
+            size_t i = (next + j) % epfFile->fieldsCount;
+
+            if (!strcmp(epfFile->fields[i]->fieldName, name)) {
+                if (!documentDecodeValue(epfGetFieldType(epfFile, i), type, field, &values[i])) {
+                    return(false);
+                }
+                next = i + 1;
+                break;
+            }
+        }
+    }
+    return(true);
+}
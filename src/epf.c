@@ -23,140 +23,279 @@
 */
 
 #include "EPF2Bson.h"
-#include "error.h"
 #include "epf.h"
 
+#include <stdarg.h>
+#include <fcntl.h>
+
 /**
- * Reads next record in EPF File.
+ * Sets file status and error message.
+ *
+ * \param file   EPFFile instance.
+ * \param status Status (EPF_ERROR_*).
+ * \param format Error message (printf format).
+ * \param ...    printf() like variable.
+ *
+ * \return Status.
+ */
+int _epfFail(EPFFile* file, int status, const char* format, ...) {
+    va_list varArgs;
+
+    va_start(varArgs, format);
+    vsnprintf(file->error, EPF_ERROR_LENGTH, format, varArgs);
+    va_end(varArgs);
+    file->status = status;
+    return(status);
+}
+
+/**
+ * Drops bytes read so far from page cache and asks to read next ones ahead.
  *
  * \param file EPFFile instance.
+ */
+void _dropBehind(EPFFile* file) {
+    int fd = fileno(file->fp);
+
+    posix_fadvise(fd, file->droppedOffset, file->lastEntryOffset - file->droppedOffset, POSIX_FADV_DONTNEED);
+    posix_fadvise(fd, file->lastEntryOffset, EPF_DROP_WINDOW, POSIX_FADV_WILLNEED);
+    file->droppedOffset = file->lastEntryOffset;
+}
+
+/**
+ * Reads a line like getdelim(), giving up past the record length limit if
+ * any : getdelim() would first buffer the whole line, whatever its size.
  *
- * \return Record as string or NULL is none (EOF).
+ * \param file      EPFFile instance.
+ * \param buffer    Line buffer (grown as needed).
+ * \param allocated Line buffer allocated size.
+ * \param limit     Maximum line length (unused without file record length limit).
+ *
+ * \return Bytes read, -1 at end of file or on read error, -2 if line is too
+ *         long, -3 if memory could not be allocated.
  */
-char* _readRecord(EPFFile* file) {
-    int bufferSize = 4096;
-    char* record = calloc(bufferSize, sizeof(char));
-    char character, lastCharacter;
-    int recordIndex = 0;
-    int alocatedBuffer = 1;
-    
+ssize_t _readLine(EPFFile* file, char** buffer, size_t* allocated, size_t limit) {
+    size_t length = 0;
+    int c;
 
-    if (bufferSize < 2) {
-        bufferSize = 1024;
+    if (!file->maxRecordLength) {
+        return(getdelim(buffer, allocated, '\n', file->fp));
     }
-    if (!file->fp) {
-        error("Could not read record in file (#100)");
+    while ((c = getc_unlocked(file->fp)) != EOF) {
+        if (length == limit) {
+            return(-2);
+        }
+        if (length + 2 > *allocated) {
+            size_t size = *allocated ? *allocated * 2 : 128;
+            char* grown;
+
+            if (size > limit + 1) {
+                size = limit + 1;
+            }
+            grown = realloc(*buffer, size);
+            if (!grown) {
+                return(-3);
+            }
+            *buffer = grown;
+            *allocated = size;
+        }
+        (*buffer)[length++] = c;
+        if (c == '\n') {
+            break;
+        }
     }
-    if (!record) {
-        error("Could not allocate memory read record in file (#101)");
+    if (!length) {
+        return(-1);
     }
-    file->lastEntryOffset = ftell(file->fp);
-    while ((character = fgetc(file->fp)) != EOF) {
-        if (recordIndex && ((recordIndex % bufferSize) == 0)) {
-            char* newBuffer = calloc(++alocatedBuffer * bufferSize, sizeof(char));
+    (*buffer)[length] = 0;
+    return(length);
+}
 
-            if (!newBuffer) {
-                error("Could not allocate memory read record in file (#102)");
-            }
-            newBuffer = strcpy(newBuffer, record);
-            free(record);
-            record = newBuffer;
+/**
+ * Reads next record in EPF File.
+ *
+ * \param file   EPFFile instance.
+ * \param record Record as string (file record buffer).
+ *
+ * \return EPF_OK, EPF_EOF or error status.
+ */
+int _readRecord(EPFFile* file, char** record) {
+    ssize_t read;
+    size_t length = 0;
+    bool complete = false;
+
+    file->lastEntryOffset = ftell(file->fp);
+    if ((file->options & EPF_OPTION_DROP_BEHIND) && (file->lastEntryOffset >= file->droppedOffset + EPF_DROP_WINDOW)) {
+        _dropBehind(file);
+    }
+    //http://www.apple.com/itunes/affiliates/resources/documentation/itunes-enterprise-partner-feed.html#fileformat
+    //$record_separator = chr(2) . "\n", a "\n" alone is part of a value : read up to
+    //"\n" (getdelim() scans stdio buffer at once) until one follows chr(2).
+    read = _readLine(file, &file->record, &file->recordAllocated, file->maxRecordLength);
+    while (read > 0) {
+        length += read;
+        if (file->record[length - 1] != '\n') {
+            break;
+        }
+        if ((length >= 2) && (file->record[length - 2] == 2)) {
+            complete = true;
+            break;
         }
-        //http://www.apple.com/itunes/affiliates/resources/documentation/itunes-enterprise-partner-feed.html#fileformat
-        //$record_separator = chr(2) . "\n"
-        if ((character == 10) && (lastCharacter == 2)) {
+        read = _readLine(file, &file->line, &file->lineAllocated, file->maxRecordLength - length);
+        if (read <= 0) {
             break;
         }
-        record[recordIndex] = character;
-        recordIndex++;
-        lastCharacter = character;
+        if (length + read + 1 > file->recordAllocated) {
+            char* grown = realloc(file->record, (length + read + 1) * 2);
+
+            if (!grown) {
+                return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory read record in file (#102)"));
+            }
+            file->record = grown;
+            file->recordAllocated = (length + read + 1) * 2;
+        }
+        memcpy(file->record + length, file->line, read + 1);
     }
-    if (character == EOF) {
-        return(NULL);
+    if (read == -2) {
+        return(_epfFail(file, EPF_ERROR_RECORD, "Record at offset %lu is longer than %zu bytes (#103)", file->lastEntryOffset, file->maxRecordLength));
     }
+    if (read == -3) {
+        return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory read record in file (#102)"));
+    }
+    if ((read == -1) && ferror(file->fp)) {
+        return(_epfFail(file, EPF_ERROR_READ, "Could not read record in file (#101) : %s", strerror(errno)));
+    }
+    if (file->md5) {
+        md5Update(file->md5, file->record, length);
+    }
+    if (!complete) {
+        if (file->options & EPF_OPTION_DROP_BEHIND) {
+            _dropBehind(file);
+        }
+        return(EPF_EOF);
+    }
+    file->record[--length] = 0;
+    file->recordLength = length;
     file->readLines++;
-    return(record);
+    *record = file->record;
+    return(EPF_OK);
 }
 
 /**
- * Get next record in file.
+ * Get next record in file, split in place in the record buffer.
  *
- * \param file EPFFile instance.
+ * \param file   EPFFile instance.
+ * \param fields Record fields (file entry buffer).
  *
- * \return Record fields or NULL is none (EOF).
+ * \return EPF_OK, EPF_COMMENT, EPF_SKIPPED, EPF_EOF or error status.
  */
-char** _getNextRecord(EPFFile* file) {
-    char* record = _readRecord(file);
-    char** fields;
-    void** separatorMarkers;
-    size_t position = 0;
+int _getNextRecord(EPFFile* file, char*** fields) {
+    char* record;
+    size_t length;
     size_t countedFields = 0;
     bool commentField = false;
+    int status;
 
-    epfRecoverableReadEmpty = false;
-    if (!record) {
-        return(NULL);
-    }
-    separatorMarkers = calloc(((file->fieldsCount == -1) ? 1024 : file->fieldsCount + 1), sizeof(void*));
-    if (!separatorMarkers) {
-        error("Could not allocate memory");
+    if ((status = _readRecord(file, &record)) != EPF_OK) {
+        return(status);
     }
-    if (!strlen(record)) {
-        return(NULL);
+    if (!*record) {
+        return(EPF_EOF);
     }
+    length = file->recordLength;
     if (record[0] == '#') {
+        if (file->ready) {
+            //Comment records after header (EG: #recordsWritten) are not entries.
+            return(EPF_COMMENT);
+        }
         commentField = true;
         record++;
+        length--;
     }
-    separatorMarkers[0] = record;
-    for(countedFields = 0; record[position] != 0; position++) {
-        if (record[position] == EPFSeparator) {
-            separatorMarkers[countedFields + 1] = record + position + 1;
-            countedFields++;
-        }
+    for(char* separator = record; (separator = memchr(separator, EPFSeparator, record + length - separator)); separator++) {
+        countedFields++;
     }
     if (file->fieldsCount != -1) {
         if (!commentField && ((countedFields + 1) != file->fieldsCount)) {
-            warning("Invalid field count (#201) : %i - %s", countedFields, record);
-            epfRecoverableReadEmpty = true;
-            return(NULL);
+            if (file->reject) {
+                char reason[64];
+
+                snprintf(reason, sizeof(reason), "Invalid field count (#201) : %zu instead of %zu", countedFields + 1, file->fieldsCount);
+                //Last character is the record separator.
+                if (!file->reject(file->rejectContext, file->lastEntryOffset, reason, record, length - 1)) {
+                    return(_epfFail(file, EPF_ERROR_REJECTS, "Too many malformed records"));
+                }
+            }
+            return(EPF_SKIPPED);
         }
     } else {
         file->fieldsCount = countedFields + 1;
     }
-    fields = calloc(file->fieldsCount + 1, sizeof(void*));
-    if (!fields) {
-        error("Could not allocate memory storing record fields (#200)");
-    }
-    if (countedFields) {
-        for(size_t i = 0; ((i <= file->fieldsCount) && (i <= countedFields)); i++) {
-            size_t stringLength;
+    if (countedFields + 2 > file->entryAllocated) {
+        char** grown = realloc(file->entry, (countedFields + 2) * sizeof(char*));
 
-            if (i == countedFields) {
-                stringLength = strlen(separatorMarkers[i]);
-            } else {
-                stringLength = (separatorMarkers[i + 1] - separatorMarkers[i]) / sizeof(char);
-            }
-            fields[i] = calloc((stringLength + 1), sizeof(char));
-            if (!fields[i]) {
-                error("Could not allocate memory");
-            }
-            strncpy(fields[i], separatorMarkers[i], stringLength - 1);
+        if (!grown) {
+            return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory storing record fields (#200)"));
         }
-    } else {
-        fields[0] = calloc(strlen(record), sizeof(char));
-        if (!fields[0]) {
-            error("Could not allocate memory");
+        file->entry = grown;
+        file->entryAllocated = countedFields + 2;
+    }
+    //Last character is the record separator.
+    if (length) {
+        record[--length] = 0;
+    }
+    file->entry[0] = record;
+    countedFields = 0;
+    for(char* separator = record; (separator = memchr(separator, EPFSeparator, record + length - separator)); ) {
+        *separator++ = 0;
+        file->entry[++countedFields] = separator;
+    }
+    file->entry[countedFields + 1] = NULL;
+    *fields = file->entry;
+    return(EPF_OK);
+}
+
+/**
+ * Reads a header record.
+ *
+ * \param file   EPFFile instance.
+ * \param line   Expected record index.
+ * \param fields Record fields.
+ * \param name   Record name, for errors.
+ * \param prefix Expected first field prefix (NULL if none).
+ *
+ * \return EPF_OK or error status.
+ */
+int _readHeaderRecord(EPFFile* file, unsigned long line, char*** fields, const char* name, const char* prefix) {
+    int status;
+
+    if (file->readLines != line) {
+        return(_epfFail(file, EPF_ERROR_FORMAT, "%s should be line %lu (#%lu00)", name, line + 1, line + 3));
+    }
+    status = _getNextRecord(file, fields);
+    if (status < 0) {
+        return(status);
+    }
+    if (status != EPF_OK) {
+        return(_epfFail(file, EPF_ERROR_FORMAT, "Premature end of file (#%lu02)", line + 3));
+    }
+    if (
+        prefix && (
+            !(*fields)[0] ||
+            (strlen((*fields)[0]) < strlen(prefix)) ||
+            strncmp((*fields)[0], prefix, strlen(prefix))
+        )
+    ) {
+        return(_epfFail(file, EPF_ERROR_FORMAT, "Invalid %s record, probably not an EPF File", name));
+    }
+    for (size_t i = 0; (*fields)[i]; i++) {
+        if (strchr((*fields)[i], '\n')) {
+            return(_epfFail(file, EPF_ERROR_FORMAT, "Header records should not contain a new line, probably not an EPF File"));
         }
-        strncpy(fields[0], record, strlen(record) - 1);
     }
-    free(separatorMarkers);
-    if (commentField) {
-        free(record - 1);
-    } else {
-        free(record);
+    if (prefix) {
+        (*fields)[0] += strlen(prefix);
     }
-    return(fields);
+    return(EPF_OK);
 }
 
 /**
@@ -164,153 +303,114 @@ char** _getNextRecord(EPFFile* file) {
  *
  * \param file EPFFile instance.
  *
+ * \return EPF_OK or error status.
  */
-void _parseFieldNames(EPFFile* file) {
+int _parseFieldNames(EPFFile* file) {
     char** fieldNames = NULL;
-    EPFField** fields;
     unsigned int i = 0;
+    int status;
 
-    if (file->readLines != 0) {
-        error("Field names should be the first line (#300)");
-    }
-    fieldNames = _getNextRecord(file);
-    if (!fieldNames) {
-        error("Premature end of file (#302)");
+    if ((status = _readHeaderRecord(file, 0, &fieldNames, "Field names", NULL)) != EPF_OK) {
+        return(status);
     }
     while(fieldNames[i]) {
-        if (strstr(fieldNames[i], "\n")) {
-            error("Header records should not contain a new line, probably not an EPF File");
-        }
         i++;
     }
     if (i < 1) {
-        error("No field name defined, probably not an EPF File");
+        return(_epfFail(file, EPF_ERROR_FORMAT, "No field name defined, probably not an EPF File"));
     }
-    file->fieldsCount = i;
-    fields = malloc(i * sizeof(EPFField*));
-    if (!fields) {
-        error("Could not allocate memory");
+    file->fields = calloc(i, sizeof(EPFField*));
+    if (!file->fields) {
+        return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory (#301)"));
     }
-    i = 0;
-    while(fieldNames[i]) {
+    file->fieldsCount = i;
+    for(i = 0; fieldNames[i]; i++) {
         EPFField* field = calloc(1, sizeof(EPFField));
 
         if (!field) {
-            error("Could not allocate memory (#301)");
+            return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory (#301)"));
         }
-        if (epf2bsonOptions->verbose) {
-        	message("Declared field :%s", fieldNames[i]);
+        file->fields[i] = field;
+        if (file->message) {
+        	file->message("Declared field :%s", fieldNames[i]);
+        }
+        field->fieldName = strdup(fieldNames[i]);
+        if (!field->fieldName) {
+            return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory (#301)"));
         }
-        field->fieldName = fieldNames[i];
-        fields[i] = field;
-        i++;
     }
-    free(fieldNames);
-    file->fields = fields;
+    return(EPF_OK);
 }
 
 /**
  * Reads the second line aka indexed fields.
  *
  * \param file EPFFile instance.
+ *
+ * \return EPF_OK or error status.
  */
-void _parseIndexedFields(EPFFile* file) {
+int _parseIndexedFields(EPFFile* file) {
     char** fields = NULL;
-    char* correctedFirstField;
-    int i = 0;
+    int status;
 
-    if (file->readLines != 1) {
-        error("Indexed fields names should be the second line (#400)");
-    }
-    fields = _getNextRecord(file);
-    if (!fields) {
-        error("Premature end of file (#402)");
-    }
-    if (
-        !fields[0] ||
-        (strlen(fields[0]) < 11) ||
-        strncmp(fields[0], "primaryKey:", 11)
-    ) {
-        error("Invalid primaryKey record, probably not an EPF File");
+    if ((status = _readHeaderRecord(file, 1, &fields, "primaryKey", "primaryKey:")) != EPF_OK) {
+        return(status);
     }
-    correctedFirstField = calloc((strlen(fields[0]) - 11) + 1, sizeof(char));
-    if (!correctedFirstField) {
-        error("Could not allocate memory (#401)");
+    file->primaryKey = calloc(file->fieldsCount, sizeof(size_t));
+    if (!file->primaryKey) {
+        return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory (#403)"));
     }
-    strncpy(correctedFirstField, fields[0] + 11, (strlen(fields[0]) - 11));
-    free(fields[0]);
-    fields[0] = correctedFirstField;
-    while(fields[i]) {
-        if (strstr(fields[i], "\n")) {
-            error("Header records should not contain a new line, probably not an EPF File");
-        }
-        for(int j = 0; j < file->fieldsCount; j++) {
+    for(size_t i = 0; fields[i]; i++) {
+        for(size_t j = 0; j < file->fieldsCount; j++) {
             if (!strcmp(file->fields[j]->fieldName, fields[i])) {
+                if (!file->fields[j]->indexed) {
+                    file->primaryKey[file->primaryKeyCount++] = j;
+                }
                 file->fields[j]->indexed = true;
-		        if (epf2bsonOptions->verbose) {
-		        	message("Field '%s' is indexed", file->fields[j]->fieldName);
+		        if (file->message) {
+		        	file->message("Field '%s' is indexed", file->fields[j]->fieldName);
 		        }
                 break;
             }
         }
-        free(fields[i]);
-        i++;
     }
-    free(fields);
+    return(EPF_OK);
 }
 
 /**
  * Reads the third line aka fields type.
  *
  * \param file EPFFile instance.
+ *
+ * \return EPF_OK or error status.
  */
-void _parseFieldsType(EPFFile* file) {
+int _parseFieldsType(EPFFile* file) {
     char** fields = NULL;
-    char* correctedFirstField;
     char* capacitedTypeName;
     size_t i = 0;
     unsigned int capacity;
-    int scanRet;
+    int status;
 
-    if (file->readLines != 2) {
-        error("Field types should be the third line (#500)");
+    if ((status = _readHeaderRecord(file, 2, &fields, "dbTypes", "dbTypes:")) != EPF_OK) {
+        return(status);
     }
-    fields = _getNextRecord(file);
-    if (!fields) {
-        error("Premature end of file (#502)");
-    }
-    if (
-        !fields[0] ||
-        (strlen(fields[0]) < 8) ||
-        strncmp(fields[0], "dbTypes:", 8)
-    ) {
-        error("Invalid dbTypes record, probably not an EPF File");
-    }
-    correctedFirstField = calloc((strlen(fields[0]) - 8) + 1, sizeof(char));
-    if (!correctedFirstField) {
-        error("Could not allocate memory (#501)");
-    }
-    strncpy(correctedFirstField, fields[0] + 8, (strlen(fields[0]) - 8));
-    free(fields[0]);
-    fields[0] = correctedFirstField;
-    while(fields[i]) {
-        if (strstr(fields[i], "\n")) {
-            error("Header records should not contain a new line, probably not an EPF File");
+    for(i = 0; fields[i]; i++) {
+        if (i >= file->fieldsCount) {
+            return(_epfFail(file, EPF_ERROR_FORMAT, "Fields type count is not equal to fields count, aborting."));
         }
         capacitedTypeName = calloc(strlen(fields[i]) + 1, sizeof(char));
         if (!capacitedTypeName) {
-            error("Could not allocate memory");
+            return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory"));
         }
-        if ((scanRet = sscanf(fields[i], "%[^(](%d,%d)", capacitedTypeName, &capacity, &capacity)) == 3) {
+        if (sscanf(fields[i], "%[^(](%u,%u)", capacitedTypeName, &capacity, &capacity) == 3) {
             capacity = 1;
-        } else if ((scanRet = sscanf(fields[i], "%[^(](%d)", capacitedTypeName, &capacity)) != 2) {
+        } else if (sscanf(fields[i], "%[^(](%u)", capacitedTypeName, &capacity) != 2) {
             capacitedTypeName = strcpy(capacitedTypeName, fields[i]);
             capacity = 1;
         }
-        if (epf2bsonOptions->verbose) {
-        	message("Field '%s' is declared as %s", file->fields[i]->fieldName, fields[i]);
+        if (file->message) {
+        	file->message("Field '%s' is declared as %s", file->fields[i]->fieldName, fields[i]);
         }
-        free(fields[i]);
         if (!strncmp(capacitedTypeName, "BIGINT", 6)) {
             file->fields[i]->fieldType = EPF_FIELDTYPE_BIGINT;
         } else if (!strncmp(capacitedTypeName, "INTEGER", 7)) {
@@ -326,122 +426,724 @@ void _parseFieldsType(EPFFile* file) {
         } else if (!strncmp(capacitedTypeName, "DECIMAL", 7)) {
             file->fields[i]->fieldType = EPF_FIELDTYPE_DECIMAL;
         } else {
-            error("Invalid field type : %s", capacitedTypeName);
+            _epfFail(file, EPF_ERROR_FORMAT, "Invalid field type : %s", capacitedTypeName);
+            free(capacitedTypeName);
+            return(file->status);
         }
         free(capacitedTypeName);
         file->fields[i]->capacity = capacity;
-        i++;
     }
-    free(fields);
     if (i != file->fieldsCount) {
-        error("Fields type count is not equal to fields count, aborting.");
+        return(_epfFail(file, EPF_ERROR_FORMAT, "Fields type count is not equal to fields count, aborting."));
     }
+    return(EPF_OK);
 }
 
 /**
  * Reads the fourth line aka export mode (full / incremental).
  *
  * \param file EPFFile instance.
+ *
+ * \return EPF_OK or error status.
  */
-void _parseExportMode(EPFFile* file) {
+int _parseExportMode(EPFFile* file) {
     char** fields = NULL;
-    int i = 0;
+    int status;
 
-    if (file->readLines != 3) {
-        error("Export mode should be the fourth line (#600)");
+    if ((status = _readHeaderRecord(file, 3, &fields, "exportMode", "exportMode:")) != EPF_OK) {
+        return(status);
     }
-    fields = _getNextRecord(file);
-    if (!fields) {
-        error("Premature end of file (#601)");
-    }
-    if (
-        !fields[0] ||
-        (strlen(fields[0]) < 11) ||
-        strncmp(fields[0], "exportMode:", 11)
-    ) {
-        error("Invalid export mode, probably not an EPF File");
-    }
-    if (!strncmp(fields[0], "exportMode:FULL", 15)) {
+    if (!strncmp(fields[0], "FULL", 4)) {
         file->incremental = false;
-        if (epf2bsonOptions->verbose) {
-        	message("Full export mode declared");
+        if (file->message) {
+        	file->message("Full export mode declared");
         }
-    } else if (!strncmp(fields[0], "exportMode:INCREMENTAL", 22)) {
-        if (epf2bsonOptions->verbose) {
-        	message("Incremental export mode declared");
+    } else if (!strncmp(fields[0], "INCREMENTAL", 11)) {
+        if (file->message) {
+        	file->message("Incremental export mode declared");
         }
         file->incremental = true;
     } else {
-        error("Unknown export mode");
-    }
-    while(fields[i]) {
-        free(fields[i++]);
+        return(_epfFail(file, EPF_ERROR_FORMAT, "Unknown export mode"));
     }
-    free(fields);
+    return(EPF_OK);
 }
 
 /**
  * Skip all the following comment lines (Like ##LEGAL, etc.).
  *
  * \param file EPFFile instance.
+ *
+ * \return EPF_OK or error status.
  */
-void _parseSkipComments(EPFFile* file) {
+int _parseSkipComments(EPFFile* file) {
     char* record = NULL;
+    md5Context md5;
+    int status;
 
     if (file->readLines != 4) {
-        error("Comments lines should be after the fourth line (#700)");
+        return(_epfFail(file, EPF_ERROR_FORMAT, "Comments lines should be after the fourth line (#700)"));
     }
-    while ((record = _readRecord(file))) {
+    while (true) {
+        if (file->md5) {
+            md5 = *file->md5;
+        }
+        if ((status = _readRecord(file, &record)) != EPF_OK) {
+            return((status == EPF_EOF) ? EPF_OK : status);
+        }
         if (strncmp(record, "##", 2)) {
-            fseek(file->fp, file->lastEntryOffset, SEEK_SET);
-            free(record);
-            break;
+            //First entry is read again, so is hashed again.
+            if (file->md5) {
+                *file->md5 = md5;
+            }
+            if (fseek(file->fp, file->lastEntryOffset, SEEK_SET)) {
+                return(_epfFail(file, EPF_ERROR_READ, "Could not read record in file (#101) : %s", strerror(errno)));
+            }
+            return(EPF_OK);
+        }
+    }
+}
+
+
+
+/**
+ * Parses fixed width digits.
+ *
+ * \param raw    Raw value.
+ * \param digits Digits count.
+ * \param value  Parsed value.
+ *
+ * \return False if a character is not a digit.
+ */
+bool _parseDigits(const char* raw, size_t digits, unsigned int* value) {
+    *value = 0;
+    for (size_t i = 0; i < digits; i++) {
+        if ((raw[i] < '0') || (raw[i] > '9')) {
+            return(false);
+        }
+        *value = *value * 10 + (raw[i] - '0');
+    }
+    return(true);
+}
+
+/**
+ * Parses the "YYYY MM DD" (or "YYYY-MM-DD") prefix of a datetime.
+ *
+ * \param raw      Raw value (at least 10 bytes).
+ * \param epochDay Days since the Unix epoch.
+ *
+ * \return False if value does not start with a valid date.
+ */
+bool _parseDate(const char* raw, int64_t* epochDay) {
+    static const unsigned char monthDays[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    unsigned int year, month, day;
+    int64_t era, yearOfEra, dayOfYear;
+
+    if (
+        !_parseDigits(raw, 4, &year) ||
+        ((raw[4] != ' ') && (raw[4] != '-')) ||
+        (raw[7] != raw[4]) ||
+        !_parseDigits(raw + 5, 2, &month) ||
+        !_parseDigits(raw + 8, 2, &day) ||
+        (month < 1) || (month > 12) ||
+        (day < 1) || (day > monthDays[month - 1]) ||
+        ((month == 2) && (day == 29) && ((year % 4) || (!(year % 100) && (year % 400))))
+    ) {
+        return(false);
+    }
+    //Proleptic Gregorian calendar, years starting in March (leap day last).
+    yearOfEra = (int64_t) year - (month <= 2);
+    era = (yearOfEra >= 0 ? yearOfEra : yearOfEra - 399) / 400;
+    yearOfEra -= era * 400;
+    dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    *epochDay = era * 146097 + yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear - 719468;
+    return(true);
+}
+
+/**
+ * Parses a datetime given as seconds since the Unix epoch (digits only).
+ *
+ * \param raw          Raw value.
+ * \param length       Raw value length.
+ * \param milliseconds Milliseconds since the Unix epoch.
+ *
+ * \return False if value is not only digits (or too long to fit).
+ */
+bool _parseEpochSeconds(const char* raw, size_t length, int64_t* milliseconds) {
+    int64_t seconds = 0;
+
+    //Up to 15 digits cannot overflow once in milliseconds.
+    if (!length || (length > 15)) {
+        return(false);
+    }
+    for (size_t i = 0; i < length; i++) {
+        if ((unsigned char)(raw[i] - '0') > 9) {
+            return(false);
         }
-        free(record);
+        seconds = seconds * 10 + (raw[i] - '0');
     }
+    *milliseconds = seconds * 1000;
+    return(true);
 }
 
+/**
+ * Gets days since the Unix epoch of a datetime date, from file dates cache.
+ *
+ * \param file     EPFFile instance.
+ * \param raw      Raw value (at least 10 bytes).
+ * \param epochDay Days since the Unix epoch.
+ *
+ * \return False if value does not start with a date.
+ */
+bool _cachedDate(EPFFile* file, const char* raw, int64_t* epochDay) {
+    EPFDateSlot* slot;
+    uint64_t prefix;
+    uint16_t suffix;
 
+    memcpy(&prefix, raw, sizeof(uint64_t));
+    memcpy(&suffix, raw + sizeof(uint64_t), sizeof(uint16_t));
+    slot = &file->dates[((prefix ^ suffix) * 0x9E3779B97F4A7C15ULL) >> (64 - EPF_DATE_CACHE_BITS)];
+    if ((slot->prefix == prefix) && (slot->suffix == suffix)) {
+        *epochDay = slot->epochDay;
+        return(true);
+    }
+    if (!_parseDate(raw, epochDay)) {
+        return(false);
+    }
+    slot->prefix = prefix;
+    slot->suffix = suffix;
+    slot->epochDay = *epochDay;
+    return(true);
+}
+
+/**
+ * Tells if a batch value is null.
+ *
+ * \param batch Batch.
+ * \param field Field index.
+ * \param row   Entry index.
+ *
+ * \return True if null.
+ */
+bool _batchIsNull(EPFBatch* batch, size_t field, size_t row) {
+    return(batch->nulls[field * ((batch->capacity + 7) / 8) + row / 8] & (1 << (row % 8)));
+}
 
 /**
- * Read EPF file header to get file infos and return an instance of EPFFile.
+ * Integers kernel (BIGINT, INTEGER) : converts a batch column.
  *
- * \param fp File pointer to EPF file.
+ * \param batch Batch.
+ * \param field Field index.
+ */
+void _batchIntegers(EPFBatch* batch, size_t field) {
+    char** raw = batch->columns + field * batch->capacity;
+    size_t* lengths = batch->lengths + field * batch->capacity;
+    EPFValue* value;
+    size_t row;
+    int64_t integer;
+    size_t i;
+
+    for (size_t selected = 0; selected < batch->selected; selected++) {
+        row = batch->selection[selected];
+        value = batch->values + row * batch->fieldsCount + field;
+        if (_batchIsNull(batch, field, row)) {
+            continue;
+        }
+        i = (raw[row][0] == '-');
+        integer = 0;
+        //Up to 18 digits cannot overflow, anything else goes through strtol().
+        if (lengths[row] - i <= 18) {
+            for (; (i < lengths[row]) && ((unsigned char)(raw[row][i] - '0') <= 9); i++) {
+                integer = integer * 10 + (raw[row][i] - '0');
+            }
+        }
+        if (i == lengths[row]) {
+            value->integer = (raw[row][0] == '-') ? -integer : integer;
+        } else {
+            value->integer = strtol(raw[row], NULL, 10);
+        }
+    }
+}
+
+/**
+ * Booleans kernel : converts a batch column.
  *
- * \return Parsed data.
+ * \param batch Batch.
+ * \param field Field index.
  */
-EPFFile* epfInit(FILE* fp) {
+void _batchBooleans(EPFBatch* batch, size_t field) {
+    char** raw = batch->columns + field * batch->capacity;
+    EPFValue* value;
+    size_t row;
+
+    for (size_t selected = 0; selected < batch->selected; selected++) {
+        row = batch->selection[selected];
+        value = batch->values + row * batch->fieldsCount + field;
+        if (!_batchIsNull(batch, field, row)) {
+            value->integer = (raw[row][0] != '0');
+        }
+    }
+}
+
+/**
+ * Datetimes kernel : converts a batch column.
+ *
+ * \param file  EPFFile instance.
+ * \param batch Batch.
+ * \param field Field index.
+ */
+void _batchDatetimes(EPFFile* file, EPFBatch* batch, size_t field) {
+    char** raw = batch->columns + field * batch->capacity;
+    size_t* lengths = batch->lengths + field * batch->capacity;
+    EPFValue* value;
+    size_t row;
+
+    for (size_t selected = 0; selected < batch->selected; selected++) {
+        row = batch->selection[selected];
+        value = batch->values + row * batch->fieldsCount + field;
+        if (
+            !_batchIsNull(batch, field, row) &&
+            !epfParseDatetime(file, raw[row], lengths[row], &value->integer) &&
+            !_parseEpochSeconds(raw[row], lengths[row], &value->integer)
+        ) {
+            //Neither a datetime nor seconds since the Unix epoch.
+            value->integer = 0;
+            value->isNull = true;
+            batch->nulls[field * ((batch->capacity + 7) / 8) + row / 8] |= 1 << (row % 8);
+        }
+    }
+}
+
+/**
+ * Decimals kernel : converts a batch column.
+ *
+ * \param batch Batch.
+ * \param field Field index.
+ */
+void _batchDecimals(EPFBatch* batch, size_t field) {
+    char** raw = batch->columns + field * batch->capacity;
+    EPFValue* value;
+    size_t row;
+
+    for (size_t selected = 0; selected < batch->selected; selected++) {
+        row = batch->selection[selected];
+        value = batch->values + row * batch->fieldsCount + field;
+        if (!_batchIsNull(batch, field, row)) {
+            value->decimal = strtod(raw[row], NULL);
+        }
+    }
+}
+
+/**
+ * Copies an entry read in file record buffer to a batch.
+ *
+ * \param file  EPFFile instance.
+ * \param batch Batch.
+ * \param entry Raw entry as returned by epfRead().
+ *
+ * \return EPF_OK or error status.
+ */
+int _batchAppend(EPFFile* file, EPFBatch* batch, char** entry) {
+    size_t row = batch->rows;
+    size_t last = batch->fieldsCount - 1;
+    char* grown;
+
+    if (batch->dataLength + file->recordLength > batch->dataAllocated) {
+        grown = realloc(batch->data, (batch->dataLength + file->recordLength) * 2);
+        if (!grown) {
+            return(_epfFail(file, EPF_ERROR_MEMORY, "Could not allocate memory storing batch records (#202)"));
+        }
+        batch->data = grown;
+        batch->dataAllocated = (batch->dataLength + file->recordLength) * 2;
+    }
+    //Fields are split in place : the record buffer holds each value and its NUL.
+    memcpy(batch->data + batch->dataLength, file->record, file->recordLength);
+    for (size_t i = 0; i < last; i++) {
+        batch->starts[i * batch->capacity + row] = batch->dataLength + (entry[i] - file->record);
+        batch->lengths[i * batch->capacity + row] = entry[i + 1] - entry[i] - 1;
+    }
+    batch->starts[last * batch->capacity + row] = batch->dataLength + (entry[last] - file->record);
+    batch->lengths[last * batch->capacity + row] = file->record + file->recordLength - 1 - entry[last];
+    batch->offsets[row] = file->lastEntryOffset;
+    batch->dataLength += file->recordLength;
+    batch->rows++;
+    return(EPF_OK);
+}
+
+
+
+/**
+ * Creates a reader of an EPF file.
+ *
+ * \param fp      File pointer to EPF file (positioned at file start).
+ * \param options Reader options (EPF_OPTION_* flags).
+ *
+ * \return Reader, NULL if memory could not be allocated.
+ */
+EPFFile* epfCreate(FILE* fp, int options) {
     EPFFile* file;
 
-    file = malloc(sizeof(EPFFile));
+    file = calloc(1, sizeof(EPFFile));
     if (!file) {
-        error("Could not allocate memory");
+        return(NULL);
     }
     file->fp = fp;
+    file->options = options;
     file->fieldsCount = -1;
-    file->readLines = file->readEntries = 0;
-    _parseFieldNames(file);
-    _parseIndexedFields(file);
-    _parseFieldsType(file);
-    _parseExportMode(file);
-    _parseSkipComments(file);
-    file->ready = true;
+    file->status = EPF_OK;
+    if (options & EPF_OPTION_MD5) {
+        file->md5 = malloc(sizeof(md5Context));
+        if (!file->md5) {
+            free(file);
+            return(NULL);
+        }
+        md5Init(file->md5);
+    }
+    if (options & EPF_OPTION_DROP_BEHIND) {
+        posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
     return(file);
 }
 
 /**
- * Get an entry from collection.
+ * Reads EPF file header (fields, primary key, types, export mode).
  *
  * \param file EPFFile instance.
  *
- * \return Raw entry data (as strings) or null if EOF.
+ * \return EPF_OK or error status (message from epfError()).
  */
-char** epfNextEntry(EPFFile* file) {
-    
+int epfReadHeader(EPFFile* file) {
+    int status;
+
+    if (file->ready || (file->status != EPF_OK)) {
+        return(file->ready ? EPF_OK : file->status);
+    }
+    if (
+        ((status = _parseFieldNames(file)) != EPF_OK) ||
+        ((status = _parseIndexedFields(file)) != EPF_OK) ||
+        ((status = _parseFieldsType(file)) != EPF_OK) ||
+        ((status = _parseExportMode(file)) != EPF_OK) ||
+        ((status = _parseSkipComments(file)) != EPF_OK)
+    ) {
+        if (file->fieldsCount == (size_t)-1) {
+            file->fieldsCount = 0;
+        }
+        return(status);
+    }
+    file->ready = true;
+    return(EPF_OK);
+}
+
+/**
+ * Reads next entry.
+ *
+ * \param file  EPFFile instance (header read).
+ * \param entry Raw entry data (as strings, owned by file and valid until next
+ *              read), set if EPF_OK is returned.
+ *
+ * \return EPF_OK, EPF_COMMENT or EPF_SKIPPED (nothing read, go on reading),
+ *         EPF_EOF or error status (message from epfError()).
+ */
+int epfRead(EPFFile* file, char*** entry) {
+    int status;
+
+    if (file->status != EPF_OK) {
+        return(file->status);
+    }
     if (!file->ready) {
-        error("EPF File is not initialized");
+        return(_epfFail(file, EPF_ERROR_FORMAT, "EPF File is not initialized"));
+    }
+    status = _getNextRecord(file, entry);
+    if (status == EPF_OK) {
+        file->readEntries++;
     }
-    return(_getNextRecord(file));
+    return(status);
+}
+
+/**
+ * Get last error message.
+ *
+ * \param file EPFFile instance.
+ *
+ * \return Error message, empty if none.
+ */
+const char* epfError(EPFFile* file) {
+    return(file->error);
+}
+
+/**
+ * Parses a datetime : "YYYY MM DD" (or "YYYY-MM-DD"), optionally followed by
+ * " HH:MM:SS" (or "THH:MM:SS") and a fraction of second, as UTC.
+ *
+ * \param file         EPFFile instance, whose dates cache is used, NULL for none.
+ * \param raw          Raw value.
+ * \param length       Raw value length.
+ * \param milliseconds Milliseconds since the Unix epoch.
+ *
+ * \return False if value is not a datetime.
+ */
+bool epfParseDatetime(EPFFile* file, const char* raw, size_t length, int64_t* milliseconds) {
+    unsigned int hour, minute, second, fraction = 0;
+    int64_t epochDay;
+
+    if ((length < 10) || !(file ? _cachedDate(file, raw, &epochDay) : _parseDate(raw, &epochDay))) {
+        return(false);
+    }
+    *milliseconds = epochDay * 86400000;
+    if (length == 10) {
+        return(true);
+    }
+    if (
+        (length < 19) ||
+        ((raw[10] != ' ') && (raw[10] != 'T')) ||
+        (raw[13] != ':') ||
+        (raw[16] != ':') ||
+        !_parseDigits(raw + 11, 2, &hour) ||
+        !_parseDigits(raw + 14, 2, &minute) ||
+        !_parseDigits(raw + 17, 2, &second) ||
+        (hour > 23) || (minute > 59) || (second > 60)
+    ) {
+        return(false);
+    }
+    if (length > 19) {
+        if ((raw[19] != '.') || (length == 20)) {
+            return(false);
+        }
+        for (size_t i = 20; i < length; i++) {
+            if ((raw[i] < '0') || (raw[i] > '9')) {
+                return(false);
+            }
+            if (i < 23) {
+                fraction = fraction * 10 + (raw[i] - '0');
+            }
+        }
+        for (size_t i = length; i < 23; i++) {
+            fraction *= 10;
+        }
+    }
+    *milliseconds += ((hour * 60 + minute) * 60 + second) * 1000 + fraction;
+    return(true);
+}
+
+/**
+ * Converts a raw value to its typed value.
+ *
+ * \param file      EPFFile instance.
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ * \param raw       Raw value.
+ * \param value     Typed value.
+ */
+void epfConvertValue(EPFFile* file, unsigned char fieldType, char* raw, EPFValue* value) {
+    value->string = raw;
+    value->length = strlen(raw);
+    value->isNull = !value->length;
+    value->integer = 0;
+    value->decimal = 0;
+    if (value->isNull) {
+        return;
+    }
+    switch(fieldType) {
+        case EPF_FIELDTYPE_BIGINT :
+        case EPF_FIELDTYPE_INTEGER :
+            value->integer = strtol(raw, NULL, 10);
+            break;
+        case EPF_FIELDTYPE_BOOLEAN :
+            value->integer = strncmp("0", raw, 1) ? 1 : 0;
+            break;
+        case EPF_FIELDTYPE_DATETIME :
+            if (
+                !epfParseDatetime(file, raw, value->length, &value->integer) &&
+                !_parseEpochSeconds(raw, value->length, &value->integer)
+            ) {
+                //Neither a datetime nor seconds since the Unix epoch.
+                value->integer = 0;
+                value->isNull = true;
+            }
+            break;
+        case EPF_FIELDTYPE_DECIMAL :
+            value->decimal = strtod(raw, NULL);
+            break;
+        case EPF_FIELDTYPE_VARCHAR :
+        case EPF_FIELDTYPE_LONGTEXT :
+        default :
+            //Unknown types are rejected when reading header.
+            break;
+    }
+}
+
+/**
+ * Converts a raw entry to typed values.
+ *
+ * \param file   EPFFile instance.
+ * \param entry  Raw entry as returned by epfRead().
+ * \param values Typed values (fieldsCount values).
+ */
+void epfConvertEntry(EPFFile* file, char** entry, EPFValue* values) {
+    for (size_t i = 0; i < file->fieldsCount; i++) {
+        if (!entry[i]) {
+            for (; i < file->fieldsCount; i++) {
+                values[i].isNull = true;
+                values[i].string = NULL;
+                values[i].length = 0;
+            }
+            break;
+        }
+        epfConvertValue(file, file->fields[i]->fieldType, entry[i], &values[i]);
+    }
+}
+
+/**
+ * Creates a batch of entries.
+ *
+ * \param file     EPFFile instance (header parsed).
+ * \param capacity Maximum entries count.
+ * \param maxBytes Records bytes a batch is cut at.
+ *
+ * \return Batch, NULL if memory could not be allocated.
+ */
+EPFBatch* epfBatchCreate(EPFFile* file, size_t capacity, size_t maxBytes) {
+    EPFBatch* batch;
+
+    batch = calloc(1, sizeof(EPFBatch));
+    if (!batch) {
+        return(NULL);
+    }
+    batch->fieldsCount = file->fieldsCount;
+    batch->capacity = capacity;
+    batch->maxBytes = maxBytes;
+    batch->starts = calloc(file->fieldsCount * capacity, sizeof(size_t));
+    batch->columns = calloc(file->fieldsCount * capacity, sizeof(char*));
+    batch->lengths = calloc(file->fieldsCount * capacity, sizeof(size_t));
+    batch->nulls = calloc(file->fieldsCount * ((capacity + 7) / 8), sizeof(unsigned char));
+    batch->entries = calloc((file->fieldsCount + 1) * capacity, sizeof(char*));
+    batch->values = calloc(file->fieldsCount * capacity, sizeof(EPFValue));
+    batch->offsets = calloc(capacity, sizeof(unsigned long));
+    batch->selection = calloc(capacity, sizeof(size_t));
+    if (
+        !batch->starts || !batch->columns || !batch->lengths || !batch->nulls ||
+        !batch->entries || !batch->values || !batch->offsets || !batch->selection
+    ) {
+        epfBatchDestroy(batch);
+        return(NULL);
+    }
+    return(batch);
+}
+
+/**
+ * Reads next entries in a batch (malformed records and comments skipped).
+ *
+ * \param file  EPFFile instance.
+ * \param batch Batch, previous entries are replaced.
+ *
+ * \return EPF_OK (at least one entry read, all selected), EPF_EOF or error
+ *         status (entries read before the error are dropped).
+ */
+int epfReadBatch(EPFFile* file, EPFBatch* batch) {
+    char** entry;
+    char* value;
+    int status = EPF_OK;
+
+    batch->rows = 0;
+    batch->selected = 0;
+    batch->dataLength = 0;
+    while ((batch->rows < batch->capacity) && (batch->dataLength < batch->maxBytes)) {
+        status = epfRead(file, &entry);
+        if ((status == EPF_COMMENT) || (status == EPF_SKIPPED)) {
+            continue;
+        }
+        if (status == EPF_OK) {
+            status = _batchAppend(file, batch, entry);
+        }
+        if (status != EPF_OK) {
+            break;
+        }
+    }
+    if (status < 0) {
+        batch->rows = 0;
+        return(status);
+    }
+    //Records copies are complete (and no longer move) : resolve values.
+    for (size_t i = 0; i < batch->fieldsCount; i++) {
+        for (size_t row = 0; row < batch->rows; row++) {
+            value = batch->data + batch->starts[i * batch->capacity + row];
+            batch->columns[i * batch->capacity + row] = value;
+            batch->entries[row * (batch->fieldsCount + 1) + i] = value;
+        }
+    }
+    for (size_t row = 0; row < batch->rows; row++) {
+        batch->entries[row * (batch->fieldsCount + 1) + batch->fieldsCount] = NULL;
+        batch->selection[row] = row;
+    }
+    batch->selected = batch->rows;
+    return(batch->rows ? EPF_OK : EPF_EOF);
+}
+
+/**
+ * Converts selected batch raw values to typed values, one field at a time.
+ *
+ * \param file  EPFFile instance.
+ * \param batch Batch.
+ */
+void epfConvertBatch(EPFFile* file, EPFBatch* batch) {
+    size_t bitmapSize = (batch->capacity + 7) / 8;
+    unsigned char* nulls;
+    EPFValue* value;
+    size_t row;
+
+    for (size_t i = 0; i < batch->fieldsCount; i++) {
+        nulls = batch->nulls + i * bitmapSize;
+        memset(nulls, 0, bitmapSize);
+        for (size_t selected = 0; selected < batch->selected; selected++) {
+            row = batch->selection[selected];
+            value = batch->values + row * batch->fieldsCount + i;
+            value->string = batch->columns[i * batch->capacity + row];
+            value->length = batch->lengths[i * batch->capacity + row];
+            value->isNull = !value->length;
+            value->integer = 0;
+            value->decimal = 0;
+            if (value->isNull) {
+                nulls[row / 8] |= 1 << (row % 8);
+            }
+        }
+        switch(file->fields[i]->fieldType) {
+            case EPF_FIELDTYPE_BIGINT :
+            case EPF_FIELDTYPE_INTEGER :
+                _batchIntegers(batch, i);
+                break;
+            case EPF_FIELDTYPE_BOOLEAN :
+                _batchBooleans(batch, i);
+                break;
+            case EPF_FIELDTYPE_DATETIME :
+                _batchDatetimes(file, batch, i);
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                _batchDecimals(batch, i);
+                break;
+            case EPF_FIELDTYPE_VARCHAR :
+            case EPF_FIELDTYPE_LONGTEXT :
+            default :
+                //Strings are raw values.
+                break;
+        }
+    }
+}
+
+/**
+ * Destroy a batch and release memory.
+ *
+ * \param batch Batch.
+ */
+void epfBatchDestroy(EPFBatch* batch) {
+    free(batch->data);
+    free(batch->starts);
+    free(batch->columns);
+    free(batch->lengths);
+    free(batch->nulls);
+    free(batch->entries);
+    free(batch->values);
+    free(batch->offsets);
+    free(batch->selection);
+    free(batch);
 }
 
 /**
@@ -477,6 +1179,25 @@ size_t epfGetFieldCapacity(EPFFile* file, size_t index) {
 }
 
 
+/**
+ * Get MD5 digest of the whole file (read up to EOF).
+ *
+ * \param file   EPFFile instance.
+ * \param digest Digest (MD5_DIGEST_LENGTH bytes).
+ *
+ * \return False if checksum was not computed (--verify-md5 not set).
+ */
+bool epfDigest(EPFFile* file, unsigned char* digest) {
+    md5Context md5;
+
+    if (!file->md5) {
+        return(false);
+    }
+    md5 = *file->md5;
+    md5Final(&md5, digest);
+    return(true);
+}
+
 /**
  * Destroy an EPF file object and release memory.
  *
@@ -484,12 +1205,17 @@ size_t epfGetFieldCapacity(EPFFile* file, size_t index) {
  */
 void epfDestroy(EPFFile* file) {
     
-    for (int i = 0; i < file->fieldsCount; i++) {
+    for (size_t i = 0; file->fields && (i < file->fieldsCount); i++) {
         if (file->fields[i]) {
             free(file->fields[i]->fieldName);
             free(file->fields[i]);
         }
     }
-    free(file->fields);   
+    free(file->fields);
+    free(file->primaryKey);
+    free(file->record);
+    free(file->line);
+    free(file->entry);
+    free(file->md5);
     free(file);
 }
@@ -35,7 +35,56 @@ void usage() {
     fputs("\t-e --epf       <directory>     EPF files directory.\n", stderr);
     fputs("\t-n --dbName    <name>          MongoDB database name to dump for.\n", stderr);
     fputs("\t-d --dumpdir   <path>          NON EXISTANT dump directory path to export to. Defaults to './dump'\n", stderr);
+    fputs("\t                               (optional with --mongo-uri, unless Arrow, NDJSON or stats outputs are asked for)\n", stderr);
     fputs("\t-l --list      <list>          List of EPF collections (comma separated) to export. Defaults to all\n", stderr);
+    fputs("\t-w --where     <clauses>       Only export rows matching all clauses (';' separated, may be repeated).\n", stderr);
+    fputs("\t                               Clause is <field><op><value>, op being =, !=, <, <=, >, >= or ^= (prefix).\n", stderr);
+    fputs("\t                               = and != accept a comma separated list (EG: storefront_id=143441,143444)\n", stderr);
+    fputs("\t-s --shards    <count>         Split each collection in <count> files (<collection>.shard<N>.bson)\n", stderr);
+    fputs("\t-k --shard-key <field>         Field whose hash selects the shard of a row (required with --shards)\n", stderr);
+    fputs("\t   --sort-by-pk                Write documents ordered by the EPF primary key (external merge sort)\n", stderr);
+    fputs("\t   --sort-memory <MB>          Memory used to sort before spilling to temporary files. Defaults to 256\n", stderr);
+    fputs("\t   --tmpdir  <directory>       Temporary files directory. Defaults to dump directory ($TMPDIR or /tmp if none)\n", stderr);
+    fputs("\t   --pk-id                     Use the EPF primary key as documents _id (embedded document if composite)\n", stderr);
+    fputs("\t                               instead of a generated ObjectId. A single column key is then not indexed twice\n", stderr);
+    fputs("\t   --cache-dir <directory>     Keep parsed EPF files in a binary columnar cache, later runs on unchanged\n", stderr);
+    fputs("\t                               files read it instead of parsing EPF files again\n", stderr);
+    fputs("\t   --arrow                     Also write exported entries as an Arrow IPC (Feather v2) file per\n", stderr);
+    fputs("\t                               collection, same entries and order as the BSON documents\n", stderr);
+    fputs("\t   --arrow-batch-rows <rows>   Rows per Arrow record batch (default 65536)\n", stderr);
+    fputs("\t   --ndjson                    Also write exported entries as NDJSON (MongoDB relaxed Extended JSON,\n", stderr);
+    fputs("\t                               one document per line) in <collection>.ndjson\n", stderr);
+    fputs("\t   --batch-rows <rows>         Entries read and converted column by column at once (default 4096,\n", stderr);
+    fputs("\t                               0 to convert entries one at a time)\n", stderr);
+    fputs("\t   --invalid-utf8 <mode>       Strings with invalid UTF-8 : replace (sequences by U+FFFD, default),\n", stderr);
+    fputs("\t                               reject (skip the row) or pass (export them unchanged)\n", stderr);
+    fputs("\t   --mongo-uri <uri>           Insert documents into a MongoDB server (mongodb://host[:port])\n", stderr);
+    fputs("\t                               instead of writing BSON files\n", stderr);
+    fputs("\t   --mongo-connections <n>     Connections to MongoDB server (default 4)\n", stderr);
+    fputs("\t   --merge-base <dir>          Merge EPF files into a previous dump (its BSON files, written with\n", stderr);
+    fputs("\t                               --sort-by-pk) : the new dump keeps the latest entry of each primary key\n", stderr);
+    fputs("\t   --merge-epf <dir>           Older incremental EPF files to merge before --epf ones, can be repeated\n", stderr);
+    fputs("\t   --dedup <mode>              Keep only the first or last entry of each primary key (first, last)\n", stderr);
+    fputs("\t                               in input order, the EPF file being read twice (once with --sort-by-pk)\n", stderr);
+    fputs("\t   --mmap-output               Preallocate BSON files from a size estimate and write them through\n", stderr);
+    fputs("\t                               a memory mapping instead of stdio\n", stderr);
+    fputs("\t   --verify-md5                Check each EPF file against its <file>.md5 while converting it\n", stderr);
+    fputs("\t   --check                     Only check EPF files (field counts, values syntax, UTF-8, entries\n", stderr);
+    fputs("\t                               count) and report, nothing is written. -n and -d are not needed\n", stderr);
+    fputs("\t   --reject-file <path>        Append malformed records, in raw form with their file and offset, to <path>\n", stderr);
+    fputs("\t   --max-errors <count>        Abort once more than <count> records are rejected. Defaults to no limit\n", stderr);
+    fputs("\t   --max-memory <MB>           Memory budget (at least 64) : bounds sort memory, writers buffers and\n", stderr);
+    fputs("\t                               records length (a longer record aborts). Defaults to no limit\n", stderr);
+    fputs("\t   --drop-behind               Read EPF files ahead and write BSON files back as they go, dropping\n", stderr);
+    fputs("\t                               their pages from page cache once used (for hosts running mongod)\n", stderr);
+    fputs("\t   --stats                     Write per column statistics (null counts, ranges, strings lengths and\n", stderr);
+    fputs("\t                               approximate distinct counts) in <collection>.stats.json, of the\n", stderr);
+    fputs("\t                               exported documents (after deduplication or merge)\n", stderr);
+    fputs("\t   --manifest                  Write inputs (size, mtime, content hash) and outputs of each collection\n", stderr);
+    fputs("\t                               in EPF2Bson.manifest\n", stderr);
+    fputs("\t   --reuse <dir>               Hard link (or copy) outputs of a previous dump written with --manifest\n", stderr);
+    fputs("\t                               (its database directory) for unchanged inputs instead of converting them\n", stderr);
+    fputs("\t   --bson-crc32c               Write the CRC32C of each BSON file in <file>.crc32c\n", stderr);
     fputs("\n", stderr);
     fputs("\n\n", stderr);
 }
@@ -0,0 +1,435 @@
+/**
+ * Rows filtering (--where).
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "epf.h"
+#include "filter.h"
+
+/**
+ * Duplicates a string part, without leading and trailing spaces.
+ *
+ * \param start  String start.
+ * \param length String length.
+ *
+ * \return Trimmed copy.
+ */
+char* _filterTrimmedCopy(char* start, size_t length) {
+    char* copy;
+
+    while (length && isspace((unsigned char)start[0])) {
+        start++;
+        length--;
+    }
+    while (length && isspace((unsigned char)start[length - 1])) {
+        length--;
+    }
+    copy = calloc(length + 1, sizeof(char));
+    if (!copy) {
+        error("Cannot allocate memory");
+    }
+    memcpy(copy, start, length);
+    return(copy);
+}
+
+/**
+ * Parse a raw integer field.
+ *
+ * \param value  Raw value.
+ * \param result Parsed value.
+ *
+ * \return True on success, false if value is not an integer.
+ */
+bool _filterParseInteger(const char* value, int64_t* result) {
+    uint64_t parsed = 0;
+    bool negative = false;
+
+    if (*value == '-') {
+        negative = true;
+        value++;
+    } else if (*value == '+') {
+        value++;
+    }
+    if (!*value) {
+        return(false);
+    }
+    while (*value) {
+        if ((*value < '0') || (*value > '9')) {
+            return(false);
+        }
+        parsed = (parsed * 10) + (*value - '0');
+        value++;
+    }
+    *result = negative ? -(int64_t)parsed : (int64_t)parsed;
+    return(true);
+}
+
+/**
+ * Parse one clause and append it to filter.
+ *
+ * \param rowFilter Filter instance.
+ * \param clause    Clause expression.
+ */
+void _filterParseClause(filter* rowFilter, char* clause) {
+    filterClause* parsed;
+    char* operatorStart = NULL;
+    size_t operatorLength = 0;
+    char* valuesStart;
+    char* valueStart;
+
+    for (char* position = clause; *position; position++) {
+        if (
+            ((position[0] == '!') || (position[0] == '<') || (position[0] == '>') || (position[0] == '^')) &&
+            (position[1] == '=')
+        ) {
+            operatorStart = position;
+            operatorLength = 2;
+            break;
+        }
+        if ((position[0] == '=') || (position[0] == '<') || (position[0] == '>')) {
+            operatorStart = position;
+            operatorLength = 1;
+            break;
+        }
+    }
+    if (!operatorStart) {
+        error("Invalid filter clause, no operator : %s", clause);
+    }
+    parsed = calloc(1, sizeof(filterClause));
+    if (!parsed) {
+        error("Cannot allocate memory");
+    }
+    parsed->fieldName = _filterTrimmedCopy(clause, operatorStart - clause);
+    if (!strlen(parsed->fieldName)) {
+        error("Invalid filter clause, no field name : %s", clause);
+    }
+    if (operatorLength == 2) {
+        switch (operatorStart[0]) {
+            case '!' :
+                parsed->operator = FILTER_OP_NOTEQUAL;
+                break;
+            case '<' :
+                parsed->operator = FILTER_OP_LOWEREQUAL;
+                break;
+            case '>' :
+                parsed->operator = FILTER_OP_GREATEREQUAL;
+                break;
+            default :
+                parsed->operator = FILTER_OP_PREFIX;
+        }
+    } else {
+        switch (operatorStart[0]) {
+            case '<' :
+                parsed->operator = FILTER_OP_LOWER;
+                break;
+            case '>' :
+                parsed->operator = FILTER_OP_GREATER;
+                break;
+            default :
+                parsed->operator = FILTER_OP_EQUAL;
+        }
+    }
+    valuesStart = operatorStart + operatorLength;
+    parsed->valuesCount = 1;
+    if ((parsed->operator == FILTER_OP_EQUAL) || (parsed->operator == FILTER_OP_NOTEQUAL)) {
+        for (char* position = valuesStart; *position; position++) {
+            if (*position == ',') {
+                parsed->valuesCount++;
+            }
+        }
+    }
+    parsed->values = calloc(parsed->valuesCount, sizeof(char*));
+    parsed->valuesLength = calloc(parsed->valuesCount, sizeof(size_t));
+    parsed->integerValues = calloc(parsed->valuesCount, sizeof(int64_t));
+    parsed->decimalValues = calloc(parsed->valuesCount, sizeof(double));
+    if (!parsed->values || !parsed->valuesLength || !parsed->integerValues || !parsed->decimalValues) {
+        error("Cannot allocate memory");
+    }
+    valueStart = valuesStart;
+    for (size_t i = 0; i < parsed->valuesCount; i++) {
+        char* valueEnd = valueStart;
+
+        while (*valueEnd && ((*valueEnd != ',') || (parsed->valuesCount == 1))) {
+            valueEnd++;
+        }
+        parsed->values[i] = _filterTrimmedCopy(valueStart, valueEnd - valueStart);
+        parsed->valuesLength[i] = strlen(parsed->values[i]);
+        valueStart = valueEnd + 1;
+    }
+    parsed->fieldIndex = -1;
+    rowFilter->clauses = realloc(rowFilter->clauses, (rowFilter->clausesCount + 1) * sizeof(filterClause*));
+    if (!rowFilter->clauses) {
+        error("Cannot allocate memory");
+    }
+    rowFilter->clauses[rowFilter->clausesCount++] = parsed;
+}
+
+/**
+ * Compare a raw value with a clause value.
+ *
+ * \param clause Clause.
+ * \param index  Clause value index.
+ * \param value  Raw field value.
+ * \param length Raw field value length.
+ * \param result Comparison result (<0, 0, >0 like strcmp()).
+ *
+ * \return False if raw value cannot be compared (invalid number).
+ */
+bool _filterCompare(filterClause* clause, size_t index, char* value, size_t length, int* result) {
+    int64_t integerValue;
+    double decimalValue;
+    char* end;
+
+    switch (clause->compare) {
+        case FILTER_COMPARE_INTEGER :
+            if (!_filterParseInteger(value, &integerValue)) {
+                return(false);
+            }
+            *result = (integerValue > clause->integerValues[index]) - (integerValue < clause->integerValues[index]);
+            return(true);
+        case FILTER_COMPARE_DECIMAL :
+            decimalValue = strtod(value, &end);
+            if (end == value) {
+                return(false);
+            }
+            *result = (decimalValue > clause->decimalValues[index]) - (decimalValue < clause->decimalValues[index]);
+            return(true);
+        default :
+            *result = memcmp(
+                value,
+                clause->values[index],
+                (length < clause->valuesLength[index]) ? length : clause->valuesLength[index]
+            );
+            if (!*result) {
+                *result = (length > clause->valuesLength[index]) - (length < clause->valuesLength[index]);
+            }
+            return(true);
+    }
+}
+
+/**
+ * Tests a raw value against a clause.
+ *
+ * \param clause Clause.
+ * \param value  Raw field value.
+ *
+ * \return True if value matches.
+ */
+bool _filterMatchClause(filterClause* clause, char* value) {
+    size_t length = strlen(value);
+    int comparison;
+
+    if (clause->operator == FILTER_OP_PREFIX) {
+        return(
+            (length >= clause->valuesLength[0]) &&
+            !memcmp(value, clause->values[0], clause->valuesLength[0])
+        );
+    }
+    if ((clause->operator == FILTER_OP_EQUAL) || (clause->operator == FILTER_OP_NOTEQUAL)) {
+        for (size_t i = 0; i < clause->valuesCount; i++) {
+            bool equal;
+
+            if (!length || !clause->valuesLength[i]) {
+                equal = (length == clause->valuesLength[i]);
+            } else {
+                equal = _filterCompare(clause, i, value, length, &comparison) && !comparison;
+            }
+            if (equal) {
+                return(clause->operator == FILTER_OP_EQUAL);
+            }
+        }
+        return(clause->operator == FILTER_OP_NOTEQUAL);
+    }
+    if (!length || !_filterCompare(clause, 0, value, length, &comparison)) {
+        return(false);
+    }
+    switch (clause->operator) {
+        case FILTER_OP_LOWER :
+            return(comparison < 0);
+        case FILTER_OP_LOWEREQUAL :
+            return(comparison <= 0);
+        case FILTER_OP_GREATER :
+            return(comparison > 0);
+        default :
+            return(comparison >= 0);
+    }
+}
+
+
+/**
+ * Creates a new, empty (matching everything) filter.
+ *
+ * \return Filter.
+ */
+filter* filterInit() {
+    filter* rowFilter;
+
+    rowFilter = calloc(1, sizeof(filter));
+    if (!rowFilter) {
+        error("Cannot allocate memory");
+    }
+    return(rowFilter);
+}
+
+/**
+ * Parse a filter expression and append its clauses to filter.
+ *
+ * \param rowFilter  Filter instance.
+ * \param expression Filter expression.
+ */
+void filterParse(filter* rowFilter, char* expression) {
+    char* copy;
+    char* clause;
+
+    copy = strdup(expression);
+    if (!copy) {
+        error("Cannot allocate memory");
+    }
+    clause = copy;
+    for (char* position = copy; ; position++) {
+        if ((*position == ';') || !*position) {
+            bool last = !*position;
+
+            *position = 0;
+            for (char* check = clause; *check; check++) {
+                if (!isspace((unsigned char)*check)) {
+                    _filterParseClause(rowFilter, clause);
+                    break;
+                }
+            }
+            if (last) {
+                break;
+            }
+            clause = position + 1;
+        }
+    }
+    free(copy);
+}
+
+/**
+ * Bind filter to an EPF file : resolve fields indexes and comparison modes.
+ *
+ * \param rowFilter Filter instance.
+ * \param file      EPFFile instance (header parsed).
+ */
+void filterBind(filter* rowFilter, EPFFile* file) {
+    rowFilter->active = false;
+    for (size_t i = 0; i < rowFilter->clausesCount; i++) {
+        filterClause* clause = rowFilter->clauses[i];
+
+        clause->fieldIndex = -1;
+        for (size_t j = 0; j < file->fieldsCount; j++) {
+            if (!strcmp(file->fields[j]->fieldName, clause->fieldName)) {
+                clause->fieldIndex = j;
+                break;
+            }
+        }
+        if (clause->fieldIndex == -1) {
+            if (epf2bsonOptions->verbose) {
+                message("Filter on '%s' ignored, no such field", clause->fieldName);
+            }
+            continue;
+        }
+        rowFilter->active = true;
+        switch (epfGetFieldType(file, clause->fieldIndex)) {
+            case EPF_FIELDTYPE_BIGINT :
+            case EPF_FIELDTYPE_INTEGER :
+                clause->compare = FILTER_COMPARE_INTEGER;
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                clause->compare = FILTER_COMPARE_DECIMAL;
+                break;
+            default :
+                clause->compare = FILTER_COMPARE_BYTES;
+        }
+        if (clause->operator == FILTER_OP_PREFIX) {
+            clause->compare = FILTER_COMPARE_BYTES;
+        }
+        for (size_t j = 0; j < clause->valuesCount; j++) {
+            char* end;
+
+            if (!clause->valuesLength[j]) {
+                continue;
+            }
+            if (
+                (clause->compare == FILTER_COMPARE_INTEGER) &&
+                !_filterParseInteger(clause->values[j], &clause->integerValues[j])
+            ) {
+                error("Invalid integer value in filter on '%s' : %s", clause->fieldName, clause->values[j]);
+            }
+            if (clause->compare == FILTER_COMPARE_DECIMAL) {
+                clause->decimalValues[j] = strtod(clause->values[j], &end);
+                if (*end) {
+                    error("Invalid decimal value in filter on '%s' : %s", clause->fieldName, clause->values[j]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Tests a raw entry against filter.
+ *
+ * \param rowFilter Filter instance (bound).
+ * \param entry     Raw entry as returned by epfRead() (fields count checked).
+ *
+ * \return True if entry is to keep, false elsewhere.
+ */
+bool filterMatch(filter* rowFilter, char** entry) {
+    if (!rowFilter->active) {
+        return(true);
+    }
+    for (size_t i = 0; i < rowFilter->clausesCount; i++) {
+        filterClause* clause = rowFilter->clauses[i];
+
+        if (clause->fieldIndex == -1) {
+            continue;
+        }
+        if (!_filterMatchClause(clause, entry[clause->fieldIndex])) {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+/**
+ * Destroy a filter and release memory.
+ *
+ * \param rowFilter Filter instance.
+ */
+void filterDestroy(filter* rowFilter) {
+    for (size_t i = 0; i < rowFilter->clausesCount; i++) {
+        for (size_t j = 0; j < rowFilter->clauses[i]->valuesCount; j++) {
+            free(rowFilter->clauses[i]->values[j]);
+        }
+        free(rowFilter->clauses[i]->values);
+        free(rowFilter->clauses[i]->valuesLength);
+        free(rowFilter->clauses[i]->integerValues);
+        free(rowFilter->clauses[i]->decimalValues);
+        free(rowFilter->clauses[i]->fieldName);
+        free(rowFilter->clauses[i]);
+    }
+    free(rowFilter->clauses);
+    free(rowFilter);
+}
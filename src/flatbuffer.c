@@ -0,0 +1,325 @@
+/**
+ * Minimal FlatBuffers builder.
+ *
+ * Only what Arrow IPC metadata needs : tables of scalars and references,
+ * strings, vectors of references and vectors of structs.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "flatbuffer.h"
+
+/**
+ * Makes room in front of used bytes.
+ *
+ * \param builder Builder.
+ * \param length  Bytes to prepend.
+ */
+void _fbReserve(flatBuilder* builder, size_t length) {
+    unsigned char* data;
+    size_t allocated = builder->allocated;
+
+    if (builder->length + length <= allocated) {
+        return;
+    }
+    while (builder->length + length > allocated) {
+        allocated = allocated ? allocated * 2 : 1024;
+    }
+    data = malloc(allocated);
+    if (!data) {
+        error("Cannot allocate memory");
+    }
+    if (builder->length) {
+        memcpy(data + allocated - builder->length, builder->data + builder->allocated - builder->length, builder->length);
+    }
+    free(builder->data);
+    builder->data = data;
+    builder->allocated = allocated;
+}
+
+/**
+ * Prepends bytes.
+ *
+ * \param builder Builder.
+ * \param bytes   Bytes (NULL for zeros).
+ * \param length  Bytes count.
+ */
+void _fbPush(flatBuilder* builder, const void* bytes, size_t length) {
+    if (!length) {
+        return;
+    }
+    _fbReserve(builder, length);
+    builder->length += length;
+    if (bytes) {
+        memcpy(builder->data + builder->allocated - builder->length, bytes, length);
+    } else {
+        memset(builder->data + builder->allocated - builder->length, 0, length);
+    }
+}
+
+/**
+ * Pads so that a value of given alignment can be prepended after other bytes.
+ *
+ * \param builder    Builder.
+ * \param alignment  Value alignment.
+ * \param additional Bytes that will be prepended before the value.
+ */
+void _fbPrepare(flatBuilder* builder, size_t alignment, size_t additional) {
+    if (alignment > builder->minAlign) {
+        builder->minAlign = alignment;
+    }
+    _fbPush(builder, NULL, (~(builder->length + additional) + 1) & (alignment - 1));
+}
+
+/**
+ * Prepends an aligned scalar.
+ *
+ * \param builder Builder.
+ * \param value   Value (little endian).
+ * \param size    Value size.
+ */
+void _fbPushScalar(flatBuilder* builder, const void* value, size_t size) {
+    _fbPrepare(builder, size, 0);
+    _fbPush(builder, value, size);
+}
+
+/**
+ * Prepends a reference to an object.
+ *
+ * \param builder Builder.
+ * \param offset  Object offset.
+ */
+void _fbPushOffset(flatBuilder* builder, uint32_t offset) {
+    uint32_t value;
+
+    _fbPrepare(builder, sizeof(uint32_t), 0);
+    value = htole32(builder->length + sizeof(uint32_t) - offset);
+    _fbPush(builder, &value, sizeof(uint32_t));
+}
+
+/**
+ * Records current table field position.
+ *
+ * \param builder Builder.
+ * \param field   Field index in schema.
+ */
+void _fbSetField(flatBuilder* builder, size_t field) {
+    if (field >= FLATBUFFER_MAX_FIELDS) {
+        error("Too many fields in FlatBuffers table");
+    }
+    builder->fields[field] = builder->length;
+    if (field >= builder->fieldsCount) {
+        builder->fieldsCount = field + 1;
+    }
+}
+
+
+/**
+ * Creates a new builder.
+ *
+ * \return Builder.
+ */
+flatBuilder* fbInit() {
+    flatBuilder* builder;
+
+    builder = calloc(1, sizeof(flatBuilder));
+    if (!builder) {
+        error("Cannot allocate memory");
+    }
+    builder->minAlign = 1;
+    return(builder);
+}
+
+/**
+ * Empties a builder to build a new buffer (keeps memory).
+ *
+ * \param builder Builder.
+ */
+void fbReset(flatBuilder* builder) {
+    builder->length = 0;
+    builder->minAlign = 1;
+}
+
+/**
+ * Creates a string.
+ *
+ * \param builder Builder.
+ * \param string  String.
+ *
+ * \return String offset.
+ */
+uint32_t fbCreateString(flatBuilder* builder, const char* string) {
+    size_t length = strlen(string);
+    uint32_t prefix = htole32(length);
+
+    _fbPrepare(builder, sizeof(uint32_t), length + 1);
+    _fbPush(builder, NULL, 1);
+    _fbPush(builder, string, length);
+    _fbPush(builder, &prefix, sizeof(uint32_t));
+    return(builder->length);
+}
+
+/**
+ * Creates a vector of objects offsets.
+ *
+ * \param builder Builder.
+ * \param offsets Objects offsets.
+ * \param count   Objects count.
+ *
+ * \return Vector offset.
+ */
+uint32_t fbCreateOffsetVector(flatBuilder* builder, uint32_t* offsets, size_t count) {
+    uint32_t prefix = htole32(count);
+
+    _fbPrepare(builder, sizeof(uint32_t), count * sizeof(uint32_t));
+    while (count--) {
+        _fbPushOffset(builder, offsets[count]);
+    }
+    _fbPush(builder, &prefix, sizeof(uint32_t));
+    return(builder->length);
+}
+
+/**
+ * Creates a vector of structs.
+ *
+ * \param builder   Builder.
+ * \param structs   Structs, already laid out little endian.
+ * \param size      Struct size.
+ * \param count     Structs count.
+ * \param alignment Struct alignment.
+ *
+ * \return Vector offset.
+ */
+uint32_t fbCreateStructVector(flatBuilder* builder, const void* structs, size_t size, size_t count, size_t alignment) {
+    uint32_t prefix = htole32(count);
+
+    _fbPrepare(builder, sizeof(uint32_t), size * count);
+    _fbPrepare(builder, alignment, size * count);
+    _fbPush(builder, structs, size * count);
+    _fbPush(builder, &prefix, sizeof(uint32_t));
+    return(builder->length);
+}
+
+/**
+ * Starts a table (no other object can be created until fbEndTable()).
+ *
+ * \param builder Builder.
+ */
+void fbStartTable(flatBuilder* builder) {
+    memset(builder->fields, 0, sizeof(builder->fields));
+    builder->fieldsCount = 0;
+    builder->tableStart = builder->length;
+}
+
+/**
+ * Adds scalar fields to current table.
+ *
+ * \param builder Builder.
+ * \param field   Field index in schema.
+ * \param value   Value.
+ */
+void fbAddUint8(flatBuilder* builder, size_t field, uint8_t value) {
+    _fbPushScalar(builder, &value, sizeof(uint8_t));
+    _fbSetField(builder, field);
+}
+
+void fbAddInt16(flatBuilder* builder, size_t field, int16_t value) {
+    value = htole16(value);
+    _fbPushScalar(builder, &value, sizeof(int16_t));
+    _fbSetField(builder, field);
+}
+
+void fbAddInt32(flatBuilder* builder, size_t field, int32_t value) {
+    value = htole32(value);
+    _fbPushScalar(builder, &value, sizeof(int32_t));
+    _fbSetField(builder, field);
+}
+
+void fbAddInt64(flatBuilder* builder, size_t field, int64_t value) {
+    value = htole64(value);
+    _fbPushScalar(builder, &value, sizeof(int64_t));
+    _fbSetField(builder, field);
+}
+
+/**
+ * Adds an object reference field to current table.
+ *
+ * \param builder Builder.
+ * \param field   Field index in schema.
+ * \param offset  Object offset.
+ */
+void fbAddOffset(flatBuilder* builder, size_t field, uint32_t offset) {
+    _fbPushOffset(builder, offset);
+    _fbSetField(builder, field);
+}
+
+/**
+ * Ends current table : prepends its vtable and links it.
+ *
+ * \param builder Builder.
+ *
+ * \return Table offset.
+ */
+uint32_t fbEndTable(flatBuilder* builder) {
+    uint32_t table;
+    uint16_t entry;
+    int32_t link;
+
+    _fbPushScalar(builder, NULL, sizeof(int32_t));
+    table = builder->length;
+    for (size_t i = builder->fieldsCount; i > 0; i--) {
+        entry = htole16(builder->fields[i - 1] ? table - builder->fields[i - 1] : 0);
+        _fbPush(builder, &entry, sizeof(uint16_t));
+    }
+    entry = htole16(table - builder->tableStart);
+    _fbPush(builder, &entry, sizeof(uint16_t));
+    entry = htole16((builder->fieldsCount + 2) * sizeof(uint16_t));
+    _fbPush(builder, &entry, sizeof(uint16_t));
+    link = htole32(builder->length - table);
+    memcpy(builder->data + builder->allocated - table, &link, sizeof(int32_t));
+    return(table);
+}
+
+/**
+ * Finishes buffer with its root table.
+ *
+ * \param builder Builder.
+ * \param root    Root table offset.
+ *
+ * \return Finished buffer (builder->length bytes, valid until next builder call).
+ */
+unsigned char* fbFinish(flatBuilder* builder, uint32_t root) {
+    _fbPrepare(builder, builder->minAlign, sizeof(uint32_t));
+    _fbPushOffset(builder, root);
+    return(builder->data + builder->allocated - builder->length);
+}
+
+/**
+ * Destroy a builder and release memory.
+ *
+ * \param builder Builder.
+ */
+void fbDestroy(flatBuilder* builder) {
+    free(builder->data);
+    free(builder);
+}
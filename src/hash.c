@@ -0,0 +1,77 @@
+/**
+ * Non cryptographic hashing.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "hash.h"
+
+#define HASH_MULTIPLIER_1           0x9E3779B97F4A7C15ULL
+#define HASH_MULTIPLIER_2           0xBF58476D1CE4E5B9ULL
+#define HASH_MULTIPLIER_3           0x94D049BB133111EBULL
+
+/**
+ * Final avalanche (splitmix64 finalizer).
+ *
+ * \param value Value to mix.
+ *
+ * \return Mixed value.
+ */
+uint64_t _hashMix(uint64_t value) {
+    value ^= value >> 30;
+    value *= HASH_MULTIPLIER_2;
+    value ^= value >> 27;
+    value *= HASH_MULTIPLIER_3;
+    value ^= value >> 31;
+    return(value);
+}
+
+/**
+ * Hash a byte buffer (64 bits, 8 bytes at a time, not cryptographic).
+ *
+ * \param data   Data to hash.
+ * \param length Data length.
+ * \param seed   Seed, or previous hash to chain several buffers.
+ *
+ * \return Hash.
+ */
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed) {
+    const unsigned char* bytes = data;
+    uint64_t hash = seed ^ (length * HASH_MULTIPLIER_1);
+    uint64_t word;
+
+    while (length >= 8) {
+        memcpy(&word, bytes, 8);
+        word = le64toh(word);
+        hash = (hash ^ _hashMix(word)) * HASH_MULTIPLIER_1;
+        hash ^= hash >> 29;
+        bytes += 8;
+        length -= 8;
+    }
+    if (length) {
+        word = 0;
+        memcpy(&word, bytes, length);
+        word = le64toh(word);
+        hash = (hash ^ _hashMix(word)) * HASH_MULTIPLIER_1;
+    }
+    return(_hashMix(hash));
+}
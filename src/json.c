@@ -0,0 +1,443 @@
+/**
+ * NDJSON (MongoDB relaxed Extended JSON) writer.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "json.h"
+#include "output.h"
+#include "sink.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Latest DATETIME written as an ISO 8601 string (9999-12-31T23:59:59.999Z).
+ */
+#define JSON_DATE_MAX               253402300799999LL
+
+/**
+ * Skips bytes written as is in a JSON string.
+ *
+ * \param data   Data.
+ * \param length Data length.
+ *
+ * \return Offset of the first byte to escape (or length).
+ */
+size_t _jsonSkipPlain(const unsigned char* data, size_t length) {
+    size_t position = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    __m128i chunk;
+
+    while (position + 16 <= length) {
+        chunk = _mm_loadu_si128((const __m128i*)(data + position));
+        //Control characters are the bytes with max(byte, 0x1F) == 0x1F.
+        if (_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control)
+        ))) {
+            break;
+        }
+        position += 16;
+    }
+#else
+    uint64_t word;
+    uint64_t quotes;
+    uint64_t backslashes;
+
+    while (position + 8 <= length) {
+        memcpy(&word, data + position, sizeof(uint64_t));
+        quotes = word ^ 0x2222222222222222ULL;
+        backslashes = word ^ 0x5C5C5C5C5C5C5C5CULL;
+        //Bytes below 0x20 (quotes and backslashes are 0 once xored) borrow their high bit.
+        if (
+            (
+                ((word - 0x2020202020202020ULL) & ~word) |
+                ((quotes - 0x0101010101010101ULL) & ~quotes) |
+                ((backslashes - 0x0101010101010101ULL) & ~backslashes)
+            ) & 0x8080808080808080ULL
+        ) {
+            break;
+        }
+        position += 8;
+    }
+#endif
+    while ((position < length) && (data[position] >= 0x20) && (data[position] != '"') && (data[position] != '\\')) {
+        position++;
+    }
+    return(position);
+}
+
+/**
+ * Makes room at the end of documents buffer.
+ *
+ * \param writer NDJSON writer.
+ * \param length Bytes to append.
+ */
+void _jsonReserve(jsonWriter* writer, size_t length) {
+    char* grown;
+
+    if (writer->length + length <= writer->allocated) {
+        return;
+    }
+    grown = realloc(writer->buffer, (writer->length + length) * 2);
+    if (!grown) {
+        error("Cannot allocate memory");
+    }
+    writer->buffer = grown;
+    writer->allocated = (writer->length + length) * 2;
+}
+
+/**
+ * Appends bytes.
+ *
+ * \param writer NDJSON writer.
+ * \param data   Data.
+ * \param length Data length.
+ */
+void _jsonAppend(jsonWriter* writer, const char* data, size_t length) {
+    _jsonReserve(writer, length);
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+/**
+ * Appends a string, quoted and escaped (runs of plain bytes are copied at once).
+ *
+ * \param writer NDJSON writer.
+ * \param string String.
+ * \param length String length.
+ */
+void _jsonAddString(jsonWriter* writer, const char* string, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* data = (const unsigned char*)string;
+    char* output;
+    size_t plain;
+
+    _jsonReserve(writer, length * 6 + 2);
+    output = writer->buffer + writer->length;
+    *output++ = '"';
+    while (length) {
+        plain = _jsonSkipPlain(data, length);
+        memcpy(output, data, plain);
+        output += plain;
+        data += plain;
+        length -= plain;
+        if (!length) {
+            break;
+        }
+        *output++ = '\\';
+        switch (*data) {
+            case '"' :
+            case '\\' :
+                *output++ = *data;
+                break;
+            case '\n' :
+                *output++ = 'n';
+                break;
+            case '\r' :
+                *output++ = 'r';
+                break;
+            case '\t' :
+                *output++ = 't';
+                break;
+            case '\b' :
+                *output++ = 'b';
+                break;
+            case '\f' :
+                *output++ = 'f';
+                break;
+            default :
+                *output++ = 'u';
+                *output++ = '0';
+                *output++ = '0';
+                *output++ = hex[*data >> 4];
+                *output++ = hex[*data & 0x0F];
+                break;
+        }
+        data++;
+        length--;
+    }
+    *output++ = '"';
+    writer->length = output - writer->buffer;
+}
+
+/**
+ * Appends a date : ISO 8601 string from 1970 to 9999, milliseconds elsewhere.
+ *
+ * \param writer       NDJSON writer.
+ * \param milliseconds Milliseconds since the Unix epoch.
+ */
+void _jsonAddDate(jsonWriter* writer, int64_t milliseconds) {
+    int64_t days, dayOfEra, yearOfEra, dayOfYear, monthIndex, year, month;
+    int64_t time;
+
+    _jsonReserve(writer, 64);
+    if ((milliseconds < 0) || (milliseconds > JSON_DATE_MAX)) {
+        writer->length += sprintf(
+            writer->buffer + writer->length,
+            "{\"$date\":{\"$numberLong\":\"%" PRId64 "\"}}",
+            milliseconds
+        );
+        return;
+    }
+    days = milliseconds / 86400000;
+    time = milliseconds % 86400000;
+    //Civil date of days since the Unix epoch (years starting in March, 400 years eras).
+    dayOfEra = (days + 719468) % 146097;
+    yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    monthIndex = (5 * dayOfYear + 2) / 153;
+    month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    year = yearOfEra + (days + 719468) / 146097 * 400 + (month <= 2);
+    writer->length += sprintf(
+        writer->buffer + writer->length,
+        "{\"$date\":\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"}",
+        (int)year,
+        (int)month,
+        (int)(dayOfYear - (153 * monthIndex + 2) / 5 + 1),
+        (int)(time / 3600000),
+        (int)(time / 60000 % 60),
+        (int)(time / 1000 % 60),
+        (int)(time % 1000)
+    );
+}
+
+/**
+ * Appends a double, shortest form reading back to the same value, always
+ * with a decimal point or an exponent so that it stays a double.
+ *
+ * \param writer NDJSON writer.
+ * \param value  Value.
+ */
+void _jsonAddDouble(jsonWriter* writer, double value) {
+    char* output;
+    int length;
+
+    if (!isfinite(value)) {
+        _jsonAppend(
+            writer,
+            isnan(value) ? "{\"$numberDouble\":\"NaN\"}" : (value > 0 ? "{\"$numberDouble\":\"Infinity\"}" : "{\"$numberDouble\":\"-Infinity\"}"),
+            isnan(value) ? 23 : (value > 0 ? 28 : 29)
+        );
+        return;
+    }
+    _jsonReserve(writer, 32);
+    output = writer->buffer + writer->length;
+    length = sprintf(output, "%.15g", value);
+    if (strtod(output, NULL) != value) {
+        length = sprintf(output, "%.17g", value);
+    }
+    if (!strpbrk(output, ".e")) {
+        output[length++] = '.';
+        output[length++] = '0';
+    }
+    writer->length += length;
+}
+
+/**
+ * Appends a typed EPF value, typed as in BSON documents.
+ *
+ * \param writer    NDJSON writer.
+ * \param fieldType EPF field type.
+ * \param value     Typed value.
+ */
+void _jsonAddValue(jsonWriter* writer, unsigned char fieldType, EPFValue* value) {
+    if (value->isNull) {
+        _jsonAppend(writer, "null", 4);
+        return;
+    }
+    switch(fieldType) {
+        case EPF_FIELDTYPE_BIGINT :
+        case EPF_FIELDTYPE_INTEGER :
+            //Relaxed format : parsers pick 32 or 64 bits integers by magnitude, as BSON documents do.
+            _jsonReserve(writer, 24);
+            writer->length += sprintf(writer->buffer + writer->length, "%" PRId64, value->integer);
+            break;
+        case EPF_FIELDTYPE_BOOLEAN :
+            if (value->integer) {
+                _jsonAppend(writer, "true", 4);
+            } else {
+                _jsonAppend(writer, "false", 5);
+            }
+            break;
+        case EPF_FIELDTYPE_VARCHAR :
+        case EPF_FIELDTYPE_LONGTEXT :
+            _jsonAddString(writer, value->string, value->length);
+            break;
+        case EPF_FIELDTYPE_DATETIME :
+            _jsonAddDate(writer, value->integer);
+            break;
+        case EPF_FIELDTYPE_DECIMAL :
+            _jsonAddDouble(writer, value->decimal);
+            break;
+        default :
+            //Unknown types are rejected when reading header.
+            _jsonAppend(writer, "null", 4);
+            break;
+    }
+}
+
+/**
+ * Writes buffered documents out.
+ *
+ * \param writer NDJSON writer.
+ */
+void _jsonFlush(jsonWriter* writer) {
+    outputWrite(writer->output, writer->buffer, writer->length);
+    writer->length = 0;
+}
+
+/**
+ * Sink entries consumer : appends an entry.
+ *
+ * \param context NDJSON writer.
+ * \param values  Typed values.
+ */
+void _jsonSinkWrite(void* context, EPFValue* values) {
+    jsonAppend(context, values);
+}
+
+/**
+ * Sink finisher : closes file.
+ *
+ * \param context NDJSON writer.
+ */
+void _jsonSinkClose(void* context) {
+    jsonClose(context);
+}
+
+
+/**
+ * Starts writing an NDJSON file.
+ *
+ * \param path         NDJSON file path.
+ * \param file         EPFFile instance (header parsed).
+ * \param primaryKeyId Write primary key as `_id` (if any).
+ * \param dropBehind   Drop written pages from page cache.
+ *
+ * \return NDJSON writer.
+ */
+jsonWriter* jsonCreate(char* path, EPFFile* file, bool primaryKeyId, bool dropBehind) {
+    jsonWriter* writer;
+
+    writer = calloc(1, sizeof(jsonWriter));
+    if (!writer) {
+        error("Cannot allocate memory");
+    }
+    writer->file = file;
+    writer->primaryKeyId = primaryKeyId && file->primaryKeyCount;
+    writer->names = calloc(file->fieldsCount, sizeof(char*));
+    writer->namesLengths = calloc(file->fieldsCount, sizeof(size_t));
+    if (!writer->names || !writer->namesLengths) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < file->fieldsCount; i++) {
+        _jsonAddString(writer, file->fields[i]->fieldName, strlen(file->fields[i]->fieldName));
+        _jsonAppend(writer, ":", 1);
+        writer->names[i] = malloc(writer->length);
+        if (!writer->names[i]) {
+            error("Cannot allocate memory");
+        }
+        memcpy(writer->names[i], writer->buffer, writer->length);
+        writer->namesLengths[i] = writer->length;
+        writer->length = 0;
+    }
+    writer->output = outputOpen(path, false, false, dropBehind, 0);
+    return(writer);
+}
+
+/**
+ * Appends an entry.
+ *
+ * \param writer NDJSON writer.
+ * \param values Typed values (fieldsCount values).
+ */
+void jsonAppend(jsonWriter* writer, EPFValue* values) {
+    EPFFile* file = writer->file;
+    size_t index;
+
+    _jsonAppend(writer, "{", 1);
+    if (writer->primaryKeyId) {
+        _jsonAppend(writer, "\"_id\":", 6);
+        if (file->primaryKeyCount == 1) {
+            index = file->primaryKey[0];
+            _jsonAddValue(writer, file->fields[index]->fieldType, &values[index]);
+        } else {
+            for (size_t i = 0; i < file->primaryKeyCount; i++) {
+                index = file->primaryKey[i];
+                _jsonAppend(writer, i ? "," : "{", 1);
+                _jsonAppend(writer, writer->names[index], writer->namesLengths[index]);
+                _jsonAddValue(writer, file->fields[index]->fieldType, &values[index]);
+            }
+            _jsonAppend(writer, "}", 1);
+        }
+    }
+    for (size_t i = 0; i < file->fieldsCount; i++) {
+        if (i || writer->primaryKeyId) {
+            _jsonAppend(writer, ",", 1);
+        }
+        _jsonAppend(writer, writer->names[i], writer->namesLengths[i]);
+        _jsonAddValue(writer, file->fields[i]->fieldType, &values[i]);
+    }
+    _jsonAppend(writer, "}\n", 2);
+    if (writer->length >= JSON_BUFFER_BYTES) {
+        _jsonFlush(writer);
+    }
+}
+
+/**
+ * Writes buffered documents, then closes file.
+ *
+ * \param writer NDJSON writer (destroyed).
+ */
+void jsonClose(jsonWriter* writer) {
+    _jsonFlush(writer);
+    outputClose(writer->output);
+    for (size_t i = 0; i < writer->file->fieldsCount; i++) {
+        free(writer->names[i]);
+    }
+    free(writer->names);
+    free(writer->namesLengths);
+    free(writer->buffer);
+    free(writer);
+}
+
+/**
+ * Creates a sink writing entries to an NDJSON file, closing it when done.
+ *
+ * \param writer NDJSON writer.
+ *
+ * \return Sink.
+ */
+rowSink* jsonSink(jsonWriter* writer) {
+    return(sinkCreate(writer, _jsonSinkWrite, _jsonSinkClose));
+}
@@ -0,0 +1,243 @@
+/**
+ * Primary keys encoding.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "epf.h"
+#include "key.h"
+
+#define KEY_MARKER_NULL             '\x00'
+#define KEY_MARKER_VALUE            '\x01'
+
+/**
+ * Makes room in key buffer.
+ *
+ * \param key    Key buffer.
+ * \param length Bytes to append.
+ */
+void _keyReserve(keyBuffer* key, size_t length) {
+    if (key->length + length <= key->_allocated) {
+        return;
+    }
+    while (key->length + length > key->_allocated) {
+        key->_allocated = key->_allocated ? key->_allocated * 2 : 64;
+    }
+    key->data = realloc(key->data, key->_allocated);
+    if (!key->data) {
+        error("Cannot allocate memory");
+    }
+}
+
+/**
+ * Appends a 64 bits value, big endian so that memcmp() orders it.
+ *
+ * \param key   Key buffer.
+ * \param value Value.
+ */
+void _keyAppend64(keyBuffer* key, uint64_t value) {
+    value = htobe64(value);
+    _keyReserve(key, sizeof(uint64_t));
+    memcpy(key->data + key->length, &value, sizeof(uint64_t));
+    key->length += sizeof(uint64_t);
+}
+
+
+/**
+ * Creates a new key buffer.
+ *
+ * \return Key buffer.
+ */
+keyBuffer* keyInit() {
+    keyBuffer* key;
+
+    key = calloc(1, sizeof(keyBuffer));
+    if (!key) {
+        error("Cannot allocate memory");
+    }
+    return(key);
+}
+
+/**
+ * Appends a raw field value to an encoded key.
+ *
+ * Integers are stored as sign flipped big endian 64 bits, decimals as
+ * order preserving IEEE 754 bits, everything else as its raw bytes followed
+ * by a 0 terminator (raw EPF values never contain 0 bytes).
+ *
+ * \param key       Key buffer.
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ * \param value     Raw value (NULL or empty for null).
+ */
+void keyAppendField(keyBuffer* key, unsigned char fieldType, char* value) {
+    size_t length;
+    int64_t integerValue;
+    double decimalValue;
+    uint64_t bits;
+    char* end;
+
+    if (!value || !*value) {
+        _keyReserve(key, 1);
+        key->data[key->length++] = KEY_MARKER_NULL;
+        return;
+    }
+    switch (fieldType) {
+        case EPF_FIELDTYPE_BIGINT :
+        case EPF_FIELDTYPE_INTEGER :
+            integerValue = strtoll(value, &end, 10);
+            if (*end) {
+                break;
+            }
+            _keyReserve(key, 1);
+            key->data[key->length++] = KEY_MARKER_VALUE;
+            _keyAppend64(key, (uint64_t)integerValue ^ 0x8000000000000000ULL);
+            return;
+        case EPF_FIELDTYPE_DECIMAL :
+            decimalValue = strtod(value, &end);
+            if (*end) {
+                break;
+            }
+            memcpy(&bits, &decimalValue, sizeof(uint64_t));
+            if (bits & 0x8000000000000000ULL) {
+                bits = ~bits;
+            } else {
+                bits ^= 0x8000000000000000ULL;
+            }
+            _keyReserve(key, 1);
+            key->data[key->length++] = KEY_MARKER_VALUE;
+            _keyAppend64(key, bits);
+            return;
+    }
+    length = strlen(value);
+    _keyReserve(key, length + 2);
+    key->data[key->length++] = KEY_MARKER_VALUE;
+    memcpy(key->data + key->length, value, length);
+    key->length += length;
+    key->data[key->length++] = 0;
+}
+
+/**
+ * Appends a typed field value to an encoded key.
+ *
+ * Integers, booleans and dates are stored like raw integers, decimals like
+ * raw decimals and strings as their bytes. Keys of typed values are only
+ * comparable with other keys of typed values.
+ *
+ * \param key       Key buffer.
+ * \param fieldType Field type (EPF_FIELDTYPE_*).
+ * \param value     Typed value.
+ */
+void keyAppendValue(keyBuffer* key, unsigned char fieldType, EPFValue* value) {
+    uint64_t bits;
+
+    if (value->isNull) {
+        _keyReserve(key, 1);
+        key->data[key->length++] = KEY_MARKER_NULL;
+        return;
+    }
+    _keyReserve(key, 1);
+    key->data[key->length++] = KEY_MARKER_VALUE;
+    switch (fieldType) {
+        case EPF_FIELDTYPE_BIGINT :
+        case EPF_FIELDTYPE_INTEGER :
+        case EPF_FIELDTYPE_BOOLEAN :
+        case EPF_FIELDTYPE_DATETIME :
+            _keyAppend64(key, (uint64_t)value->integer ^ 0x8000000000000000ULL);
+            return;
+        case EPF_FIELDTYPE_DECIMAL :
+            memcpy(&bits, &value->decimal, sizeof(uint64_t));
+            if (bits & 0x8000000000000000ULL) {
+                bits = ~bits;
+            } else {
+                bits ^= 0x8000000000000000ULL;
+            }
+            _keyAppend64(key, bits);
+            return;
+    }
+    _keyReserve(key, value->length + 1);
+    memcpy(key->data + key->length, value->string, value->length);
+    key->length += value->length;
+    key->data[key->length++] = 0;
+}
+
+/**
+ * Encodes the primary key of a raw entry (replaces buffer content).
+ *
+ * \param key   Key buffer.
+ * \param file  EPFFile instance.
+ * \param entry Raw entry as returned by epfRead() (fields count checked).
+ */
+void keyEncode(keyBuffer* key, EPFFile* file, char** entry) {
+    key->length = 0;
+    for (size_t i = 0; i < file->primaryKeyCount; i++) {
+        size_t index = file->primaryKey[i];
+
+        keyAppendField(key, epfGetFieldType(file, index), entry[index]);
+    }
+}
+
+/**
+ * Encodes the primary key of typed values (replaces buffer content).
+ *
+ * \param key    Key buffer.
+ * \param file   EPFFile instance.
+ * \param values Typed values (fieldsCount values).
+ */
+void keyEncodeValues(keyBuffer* key, EPFFile* file, EPFValue* values) {
+    key->length = 0;
+    for (size_t i = 0; i < file->primaryKeyCount; i++) {
+        size_t index = file->primaryKey[i];
+
+        keyAppendValue(key, epfGetFieldType(file, index), &values[index]);
+    }
+}
+
+/**
+ * Compares two encoded keys.
+ *
+ * \param first        First key.
+ * \param firstLength  First key length.
+ * \param second       Second key.
+ * \param secondLength Second key length.
+ *
+ * \return <0, 0, >0 like memcmp().
+ */
+int keyCompare(const void* first, size_t firstLength, const void* second, size_t secondLength) {
+    int result;
+
+    result = memcmp(first, second, (firstLength < secondLength) ? firstLength : secondLength);
+    if (result) {
+        return(result);
+    }
+    return((firstLength > secondLength) - (firstLength < secondLength));
+}
+
+/**
+ * Destroy a key buffer and release memory.
+ *
+ * \param key Key buffer.
+ */
+void keyDestroy(keyBuffer* key) {
+    free(key->data);
+    free(key);
+}
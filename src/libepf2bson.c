@@ -0,0 +1,287 @@
+/**
+ * EPF2Bson library : streaming EPF to BSON conversion API.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "EPF2Bson.h"
+#include "libepf2bson.h"
+#include "document.h"
+#include "utf8.h"
+
+#include <stdarg.h>
+
+
+/**
+ * Sets reader status and error message.
+ *
+ * \param reader Reader.
+ * \param status Status (EPF_ERROR_* or EPF2BSON_ERROR_*).
+ * \param format Error message (printf format).
+ * \param ...    printf() like variable.
+ *
+ * \return Status.
+ */
+int _epf2bsonFail(epf2bsonReader* reader, int status, const char* format, ...) {
+    va_list varArgs;
+
+    va_start(varArgs, format);
+    vsnprintf(reader->error, EPF_ERROR_LENGTH, format, varArgs);
+    va_end(varArgs);
+    reader->status = status;
+    return(status);
+}
+
+/**
+ * Creates a reader of an opened source and reads its header.
+ *
+ * \param fp      Source (NULL if it could not be opened, errno set).
+ * \param name    Source name, for error messages.
+ * \param options Conversion options (EPF2BSON_* flags).
+ *
+ * \return Reader, NULL if memory could not be allocated.
+ */
+epf2bsonReader* _epf2bsonOpen(FILE* fp, const char* name, int options) {
+    epf2bsonReader* reader;
+
+    reader = calloc(1, sizeof(epf2bsonReader));
+    if (!reader) {
+        if (fp) {
+            fclose(fp);
+        }
+        return(NULL);
+    }
+    reader->fp = fp;
+    reader->options = options;
+    if (!fp) {
+        _epf2bsonFail(reader, EPF2BSON_ERROR_OPEN, "Could not open EPF source (%s) : %s", strerror(errno), name);
+        return(reader);
+    }
+    reader->file = epfCreate(
+        fp,
+        ((options & EPF2BSON_MD5) ? EPF_OPTION_MD5 : 0) | ((options & EPF2BSON_DROP_BEHIND) ? EPF_OPTION_DROP_BEHIND : 0)
+    );
+    reader->document = createBsonDocument();
+    reader->id = createBsonDocument();
+    if (!reader->file || !reader->document || !reader->id) {
+        epf2bsonClose(reader);
+        return(NULL);
+    }
+    if (epfReadHeader(reader->file) != EPF_OK) {
+        _epf2bsonFail(reader, reader->file->status, "%s : %s", epfError(reader->file), name);
+        return(reader);
+    }
+    reader->values = calloc(reader->file->fieldsCount, sizeof(EPFValue));
+    if (!reader->values) {
+        epf2bsonClose(reader);
+        return(NULL);
+    }
+    return(reader);
+}
+
+
+/**
+ * Opens an EPF file and reads its header.
+ *
+ * \param path    EPF file path.
+ * \param options Conversion options (EPF2BSON_* flags).
+ *
+ * \return Reader (check its status, see epf2bsonError()), NULL if memory
+ *         could not be allocated.
+ */
+epf2bsonReader* epf2bsonOpenPath(const char* path, int options) {
+    return(_epf2bsonOpen(fopen(path, "r"), path, options));
+}
+
+/**
+ * Opens an EPF file descriptor and reads its header.
+ *
+ * \param fd      File descriptor (duplicated, still owned by caller), positioned at file start.
+ * \param options Conversion options (EPF2BSON_* flags).
+ *
+ * \return Reader (check its status, see epf2bsonError()), NULL if memory
+ *         could not be allocated.
+ */
+epf2bsonReader* epf2bsonOpenFd(int fd, int options) {
+    FILE* fp = NULL;
+    int duplicate;
+
+    duplicate = dup(fd);
+    if (duplicate != -1) {
+        fp = fdopen(duplicate, "r");
+        if (!fp) {
+            close(duplicate);
+        }
+    }
+    return(_epf2bsonOpen(fp, "file descriptor", options));
+}
+
+/**
+ * Opens an EPF file held in memory and reads its header.
+ *
+ * \param data    EPF file content (not copied, must outlive reader).
+ * \param length  Content length.
+ * \param options Conversion options (EPF2BSON_* flags).
+ *
+ * \return Reader (check its status, see epf2bsonError()), NULL if memory
+ *         could not be allocated.
+ */
+epf2bsonReader* epf2bsonOpenBuffer(const void* data, size_t length, int options) {
+    //fmemopen() does not write to read only streams.
+    return(_epf2bsonOpen(fmemopen((void*)data, length, "r"), "memory buffer", options));
+}
+
+/**
+ * Converts next entry.
+ *
+ * \param reader   Reader.
+ * \param document Filled with BSON document (valid until next call).
+ * \param length   Filled with document length.
+ *
+ * \return EPF_OK, EPF_EOF or error status.
+ */
+int epf2bsonNext(epf2bsonReader* reader, const void** document, size_t* length) {
+    bsonSerializedValue serialized;
+    char** entry;
+    int status;
+
+    if (reader->status != EPF_OK) {
+        return(reader->status);
+    }
+    while (true) {
+        status = epfRead(reader->file, &entry);
+        if (status == EPF_EOF) {
+            reader->status = EPF_EOF;
+            return(EPF_EOF);
+        }
+        if (status < 0) {
+            return(_epf2bsonFail(reader, status, "%s", epfError(reader->file)));
+        }
+        if (status == EPF_SKIPPED) {
+            reader->skipped++;
+        }
+        if (status != EPF_OK) {
+            continue;
+        }
+        epfConvertEntry(reader->file, entry, reader->values);
+        if (reader->options & (EPF2BSON_UTF8_REPLACE | EPF2BSON_UTF8_REJECT)) {
+            status = documentCheckStrings(
+                reader->file,
+                reader->values,
+                (reader->options & EPF2BSON_UTF8_REJECT) ? UTF8_MODE_REJECT : UTF8_MODE_REPLACE,
+                &reader->repaired,
+                &reader->repairedAllocated
+            );
+            if (status == DOCUMENT_STRINGS_MEMORY) {
+                return(_epf2bsonFail(reader, EPF_ERROR_MEMORY, "Could not allocate memory repairing strings"));
+            }
+            if (status == DOCUMENT_STRINGS_REJECTED) {
+                reader->skipped++;
+                continue;
+            }
+        }
+        break;
+    }
+    if (!documentBuild(reader->document, reader->id, reader->file, reader->values, reader->options & EPF2BSON_PRIMARY_KEY_ID)) {
+        return(_epf2bsonFail(reader, EPF2BSON_ERROR_DOCUMENT, "Could not build BSON document (out of memory or unknown field type)"));
+    }
+    serialized = bsonSerialize(reader->document);
+    if (!serialized.binaryValue) {
+        return(_epf2bsonFail(reader, EPF_ERROR_MEMORY, "Could not allocate memory serializing BSON document"));
+    }
+    *document = serialized.binaryValue;
+    *length = serialized.length;
+    reader->documents++;
+    return(EPF_OK);
+}
+
+/**
+ * Registers the sink epf2bsonRun() feeds.
+ *
+ * \param reader  Reader.
+ * \param sink    Sink.
+ * \param context Sink context.
+ */
+void epf2bsonSetSink(epf2bsonReader* reader, epf2bsonSink sink, void* context) {
+    reader->sink = sink;
+    reader->sinkContext = context;
+}
+
+/**
+ * Converts all remaining entries into the registered sink.
+ *
+ * \param reader Reader.
+ *
+ * \return EPF_OK once all entries are converted, what the sink returned if
+ *         it stopped conversion, or error status.
+ */
+int epf2bsonRun(epf2bsonReader* reader) {
+    const void* document;
+    size_t length;
+    int status;
+
+    if (!reader->sink) {
+        return(_epf2bsonFail(reader, EPF2BSON_ERROR_SINK, "No sink registered"));
+    }
+    while ((status = epf2bsonNext(reader, &document, &length)) == EPF_OK) {
+        int stop = reader->sink(reader->sinkContext, document, length);
+
+        if (stop) {
+            return(stop);
+        }
+    }
+    return((status == EPF_EOF) ? EPF_OK : status);
+}
+
+/**
+ * Get last error message.
+ *
+ * \param reader Reader.
+ *
+ * \return Error message, empty if none.
+ */
+const char* epf2bsonError(epf2bsonReader* reader) {
+    return(reader->error);
+}
+
+/**
+ * Closes source and releases memory.
+ *
+ * \param reader Reader.
+ */
+void epf2bsonClose(epf2bsonReader* reader) {
+    if (reader->file) {
+        epfDestroy(reader->file);
+    }
+    if (reader->document) {
+        destroyBsonDocument(reader->document);
+    }
+    if (reader->id) {
+        destroyBsonDocument(reader->id);
+    }
+    if (reader->fp) {
+        fclose(reader->fp);
+    }
+    free(reader->values);
+    free(reader->repaired);
+    free(reader);
+}
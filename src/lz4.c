@@ -0,0 +1,257 @@
+/**
+ * LZ4 block format codec.
+ *
+ * Only what spill files need : a single pass greedy compressor and a
+ * bounds checked decompressor, both speaking the standard LZ4 block format.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "lz4.h"
+
+#define LZ4_MINMATCH                4
+#define LZ4_LASTLITERALS            5
+#define LZ4_MFLIMIT                 12
+#define LZ4_HASHLOG                 12
+#define LZ4_MAXOFFSET               65535
+#define LZ4_SKIPTRIGGER             6
+
+/**
+ * Reads 4 bytes (unaligned).
+ *
+ * \param data Data.
+ *
+ * \return Value.
+ */
+uint32_t _lz4Read32(const unsigned char* data) {
+    uint32_t value;
+
+    memcpy(&value, data, sizeof(uint32_t));
+    return(value);
+}
+
+/**
+ * Hash a 4 bytes sequence.
+ *
+ * \param sequence Sequence.
+ *
+ * \return Hash table slot.
+ */
+uint32_t _lz4Hash(uint32_t sequence) {
+    return((sequence * 2654435761U) >> (32 - LZ4_HASHLOG));
+}
+
+/**
+ * Writes a length extension (255 bytes run + remainder).
+ *
+ * \param output Output position.
+ * \param length Length left after the token nibble.
+ *
+ * \return New output position.
+ */
+unsigned char* _lz4WriteLength(unsigned char* output, size_t length) {
+    while (length >= 255) {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = (unsigned char)length;
+    return(output);
+}
+
+/**
+ * Writes a sequence (literals, then a match if matchLength is not 0).
+ *
+ * \param output        Output position.
+ * \param literals      Literals start.
+ * \param literalLength Literals count.
+ * \param offset        Match offset.
+ * \param matchLength   Match length (0 for the last literals only sequence).
+ *
+ * \return New output position.
+ */
+unsigned char* _lz4WriteSequence(
+    unsigned char* output,
+    const unsigned char* literals,
+    size_t literalLength,
+    size_t offset,
+    size_t matchLength
+) {
+    unsigned char* token = output++;
+
+    *token = ((literalLength >= 15) ? 15 : literalLength) << 4;
+    if (literalLength >= 15) {
+        output = _lz4WriteLength(output, literalLength - 15);
+    }
+    memcpy(output, literals, literalLength);
+    output += literalLength;
+    if (!matchLength) {
+        return(output);
+    }
+    *output++ = offset & 0xFF;
+    *output++ = (offset >> 8) & 0xFF;
+    matchLength -= LZ4_MINMATCH;
+    *token |= (matchLength >= 15) ? 15 : matchLength;
+    if (matchLength >= 15) {
+        output = _lz4WriteLength(output, matchLength - 15);
+    }
+    return(output);
+}
+
+
+/**
+ * Maximum compressed size of a block of given size.
+ *
+ * \param length Uncompressed length.
+ *
+ * \return Compressed size upper bound.
+ */
+size_t lz4CompressBound(size_t length) {
+    return(length + (length / 255) + 16);
+}
+
+/**
+ * Compress a block (LZ4 block format, fast greedy matcher).
+ *
+ * \param source      Data to compress.
+ * \param length      Data length.
+ * \param destination Destination buffer (at least lz4CompressBound(length) bytes).
+ *
+ * \return Compressed length.
+ */
+size_t lz4Compress(const void* source, size_t length, void* destination) {
+    const unsigned char* input = source;
+    unsigned char* output = destination;
+    uint32_t table[1 << LZ4_HASHLOG];
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t searches = 1 << LZ4_SKIPTRIGGER;
+
+    memset(table, 0, sizeof(table));
+    while ((length >= LZ4_MFLIMIT) && (position <= length - LZ4_MFLIMIT)) {
+        uint32_t sequence = _lz4Read32(input + position);
+        uint32_t slot = _lz4Hash(sequence);
+        size_t candidate = table[slot];
+        size_t matchLength = LZ4_MINMATCH;
+
+        table[slot] = position;
+        if (
+            (candidate >= position) ||
+            ((position - candidate) > LZ4_MAXOFFSET) ||
+            (_lz4Read32(input + candidate) != sequence)
+        ) {
+            position += (searches++ >> LZ4_SKIPTRIGGER);
+            continue;
+        }
+        while (
+            (position + matchLength < length - LZ4_LASTLITERALS) &&
+            (input[candidate + matchLength] == input[position + matchLength])
+        ) {
+            matchLength++;
+        }
+        output = _lz4WriteSequence(
+            output,
+            input + anchor,
+            position - anchor,
+            position - candidate,
+            matchLength
+        );
+        position += matchLength;
+        anchor = position;
+        searches = 1 << LZ4_SKIPTRIGGER;
+    }
+    output = _lz4WriteSequence(output, input + anchor, length - anchor, 0, 0);
+    return(output - (unsigned char*)destination);
+}
+
+/**
+ * Decompress a block (LZ4 block format).
+ *
+ * \param source            Compressed data.
+ * \param length            Compressed data length.
+ * \param destination       Destination buffer.
+ * \param destinationLength Destination buffer size (exact uncompressed size).
+ *
+ * \return Decompressed length, 0 on corrupted input.
+ */
+size_t lz4Decompress(const void* source, size_t length, void* destination, size_t destinationLength) {
+    const unsigned char* input = source;
+    const unsigned char* inputEnd = input + length;
+    unsigned char* output = destination;
+    unsigned char* outputEnd = output + destinationLength;
+
+    while (input < inputEnd) {
+        unsigned char token = *input++;
+        size_t literalLength = token >> 4;
+        size_t matchLength = token & 15;
+        size_t offset;
+        unsigned char extension;
+
+        if (literalLength == 15) {
+            do {
+                if (input >= inputEnd) {
+                    return(0);
+                }
+                extension = *input++;
+                literalLength += extension;
+            } while (extension == 255);
+        }
+        if ((literalLength > (size_t)(inputEnd - input)) || (literalLength > (size_t)(outputEnd - output))) {
+            return(0);
+        }
+        memcpy(output, input, literalLength);
+        input += literalLength;
+        output += literalLength;
+        if (input == inputEnd) {
+            break;
+        }
+        if (inputEnd - input < 2) {
+            return(0);
+        }
+        offset = input[0] | (input[1] << 8);
+        input += 2;
+        if (!offset || (offset > (size_t)(output - (unsigned char*)destination))) {
+            return(0);
+        }
+        if (matchLength == 15) {
+            do {
+                if (input >= inputEnd) {
+                    return(0);
+                }
+                extension = *input++;
+                matchLength += extension;
+            } while (extension == 255);
+        }
+        matchLength += LZ4_MINMATCH;
+        if (matchLength > (size_t)(outputEnd - output)) {
+            return(0);
+        }
+        if (offset >= matchLength) {
+            memcpy(output, output - offset, matchLength);
+            output += matchLength;
+        } else {
+            for (size_t i = 0; i < matchLength; i++, output++) {
+                *output = *(output - offset);
+            }
+        }
+    }
+    return(output - (unsigned char*)destination);
+}
@@ -27,10 +27,57 @@
 #include "epf.h"
 #include "bson.h"
 #include "error.h"
+#include "filter.h"
+#include "hash.h"
+#include "key.h"
+#include "sort.h"
+#include "cache.h"
+#include "arrow.h"
+#include "utf8.h"
+#include "mongo.h"
+#include "merge.h"
+#include "dedup.h"
+#include "output.h"
+#include "check.h"
+#include "reject.h"
+#include "document.h"
+#include "stats.h"
+#include "manifest.h"
+#include "sink.h"
+#include "json.h"
+
+/**
+ * Long only options identifiers.
+ */
+#define OPTION_SORT_BY_PK           256
+#define OPTION_SORT_MEMORY          257
+#define OPTION_TMPDIR               258
+#define OPTION_PK_ID                259
+#define OPTION_CACHE_DIR            260
+#define OPTION_ARROW                261
+#define OPTION_ARROW_BATCH_ROWS     262
+#define OPTION_INVALID_UTF8         263
+#define OPTION_MONGO_URI            264
+#define OPTION_MONGO_CONNECTIONS    265
+#define OPTION_MERGE_BASE           266
+#define OPTION_MERGE_EPF            267
+#define OPTION_DEDUP                268
+#define OPTION_MMAP_OUTPUT          269
+#define OPTION_VERIFY_MD5           270
+#define OPTION_BSON_CRC32C          271
+#define OPTION_CHECK                272
+#define OPTION_REJECT_FILE          273
+#define OPTION_MAX_ERRORS           274
+#define OPTION_MAX_MEMORY           275
+#define OPTION_DROP_BEHIND          276
+#define OPTION_STATS                277
+#define OPTION_BATCH_ROWS           278
+#define OPTION_MANIFEST             279
+#define OPTION_REUSE                280
+#define OPTION_NDJSON               281
 
 
 programOptions* epf2bsonOptions;
-bool            epfRecoverableReadEmpty;
 
 /**
  * Trim list elements.
@@ -123,6 +170,34 @@ char** _epfListToArray(char* argument) {
     return(list);
 }
 
+/**
+ * Splits --max-memory between buffers. The pipeline runs in one thread : a
+ * full buffer is flushed (sort runs spilled, batches written) before the
+ * next entry is read, so each buffer only needs an upper bound :
+ *  - 1/2 to sorting or merging (--sort-memory is lowered to it),
+ *  - 1/8 to each writer (cache row groups, Arrow batches, MongoDB batches),
+ *  - 1/64 to the longest record, which is held about 6 times (record and
+ *    line buffers, repaired strings, BSON document, sort key).
+ */
+void _splitMemoryBudget() {
+    size_t budget = epf2bsonOptions->maxMemory;
+
+    if (epf2bsonOptions->sortMemory > budget / 2) {
+        epf2bsonOptions->sortMemory = budget / 2;
+    }
+    epf2bsonOptions->bufferMemory = budget / 8;
+    epf2bsonOptions->maxRecord = budget / 64;
+    if (epf2bsonOptions->verbose) {
+        message(
+            "Memory budget: %zu MB (sort %zu MB, writers buffers %zu MB each, records up to %zu KB)",
+            budget / 1048576,
+            epf2bsonOptions->sortMemory / 1048576,
+            epf2bsonOptions->bufferMemory / 1048576,
+            epf2bsonOptions->maxRecord / 1024
+        );
+    }
+}
+
 /**
  * Parse command line arguments.
  *
@@ -133,26 +208,68 @@ char** _epfListToArray(char* argument) {
  */
 void _getOpt(int argc, char** argv) {
     const char* shortOptions;
-    int verbose = 0;
     int optionsIndex = 0;
     int option;
+    long shards;
+    long sortMemory;
+    long arrowBatchRows;
+    long batchRows;
+    long mongoConnections;
+    long maxErrors;
+    long maxMemory;
+    char* end;
     char* collectionList = NULL;
+    size_t mergeEpfCount = 0;
 
     epf2bsonOptions = calloc(1, sizeof(programOptions));
     if (!epf2bsonOptions) {
         error("Unable to allocate memory for options (#1)");
     }
     epf2bsonOptions->verbose = false;
+    epf2bsonOptions->sortMemory = 256 * 1048576;
+    epf2bsonOptions->arrowBatchRows = ARROW_BATCH_ROWS;
+    epf2bsonOptions->batchRows = EPF_BATCH_ROWS;
+    epf2bsonOptions->invalidUtf8 = UTF8_MODE_REPLACE;
+    epf2bsonOptions->mongoConnections = MONGO_CONNECTIONS;
 
-    shortOptions = "ve:n:l:d:";
+    shortOptions = "ve:n:l:d:w:s:k:";
     struct option longOptions[] = {
 
-        {"verbose",     no_argument,        &verbose,   1},
+        {"verbose",     no_argument,        0,          'v'},
 
-        {"epf",         required_argument,  0,          0},
-        {"dbName",      required_argument,  0,          0},
-        {"list",        required_argument,  0,          0},
-        {"dumpdir",     optional_argument,  0,          0},
+        {"epf",         required_argument,  0,          'e'},
+        {"dbName",      required_argument,  0,          'n'},
+        {"list",        required_argument,  0,          'l'},
+        {"dumpdir",     required_argument,  0,          'd'},
+        {"where",       required_argument,  0,          'w'},
+        {"shards",      required_argument,  0,          's'},
+        {"shard-key",   required_argument,  0,          'k'},
+        {"sort-by-pk",  no_argument,        0,          OPTION_SORT_BY_PK},
+        {"sort-memory", required_argument,  0,          OPTION_SORT_MEMORY},
+        {"tmpdir",      required_argument,  0,          OPTION_TMPDIR},
+        {"pk-id",       no_argument,        0,          OPTION_PK_ID},
+        {"cache-dir",   required_argument,  0,          OPTION_CACHE_DIR},
+        {"arrow",       no_argument,        0,          OPTION_ARROW},
+        {"arrow-batch-rows", required_argument, 0,      OPTION_ARROW_BATCH_ROWS},
+        {"invalid-utf8", required_argument, 0,          OPTION_INVALID_UTF8},
+        {"mongo-uri",   required_argument,  0,          OPTION_MONGO_URI},
+        {"mongo-connections", required_argument, 0,     OPTION_MONGO_CONNECTIONS},
+        {"merge-base",  required_argument,  0,          OPTION_MERGE_BASE},
+        {"merge-epf",   required_argument,  0,          OPTION_MERGE_EPF},
+        {"dedup",       required_argument,  0,          OPTION_DEDUP},
+        {"mmap-output", no_argument,        0,          OPTION_MMAP_OUTPUT},
+        {"verify-md5",  no_argument,        0,          OPTION_VERIFY_MD5},
+        {"bson-crc32c", no_argument,        0,          OPTION_BSON_CRC32C},
+        {"check",       no_argument,        0,          OPTION_CHECK},
+        {"reject-file", required_argument,  0,          OPTION_REJECT_FILE},
+        {"max-errors",  required_argument,  0,          OPTION_MAX_ERRORS},
+        {"max-memory",  required_argument,  0,          OPTION_MAX_MEMORY},
+        {"drop-behind", no_argument,        0,          OPTION_DROP_BEHIND},
+        {"stats",       no_argument,        0,          OPTION_STATS},
+        {"batch-rows",  required_argument,  0,          OPTION_BATCH_ROWS},
+        {"manifest",    no_argument,        0,          OPTION_MANIFEST},
+        {"reuse",       required_argument,  0,          OPTION_REUSE},
+        {"ndjson",      no_argument,        0,          OPTION_NDJSON},
 
         {0,0,0,0}
     };
@@ -173,6 +290,145 @@ void _getOpt(int argc, char** argv) {
             case 'd' :
                 epf2bsonOptions->dumpDir = optarg;
                 break;
+            case 'w' :
+                if (!epf2bsonOptions->rowFilter) {
+                    epf2bsonOptions->rowFilter = filterInit();
+                }
+                filterParse(epf2bsonOptions->rowFilter, optarg);
+                epf2bsonOptions->filterHash = hashBytes(optarg, strlen(optarg) + 1, epf2bsonOptions->filterHash);
+                break;
+            case 's' :
+                shards = strtol(optarg, &end, 10);
+                if (*end || (shards < 1) || (shards > 1024)) {
+                    error("Invalid shards count (1 to 1024) : %s", optarg);
+                }
+                epf2bsonOptions->shards = shards;
+                break;
+            case 'k' :
+                epf2bsonOptions->shardKey = optarg;
+                break;
+            case OPTION_SORT_BY_PK :
+                epf2bsonOptions->sortByPk = true;
+                break;
+            case OPTION_SORT_MEMORY :
+                sortMemory = strtol(optarg, &end, 10);
+                if (*end || (sortMemory < 16)) {
+                    error("Invalid sort memory (at least 16 MB) : %s", optarg);
+                }
+                epf2bsonOptions->sortMemory = sortMemory * 1048576;
+                break;
+            case OPTION_TMPDIR :
+                epf2bsonOptions->tempDir = optarg;
+                break;
+            case OPTION_PK_ID :
+                epf2bsonOptions->pkId = true;
+                break;
+            case OPTION_CACHE_DIR :
+                epf2bsonOptions->cacheDir = optarg;
+                break;
+            case OPTION_ARROW :
+                epf2bsonOptions->arrow = true;
+                break;
+            case OPTION_ARROW_BATCH_ROWS :
+                arrowBatchRows = strtol(optarg, &end, 10);
+                if (*end || (arrowBatchRows < 1)) {
+                    error("Invalid Arrow batch rows (at least 1) : %s", optarg);
+                }
+                epf2bsonOptions->arrowBatchRows = arrowBatchRows;
+                break;
+            case OPTION_INVALID_UTF8 :
+                if (!strcmp(optarg, "replace")) {
+                    epf2bsonOptions->invalidUtf8 = UTF8_MODE_REPLACE;
+                } else if (!strcmp(optarg, "reject")) {
+                    epf2bsonOptions->invalidUtf8 = UTF8_MODE_REJECT;
+                } else if (!strcmp(optarg, "pass")) {
+                    epf2bsonOptions->invalidUtf8 = UTF8_MODE_PASS;
+                } else {
+                    error("Invalid UTF-8 mode (replace, reject or pass) : %s", optarg);
+                }
+                break;
+            case OPTION_MONGO_URI :
+                epf2bsonOptions->mongoUri = optarg;
+                break;
+            case OPTION_MONGO_CONNECTIONS :
+                mongoConnections = strtol(optarg, &end, 10);
+                if (*end || (mongoConnections < 1) || (mongoConnections > 64)) {
+                    error("Invalid MongoDB connections count (1 to 64) : %s", optarg);
+                }
+                epf2bsonOptions->mongoConnections = mongoConnections;
+                break;
+            case OPTION_MERGE_BASE :
+                epf2bsonOptions->mergeBase = optarg;
+                break;
+            case OPTION_MERGE_EPF :
+                epf2bsonOptions->mergeEpf = realloc(epf2bsonOptions->mergeEpf, (mergeEpfCount + 2) * sizeof(char*));
+                if (!epf2bsonOptions->mergeEpf) {
+                    error("Cannot allocate memory");
+                }
+                epf2bsonOptions->mergeEpf[mergeEpfCount++] = optarg;
+                epf2bsonOptions->mergeEpf[mergeEpfCount] = NULL;
+                break;
+            case OPTION_DEDUP :
+                if (!strcmp(optarg, "first")) {
+                    epf2bsonOptions->dedup = DEDUP_KEEP_FIRST;
+                } else if (!strcmp(optarg, "last")) {
+                    epf2bsonOptions->dedup = DEDUP_KEEP_LAST;
+                } else {
+                    error("Invalid deduplication mode (first or last) : %s", optarg);
+                }
+                break;
+            case OPTION_MMAP_OUTPUT :
+                epf2bsonOptions->mmapOutput = true;
+                break;
+            case OPTION_VERIFY_MD5 :
+                epf2bsonOptions->verifyMd5 = true;
+                break;
+            case OPTION_BSON_CRC32C :
+                epf2bsonOptions->bsonCrc32c = true;
+                break;
+            case OPTION_CHECK :
+                epf2bsonOptions->check = true;
+                break;
+            case OPTION_REJECT_FILE :
+                epf2bsonOptions->rejectFile = optarg;
+                break;
+            case OPTION_MAX_ERRORS :
+                maxErrors = strtol(optarg, &end, 10);
+                if (*end || (maxErrors < 1)) {
+                    error("Invalid malformed records count : %s", optarg);
+                }
+                epf2bsonOptions->maxErrors = maxErrors;
+                break;
+            case OPTION_MAX_MEMORY :
+                maxMemory = strtol(optarg, &end, 10);
+                if (*end || (maxMemory < 64)) {
+                    error("Invalid memory budget (at least 64 MB) : %s", optarg);
+                }
+                epf2bsonOptions->maxMemory = maxMemory * 1048576;
+                break;
+            case OPTION_DROP_BEHIND :
+                epf2bsonOptions->dropBehind = true;
+                break;
+            case OPTION_STATS :
+                epf2bsonOptions->stats = true;
+                break;
+            case OPTION_BATCH_ROWS :
+                batchRows = strtol(optarg, &end, 10);
+                if (*end || (batchRows < 0)) {
+                    error("Invalid batch rows : %s", optarg);
+                }
+                epf2bsonOptions->batchRows = batchRows;
+                break;
+            case OPTION_MANIFEST :
+                epf2bsonOptions->manifest = true;
+                break;
+            case OPTION_REUSE :
+                epf2bsonOptions->reuseDir = optarg;
+                epf2bsonOptions->manifest = true;
+                break;
+            case OPTION_NDJSON :
+                epf2bsonOptions->ndjson = true;
+                break;
             case '?' :
                 error("Missing argument or invalid option.");
                 break;
@@ -181,15 +437,43 @@ void _getOpt(int argc, char** argv) {
                 exit(EXIT_FAILURE);
         }
     }
-    if (!epf2bsonOptions->dbName) {
+    if (!epf2bsonOptions->dbName && !epf2bsonOptions->check) {
         error("MongoDB database name is required");
     }
     if (!epf2bsonOptions->epfDir) {
         error("EPF files directory is required");
     }
-    if (!epf2bsonOptions->dumpDir) {
+    //Nothing is written in dump directory when inserting into MongoDB, unless other outputs are asked for.
+    if (
+        !epf2bsonOptions->dumpDir &&
+        (!epf2bsonOptions->mongoUri || epf2bsonOptions->arrow || epf2bsonOptions->ndjson || epf2bsonOptions->stats)
+    ) {
         epf2bsonOptions->dumpDir = "dump";
     }
+    if (epf2bsonOptions->shards && !epf2bsonOptions->shardKey) {
+        error("Shard key is required when sharding output");
+    }
+    if (epf2bsonOptions->shardKey && !epf2bsonOptions->shards) {
+        error("Shards count is required with a shard key");
+    }
+    if (epf2bsonOptions->shards && epf2bsonOptions->mongoUri) {
+        error("Sharding output is not supported when inserting into MongoDB");
+    }
+    if (epf2bsonOptions->mergeEpf && !epf2bsonOptions->mergeBase) {
+        error("Previous dump directory (--merge-base) is required to merge EPF files");
+    }
+    if (epf2bsonOptions->mergeBase && epf2bsonOptions->shards) {
+        error("Sharding output is not supported when merging");
+    }
+    if (epf2bsonOptions->mergeBase && epf2bsonOptions->dedup) {
+        error("Merging already keeps the latest entry of each primary key");
+    }
+    if (epf2bsonOptions->manifest && (epf2bsonOptions->mongoUri || epf2bsonOptions->mergeBase)) {
+        error("Run manifest is not supported when inserting into MongoDB or merging");
+    }
+    if (epf2bsonOptions->maxMemory) {
+        _splitMemoryBudget();
+    }
     if (!collectionList) {
         epf2bsonOptions->epfList = NULL;
     } else {
@@ -225,6 +509,198 @@ FILE* _openEPFFile(char* file) {
     return(fp);
 }
 
+/**
+ * Reads an EPF file header.
+ *
+ * \param fp   EPF file handle.
+ * \param path EPF file path.
+ * \param md5  Compute MD5 of the file while reading it (--verify-md5, --manifest).
+ *
+ * \return EPF File instance, ready to read entries.
+ */
+EPFFile* _readEpfHeader(FILE* fp, char* path, bool md5) {
+    EPFFile* file;
+
+    file = epfCreate(
+        fp,
+        (md5 ? EPF_OPTION_MD5 : 0) | (epf2bsonOptions->dropBehind ? EPF_OPTION_DROP_BEHIND : 0)
+    );
+    if (!file) {
+        error("Cannot allocate memory");
+    }
+    if (epf2bsonOptions->verbose) {
+        file->message = message;
+    }
+    file->maxRecordLength = epf2bsonOptions->maxRecord;
+    if (epfReadHeader(file) != EPF_OK) {
+        error("%s : %s", epfError(file), path);
+    }
+    return(file);
+}
+
+/**
+ * Reads next entry of an EPF file or of its cache.
+ *
+ * \param file   EPF File instance.
+ * \param cache  Cache to read entries from, NULL to read EPF file.
+ * \param values Typed values, filled from cache.
+ * \param entry  Raw entry, NULL if a record was skipped.
+ *
+ * \return False at end of file.
+ */
+bool _nextEpfEntry(EPFFile* file, cacheReader* cache, EPFValue* values, char*** entry) {
+    int status;
+
+    if (cache) {
+        *entry = cacheNext(cache, values);
+        if (cache->rejectsExceeded) {
+            error("Too many malformed records (more than %lu)", epf2bsonOptions->rejects->maxErrors);
+        }
+        return(*entry != NULL);
+    }
+    *entry = NULL;
+    status = epfRead(file, entry);
+    if (status == EPF_ERROR_REJECTS) {
+        error("Too many malformed records (more than %lu)", epf2bsonOptions->rejects->maxErrors);
+    }
+    if (status == EPF_ERROR_RECORD) {
+        error("%s, out of --max-memory budget", epfError(file));
+    }
+    if (status < 0) {
+        error("%s", epfError(file));
+    }
+    if (status != EPF_OK) {
+        *entry = NULL;
+    }
+    return(status != EPF_EOF);
+}
+
+/**
+ * Unselects batch entries not matching a row filter, on raw values.
+ *
+ * \param batch     Batch (just read).
+ * \param rowFilter Row filter.
+ *
+ * \return Filtered out entries count.
+ */
+size_t _filterBatch(EPFBatch* batch, filter* rowFilter) {
+    size_t selected = 0;
+
+    for (size_t row = 0; row < batch->rows; row++) {
+        if (filterMatch(rowFilter, batch->entries + row * (batch->fieldsCount + 1))) {
+            batch->selection[selected++] = row;
+        }
+    }
+    batch->selected = selected;
+    return(batch->rows - selected);
+}
+
+/**
+ * Get next entry of an EPF file from a batch, reading next batch when needed.
+ * Entries not matching row filter are dropped before conversion.
+ *
+ * \param file      EPF File instance.
+ * \param batch     Batch.
+ * \param rowFilter Row filter, NULL if none.
+ * \param position  Current entry index in batch selection, incremented.
+ * \param row       Current entry index in batch.
+ * \param entry     Raw entry.
+ * \param values    Typed values of entry.
+ * \param filtered  Filtered out entries count, incremented.
+ *
+ * \return False at end of file.
+ */
+bool _nextBatchEntry(EPFFile* file, EPFBatch* batch, filter* rowFilter, size_t* position, size_t* row, char*** entry, EPFValue** values, long* filtered) {
+    int status;
+
+    if (++*position >= batch->selected) {
+        do {
+            status = epfReadBatch(file, batch);
+            if (status == EPF_ERROR_REJECTS) {
+                error("Too many malformed records (more than %lu)", epf2bsonOptions->rejects->maxErrors);
+            }
+            if (status == EPF_ERROR_RECORD) {
+                error("%s, out of --max-memory budget", epfError(file));
+            }
+            if (status < 0) {
+                error("%s", epfError(file));
+            }
+            if (status == EPF_EOF) {
+                return(false);
+            }
+            if (rowFilter) {
+                *filtered += _filterBatch(batch, rowFilter);
+            }
+        } while (!batch->selected);
+        epfConvertBatch(file, batch);
+        *position = 0;
+    }
+    *row = batch->selection[*position];
+    *entry = batch->entries + *row * (batch->fieldsCount + 1);
+    *values = batch->values + *row * batch->fieldsCount;
+    return(true);
+}
+
+/**
+ * Checks an EPF file read up to its end against its <file>.md5 (--verify-md5).
+ *
+ * \param epfFile EPFFile instance, read up to EOF.
+ * \param path    EPF file path.
+ */
+void _verifyEpfMd5(EPFFile* epfFile, char* path) {
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    char computed[MD5_DIGEST_LENGTH * 2 + 1];
+    char expected[MD5_DIGEST_LENGTH * 2 + 1] = { 0 };
+    char content[4096];
+    char* md5Path;
+    FILE* fp;
+    size_t length;
+    size_t digits = 0;
+
+    if (!epf2bsonOptions->verifyMd5 || !epfDigest(epfFile, digest)) {
+        return;
+    }
+    for (size_t i = 0; i < MD5_DIGEST_LENGTH; i++) {
+        sprintf(computed + i * 2, "%02x", digest[i]);
+    }
+    md5Path = calloc(strlen(path) + 5, sizeof(char));
+    if (!md5Path) {
+        error("Cannot allocate memory");
+    }
+    sprintf(md5Path, "%s.md5", path);
+    fp = fopen(md5Path, "r");
+    if (!fp) {
+        warning("No MD5 file to verify EPF file against : %s", md5Path);
+        free(md5Path);
+        return;
+    }
+    length = fread(content, 1, sizeof(content) - 1, fp);
+    content[length] = 0;
+    fclose(fp);
+    //Digest is the 32 hex digits word : "<md5>  <file>" (md5sum) or "MD5 (<file>) = <md5>".
+    for (size_t i = 0; i <= length; i++) {
+        if (isxdigit((unsigned char)content[i])) {
+            digits++;
+            continue;
+        }
+        if (digits == MD5_DIGEST_LENGTH * 2) {
+            for (size_t j = 0; j < digits; j++) {
+                expected[j] = tolower((unsigned char)content[i - digits + j]);
+            }
+            break;
+        }
+        digits = 0;
+    }
+    if (!expected[0]) {
+        error("Invalid MD5 file : %s", md5Path);
+    }
+    if (strcmp(expected, computed)) {
+        error("EPF file is corrupted, MD5 is %s instead of %s : %s", computed, expected, path);
+    }
+    message("MD5 verified: %s", path);
+    free(md5Path);
+}
+
 /**
  * Checks epf files dir and stores realpath.
  */
@@ -261,6 +737,24 @@ void _checkEpfDir() {
     }
 }
 
+/**
+ * Checks and create if necessary cache dir.
+ */
+void _checkCacheDir() {
+    struct stat statBuffer;
+
+    if (stat(epf2bsonOptions->cacheDir, &statBuffer) == -1) {
+        if ((errno != ENOENT) || mkdir(epf2bsonOptions->cacheDir, 0755)) {
+            error("Cannot create cache directory (%s) : %s", strerror(errno), epf2bsonOptions->cacheDir);
+        }
+    } else if (!S_ISDIR(statBuffer.st_mode)) {
+        error("Cache directory is not a directory : %s", epf2bsonOptions->cacheDir);
+    }
+    if (access(epf2bsonOptions->cacheDir, R_OK | W_OK) == -1) {
+        error("Cannot write in cache directory (%s) : %s", strerror(errno), epf2bsonOptions->cacheDir);
+    }
+}
+
 /**
  * Checks and create if necessary dump dir and stores realpath.
  */
@@ -327,100 +821,361 @@ void _checkDumpDir() {
     epf2bsonOptions->dumpDir = realPath;
 }
 
+/**
+ * Get the shard key field index of an EPF file.
+ *
+ * \param epfFile EPF File instance.
+ *
+ * \return Field index, -1 if the file does not declare the shard key.
+ */
+long _getShardKeyIndex(EPFFile* epfFile) {
+    for (size_t i = 0; i < epfFile->fieldsCount; i++) {
+        if (!strcmp(epfFile->fields[i]->fieldName, epf2bsonOptions->shardKey)) {
+            return(i);
+        }
+    }
+    if (epf2bsonOptions->verbose) {
+        message("No '%s' field, sharding on whole rows", epf2bsonOptions->shardKey);
+    }
+    return(-1);
+}
+
+/**
+ * Get the shard an entry belongs to.
+ *
+ * \param entry         Raw entry.
+ * \param shardKeyIndex Shard key field index (-1 to hash the whole entry).
+ * \param shards        Shards count.
+ *
+ * \return Shard index.
+ */
+size_t _getEntryShard(char** entry, long shardKeyIndex, size_t shards) {
+    uint64_t hash = 0;
+
+    if (shardKeyIndex >= 0) {
+        hash = hashBytes(entry[shardKeyIndex], strlen(entry[shardKeyIndex]), 0);
+    } else {
+        for (size_t i = 0; entry[i]; i++) {
+            hash = hashBytes(entry[i], strlen(entry[i]), hash);
+        }
+    }
+    return(hash % shards);
+}
+
+/**
+ * Writes a serialized document.
+ *
+ * \param bson     BSON file.
+ * \param mongo    MongoDB sink to insert document into instead, NULL if none.
+ * \param document Document.
+ * \param length   Document length.
+ */
+void _writeDocument(bsonOutput* bson, mongoSink* mongo, const void* document, size_t length) {
+    if (mongo) {
+        mongoInsert(mongo, document, length);
+    } else {
+        outputWrite(bson, document, length);
+    }
+}
+
+/**
+ * Writes a serialized document, also feeding other outputs its values.
+ *
+ * \param bson     BSON file.
+ * \param mongo    MongoDB sink to insert document into instead, NULL if none.
+ * \param sinks    Other outputs, NULL if none.
+ * \param epfFile  EPF File instance the document was built from.
+ * \param values   Typed values buffer (fieldsCount values).
+ * \param document Document.
+ * \param length   Document length.
+ */
+void _writeDecodedDocument(bsonOutput* bson, mongoSink* mongo, rowSink* sinks, EPFFile* epfFile, EPFValue* values, const void* document, size_t length) {
+    _writeDocument(bson, mongo, document, length);
+    if (!sinks) {
+        return;
+    }
+    if (!documentValues(epfFile, document, length, values)) {
+        error("Unexpected field type in BSON document");
+    }
+    sinkWrite(sinks, values);
+}
+
+/**
+ * Writes documents of a sorter, keeping one document per key when deduplicating.
+ *
+ * \param sorter  Sorter.
+ * \param bson    BSON file.
+ * \param mongo   MongoDB sink to insert documents into instead, NULL if none.
+ * \param sinks   Other outputs to also feed written documents to, NULL if none.
+ * \param epfFile EPF File instance.
+ * \param values  Typed values buffer (fieldsCount values).
+ *
+ * \return Dropped duplicate documents count.
+ */
+long _writeSorted(externalSorter* sorter, bsonOutput* bson, mongoSink* mongo, rowSink* sinks, EPFFile* epfFile, EPFValue* values) {
+    sortRecord record;
+    unsigned char* held = NULL;
+    size_t heldAllocated = 0;
+    size_t heldKeyLength = 0;
+    size_t heldLength = 0;
+    long dropped = 0;
+
+    if (!epf2bsonOptions->dedup) {
+        while (sorterNext(sorter, &record)) {
+            _writeDecodedDocument(bson, mongo, sinks, epfFile, values, record.value, record.valueLength);
+        }
+        return(0);
+    }
+    while (sorterNext(sorter, &record)) {
+        if (held && !keyCompare(held, heldKeyLength, record.key, record.keyLength)) {
+            dropped++;
+            if (epf2bsonOptions->dedup == DEDUP_KEEP_FIRST) {
+                continue;
+            }
+        } else if (held) {
+            _writeDecodedDocument(bson, mongo, sinks, epfFile, values, held + heldKeyLength, heldLength);
+        }
+        if (record.keyLength + record.valueLength > heldAllocated) {
+            heldAllocated = (record.keyLength + record.valueLength) * 2;
+            free(held);
+            held = malloc(heldAllocated);
+            if (!held) {
+                error("Cannot allocate memory");
+            }
+        }
+        memcpy(held, record.key, record.keyLength);
+        memcpy(held + record.keyLength, record.value, record.valueLength);
+        heldKeyLength = record.keyLength;
+        heldLength = record.valueLength;
+    }
+    if (held) {
+        _writeDecodedDocument(bson, mongo, sinks, epfFile, values, held + heldKeyLength, heldLength);
+    }
+    free(held);
+    return(dropped);
+}
+
 /**
  * Write an epf file as bson.
  *
- * \param epfFile   EPF File instance.
- * \param bsonFile  BSON file path.
+ * \param epfFile       EPF File instance.
+ * \param bsonFiles     BSON files paths (NULL terminated, one per shard).
+ * \param shardKeyIndex Shard key field index (-1 to hash the whole entry).
+ * \param cache         Cache to read entries from, NULL to read EPF file.
+ * \param cacheOut      Cache to store EPF file entries into, NULL if none.
+ * \param mongo         MongoDB sink to insert entries into instead of BSON files, NULL if none.
+ * \param merger        Merger to add entries to instead of writing them, NULL if not merging.
+ * \param dedup         Duplicate keys filter when deduplicating unsorted entries, NULL if none.
+ * \param sinks         Other outputs to also feed written documents to, NULL if none.
  */
-void _writeEpfInBson(EPFFile* epfFile, char* bsonFile) {
-    FILE* bson;
+void _writeEpfInBson(EPFFile* epfFile, char** bsonFiles, long shardKeyIndex, cacheReader* cache, cacheWriter* cacheOut, mongoSink* mongo, bsonMerger* merger, dedupFilter* dedup, rowSink* sinks) {
+    bsonOutput** bson;
+    struct stat statBuffer;
+    uint64_t inputSize = 0;
+    size_t shards = 0;
+    size_t shard = 0;
     bsonDocument* doc;
+    bsonDocument* id;
     bsonSerializedValue serialized;
     char** entry;
+    EPFValue* values;
+    EPFValue* rowValues;
+    EPFBatch* batch = NULL;
+    size_t batchPosition = 0;
+    size_t batchRow = 0;
+    filter* rowFilter = epf2bsonOptions->rowFilter;
+    filter* batchFilter = NULL;
     size_t i = 0;
     long j = 0;
-    bsonInt64 i64Value;
-    bsonInt32 i32Value;
-    bsonDouble doubleValue;
+    long filtered = 0;
+    long repairedEntries = 0;
+    long rejected = 0;
+    long duplicates = 0;
+    char* repaired = NULL;
+    size_t repairedAllocated = 0;
+    externalSorter** sorters = NULL;
+    keyBuffer* key = NULL;
 
-    message("Exporting to BSON file: %s", bsonFile);
-    bson = fopen(bsonFile, "w");
+    shards = epf2bsonOptions->shards ? epf2bsonOptions->shards : 1;
+    bson = calloc(shards, sizeof(bsonOutput*));
     if (!bson) {
-        error("Could not create file (%s) : %s", strerror(errno), bsonFile);
+        error("Cannot allocate memory");
+    }
+    if (cache) {
+        inputSize = cache->mappingLength;
+    } else if (!fstat(fileno(epfFile->fp), &statBuffer)) {
+        inputSize = statBuffer.st_size;
+    }
+    for (i = 0; !mongo && !merger && (i < shards); i++) {
+        message("Exporting to BSON file: %s", bsonFiles[i]);
+        bson[i] = outputOpen(bsonFiles[i], epf2bsonOptions->mmapOutput, epf2bsonOptions->bsonCrc32c, epf2bsonOptions->dropBehind, inputSize * OUTPUT_DEFAULT_RATIO / shards);
+    }
+    if (epf2bsonOptions->dedup && !epfFile->primaryKeyCount) {
+        warning("No primary key declared, documents will not be deduplicated");
     }
-    while(
-            (entry = epfNextEntry(epfFile)) ||
-            epfRecoverableReadEmpty
+    if (dedup) {
+        key = keyInit();
+    }
+    if (epf2bsonOptions->sortByPk && !merger) {
+        if (!epfFile->primaryKeyCount) {
+            warning("No primary key declared, documents will not be sorted");
+        } else {
+            if (!key) {
+                key = keyInit();
+            }
+            sorters = calloc(shards, sizeof(externalSorter*));
+            if (!sorters) {
+                error("Cannot allocate memory");
+            }
+            for (i = 0; i < shards; i++) {
+                sorters[i] = sorterInit(epf2bsonOptions->tempDir, epf2bsonOptions->sortMemory / shards);
+            }
+        }
+    }
+    values = calloc(epfFile->fieldsCount, sizeof(EPFValue));
+    if (!values) {
+        error("Cannot allocate memory");
+    }
+    rowValues = values;
+    if (!cache && epf2bsonOptions->batchRows) {
+        batch = epfBatchCreate(
+            epfFile,
+            epf2bsonOptions->batchRows,
+            (epf2bsonOptions->bufferMemory && (epf2bsonOptions->bufferMemory < EPF_BATCH_BYTES)) ? epf2bsonOptions->bufferMemory : EPF_BATCH_BYTES
+        );
+        if (!batch) {
+            error("Cannot allocate memory");
+        }
+        //Filter raw entries before converting them, unless all go to cache.
+        if (!cacheOut) {
+            batchFilter = rowFilter;
+            rowFilter = NULL;
+        }
+    }
+    doc = createBsonDocument();
+    id = createBsonDocument();
+    if (!doc || !id) {
+        error("Cannot allocate memory");
+    }
+    while (
+        batch ?
+        _nextBatchEntry(epfFile, batch, batchFilter, &batchPosition, &batchRow, &entry, &rowValues, &filtered) :
+        _nextEpfEntry(epfFile, cache, values, &entry)
     ) {
-        if (epfRecoverableReadEmpty) {
+        if (!entry) {
             continue;
         }
-        i = 0;
-        doc = createBsonDocument();
-        while(i < epfFile->fieldsCount) {
-            if (!entry[i]) {
-                break;
+        if (cacheOut) {
+            if (!batch) {
+                epfConvertEntry(epfFile, entry, values);
             }
-            if (!strlen(entry[i])) {
-                bsonAddNull(doc, epfFile->fields[i]->fieldName);
+            cacheAppend(cacheOut, batch ? batch->offsets[batchRow] : epfFile->lastEntryOffset, rowValues);
+        }
+        if (rowFilter && !filterMatch(rowFilter, entry)) {
+            filtered++;
+            continue;
+        }
+        if (key) {
+            keyEncode(key, epfFile, entry);
+        }
+        if (dedup && !dedupKeep(dedup, key->data, key->length)) {
+            duplicates++;
+            continue;
+        }
+        if (shards > 1) {
+            if ((shardKeyIndex >= 0) && !entry[shardKeyIndex]) {
+                shard = 0;
             } else {
-                switch(epfGetFieldType(epfFile, i)) {
-                    case EPF_FIELDTYPE_BIGINT :
-                    case EPF_FIELDTYPE_INTEGER :
-                        i64Value = strtol(entry[i], NULL, 10);
-                        if (i64Value >= INT_MIN && i64Value <= INT_MAX) {
-                            i32Value = i64Value;
-                            bsonAddInt32(doc, epfFile->fields[i]->fieldName, i32Value);
-                        } else {
-                            bsonAddInt64(doc, epfFile->fields[i]->fieldName, i64Value);
-                        }                    
-                        break;
-                    case EPF_FIELDTYPE_BOOLEAN :
-                        if (!strncmp("0", entry[i], 1)) {
-                            bsonAddBool(doc, epfFile->fields[i]->fieldName, false);
-                        } else {
-                            bsonAddBool(doc, epfFile->fields[i]->fieldName, true);
-                        }
-                        break;
-                    case EPF_FIELDTYPE_VARCHAR :
-                    case EPF_FIELDTYPE_LONGTEXT :
-                        bsonAddString(doc, epfFile->fields[i]->fieldName, entry[i]);
-                        break;
-                    case EPF_FIELDTYPE_DATETIME :
-                        i64Value = strtol(entry[i], NULL, 10);
-                        i64Value *= 1000;
-                        bsonAddDate(doc, epfFile->fields[i]->fieldName, i64Value);
-                        break;
-                    case EPF_FIELDTYPE_DECIMAL :
-                        doubleValue = strtod(entry[i], NULL);
-                        bsonAddDouble(doc, epfFile->fields[i]->fieldName, doubleValue);
-                        break;
-                    case 0:
-                    default :
-                        error("Unknown EPF field type, aborting");
-                        break;
-                }
+                shard = _getEntryShard(entry, shardKeyIndex, shards);
             }
-            free(entry[i]);
-            i++;
         }
+        if (!cache && !batch && !cacheOut) {
+            epfConvertEntry(epfFile, entry, values);
+        }
+        if (epf2bsonOptions->invalidUtf8 != UTF8_MODE_PASS) {
+            int checked = documentCheckStrings(epfFile, rowValues, epf2bsonOptions->invalidUtf8, &repaired, &repairedAllocated);
 
-        free(entry);
+            if (checked == DOCUMENT_STRINGS_MEMORY) {
+                error("Cannot allocate memory");
+            }
+            if (checked == DOCUMENT_STRINGS_REJECTED) {
+                if (!rejectEntry(epf2bsonOptions->rejects, batch ? batch->offsets[batchRow] : epfFile->lastEntryOffset, "Invalid UTF-8 string", entry, epfFile->fieldsCount)) {
+                    error("Too many malformed records (more than %lu)", epf2bsonOptions->rejects->maxErrors);
+                }
+                rejected++;
+                continue;
+            }
+            repairedEntries += checked;
+        }
+        if (!documentBuild(doc, id, epfFile, rowValues, epf2bsonOptions->pkId)) {
+            error("Cannot build BSON document (out of memory or unknown EPF field type)");
+        }
         serialized = bsonSerialize(doc);
+        if (!serialized.binaryValue) {
+            error("Cannot allocate memory");
+        }
 
-        fwrite(serialized.binaryValue, 1, serialized.length, bson);
-
-        free(serialized.binaryValue);
-        destroyBsonDocument(doc);
+        if (merger) {
+            mergeAdd(merger, rowValues, serialized.binaryValue, serialized.length);
+        } else if (sorters) {
+            sorterAdd(sorters[shard], key->data, key->length, serialized.binaryValue, serialized.length);
+        } else {
+            _writeDocument(bson[shard], mongo, serialized.binaryValue, serialized.length);
+            sinkWrite(sinks, rowValues);
+        }
 
         if (j && !(j % 10000)) {
             message("Exported %'li entries.", j);
+            if (epf2bsonOptions->mmapOutput && !cache && !mongo && !merger && epfFile->lastEntryOffset) {
+                for (i = 0; i < shards; i++) {
+                    outputEstimate(bson[i], (double)bson[i]->position * inputSize / epfFile->lastEntryOffset);
+                }
+            }
         }
         j++;
     }
+    if (sorters) {
+        message("Writing entries sorted by primary key.");
+        for (i = 0; i < shards; i++) {
+            duplicates += _writeSorted(sorters[i], bson[i], mongo, sinks, epfFile, values);
+            if (epf2bsonOptions->verbose) {
+                message("Sort used %lu temporary run(s).", sorters[i]->spilledRuns);
+            }
+            sorterDestroy(sorters[i]);
+        }
+        free(sorters);
+    }
+    if (key) {
+        keyDestroy(key);
+    }
     message("Exported %li entries.", j);
-    fclose(bson);
+    if (filtered) {
+        message("Filtered out %li entries.", filtered);
+    }
+    if (duplicates) {
+        warning(
+            "Dropped %li entries with a duplicate primary key (kept %s one).",
+            duplicates,
+            (epf2bsonOptions->dedup == DEDUP_KEEP_FIRST) ? "first" : "last"
+        );
+    }
+    if (repairedEntries) {
+        warning("Replaced invalid UTF-8 sequences in %li entries.", repairedEntries);
+    }
+    if (rejected) {
+        warning("Rejected %li entries with invalid UTF-8 strings.", rejected);
+    }
+    for (i = 0; !mongo && !merger && (i < shards); i++) {
+        outputClose(bson[i]);
+    }
+    free(bson);
+    free(values);
+    if (batch) {
+        epfBatchDestroy(batch);
+    }
+    free(repaired);
+    destroyBsonDocument(doc);
+    destroyBsonDocument(id);
 }
 
 
@@ -487,6 +1242,7 @@ char** _getCollectionsList() {
 
         if (
                 (glob_results.gl_pathv[i][strLen - 1] != '/') &&
+                ((strLen < 4) || strcmp(glob_results.gl_pathv[i] + strLen - 4, ".md5")) &&
                 _collectionsIsToParse(glob_results.gl_pathv[i])
         ) {
             filesList[index] = calloc(strLen + 1, sizeof(char));
@@ -497,7 +1253,7 @@ char** _getCollectionsList() {
             index++;
         }
     }
-    for(size_t i = 0; epf2bsonOptions->epfList[i]; i++) {
+    for(size_t i = 0; epf2bsonOptions->epfList && epf2bsonOptions->epfList[i]; i++) {
         free(epf2bsonOptions->epfList[i]);
     }
     free(epf2bsonOptions->epfList);
@@ -509,60 +1265,653 @@ char** _getCollectionsList() {
  * Generate the bson file path for a given EPF file.
  *
  * \param epfFile EPF File path.
+ * \param shard   Shard index, -1 if output is not sharded.
  *
  * \return File path.
  */
-char* _getBsonFilePath(char* epfFile) {
+char* _getBsonFilePath(char* epfFile, long shard) {
     char* bsonPath;
     char* copy;
+    char shardSuffix[32] = "";
 
     copy = strdup(epfFile);
     epfFile = basename(copy);
-    bsonPath = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(epfFile) + 7, sizeof(char));
+    if (shard >= 0) {
+        snprintf(shardSuffix, sizeof(shardSuffix), ".shard%li", shard);
+    }
+    bsonPath = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(epfFile) + strlen(shardSuffix) + 7, sizeof(char));
     if (!bsonPath) {
         error("Cannot allocate memory");
     }
     strcpy(bsonPath, epf2bsonOptions->dumpDir);
     strcat(bsonPath, "/");
     strcat(bsonPath, epfFile);
+    strcat(bsonPath, shardSuffix);
     strcat(bsonPath, ".bson");
     free(copy);
     return(bsonPath);
 }
 
 /**
- * Generate the metadata json file path for a given EPF file.
+ * Generate the Arrow file path for a given EPF file.
  *
  * \param epfFile EPF File path.
  *
  * \return File path.
  */
-char* _getMetaFilePath(char* epfFile) {
-    char* jsonPath;
+char* _getArrowFilePath(char* epfFile) {
+    char* arrowPath;
     char* copy;
 
     copy = strdup(epfFile);
     epfFile = basename(copy);
-    jsonPath = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(epfFile) + 16, sizeof(char));
-    if (!jsonPath) {
+    arrowPath = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(epfFile) + 8, sizeof(char));
+    if (!arrowPath) {
         error("Cannot allocate memory");
     }
-    strcpy(jsonPath, epf2bsonOptions->dumpDir);
-    strcat(jsonPath, "/");
-    strcat(jsonPath, epfFile);
-    strcat(jsonPath, ".metadata.json");
+    strcpy(arrowPath, epf2bsonOptions->dumpDir);
+    strcat(arrowPath, "/");
+    strcat(arrowPath, epfFile);
+    strcat(arrowPath, ".arrow");
     free(copy);
-    return(jsonPath);
+    return(arrowPath);
 }
 
 /**
- * Export EPF index as Mongo metadata json file.
+ * Generate the NDJSON file path for a given EPF file.
  *
- * \param epfFile     EPF File instance.
- * \param epfFilePath EPF file path.
- * \param jsonFile    JSON file path.
+ * \param epfFile EPF File path.
+ *
+ * \return File path.
  */
-void _writeMetadataInJson(EPFFile* epfFile, char* epfFilePath, char* jsonFile) {
+char* _getNdjsonFilePath(char* epfFile) {
+    char* ndjsonPath;
+    char* copy;
+
+    copy = strdup(epfFile);
+    epfFile = basename(copy);
+    ndjsonPath = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(epfFile) + 9, sizeof(char));
+    if (!ndjsonPath) {
+        error("Cannot allocate memory");
+    }
+    strcpy(ndjsonPath, epf2bsonOptions->dumpDir);
+    strcat(ndjsonPath, "/");
+    strcat(ndjsonPath, epfFile);
+    strcat(ndjsonPath, ".ndjson");
+    free(copy);
+    return(ndjsonPath);
+}
+
+/**
+ * Generate the statistics json file path for a given EPF file.
+ *
+ * \param epfFile EPF File path.
+ *
+ * \return File path.
+ */
+char* _getStatsFilePath(char* epfFile) {
+    char* statsPath;
+    char* copy;
+
+    copy = strdup(epfFile);
+    epfFile = basename(copy);
+    statsPath = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(epfFile) + 13, sizeof(char));
+    if (!statsPath) {
+        error("Cannot allocate memory");
+    }
+    strcpy(statsPath, epf2bsonOptions->dumpDir);
+    strcat(statsPath, "/");
+    strcat(statsPath, epfFile);
+    strcat(statsPath, ".stats.json");
+    free(copy);
+    return(statsPath);
+}
+
+/**
+ * Generate the previous dump BSON file path for a given EPF file.
+ *
+ * \param epfFile EPF File path.
+ *
+ * \return File path.
+ */
+char* _getMergeBasePath(char* epfFile) {
+    char* basePath;
+    char* copy;
+
+    copy = strdup(epfFile);
+    epfFile = basename(copy);
+    basePath = calloc(strlen(epf2bsonOptions->mergeBase) + strlen(epfFile) + 7, sizeof(char));
+    if (!basePath) {
+        error("Cannot allocate memory");
+    }
+    strcpy(basePath, epf2bsonOptions->mergeBase);
+    strcat(basePath, "/");
+    strcat(basePath, epfFile);
+    strcat(basePath, ".bson");
+    free(copy);
+    return(basePath);
+}
+
+/**
+ * Generate the cache file path for a given EPF file.
+ *
+ * \param epfFile EPF File path.
+ *
+ * \return File path.
+ */
+char* _getCacheFilePath(char* epfFile) {
+    char* cachePath;
+    char* copy;
+
+    copy = strdup(epfFile);
+    epfFile = basename(copy);
+    cachePath = calloc(strlen(epf2bsonOptions->cacheDir) + strlen(epfFile) + 7, sizeof(char));
+    if (!cachePath) {
+        error("Cannot allocate memory");
+    }
+    strcpy(cachePath, epf2bsonOptions->cacheDir);
+    strcat(cachePath, "/");
+    strcat(cachePath, epfFile);
+    strcat(cachePath, ".epfc");
+    free(copy);
+    return(cachePath);
+}
+
+/**
+ * Generate the metadata json file path for a given EPF file.
+ *
+ * \param epfFile EPF File path.
+ * \param shard   Shard index, -1 if output is not sharded.
+ *
+ * \return File path.
+ */
+char* _getMetaFilePath(char* epfFile, long shard) {
+    char* jsonPath;
+    char* copy;
+    char shardSuffix[32] = "";
+
+    copy = strdup(epfFile);
+    epfFile = basename(copy);
+    if (shard >= 0) {
+        snprintf(shardSuffix, sizeof(shardSuffix), ".shard%li", shard);
+    }
+    jsonPath = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(epfFile) + strlen(shardSuffix) + 16, sizeof(char));
+    if (!jsonPath) {
+        error("Cannot allocate memory");
+    }
+    strcpy(jsonPath, epf2bsonOptions->dumpDir);
+    strcat(jsonPath, "/");
+    strcat(jsonPath, epfFile);
+    strcat(jsonPath, shardSuffix);
+    strcat(jsonPath, ".metadata.json");
+    free(copy);
+    return(jsonPath);
+}
+
+/**
+ * Scans primary keys of an EPF file for duplicates.
+ *
+ * \param epfPath   EPF file path.
+ * \param cacheFile Cache file to read entries from, NULL to read EPF file.
+ *
+ * \return Duplicate keys filter.
+ */
+dedupFilter* _scanPrimaryKeys(char* epfPath, char* cacheFile) {
+    FILE* fp = NULL;
+    EPFFile* file;
+    cacheReader* cache = NULL;
+    EPFValue* values = NULL;
+    dedupFilter* filter;
+    keyBuffer* key;
+    struct stat statBuffer;
+    char** entry;
+    size_t rowBytes = 0;
+
+    if (stat(epfPath, &statBuffer) == -1) {
+        error("EPF File does not exists : %s", epfPath);
+    }
+    if (cacheFile) {
+        cache = cacheOpen(cacheFile, &statBuffer);
+        if (!cache) {
+            error("Cannot read cache file : %s", cacheFile);
+        }
+        file = cache->file;
+        values = calloc(file->fieldsCount, sizeof(EPFValue));
+        if (!values) {
+            error("Cannot allocate memory");
+        }
+    } else {
+        fp = _openEPFFile(epfPath);
+        file = _readEpfHeader(fp, epfPath, epf2bsonOptions->verifyMd5);
+    }
+    message("Scanning primary keys for duplicates: %s", epfPath);
+    filter = dedupInit(statBuffer.st_size, epf2bsonOptions->dedup);
+    key = keyInit();
+    while(_nextEpfEntry(file, cache, values, &entry)) {
+        if (!entry || (epf2bsonOptions->rowFilter && !filterMatch(epf2bsonOptions->rowFilter, entry))) {
+            continue;
+        }
+        keyEncode(key, file, entry);
+        if (filter->scanned < DEDUP_SAMPLE_ROWS) {
+            rowBytes = 1;
+            for (size_t i = 0; (i < file->fieldsCount) && entry[i]; i++) {
+                rowBytes += strlen(entry[i]) + 1;
+            }
+        }
+        dedupScan(filter, key->data, key->length, rowBytes);
+    }
+    dedupScanEnd(filter);
+    if (!cache) {
+        _verifyEpfMd5(file, epfPath);
+    }
+    message("Found %'lu possibly duplicated key(s) in %'lu entries.", filter->count, filter->scanned);
+    keyDestroy(key);
+    free(values);
+    if (cache) {
+        cacheClose(cache);
+    } else {
+        epfDestroy(file);
+        fclose(fp);
+    }
+    return(filter);
+}
+
+/**
+ * Adds entries of older incremental EPF files of a collection to a merge.
+ *
+ * \param merger    Merger.
+ * \param epfFile   Collection EPF file path (in EPF files directory).
+ * \param bsonFiles BSON files paths.
+ */
+void _mergeOlderEpf(bsonMerger* merger, char* epfFile, char** bsonFiles) {
+    FILE* fp;
+    EPFFile* olderFile;
+    char* copy;
+    char* olderPath;
+    struct stat statBuffer;
+
+    copy = strdup(epfFile);
+    if (!copy) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; epf2bsonOptions->mergeEpf[i]; i++) {
+        olderPath = calloc(strlen(epf2bsonOptions->mergeEpf[i]) + strlen(copy) + 2, sizeof(char));
+        if (!olderPath) {
+            error("Cannot allocate memory");
+        }
+        sprintf(olderPath, "%s/%s", epf2bsonOptions->mergeEpf[i], basename(copy));
+        if (stat(olderPath, &statBuffer) == -1) {
+            message("No older EPF File to merge: %s", olderPath);
+            free(olderPath);
+            continue;
+        }
+        fp = _openEPFFile(olderPath);
+        message("Parsing older EPF File: %s", olderPath);
+        olderFile = _readEpfHeader(fp, olderPath, epf2bsonOptions->verifyMd5);
+        olderFile->reject = rejectHandler;
+        olderFile->rejectContext = epf2bsonOptions->rejects;
+        rejectStart(epf2bsonOptions->rejects, olderPath);
+        if (!olderFile->incremental) {
+            warning("Merging a full export : %s", olderPath);
+        }
+        mergeBind(merger, olderFile);
+        if (epf2bsonOptions->rowFilter) {
+            filterBind(epf2bsonOptions->rowFilter, olderFile);
+        }
+        _writeEpfInBson(olderFile, bsonFiles, -1, NULL, NULL, NULL, merger, NULL, NULL);
+        rejectEnd(epf2bsonOptions->rejects);
+        _verifyEpfMd5(olderFile, olderPath);
+        epfDestroy(olderFile);
+        fclose(fp);
+        free(olderPath);
+    }
+    free(copy);
+}
+
+/**
+ * Write merged documents as bson.
+ *
+ * \param merger   Merger (all entries added).
+ * \param bsonFile BSON file path.
+ * \param mongo    MongoDB sink to insert documents into instead, NULL if none.
+ * \param sinks    Other outputs to also feed merged documents to, NULL if none.
+ */
+void _writeMergedBson(bsonMerger* merger, char* bsonFile, mongoSink* mongo, rowSink* sinks) {
+    bsonOutput* bson = NULL;
+    sortRecord record;
+    struct stat statBuffer;
+    uint64_t estimate = 0;
+    EPFValue* values;
+
+    values = calloc(merger->file->fieldsCount, sizeof(EPFValue));
+    if (!values) {
+        error("Cannot allocate memory");
+    }
+    if (!mongo) {
+        message("Exporting to BSON file: %s", bsonFile);
+        if (merger->base && !fstat(fileno(merger->base), &statBuffer)) {
+            estimate = statBuffer.st_size + statBuffer.st_size / 8;
+        }
+        bson = outputOpen(bsonFile, epf2bsonOptions->mmapOutput, epf2bsonOptions->bsonCrc32c, epf2bsonOptions->dropBehind, estimate);
+    }
+    message("Merging with previous dump: %s", merger->basePath);
+    while (mergeNext(merger, &record)) {
+        _writeDecodedDocument(bson, mongo, sinks, merger->file, values, record.value, record.valueLength);
+    }
+    message(
+        "Merged : %'lu entries kept, %'lu replaced, %'lu added.",
+        merger->kept,
+        merger->replaced,
+        merger->added
+    );
+    if (merger->superseded) {
+        message("Superseded %'lu older incremental entries.", merger->superseded);
+    }
+    if (bson) {
+        outputClose(bson);
+    }
+    free(values);
+}
+
+/**
+ * Hashes the options outputs depend on, for the run manifest.
+ *
+ * \return Settings hash.
+ */
+uint64_t _getSettingsHash() {
+    char settings[512];
+    uint64_t hash;
+
+    hash = hashBytes(epf2bsonOptions->dbName, strlen(epf2bsonOptions->dbName) + 1, MANIFEST_VERSION);
+    if (epf2bsonOptions->shardKey) {
+        hash = hashBytes(epf2bsonOptions->shardKey, strlen(epf2bsonOptions->shardKey) + 1, hash);
+    }
+    snprintf(
+        settings,
+        sizeof(settings),
+        "shards=%u sort=%d pkid=%d utf8=%u dedup=%u arrow=%d/%zu/%zu ndjson=%d stats=%d crc32c=%d filters=%016" PRIx64,
+        epf2bsonOptions->shards,
+        epf2bsonOptions->sortByPk,
+        epf2bsonOptions->pkId,
+        epf2bsonOptions->invalidUtf8,
+        epf2bsonOptions->dedup,
+        epf2bsonOptions->arrow,
+        epf2bsonOptions->arrow ? epf2bsonOptions->arrowBatchRows : 0,
+        epf2bsonOptions->arrow ? epf2bsonOptions->bufferMemory : 0,
+        epf2bsonOptions->ndjson,
+        epf2bsonOptions->stats,
+        epf2bsonOptions->bsonCrc32c,
+        epf2bsonOptions->filterHash
+    );
+    return(hashBytes(settings, strlen(settings), hash));
+}
+
+/**
+ * Reads the manifest of previous dump (--reuse).
+ *
+ * \param settings Current settings hash.
+ *
+ * \return Manifest, NULL if it cannot be used.
+ */
+runManifest* _readPreviousManifest(uint64_t settings) {
+    runManifest* previous;
+    char* path;
+
+    path = calloc(strlen(epf2bsonOptions->reuseDir) + strlen(MANIFEST_FILE) + 2, sizeof(char));
+    if (!path) {
+        error("Cannot allocate memory");
+    }
+    sprintf(path, "%s/%s", epf2bsonOptions->reuseDir, MANIFEST_FILE);
+    previous = manifestRead(path);
+    if (!previous) {
+        warning("No usable manifest in previous dump, converting all collections : %s", path);
+    } else if (previous->settings != settings) {
+        warning("Options changed since previous dump, converting all collections : %s", path);
+        manifestDestroy(previous);
+        previous = NULL;
+    }
+    free(path);
+    return(previous);
+}
+
+/**
+ * Copies a previous dump output file (when it cannot be hard linked).
+ *
+ * \param source      Previous output path.
+ * \param destination Output path.
+ */
+void _copyOutput(char* source, char* destination) {
+    FILE* in;
+    FILE* out;
+    char* buffer;
+    size_t length;
+
+    in = fopen(source, "r");
+    if (!in) {
+        error("Could not read file (%s) : %s", strerror(errno), source);
+    }
+    out = fopen(destination, "w");
+    if (!out) {
+        error("Could not create file (%s) : %s", strerror(errno), destination);
+    }
+    buffer = malloc(MANIFEST_HASH_CHUNK);
+    if (!buffer) {
+        error("Cannot allocate memory");
+    }
+    while ((length = fread(buffer, 1, MANIFEST_HASH_CHUNK, in))) {
+        if (fwrite(buffer, 1, length, out) != length) {
+            error("Could not write file (%s) : %s", strerror(errno), destination);
+        }
+    }
+    if (ferror(in)) {
+        error("Could not read file (%s) : %s", strerror(errno), source);
+    }
+    if (fclose(out)) {
+        error("Could not write file (%s) : %s", strerror(errno), destination);
+    }
+    fclose(in);
+    free(buffer);
+}
+
+/**
+ * Reuses previous dump outputs of a collection if its input is unchanged.
+ *
+ * Size and modification time matching the previous input are trusted, else
+ * a same size input is hashed.
+ *
+ * \param previous Previous dump manifest.
+ * \param epfFile  EPF file path.
+ * \param input    EPF file stat.
+ * \param hash     EPF file content hash, set if hashed is.
+ * \param hashed   EPF file content hash is known.
+ *
+ * \return Reused collection, NULL if collection is to convert.
+ */
+manifestEntry* _reuseCollection(runManifest* previous, char* epfFile, struct stat* input, uint64_t* hash, bool* hashed) {
+    manifestEntry* entry;
+    struct stat statBuffer;
+    char* copy;
+    char* source;
+    char* destination;
+    size_t length = 0;
+
+    copy = strdup(epfFile);
+    if (!copy) {
+        error("Cannot allocate memory");
+    }
+    entry = manifestFind(previous, basename(copy));
+    free(copy);
+    if (!entry || (entry->size != (uint64_t)input->st_size)) {
+        return(NULL);
+    }
+    if ((entry->mtime.tv_sec == input->st_mtim.tv_sec) && (entry->mtime.tv_nsec == input->st_mtim.tv_nsec)) {
+        *hash = entry->hash;
+    } else if (!manifestHashFile(epfFile, hash)) {
+        error("Cannot read EPF file (%s) : %s", strerror(errno), epfFile);
+    }
+    *hashed = true;
+    if (*hash != entry->hash) {
+        return(NULL);
+    }
+    for (size_t i = 0; entry->outputs[i]; i++) {
+        if (strlen(entry->outputs[i]) > length) {
+            length = strlen(entry->outputs[i]);
+        }
+    }
+    source = calloc(strlen(epf2bsonOptions->reuseDir) + length + 2, sizeof(char));
+    destination = calloc(strlen(epf2bsonOptions->dumpDir) + length + 2, sizeof(char));
+    if (!source || !destination) {
+        error("Cannot allocate memory");
+    }
+    //All outputs must still be there before any is linked.
+    for (size_t i = 0; entry->outputs[i]; i++) {
+        sprintf(source, "%s/%s", epf2bsonOptions->reuseDir, entry->outputs[i]);
+        if (stat(source, &statBuffer) == -1) {
+            warning("Previous dump output is missing, converting collection : %s", source);
+            entry = NULL;
+            break;
+        }
+    }
+    for (size_t i = 0; entry && entry->outputs[i]; i++) {
+        sprintf(source, "%s/%s", epf2bsonOptions->reuseDir, entry->outputs[i]);
+        sprintf(destination, "%s/%s", epf2bsonOptions->dumpDir, entry->outputs[i]);
+        if (link(source, destination)) {
+            if ((errno != EXDEV) && (errno != EPERM) && (errno != EMLINK)) {
+                error("Cannot link previous dump output (%s) : %s", strerror(errno), source);
+            }
+            _copyOutput(source, destination);
+        }
+    }
+    if (entry) {
+        message("Reusing unchanged collection from previous dump: %s", epfFile);
+    }
+    free(source);
+    free(destination);
+    return(entry);
+}
+
+/**
+ * Lists output files names of a collection, for the run manifest.
+ *
+ * \param epfFile   EPF File path.
+ * \param bsonFiles BSON files paths (NULL terminated).
+ * \param jsonFiles Metadata json files paths (one per BSON file).
+ *
+ * \return Output files names (NULL terminated, to free with each name).
+ */
+char** _getOutputFiles(char* epfFile, char** bsonFiles, char** jsonFiles) {
+    char** outputs;
+    char* path;
+    size_t shards = 0;
+    size_t count = 0;
+
+    while (bsonFiles[shards]) {
+        shards++;
+    }
+    outputs = calloc(shards * 3 + 4, sizeof(char*));
+    if (!outputs) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < shards; i++) {
+        outputs[count++] = strdup(bsonFiles[i]);
+        if (epf2bsonOptions->bsonCrc32c) {
+            path = calloc(strlen(bsonFiles[i]) + 8, sizeof(char));
+            if (path) {
+                sprintf(path, "%s.crc32c", bsonFiles[i]);
+            }
+            outputs[count++] = path;
+        }
+        outputs[count++] = strdup(jsonFiles[i]);
+    }
+    if (epf2bsonOptions->arrow) {
+        outputs[count++] = _getArrowFilePath(epfFile);
+    }
+    if (epf2bsonOptions->ndjson) {
+        outputs[count++] = _getNdjsonFilePath(epfFile);
+    }
+    if (epf2bsonOptions->stats) {
+        outputs[count++] = _getStatsFilePath(epfFile);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!outputs[i]) {
+            error("Cannot allocate memory");
+        }
+        //Names only : outputs are all in dump directory.
+        path = strdup(basename(outputs[i]));
+        if (!path) {
+            error("Cannot allocate memory");
+        }
+        free(outputs[i]);
+        outputs[i] = path;
+    }
+    return(outputs);
+}
+
+/**
+ * Opens the outputs fed alongside BSON by the conversion pass.
+ *
+ * \param epfFile     EPF File instance (header parsed).
+ * \param epfFilePath EPF file path.
+ *
+ * \return Sinks, NULL if none.
+ */
+rowSink* _openSinks(EPFFile* epfFile, char* epfFilePath) {
+    rowSink* sinks = NULL;
+    arrowWriter* arrow;
+    char* path;
+    char* copy;
+
+    if (epf2bsonOptions->arrow) {
+        path = _getArrowFilePath(epfFilePath);
+        message("Exporting to Arrow file: %s", path);
+        arrow = arrowCreate(path, epfFile, epf2bsonOptions->arrowBatchRows);
+        arrow->batchBytes = epf2bsonOptions->bufferMemory;
+        sinkAdd(&sinks, arrowSink(arrow));
+        free(path);
+    }
+    if (epf2bsonOptions->ndjson) {
+        path = _getNdjsonFilePath(epfFilePath);
+        message("Exporting to NDJSON file: %s", path);
+        sinkAdd(&sinks, jsonSink(jsonCreate(path, epfFile, epf2bsonOptions->pkId, epf2bsonOptions->dropBehind)));
+        free(path);
+    }
+    if (epf2bsonOptions->stats) {
+        path = _getStatsFilePath(epfFilePath);
+        copy = strdup(epfFilePath);
+        if (!copy) {
+            error("Cannot allocate memory");
+        }
+        message("Exporting to statistics JSON file: %s", path);
+        sinkAdd(&sinks, statsSink(statsInit(epfFile), basename(copy), path));
+        free(copy);
+        free(path);
+    }
+    return(sinks);
+}
+
+/**
+ * Tells if an EPF field index is exported as a MongoDB index.
+ *
+ * \param epfFile EPF File instance.
+ * \param field   Field index.
+ *
+ * \return true if exported (the _id index covers a single field primary key with --pk-id).
+ */
+bool _isIndexExported(EPFFile* epfFile, size_t field) {
+    return(
+        epfFile->fields[field]->indexed &&
+        !(epf2bsonOptions->pkId && (epfFile->primaryKeyCount == 1) && (epfFile->primaryKey[0] == field))
+    );
+}
+
+/**
+ * Export EPF index as Mongo metadata json file.
+ *
+ * \param epfFile     EPF File instance.
+ * \param epfFilePath EPF file path.
+ * \param jsonFile    JSON file path.
+ */
+void _writeMetadataInJson(EPFFile* epfFile, char* epfFilePath, char* jsonFile) {
     char* jsonData = calloc(1024, sizeof(char));
     size_t allocated = 1024;
     size_t index = 0;
@@ -586,7 +1935,7 @@ void _writeMetadataInJson(EPFFile* epfFile, char* epfFilePath, char* jsonFile) {
         int entryLength;
         char* entry;
 
-        if (epfFile->fields[i]->indexed) {
+        if (_isIndexExported(epfFile, i)) {
             entryLength = strlen(indexFormat);
             entryLength += strlen(epf2bsonOptions->dbName);
             entryLength += strlen(collectionName);
@@ -632,6 +1981,64 @@ void _writeMetadataInJson(EPFFile* epfFile, char* epfFilePath, char* jsonFile) {
     message("Exported %i indexe(s)", count);
 }
 
+/**
+ * Create EPF indexes on the MongoDB collection being inserted into.
+ *
+ * \param epfFile EPF File instance.
+ * \param mongo   MongoDB sink.
+ */
+void _createMongoIndexes(EPFFile* epfFile, mongoSink* mongo) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < epfFile->fieldsCount; i++) {
+        if (_isIndexExported(epfFile, i)) {
+            mongoCreateIndex(mongo, epfFile->fields[i]->fieldName);
+            count++;
+        }
+    }
+    message("Created %lu indexe(s)", count);
+}
+
+/**
+ * Checks EPF files without converting them (--check).
+ *
+ * \return EXIT_SUCCESS if no error was found, EXIT_FAILURE elsewhere.
+ */
+int _checkEpfFiles() {
+    FILE* fp;
+    EPFFile* epfFile;
+    checkReport* report;
+    char** files;
+    size_t failed = 0;
+    size_t count = 0;
+
+    files = _getCollectionsList();
+    for(size_t i = 0; files[i]; i++) {
+        fp = _openEPFFile(files[i]);
+        message("Checking EPF File: %s", files[i]);
+        epfFile = _readEpfHeader(fp, files[i], epf2bsonOptions->verifyMd5);
+        epfFile->reject = rejectHandler;
+        epfFile->rejectContext = epf2bsonOptions->rejects;
+        rejectStart(epf2bsonOptions->rejects, files[i]);
+        report = checkFile(epfFile);
+        rejectEnd(epf2bsonOptions->rejects);
+        _verifyEpfMd5(epfFile, files[i]);
+        checkPrint(report, files[i]);
+        if (checkErrors(report)) {
+            failed++;
+        }
+        count++;
+        checkDestroy(report);
+        epfDestroy(epfFile);
+        fclose(fp);
+        free(files[i]);
+    }
+    free(files);
+    message("Checked %'lu EPF file(s), %'lu with errors.", count, failed);
+    rejectClose(epf2bsonOptions->rejects);
+    return(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
 /**
  * Validates MongoDB db name is valid.
  */
@@ -667,40 +2074,250 @@ void _checkDbName() {
 int main(int argc, char** argv) {
     FILE* fp;
     EPFFile* epfFile;
+    cacheReader* cache;
+    cacheWriter* cacheOut;
+    char* cacheFile;
+    rowSink* sinks;
+    struct stat statBuffer;
     char** files;
-    char* bsonFile;
-    char* jsonFile;
+    char** bsonFiles;
+    char** jsonFiles;
+    size_t shards;
+    long shardKeyIndex;
+    mongoSink* mongo = NULL;
+    bsonMerger* merger;
+    dedupFilter* dedup;
+    char* collectionName;
+    char* basePath;
+    runManifest* manifest = NULL;
+    runManifest* previous = NULL;
+    manifestEntry* reused;
+    struct stat inputStat;
+    uint64_t inputHash = 0;
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    bool hashed;
+    char** outputs;
+    char* manifestFile;
 
     setlocale(LC_ALL, "en_US.utf-8");
 
     _getOpt(argc, argv);
+    if (epf2bsonOptions->check) {
+        _checkEpfDir();
+        epf2bsonOptions->rejects = rejectOpen(epf2bsonOptions->rejectFile, epf2bsonOptions->maxErrors);
+        return(_checkEpfFiles());
+    }
     _checkDbName();
     _checkEpfDir();
-    _checkDumpDir();
+    if (epf2bsonOptions->dumpDir) {
+        _checkDumpDir();
+    }
+    epf2bsonOptions->rejects = rejectOpen(epf2bsonOptions->rejectFile, epf2bsonOptions->maxErrors);
+    if (!epf2bsonOptions->tempDir) {
+        epf2bsonOptions->tempDir = epf2bsonOptions->dumpDir;
+    }
+    if (!epf2bsonOptions->tempDir) {
+        epf2bsonOptions->tempDir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    }
+    if (epf2bsonOptions->cacheDir) {
+        _checkCacheDir();
+    }
+
+    if (epf2bsonOptions->mongoUri) {
+        mongo = mongoConnect(epf2bsonOptions->mongoUri, epf2bsonOptions->mongoConnections);
+        if (epf2bsonOptions->bufferMemory && (epf2bsonOptions->bufferMemory < mongo->batchBytes)) {
+            mongo->batchBytes = epf2bsonOptions->bufferMemory;
+        }
+    }
+
+    if (epf2bsonOptions->manifest) {
+        manifest = manifestInit(_getSettingsHash());
+        if (epf2bsonOptions->reuseDir) {
+            previous = _readPreviousManifest(manifest->settings);
+        }
+    }
 
     files = _getCollectionsList();
 
     for(size_t i = 0; files[i]; i++) {
-        fp = _openEPFFile(files[i]);
-        bsonFile = _getBsonFilePath(files[i]);
-        jsonFile = _getMetaFilePath(files[i]);
+        hashed = false;
+        if (manifest) {
+            if (stat(files[i], &inputStat) == -1) {
+                error("EPF File does not exists : %s", files[i]);
+            }
+            reused = previous ? _reuseCollection(previous, files[i], &inputStat, &inputHash, &hashed) : NULL;
+            if (reused) {
+                manifestAdd(manifest, reused->collection, &inputStat, inputHash, reused->outputs);
+                free(files[i]);
+                continue;
+            }
+        }
+        fp = NULL;
+        cache = NULL;
+        cacheOut = NULL;
+        cacheFile = NULL;
+        if (epf2bsonOptions->cacheDir) {
+            if (stat(files[i], &statBuffer) == -1) {
+                error("EPF File does not exists : %s", files[i]);
+            }
+            cacheFile = _getCacheFilePath(files[i]);
+            cache = cacheOpen(cacheFile, &statBuffer);
+        }
+        shards = epf2bsonOptions->shards ? epf2bsonOptions->shards : 1;
+        bsonFiles = calloc(shards + 1, sizeof(char*));
+        jsonFiles = calloc(shards + 1, sizeof(char*));
+        if (!bsonFiles || !jsonFiles) {
+            error("Cannot allocate memory");
+        }
+        for (size_t j = 0; epf2bsonOptions->dumpDir && (j < shards); j++) {
+            bsonFiles[j] = _getBsonFilePath(files[i], epf2bsonOptions->shards ? (long)j : -1);
+            jsonFiles[j] = _getMetaFilePath(files[i], epf2bsonOptions->shards ? (long)j : -1);
+        }
 
-        message("Parsing EPF File: %s", files[i]);
-        epfFile = epfInit(fp);
-        message("Parsed !");
+        if (cache) {
+            message("Reading EPF File from cache: %s", cacheFile);
+            epfFile = cache->file;
+            epfFile->reject = rejectHandler;
+            epfFile->rejectContext = epf2bsonOptions->rejects;
+        } else {
+            fp = _openEPFFile(files[i]);
+            message("Parsing EPF File: %s", files[i]);
+            epfFile = _readEpfHeader(fp, files[i], epf2bsonOptions->verifyMd5 || manifest);
+            epfFile->reject = rejectHandler;
+            epfFile->rejectContext = epf2bsonOptions->rejects;
+            message("Parsed !");
+            if (cacheFile) {
+                message("Caching EPF File to: %s", cacheFile);
+                cacheOut = cacheCreate(cacheFile, epfFile, &statBuffer);
+                //Malformed records are kept in cache, to be rejected again by next runs.
+                cacheOut->reject = epfFile->reject;
+                cacheOut->rejectContext = epfFile->rejectContext;
+                epfFile->reject = cacheReject;
+                epfFile->rejectContext = cacheOut;
+                if (epf2bsonOptions->bufferMemory && (epf2bsonOptions->bufferMemory < cacheOut->maxGroupBytes)) {
+                    cacheOut->maxGroupBytes = epf2bsonOptions->bufferMemory;
+                }
+            }
+        }
+        merger = NULL;
+        if (epf2bsonOptions->mergeBase) {
+            if (!epfFile->incremental) {
+                warning("Merging a full export : %s", files[i]);
+            }
+            basePath = _getMergeBasePath(files[i]);
+            merger = mergeInit(epfFile, basePath, epf2bsonOptions->tempDir, epf2bsonOptions->sortMemory);
+            free(basePath);
+            if (epf2bsonOptions->mergeEpf) {
+                _mergeOlderEpf(merger, files[i], bsonFiles);
+                mergeBind(merger, epfFile);
+            }
+        }
+        if (epf2bsonOptions->rowFilter) {
+            filterBind(epf2bsonOptions->rowFilter, epfFile);
+        }
 
-        _writeEpfInBson(epfFile, bsonFile);
-        _writeMetadataInJson(epfFile, files[i], jsonFile);
+        shardKeyIndex = epf2bsonOptions->shards ? _getShardKeyIndex(epfFile) : -1;
 
-        epfDestroy(epfFile);
-        fclose(fp);
+        sinks = _openSinks(epfFile, files[i]);
+        collectionName = NULL;
+        if (mongo) {
+            collectionName = strdup(files[i]);
+            if (!collectionName) {
+                error("Cannot allocate memory");
+            }
+            mongoStart(mongo, epf2bsonOptions->dbName, basename(collectionName));
+        }
+        dedup = NULL;
+        if (epf2bsonOptions->dedup && !epf2bsonOptions->sortByPk && epfFile->primaryKeyCount) {
+            dedup = _scanPrimaryKeys(files[i], cache ? cacheFile : NULL);
+        }
+        rejectStart(epf2bsonOptions->rejects, files[i]);
+        _writeEpfInBson(epfFile, bsonFiles, shardKeyIndex, cache, cacheOut, mongo, merger, dedup, sinks);
+        rejectEnd(epf2bsonOptions->rejects);
+        if (!cache && !dedup) {
+            _verifyEpfMd5(epfFile, files[i]);
+        }
+        if (dedup) {
+            dedupDestroy(dedup);
+        }
+        if (merger) {
+            _writeMergedBson(merger, bsonFiles[0], mongo, sinks);
+            mergeDestroy(merger);
+        }
+        if (mongo) {
+            mongoFinish(mongo);
+            _createMongoIndexes(epfFile, mongo);
+            free(collectionName);
+        }
+        if (cacheOut) {
+            cacheCommit(cacheOut);
+        }
+        sinkClose(sinks);
+        for (size_t j = 0; j < shards; j++) {
+            if (!mongo) {
+                _writeMetadataInJson(epfFile, files[i], jsonFiles[j]);
+            }
+        }
+        if (manifest) {
+            //EPF file is hashed while converted, unless read from cache.
+            if (!hashed && !cache && epfDigest(epfFile, digest)) {
+                inputHash = manifestDigestHash(digest);
+            } else if (!hashed && !manifestHashFile(files[i], &inputHash)) {
+                error("Cannot read EPF file (%s) : %s", strerror(errno), files[i]);
+            }
+            outputs = _getOutputFiles(files[i], bsonFiles, jsonFiles);
+            collectionName = strdup(files[i]);
+            if (!collectionName) {
+                error("Cannot allocate memory");
+            }
+            manifestAdd(manifest, basename(collectionName), &inputStat, inputHash, outputs);
+            for (size_t j = 0; outputs[j]; j++) {
+                free(outputs[j]);
+            }
+            free(outputs);
+            free(collectionName);
+        }
+        for (size_t j = 0; j < shards; j++) {
+            free(bsonFiles[j]);
+            free(jsonFiles[j]);
+        }
+
+        if (cache) {
+            cacheClose(cache);
+        } else {
+            epfDestroy(epfFile);
+            fclose(fp);
+        }
+        free(cacheFile);
         free(files[i]);
-        free(bsonFile);
-        free(jsonFile);
+        free(bsonFiles);
+        free(jsonFiles);
     }
     free(files);
+    if (manifest) {
+        manifestFile = calloc(strlen(epf2bsonOptions->dumpDir) + strlen(MANIFEST_FILE) + 2, sizeof(char));
+        if (!manifestFile) {
+            error("Cannot allocate memory");
+        }
+        sprintf(manifestFile, "%s/%s", epf2bsonOptions->dumpDir, MANIFEST_FILE);
+        message("Writing run manifest: %s", manifestFile);
+        manifestWrite(manifest, manifestFile);
+        free(manifestFile);
+        manifestDestroy(manifest);
+    }
+    if (previous) {
+        manifestDestroy(previous);
+    }
+    if (mongo) {
+        mongoClose(mongo);
+    }
+    if (epf2bsonOptions->rowFilter) {
+        filterDestroy(epf2bsonOptions->rowFilter);
+    }
+    rejectClose(epf2bsonOptions->rejects);
     free(epf2bsonOptions->epfDir);
     free(epf2bsonOptions->dumpDir);
+    free(epf2bsonOptions->mergeEpf);
     free(epf2bsonOptions);
     return (EXIT_SUCCESS);
 }
@@ -0,0 +1,310 @@
+/**
+ * Run manifest : inputs and outputs of each collection of a dump, so that
+ * a later run can reuse outputs of unchanged inputs.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "digest.h"
+#include "manifest.h"
+
+/**
+ * Parses a manifest collection line.
+ *
+ * \param manifest Manifest.
+ * \param line     Line (modified).
+ *
+ * \return False if line is malformed.
+ */
+bool _manifestParseLine(runManifest* manifest, char* line) {
+    char* fields[4];
+    char** outputs;
+    size_t outputsCount = 0;
+    struct stat input;
+    char* end;
+    char* field;
+    bool valid = true;
+
+    for (size_t i = 0; i < 4; i++) {
+        fields[i] = strsep(&line, "\t");
+        if (!fields[i] || !*fields[i] || !line) {
+            return(false);
+        }
+    }
+    memset(&input, 0, sizeof(struct stat));
+    input.st_size = strtoull(fields[1], &end, 10);
+    if (*end) {
+        return(false);
+    }
+    input.st_mtim.tv_sec = strtoll(fields[2], &end, 10);
+    if (*end != '.') {
+        return(false);
+    }
+    input.st_mtim.tv_nsec = strtol(end + 1, &end, 10);
+    if (*end) {
+        return(false);
+    }
+    //At most one output per remaining field.
+    outputs = calloc(strlen(line) / 2 + 2, sizeof(char*));
+    if (!outputs) {
+        error("Cannot allocate memory");
+    }
+    while ((field = strsep(&line, "\t"))) {
+        //Output names are file names in dump directory.
+        if (!*field || strchr(field, '/')) {
+            valid = false;
+            break;
+        }
+        outputs[outputsCount++] = field;
+    }
+    if (valid) {
+        manifestAdd(manifest, fields[0], &input, strtoull(fields[3], NULL, 16), outputs);
+    }
+    free(outputs);
+    return(valid);
+}
+
+
+/**
+ * Creates an empty manifest.
+ *
+ * \param settings Hash of the options outputs depend on.
+ *
+ * \return Manifest.
+ */
+runManifest* manifestInit(uint64_t settings) {
+    runManifest* manifest;
+
+    manifest = calloc(1, sizeof(runManifest));
+    if (!manifest) {
+        error("Cannot allocate memory");
+    }
+    manifest->settings = settings;
+    return(manifest);
+}
+
+/**
+ * Reads the manifest of a dump.
+ *
+ * \param path Manifest file path.
+ *
+ * \return Manifest, NULL if missing or not readable.
+ */
+runManifest* manifestRead(char* path) {
+    runManifest* manifest;
+    FILE* fp;
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t length;
+    unsigned int version;
+    uint64_t settings;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        return(NULL);
+    }
+    if (
+        (getline(&line, &allocated, fp) == -1) ||
+        (sscanf(line, "#EPF2Bson manifest\t%u\t%" SCNx64, &version, &settings) != 2) ||
+        (version != MANIFEST_VERSION)
+    ) {
+        free(line);
+        fclose(fp);
+        return(NULL);
+    }
+    manifest = manifestInit(settings);
+    while ((length = getline(&line, &allocated, fp)) != -1) {
+        if (length && (line[length - 1] == '\n')) {
+            line[--length] = 0;
+        }
+        if (!_manifestParseLine(manifest, line)) {
+            manifestDestroy(manifest);
+            manifest = NULL;
+            break;
+        }
+    }
+    free(line);
+    fclose(fp);
+    return(manifest);
+}
+
+/**
+ * Finds a collection.
+ *
+ * \param manifest   Manifest.
+ * \param collection Collection name.
+ *
+ * \return Collection, NULL if not found.
+ */
+manifestEntry* manifestFind(runManifest* manifest, const char* collection) {
+    for (size_t i = 0; i < manifest->count; i++) {
+        if (!strcmp(manifest->entries[i].collection, collection)) {
+            return(manifest->entries + i);
+        }
+    }
+    return(NULL);
+}
+
+/**
+ * Hashes a file content.
+ *
+ * \param path File path.
+ * \param hash Content hash.
+ *
+ * \return False if file could not be read.
+ */
+bool manifestHashFile(const char* path, uint64_t* hash) {
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    md5Context md5;
+    FILE* fp;
+    char* chunk;
+    size_t length;
+    bool read;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        return(false);
+    }
+    chunk = malloc(MANIFEST_HASH_CHUNK);
+    if (!chunk) {
+        error("Cannot allocate memory");
+    }
+    md5Init(&md5);
+    while ((length = fread(chunk, 1, MANIFEST_HASH_CHUNK, fp))) {
+        md5Update(&md5, chunk, length);
+    }
+    read = !ferror(fp);
+    free(chunk);
+    fclose(fp);
+    md5Final(&md5, digest);
+    *hash = manifestDigestHash(digest);
+    return(read);
+}
+
+/**
+ * Content hash of a file from its MD5 digest (computed while reading it).
+ *
+ * \param digest MD5 digest (MD5_DIGEST_LENGTH bytes).
+ *
+ * \return Content hash.
+ */
+uint64_t manifestDigestHash(const unsigned char* digest) {
+    uint64_t hash;
+
+    memcpy(&hash, digest, sizeof(hash));
+    return(le64toh(hash));
+}
+
+/**
+ * Adds a collection.
+ *
+ * \param manifest   Manifest.
+ * \param collection Collection name.
+ * \param input      Input stat.
+ * \param hash       Input content hash.
+ * \param outputs    Output files names (NULL terminated), copied.
+ */
+void manifestAdd(runManifest* manifest, const char* collection, struct stat* input, uint64_t hash, char** outputs) {
+    manifestEntry* entry;
+    size_t count = 0;
+
+    if (manifest->count == manifest->allocated) {
+        manifest->allocated = manifest->allocated ? manifest->allocated * 2 : 64;
+        manifest->entries = realloc(manifest->entries, manifest->allocated * sizeof(manifestEntry));
+        if (!manifest->entries) {
+            error("Cannot allocate memory");
+        }
+    }
+    while (outputs[count]) {
+        count++;
+    }
+    entry = manifest->entries + manifest->count++;
+    entry->collection = strdup(collection);
+    entry->size = input->st_size;
+    entry->mtime = input->st_mtim;
+    entry->hash = hash;
+    entry->outputs = calloc(count + 1, sizeof(char*));
+    if (!entry->collection || !entry->outputs) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < count; i++) {
+        entry->outputs[i] = strdup(outputs[i]);
+        if (!entry->outputs[i]) {
+            error("Cannot allocate memory");
+        }
+    }
+}
+
+/**
+ * Writes a manifest.
+ *
+ * \param manifest Manifest.
+ * \param path     Manifest file path.
+ */
+void manifestWrite(runManifest* manifest, char* path) {
+    manifestEntry* entry;
+    FILE* fp;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        error("Could not create file (%s) : %s", strerror(errno), path);
+    }
+    fprintf(fp, "#EPF2Bson manifest\t%u\t%016" PRIx64 "\n", MANIFEST_VERSION, manifest->settings);
+    for (size_t i = 0; i < manifest->count; i++) {
+        entry = manifest->entries + i;
+        fprintf(
+            fp,
+            "%s\t%" PRIu64 "\t%lld.%09ld\t%016" PRIx64,
+            entry->collection,
+            entry->size,
+            (long long)entry->mtime.tv_sec,
+            entry->mtime.tv_nsec,
+            entry->hash
+        );
+        for (size_t j = 0; entry->outputs[j]; j++) {
+            fprintf(fp, "\t%s", entry->outputs[j]);
+        }
+        fprintf(fp, "\n");
+    }
+    if (fclose(fp)) {
+        error("Could not write file (%s) : %s", strerror(errno), path);
+    }
+}
+
+/**
+ * Destroy a manifest and release memory.
+ *
+ * \param manifest Manifest.
+ */
+void manifestDestroy(runManifest* manifest) {
+    for (size_t i = 0; i < manifest->count; i++) {
+        for (size_t j = 0; manifest->entries[i].outputs[j]; j++) {
+            free(manifest->entries[i].outputs[j]);
+        }
+        free(manifest->entries[i].outputs);
+        free(manifest->entries[i].collection);
+    }
+    free(manifest->entries);
+    free(manifest);
+}
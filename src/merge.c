@@ -0,0 +1,318 @@
+/**
+ * Incremental feed merge.
+ *
+ * Streams a new full dump out of a previous one and incremental EPF files,
+ * keeping the latest document of each primary key.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "bson.h"
+#include "document.h"
+#include "key.h"
+#include "sort.h"
+#include "merge.h"
+
+/**
+ * Makes room in a buffer.
+ *
+ * \param buffer    Buffer.
+ * \param allocated Buffer allocated size.
+ * \param needed    Needed size.
+ */
+void _mergeReserve(unsigned char** buffer, size_t* allocated, size_t needed) {
+    if (needed <= *allocated) {
+        return;
+    }
+    while (needed > *allocated) {
+        *allocated = *allocated ? *allocated * 2 : 4096;
+    }
+    *buffer = realloc(*buffer, *allocated);
+    if (!*buffer) {
+        error("Cannot allocate memory");
+    }
+}
+
+/**
+ * Decodes a primary key field of a previous dump document.
+ *
+ * \param merger Merger.
+ * \param index  Primary key field index.
+ * \param value  Filled with typed value.
+ */
+void _mergeDecodeField(bsonMerger* merger, size_t index, EPFValue* value) {
+    const char* field;
+    char type = 0;
+
+    field = bsonFindField((char*)merger->baseDocument, merger->baseLength, merger->keyNames[index], &type);
+    if (!documentDecodeValue(merger->keyTypes[index], type, field, value)) {
+        error("Unexpected type of primary key field '%s' in previous dump : %s", merger->keyNames[index], merger->basePath);
+    }
+}
+
+/**
+ * Reads next previous dump document and its key.
+ *
+ * \param merger Merger.
+ */
+void _mergeReadBase(bsonMerger* merger) {
+    int32_t length;
+    keyBuffer* swap;
+    EPFValue value;
+
+    merger->baseValid = false;
+    merger->basePending = false;
+    if (!merger->base) {
+        return;
+    }
+    if (fread(&length, sizeof(int32_t), 1, merger->base) != 1) {
+        if (ferror(merger->base)) {
+            error("Cannot read previous dump (%s) : %s", strerror(errno), merger->basePath);
+        }
+        return;
+    }
+    length = le32toh(length);
+    if ((length < 5) || (length > MERGE_MAX_DOCUMENT)) {
+        error("Invalid document in previous dump : %s", merger->basePath);
+    }
+    _mergeReserve(&merger->baseDocument, &merger->baseAllocated, length);
+    memcpy(merger->baseDocument, &length, sizeof(int32_t));
+    if (fread(merger->baseDocument + sizeof(int32_t), length - sizeof(int32_t), 1, merger->base) != 1) {
+        error("Truncated previous dump : %s", merger->basePath);
+    }
+    merger->baseLength = length;
+
+    swap = merger->lastBaseKey;
+    merger->lastBaseKey = merger->baseKey;
+    merger->baseKey = swap;
+    merger->baseKey->length = 0;
+    for (size_t i = 0; i < merger->keyCount; i++) {
+        _mergeDecodeField(merger, i, &value);
+        keyAppendValue(merger->baseKey, merger->keyTypes[i], &value);
+    }
+    if (keyCompare(merger->lastBaseKey->data, merger->lastBaseKey->length, merger->baseKey->data, merger->baseKey->length) > 0) {
+        error("Previous dump is not sorted by primary key (export it with --sort-by-pk) : %s", merger->basePath);
+    }
+    merger->baseValid = true;
+}
+
+/**
+ * Reads next incremental entry.
+ *
+ * \param merger Merger.
+ */
+void _mergeReadUpdate(bsonMerger* merger) {
+    merger->updateValid = sorterNext(merger->updates, &merger->update);
+}
+
+/**
+ * Takes the last incremental entry of current key.
+ *
+ * \param merger Merger.
+ * \param record Filled with the entry.
+ */
+void _mergeTakeUpdate(bsonMerger* merger, sortRecord* record) {
+    while (true) {
+        _mergeReserve(&merger->latest, &merger->latestAllocated, merger->update.keyLength + merger->update.valueLength);
+        memcpy(merger->latest, merger->update.key, merger->update.keyLength);
+        memcpy(merger->latest + merger->update.keyLength, merger->update.value, merger->update.valueLength);
+        record->key = merger->latest;
+        record->keyLength = merger->update.keyLength;
+        record->value = merger->latest + merger->update.keyLength;
+        record->valueLength = merger->update.valueLength;
+        _mergeReadUpdate(merger);
+        if (
+            !merger->updateValid ||
+            keyCompare(record->key, record->keyLength, merger->update.key, merger->update.keyLength)
+        ) {
+            return;
+        }
+        merger->superseded++;
+    }
+}
+
+
+/**
+ * Starts a merge.
+ *
+ * \param file         First EPFFile entries are added from (header parsed).
+ * \param basePath     Previous dump BSON file path (may not exist).
+ * \param tempDir      Temporary files directory.
+ * \param memoryBudget Incremental entries sort memory budget (bytes).
+ *
+ * \return Merger.
+ */
+bsonMerger* mergeInit(EPFFile* file, char* basePath, char* tempDir, size_t memoryBudget) {
+    bsonMerger* merger;
+
+    if (!file->primaryKeyCount) {
+        error("No primary key declared, cannot merge");
+    }
+    merger = calloc(1, sizeof(bsonMerger));
+    if (!merger) {
+        error("Cannot allocate memory");
+    }
+    merger->keyCount = file->primaryKeyCount;
+    merger->keyNames = calloc(merger->keyCount, sizeof(char*));
+    merger->keyTypes = calloc(merger->keyCount, sizeof(unsigned char));
+    if (!merger->keyNames || !merger->keyTypes) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < merger->keyCount; i++) {
+        merger->keyNames[i] = strdup(file->fields[file->primaryKey[i]]->fieldName);
+        if (!merger->keyNames[i]) {
+            error("Cannot allocate memory");
+        }
+        merger->keyTypes[i] = epfGetFieldType(file, file->primaryKey[i]);
+    }
+    merger->file = file;
+    merger->basePath = strdup(basePath);
+    if (!merger->basePath) {
+        error("Cannot allocate memory");
+    }
+    merger->base = fopen(basePath, "r");
+    if (!merger->base) {
+        if (errno != ENOENT) {
+            error("Cannot open previous dump (%s) : %s", strerror(errno), basePath);
+        }
+        warning("No previous dump, keeping incremental entries only : %s", basePath);
+    }
+    merger->baseKey = keyInit();
+    merger->lastBaseKey = keyInit();
+    merger->key = keyInit();
+    merger->updates = sorterInit(tempDir, memoryBudget);
+    return(merger);
+}
+
+/**
+ * Sets EPF file next entries are added from (same primary key).
+ *
+ * \param merger Merger.
+ * \param file   EPFFile instance (header parsed).
+ */
+void mergeBind(bsonMerger* merger, EPFFile* file) {
+    bool same = (file->primaryKeyCount == merger->keyCount);
+
+    for (size_t i = 0; same && (i < merger->keyCount); i++) {
+        same = !strcmp(file->fields[file->primaryKey[i]]->fieldName, merger->keyNames[i]) &&
+            (epfGetFieldType(file, file->primaryKey[i]) == merger->keyTypes[i]);
+    }
+    if (!same) {
+        error("Primary key differs between merged EPF files");
+    }
+    merger->file = file;
+}
+
+/**
+ * Adds an incremental entry, it replaces previously added ones with the same key.
+ *
+ * \param merger   Merger.
+ * \param values   Entry typed values.
+ * \param document Serialized BSON document.
+ * \param length   Document length.
+ */
+void mergeAdd(bsonMerger* merger, EPFValue* values, const void* document, size_t length) {
+    keyEncodeValues(merger->key, merger->file, values);
+    sorterAdd(merger->updates, merger->key->data, merger->key->length, document, length);
+}
+
+/**
+ * Gets next merged document, in key order.
+ *
+ * \param merger Merger.
+ * \param record Record (value is the document, valid until next call).
+ *
+ * \return False when all documents were read.
+ */
+bool mergeNext(bsonMerger* merger, sortRecord* record) {
+    int compare;
+
+    if (!merger->started) {
+        merger->started = true;
+        _mergeReadBase(merger);
+        _mergeReadUpdate(merger);
+    } else if (merger->basePending) {
+        _mergeReadBase(merger);
+    }
+    if (!merger->baseValid && !merger->updateValid) {
+        return(false);
+    }
+    if (!merger->updateValid) {
+        compare = -1;
+    } else if (!merger->baseValid) {
+        compare = 1;
+    } else {
+        compare = keyCompare(
+            merger->baseKey->data, merger->baseKey->length,
+            merger->update.key, merger->update.keyLength
+        );
+    }
+    if (compare < 0) {
+        record->key = merger->baseKey->data;
+        record->keyLength = merger->baseKey->length;
+        record->value = merger->baseDocument;
+        record->valueLength = merger->baseLength;
+        merger->basePending = true;
+        merger->kept++;
+        return(true);
+    }
+    if (!compare) {
+        merger->replaced++;
+        _mergeReadBase(merger);
+        while (
+            merger->baseValid &&
+            !keyCompare(merger->baseKey->data, merger->baseKey->length, merger->update.key, merger->update.keyLength)
+        ) {
+            merger->replaced++;
+            _mergeReadBase(merger);
+        }
+    } else {
+        merger->added++;
+    }
+    _mergeTakeUpdate(merger, record);
+    return(true);
+}
+
+/**
+ * Destroy a merger and release memory.
+ *
+ * \param merger Merger.
+ */
+void mergeDestroy(bsonMerger* merger) {
+    for (size_t i = 0; i < merger->keyCount; i++) {
+        free(merger->keyNames[i]);
+    }
+    free(merger->keyNames);
+    free(merger->keyTypes);
+    if (merger->base) {
+        fclose(merger->base);
+    }
+    free(merger->basePath);
+    free(merger->baseDocument);
+    free(merger->latest);
+    keyDestroy(merger->baseKey);
+    keyDestroy(merger->lastBaseKey);
+    keyDestroy(merger->key);
+    sorterDestroy(merger->updates);
+    free(merger);
+}
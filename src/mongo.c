@@ -0,0 +1,551 @@
+/**
+ * MongoDB wire protocol bulk insert sink.
+ *
+ * Documents are sent as OP_MSG `insert` commands (unordered), each batch
+ * carrying documents in a document sequence section built directly from
+ * serialized documents. Batches are spread round robin over several
+ * connections and pipelined : a connection only waits for a reply once
+ * MONGO_PIPELINE_DEPTH inserts are pending on it.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "bson.h"
+#include "mongo.h"
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/**
+ * Wire protocol constants.
+ */
+#define MONGO_OP_MSG                2013
+#define MONGO_HEADER_LENGTH         16
+#define MONGO_SECTION_BODY          0
+#define MONGO_SECTION_SEQUENCE      1
+#define MONGO_MAX_REPLY             50331648
+
+/**
+ * Reads a little endian int32.
+ *
+ * \param data Data.
+ *
+ * \return Value.
+ */
+int32_t _mongoInt32(const char* data) {
+    int32_t value;
+
+    memcpy(&value, data, sizeof(int32_t));
+    return(le32toh(value));
+}
+
+/**
+ * Reads a numeric field of a BSON document.
+ *
+ * \param document Document.
+ * \param length   Document length.
+ * \param name     Field name.
+ *
+ * \return Value, 0 if missing.
+ */
+int64_t _mongoNumber(const char* document, size_t length, const char* name) {
+    const char* value;
+    char type;
+    int64_t integer;
+    double decimal;
+
+    if (!(value = bsonFindField(document, length, name, &type))) {
+        return(0);
+    }
+    switch (type) {
+        case BSON_TYPE_INT32 :
+            return(_mongoInt32(value));
+        case BSON_TYPE_INT64 :
+            memcpy(&integer, value, sizeof(int64_t));
+            return(le64toh(integer));
+        case BSON_TYPE_DOUBLE :
+            memcpy(&integer, value, sizeof(int64_t));
+            integer = le64toh(integer);
+            memcpy(&decimal, &integer, sizeof(double));
+            return((int64_t)decimal);
+        case BSON_TYPE_BOOL :
+            return(*value != 0);
+    }
+    return(0);
+}
+
+/**
+ * Reads a string field of a BSON document.
+ *
+ * \param document Document.
+ * \param length   Document length.
+ * \param name     Field name.
+ *
+ * \return Value, "unknown error" if missing.
+ */
+const char* _mongoString(const char* document, size_t length, const char* name) {
+    const char* value;
+    char type;
+
+    if (!(value = bsonFindField(document, length, name, &type)) || (type != BSON_TYPE_STRING)) {
+        return("unknown error");
+    }
+    return(value + 4);
+}
+
+/**
+ * Appends bytes to the message being built.
+ *
+ * \param sink   Sink.
+ * \param data   Data (NULL for zeros).
+ * \param length Data length.
+ */
+void _mongoAppend(mongoSink* sink, const void* data, size_t length) {
+    if (sink->messageLength + length > sink->messageAllocated) {
+        while (sink->messageLength + length > sink->messageAllocated) {
+            sink->messageAllocated = sink->messageAllocated ? sink->messageAllocated * 2 : 65536;
+        }
+        sink->message = realloc(sink->message, sink->messageAllocated);
+        if (!sink->message) {
+            error("Cannot allocate memory");
+        }
+    }
+    if (data) {
+        memcpy(sink->message + sink->messageLength, data, length);
+    } else {
+        memset(sink->message + sink->messageLength, 0, length);
+    }
+    sink->messageLength += length;
+}
+
+/**
+ * Starts a message with a command body section.
+ *
+ * \param sink    Sink.
+ * \param command Command document.
+ */
+void _mongoStartMessage(mongoSink* sink, bsonDocument* command) {
+    bsonSerializedValue serialized = bsonSerialize(command);
+    char kind = MONGO_SECTION_BODY;
+
+    if (!serialized.binaryValue) {
+        error("Cannot allocate memory");
+    }
+    sink->messageLength = 0;
+    _mongoAppend(sink, NULL, MONGO_HEADER_LENGTH + sizeof(uint32_t));
+    _mongoAppend(sink, &kind, 1);
+    _mongoAppend(sink, serialized.binaryValue, serialized.length);
+}
+
+/**
+ * Sends bytes.
+ *
+ * \param connection Connection.
+ * \param data       Data.
+ * \param length     Data length.
+ */
+void _mongoSend(mongoConnection* connection, const char* data, size_t length) {
+    ssize_t sent;
+
+    while (length) {
+        sent = send(connection->socket, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("Cannot send to MongoDB server : %s", strerror(errno));
+        }
+        data += sent;
+        length -= sent;
+    }
+}
+
+/**
+ * Receives bytes.
+ *
+ * \param connection Connection.
+ * \param data       Buffer.
+ * \param length     Bytes to receive.
+ */
+void _mongoReceive(mongoConnection* connection, char* data, size_t length) {
+    ssize_t received;
+
+    while (length) {
+        received = recv(connection->socket, data, length, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("Cannot receive from MongoDB server : %s", strerror(errno));
+        }
+        if (!received) {
+            error("Connection closed by MongoDB server");
+        }
+        data += received;
+        length -= received;
+    }
+}
+
+/**
+ * Sends the message being built.
+ *
+ * \param sink       Sink.
+ * \param connection Connection.
+ */
+void _mongoSendMessage(mongoSink* sink, mongoConnection* connection) {
+    int32_t header[4];
+
+    header[0] = htole32(sink->messageLength);
+    header[1] = htole32(++sink->requestId);
+    header[2] = 0;
+    header[3] = htole32(MONGO_OP_MSG);
+    memcpy(sink->message, header, MONGO_HEADER_LENGTH);
+    _mongoSend(connection, sink->message, sink->messageLength);
+}
+
+/**
+ * Reads a command reply, aborts if command failed.
+ *
+ * \param sink       Sink.
+ * \param connection Connection.
+ */
+void _mongoReadReply(mongoSink* sink, mongoConnection* connection) {
+    char header[MONGO_HEADER_LENGTH];
+    size_t length;
+    const char* body;
+    const char* errors;
+    size_t bodyLength;
+    char type;
+
+    _mongoReceive(connection, header, MONGO_HEADER_LENGTH);
+    length = _mongoInt32(header);
+    if ((length < MONGO_HEADER_LENGTH + 10) || (length > MONGO_MAX_REPLY)) {
+        error("Invalid reply from MongoDB server");
+    }
+    length -= MONGO_HEADER_LENGTH;
+    if (length > sink->replyAllocated) {
+        sink->replyAllocated = length;
+        sink->reply = realloc(sink->reply, sink->replyAllocated);
+        if (!sink->reply) {
+            error("Cannot allocate memory");
+        }
+    }
+    _mongoReceive(connection, sink->reply, length);
+    body = sink->reply + sizeof(uint32_t) + 1;
+    bodyLength = length - sizeof(uint32_t) - 1;
+    if (
+        (_mongoInt32(header + 12) != MONGO_OP_MSG) ||
+        (sink->reply[sizeof(uint32_t)] != MONGO_SECTION_BODY) ||
+        ((size_t)_mongoInt32(body) > bodyLength)
+    ) {
+        error("Unexpected reply from MongoDB server");
+    }
+    bodyLength = _mongoInt32(body);
+    if (_mongoNumber(body, bodyLength, "ok") != 1) {
+        error(
+            "MongoDB command failed (%li) : %s",
+            (long)_mongoNumber(body, bodyLength, "code"),
+            _mongoString(body, bodyLength, "errmsg")
+        );
+    }
+    sink->inserted += _mongoNumber(body, bodyLength, "n");
+    if ((errors = bsonFindField(body, bodyLength, "writeErrors", &type)) && (type == BSON_TYPE_ARRAY)) {
+        size_t errorsLength = _mongoInt32(errors);
+        const char* first = bsonFindField(errors, errorsLength, "0", &type);
+
+        for (size_t position = 4; position < errorsLength && errors[position]; sink->writeErrors++) {
+            position += strlen(errors + position + 1) + 2;
+            position += _mongoInt32(errors + position);
+        }
+        if (first && (type == BSON_TYPE_DOCUMENT)) {
+            warning("MongoDB rejected documents : %s", _mongoString(first, _mongoInt32(first), "errmsg"));
+        }
+    }
+}
+
+/**
+ * Sends current batch, if not empty.
+ *
+ * \param sink Sink.
+ */
+void _mongoFlush(mongoSink* sink) {
+    mongoConnection* connection;
+    int32_t sequenceLength;
+
+    if (!sink->batchDocuments) {
+        return;
+    }
+    sequenceLength = htole32(sink->messageLength - sink->sequenceOffset);
+    memcpy(sink->message + sink->sequenceOffset, &sequenceLength, sizeof(int32_t));
+    connection = &sink->connections[sink->nextConnection];
+    sink->nextConnection = (sink->nextConnection + 1) % sink->connectionsCount;
+    while (connection->inFlight >= MONGO_PIPELINE_DEPTH) {
+        _mongoReadReply(sink, connection);
+        connection->inFlight--;
+    }
+    _mongoSendMessage(sink, connection);
+    connection->inFlight++;
+    sink->messageLength = sink->sequenceOffset + sizeof(int32_t) + sizeof("documents");
+    sink->batchDocuments = 0;
+}
+
+/**
+ * Waits for all pending replies.
+ *
+ * \param sink Sink.
+ */
+void _mongoDrain(mongoSink* sink) {
+    for (size_t i = 0; i < sink->connectionsCount; i++) {
+        while (sink->connections[i].inFlight) {
+            _mongoReadReply(sink, &sink->connections[i]);
+            sink->connections[i].inFlight--;
+        }
+    }
+}
+
+/**
+ * Opens a connection.
+ *
+ * \param host Host.
+ * \param port Port.
+ *
+ * \return Socket.
+ */
+int _mongoOpen(char* host, char* port) {
+    struct addrinfo hints;
+    struct addrinfo* addresses;
+    struct addrinfo* address;
+    int result;
+    int fd = -1;
+    int enabled = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((result = getaddrinfo(host, port, &hints, &addresses))) {
+        error("Cannot resolve MongoDB host (%s) : %s", gai_strerror(result), host);
+    }
+    for (address = addresses; address; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (!connect(fd, address->ai_addr, address->ai_addrlen)) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd == -1) {
+        error("Cannot connect to MongoDB server (%s) : %s:%s", strerror(errno), host, port);
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    return(fd);
+}
+
+
+/**
+ * Connects to a MongoDB server.
+ *
+ * \param uri         Server URI (mongodb://host[:port][/...], no authentication).
+ * \param connections Connections to open.
+ *
+ * \return Sink.
+ */
+mongoSink* mongoConnect(char* uri, size_t connections) {
+    mongoSink* sink;
+    char* host;
+    char* port = MONGO_DEFAULT_PORT;
+    char* end;
+
+    if (strncmp(uri, "mongodb://", 10)) {
+        error("Invalid MongoDB URI (mongodb://host[:port] expected) : %s", uri);
+    }
+    host = strdup(uri + 10);
+    if (!host) {
+        error("Cannot allocate memory");
+    }
+    host[strcspn(host, "/?")] = 0;
+    if (strchr(host, '@')) {
+        error("MongoDB authentication is not supported : %s", uri);
+    }
+    host[strcspn(host, ",")] = 0;
+    if (host[0] == '[') {
+        end = strchr(host, ']');
+        if (!end) {
+            error("Invalid MongoDB URI : %s", uri);
+        }
+        *end++ = 0;
+        if (*end == ':') {
+            port = end + 1;
+        }
+        memmove(host, host + 1, strlen(host));
+    } else if ((end = strchr(host, ':'))) {
+        *end = 0;
+        port = end + 1;
+    }
+    if (!*host) {
+        error("Invalid MongoDB URI (no host) : %s", uri);
+    }
+
+    sink = calloc(1, sizeof(mongoSink));
+    if (!sink) {
+        error("Cannot allocate memory");
+    }
+    sink->connections = calloc(connections, sizeof(mongoConnection));
+    if (!sink->connections) {
+        error("Cannot allocate memory");
+    }
+    sink->connectionsCount = connections;
+    sink->batchBytes = MONGO_BATCH_BYTES;
+    for (size_t i = 0; i < connections; i++) {
+        sink->connections[i].socket = _mongoOpen(host, port);
+    }
+    message("Connected to MongoDB server %s:%s (%lu connection(s))", host, port, connections);
+    sink->command = createBsonDocument();
+    if (!sink->command) {
+        error("Cannot allocate memory");
+    }
+    free(host);
+    return(sink);
+}
+
+/**
+ * Starts inserting into a collection.
+ *
+ * \param sink       Sink.
+ * \param database   Database name.
+ * \param collection Collection name.
+ */
+void mongoStart(mongoSink* sink, char* database, char* collection) {
+    char kind = MONGO_SECTION_SEQUENCE;
+
+    sink->database = database;
+    sink->collection = collection;
+    sink->inserted = 0;
+    sink->writeErrors = 0;
+    resetBsonDocument(sink->command);
+    bsonAddString(sink->command, "insert", collection);
+    bsonAddBool(sink->command, "ordered", false);
+    bsonAddString(sink->command, "$db", database);
+    _mongoStartMessage(sink, sink->command);
+    _mongoAppend(sink, &kind, 1);
+    sink->sequenceOffset = sink->messageLength;
+    _mongoAppend(sink, NULL, sizeof(int32_t));
+    _mongoAppend(sink, "documents", sizeof("documents"));
+    sink->batchDocuments = 0;
+    message("Inserting into MongoDB collection: %s.%s", database, collection);
+}
+
+/**
+ * Queues a document for insertion.
+ *
+ * \param sink     Sink.
+ * \param document Serialized BSON document.
+ * \param length   Document length.
+ */
+void mongoInsert(mongoSink* sink, const void* document, size_t length) {
+    if (
+        sink->batchDocuments &&
+        (
+            (sink->batchDocuments >= MONGO_BATCH_DOCUMENTS) ||
+            (sink->messageLength + length > sink->batchBytes)
+        )
+    ) {
+        _mongoFlush(sink);
+    }
+    _mongoAppend(sink, document, length);
+    sink->batchDocuments++;
+}
+
+/**
+ * Sends last batch and waits for all insertions to be acknowledged.
+ *
+ * \param sink Sink.
+ */
+void mongoFinish(mongoSink* sink) {
+    _mongoFlush(sink);
+    _mongoDrain(sink);
+    message("Inserted %'lu documents.", sink->inserted);
+    if (sink->writeErrors) {
+        warning("MongoDB rejected %'lu documents.", sink->writeErrors);
+    }
+}
+
+/**
+ * Creates an ascending index on a field of current collection (once
+ * insertions are finished).
+ *
+ * \param sink  Sink.
+ * \param field Field name.
+ */
+void mongoCreateIndex(mongoSink* sink, char* field) {
+    bsonDocument* key = createBsonDocument();
+    bsonDocument* index = createBsonDocument();
+    bsonDocument* indexes = createBsonDocument();
+    char* name;
+
+    name = calloc(strlen(field) + 12, sizeof(char));
+    if (!name) {
+        error("Cannot allocate memory");
+    }
+    if (!key || !index || !indexes) {
+        error("Cannot allocate memory");
+    }
+    sprintf(name, "_EPF2Bson_%s_", field);
+    bsonAddInt32(key, field, 1);
+    bsonAddSubDocument(index, "key", key);
+    bsonAddString(index, "name", name);
+    bsonAddSubDocument(indexes, "0", index);
+    resetBsonDocument(sink->command);
+    bsonAddString(sink->command, "createIndexes", sink->collection);
+    bsonAddArray(sink->command, "indexes", indexes);
+    bsonAddString(sink->command, "$db", sink->database);
+    _mongoStartMessage(sink, sink->command);
+    _mongoSendMessage(sink, &sink->connections[0]);
+    _mongoReadReply(sink, &sink->connections[0]);
+    destroyBsonDocument(key);
+    destroyBsonDocument(index);
+    destroyBsonDocument(indexes);
+    free(name);
+}
+
+/**
+ * Closes connections and releases memory.
+ *
+ * \param sink Sink.
+ */
+void mongoClose(mongoSink* sink) {
+    for (size_t i = 0; i < sink->connectionsCount; i++) {
+        close(sink->connections[i].socket);
+    }
+    free(sink->connections);
+    free(sink->message);
+    free(sink->reply);
+    destroyBsonDocument(sink->command);
+    free(sink);
+}
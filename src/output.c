@@ -0,0 +1,271 @@
+/**
+ * BSON output file.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "output.h"
+#include "digest.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * Preallocates file up to a size (keeps extents contiguous, and mapped
+ * pages backed so that a full disk fails here instead of raising SIGBUS).
+ *
+ * \param output Output.
+ * \param size   File size.
+ */
+void _outputReserve(bsonOutput* output, uint64_t size) {
+    if (size <= output->allocated) {
+        return;
+    }
+    if (fallocate(output->fd, 0, output->allocated, size - output->allocated)) {
+        if ((errno != EOPNOTSUPP) && (errno != ENOSYS)) {
+            error("Cannot preallocate file (%s) : %s", strerror(errno), output->path);
+        }
+        if (ftruncate(output->fd, size)) {
+            error("Cannot extend file (%s) : %s", strerror(errno), output->path);
+        }
+    }
+    output->allocated = size;
+}
+
+/**
+ * Maps the window starting at current position.
+ *
+ * \param output Output.
+ */
+void _outputMoveWindow(bsonOutput* output) {
+    uint64_t end;
+
+    if (output->window) {
+        munmap(output->window, output->windowLength);
+        output->window = NULL;
+    }
+    output->windowOffset = output->position;
+    end = output->windowOffset + output->windowLength;
+    if (end > output->allocated) {
+        _outputReserve(output, (end > output->allocated + output->allocated / 4) ? end : output->allocated + output->allocated / 4);
+    }
+    output->window = mmap(
+        NULL, output->windowLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        output->fd, output->windowOffset
+    );
+    if (output->window == MAP_FAILED) {
+        output->window = NULL;
+        error("Cannot map file (%s) : %s", strerror(errno), output->path);
+    }
+}
+
+/**
+ * Writes file CRC32C in <path>.crc32c, as "<crc>  <file name>".
+ *
+ * \param output Output.
+ */
+void _outputWriteChecksum(bsonOutput* output) {
+    FILE* fp;
+    char* path;
+    char* copy;
+
+    path = calloc(strlen(output->path) + 8, sizeof(char));
+    copy = strdup(output->path);
+    if (!path || !copy) {
+        error("Cannot allocate memory");
+    }
+    sprintf(path, "%s.crc32c", output->path);
+    fp = fopen(path, "w");
+    if (!fp) {
+        error("Could not create file (%s) : %s", strerror(errno), path);
+    }
+    fprintf(fp, "%08" PRIx32 "  %s\n", output->crc, basename(copy));
+    if (fclose(fp)) {
+        error("Cannot write file (%s) : %s", strerror(errno), path);
+    }
+    free(copy);
+    free(path);
+}
+
+/**
+ * Writes back bytes written since last call and drops from page cache those
+ * written back by the previous call : a window is flushed while the next one
+ * is filled, so waiting for it seldom blocks. Pages still mapped are kept.
+ *
+ * \param output Output.
+ * \param last   Close : wait for and drop everything.
+ */
+void _outputWriteBehind(bsonOutput* output, bool last) {
+    int fd = output->fd;
+    uint64_t dropEnd = output->syncedOffset;
+
+    if (fd == -1) {
+        fflush(output->fp);
+        fd = fileno(output->fp);
+    }
+    if (output->position > output->syncedOffset) {
+        sync_file_range(fd, output->syncedOffset, output->position - output->syncedOffset, SYNC_FILE_RANGE_WRITE);
+        output->syncedOffset = output->position;
+    }
+    if (last) {
+        dropEnd = output->position;
+    }
+    if (output->window && (dropEnd > output->windowOffset)) {
+        dropEnd = output->windowOffset;
+    }
+    if (dropEnd > output->droppedOffset) {
+        sync_file_range(
+            fd, output->droppedOffset, dropEnd - output->droppedOffset,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER
+        );
+        posix_fadvise(fd, output->droppedOffset, dropEnd - output->droppedOffset, POSIX_FADV_DONTNEED);
+        output->droppedOffset = dropEnd;
+    }
+}
+
+
+/**
+ * Creates an output file.
+ *
+ * \param path       File path.
+ * \param mapped     Write through a mapping instead of stdio.
+ * \param checksum   Compute file CRC32C, written in <path>.crc32c on close.
+ * \param dropBehind Write back and drop written pages from page cache as output goes.
+ * \param estimate   Expected file size (mapped output).
+ *
+ * \return Output.
+ */
+bsonOutput* outputOpen(char* path, bool mapped, bool checksum, bool dropBehind, uint64_t estimate) {
+    bsonOutput* output;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+
+    output = calloc(1, sizeof(bsonOutput));
+    if (!output) {
+        error("Cannot allocate memory");
+    }
+    output->path = path;
+    output->fd = -1;
+    output->checksum = checksum;
+    output->dropBehind = dropBehind;
+    if (!mapped) {
+        output->fp = fopen(path, "w");
+        if (!output->fp) {
+            error("Could not create file (%s) : %s", strerror(errno), path);
+        }
+        return(output);
+    }
+    output->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (output->fd == -1) {
+        error("Could not create file (%s) : %s", strerror(errno), path);
+    }
+    output->windowLength = estimate / 4;
+    if (output->windowLength < OUTPUT_MIN_WINDOW) {
+        output->windowLength = OUTPUT_MIN_WINDOW;
+    } else if (output->windowLength > OUTPUT_MAX_WINDOW) {
+        output->windowLength = OUTPUT_MAX_WINDOW;
+    }
+    output->windowLength = (output->windowLength + pageSize - 1) / pageSize * pageSize;
+    _outputReserve(output, estimate);
+    return(output);
+}
+
+/**
+ * Updates expected file size, preallocating more if needed.
+ *
+ * \param output   Output.
+ * \param estimate Expected file size.
+ */
+void outputEstimate(bsonOutput* output, uint64_t estimate) {
+    if ((output->fd != -1) && (estimate > output->allocated)) {
+        _outputReserve(output, estimate + estimate / 16);
+    }
+}
+
+/**
+ * Writes bytes.
+ *
+ * \param output Output.
+ * \param data   Data.
+ * \param length Data length.
+ */
+void outputWrite(bsonOutput* output, const void* data, size_t length) {
+    size_t chunk;
+
+    if (output->checksum) {
+        output->crc = crc32cUpdate(output->crc, data, length);
+    }
+    if (output->dropBehind && (output->position - output->syncedOffset >= OUTPUT_SYNC_WINDOW)) {
+        _outputWriteBehind(output, false);
+    }
+    if (output->fd == -1) {
+        fwrite(data, 1, length, output->fp);
+        output->position += length;
+        return;
+    }
+    while (length) {
+        if (!output->window || (output->position == output->windowOffset + output->windowLength)) {
+            _outputMoveWindow(output);
+        }
+        chunk = output->windowOffset + output->windowLength - output->position;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(output->window + (output->position - output->windowOffset), data, chunk);
+        output->position += chunk;
+        data = (const unsigned char*)data + chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * Closes an output file and releases memory.
+ *
+ * \param output Output (destroyed).
+ */
+void outputClose(bsonOutput* output) {
+    if (output->dropBehind) {
+        if (output->window) {
+            munmap(output->window, output->windowLength);
+            output->window = NULL;
+        }
+        _outputWriteBehind(output, true);
+    }
+    if (output->fd == -1) {
+        if (fclose(output->fp)) {
+            error("Cannot write file (%s) : %s", strerror(errno), output->path);
+        }
+    } else {
+        if (output->window) {
+            munmap(output->window, output->windowLength);
+        }
+        if (ftruncate(output->fd, output->position)) {
+            error("Cannot truncate file (%s) : %s", strerror(errno), output->path);
+        }
+        close(output->fd);
+    }
+    if (output->checksum) {
+        _outputWriteChecksum(output);
+    }
+    free(output);
+}
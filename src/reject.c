@@ -0,0 +1,222 @@
+/**
+ * Malformed records quarantine.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "epf.h"
+#include "reject.h"
+
+/**
+ * Counts a rejected record, showing it or a summary.
+ *
+ * \param log    Log.
+ * \param offset Record offset in EPF file.
+ * \param reason Reason.
+ * \param record Raw record (first bytes), NULL if not available.
+ * \param length Raw record length.
+ *
+ * \return False if more than maxErrors records are rejected.
+ */
+bool _rejectCount(rejectLog* log, uint64_t offset, const char* reason, const char* record, size_t length) {
+    time_t now;
+
+    log->count++;
+    log->sourceCount++;
+    if (log->count <= REJECT_WARNINGS) {
+        warning(
+            "%s at offset %" PRIu64 " of %s%s%.*s%s",
+            reason,
+            offset,
+            log->source,
+            record ? " : " : "",
+            (int)((length > REJECT_WARNING_LENGTH) ? REJECT_WARNING_LENGTH : length),
+            record ? record : "",
+            (record && (length > REJECT_WARNING_LENGTH)) ? "..." : ""
+        );
+        if (log->count == REJECT_WARNINGS) {
+            warning("Next malformed records will only be counted%s%s", log->path ? ", see " : "", log->path ? log->path : "");
+        }
+        log->lastSummary = time(NULL);
+    } else if ((now = time(NULL)) >= log->lastSummary + REJECT_SUMMARY_DELAY) {
+        warning("%'lu malformed records so far (%'lu in %s).", log->count, log->sourceCount, log->source);
+        log->lastSummary = now;
+    }
+    if (log->maxErrors && (log->count > log->maxErrors)) {
+        if (log->fp) {
+            fflush(log->fp);
+        }
+        return(false);
+    }
+    return(true);
+}
+
+/**
+ * Writes a rejected record header in reject file.
+ *
+ * \param log    Log.
+ * \param offset Record offset in EPF file.
+ * \param reason Reason.
+ */
+void _rejectWriteHeader(rejectLog* log, uint64_t offset, const char* reason) {
+    fprintf(log->fp, "#rejected:%s:%" PRIu64 ":%s\x02\n", log->source, offset, reason);
+}
+
+
+/**
+ * Creates a malformed records log.
+ *
+ * \param path      Reject file path, NULL to only show warnings.
+ * \param maxErrors Rejected records count aborting the run (0 : no limit).
+ *
+ * \return Log.
+ */
+rejectLog* rejectOpen(char* path, unsigned long maxErrors) {
+    rejectLog* log;
+
+    log = calloc(1, sizeof(rejectLog));
+    if (!log) {
+        error("Cannot allocate memory");
+    }
+    pthread_mutex_init(&log->lock, NULL);
+    log->path = path;
+    log->maxErrors = maxErrors;
+    log->source = "";
+    if (path) {
+        log->fp = fopen(path, "a");
+        if (!log->fp) {
+            error("Could not open reject file (%s) : %s", strerror(errno), path);
+        }
+    }
+    return(log);
+}
+
+/**
+ * Starts logging records of an EPF file.
+ *
+ * \param log    Log.
+ * \param source EPF file path (not copied).
+ */
+void rejectStart(rejectLog* log, char* source) {
+    log->source = source;
+    log->sourceCount = 0;
+}
+
+/**
+ * Rejects a raw record.
+ *
+ * \param log    Log.
+ * \param offset Record offset in EPF file.
+ * \param reason Reason.
+ * \param record Raw record, record separator excluded.
+ * \param length Raw record length.
+ */
+bool rejectRecord(rejectLog* log, uint64_t offset, const char* reason, const char* record, size_t length) {
+    bool accepted;
+
+    pthread_mutex_lock(&log->lock);
+    if (log->fp) {
+        _rejectWriteHeader(log, offset, reason);
+        fwrite(record, 1, length, log->fp);
+        fputs("\x02\n", log->fp);
+    }
+    accepted = _rejectCount(log, offset, reason, record, length);
+    pthread_mutex_unlock(&log->lock);
+    return(accepted);
+}
+
+/**
+ * Rejects a raw record for an EPF reader (epfRejectHandler).
+ *
+ * \param context Log.
+ * \param offset  Record offset in EPF file.
+ * \param reason  Reason.
+ * \param record  Raw record, record separator excluded.
+ * \param length  Raw record length.
+ *
+ * \return False if more than maxErrors records are rejected.
+ */
+bool rejectHandler(void* context, uint64_t offset, const char* reason, const char* record, size_t length) {
+    return(rejectRecord(context, offset, reason, record, length));
+}
+
+/**
+ * Rejects an entry (fields are written back with field separators).
+ *
+ * \param log         Log.
+ * \param offset      Entry offset in EPF file.
+ * \param reason      Reason.
+ * \param entry       Entry fields.
+ * \param fieldsCount Fields count.
+ *
+ * \return False if more than maxErrors records are rejected.
+ */
+bool rejectEntry(rejectLog* log, uint64_t offset, const char* reason, char** entry, size_t fieldsCount) {
+    bool accepted;
+
+    pthread_mutex_lock(&log->lock);
+    if (log->fp) {
+        _rejectWriteHeader(log, offset, reason);
+        for (size_t i = 0; i < fieldsCount; i++) {
+            if (i) {
+                fputc(EPFSeparator, log->fp);
+            }
+            fputs(entry[i], log->fp);
+        }
+        fputs("\x02\n", log->fp);
+    }
+    accepted = _rejectCount(log, offset, reason, NULL, 0);
+    pthread_mutex_unlock(&log->lock);
+    return(accepted);
+}
+
+/**
+ * Ends logging records of current EPF file, showing their count.
+ *
+ * \param log Log.
+ */
+void rejectEnd(rejectLog* log) {
+    if (log->sourceCount) {
+        warning(
+            "Rejected %'lu malformed records of %s%s%s.",
+            log->sourceCount,
+            log->source,
+            log->path ? ", see " : "",
+            log->path ? log->path : ""
+        );
+    }
+    log->sourceCount = 0;
+}
+
+/**
+ * Closes reject file and release memory.
+ *
+ * \param log Log (destroyed).
+ */
+void rejectClose(rejectLog* log) {
+    if (log->fp && fclose(log->fp)) {
+        error("Cannot write reject file (%s) : %s", strerror(errno), log->path);
+    }
+    pthread_mutex_destroy(&log->lock);
+    free(log);
+}
@@ -0,0 +1,92 @@
+/**
+ * Conversion sinks.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "sink.h"
+
+/**
+ * Creates a sink.
+ *
+ * \param context Sink state.
+ * \param write   Entries consumer.
+ * \param close   Finisher.
+ *
+ * \return Sink.
+ */
+rowSink* sinkCreate(void* context, sinkWriter write, sinkCloser close) {
+    rowSink* sink;
+
+    sink = calloc(1, sizeof(rowSink));
+    if (!sink) {
+        error("Cannot allocate memory");
+    }
+    sink->context = context;
+    sink->write = write;
+    sink->close = close;
+    return(sink);
+}
+
+/**
+ * Appends a sink to a list.
+ *
+ * \param sinks Sinks list (NULL if empty).
+ * \param sink  Sink.
+ */
+void sinkAdd(rowSink** sinks, rowSink* sink) {
+    while (*sinks) {
+        sinks = &(*sinks)->next;
+    }
+    *sinks = sink;
+}
+
+/**
+ * Feeds an exported entry to every sink of a list.
+ *
+ * \param sinks  Sinks list.
+ * \param values Typed values (fieldsCount values).
+ */
+void sinkWrite(rowSink* sinks, EPFValue* values) {
+    for (; sinks; sinks = sinks->next) {
+        sinks->write(sinks->context, values);
+    }
+}
+
+/**
+ * Finishes every sink of a list and destroys them.
+ *
+ * \param sinks Sinks list.
+ */
+void sinkClose(rowSink* sinks) {
+    rowSink* next;
+
+    for (; sinks; sinks = next) {
+        next = sinks->next;
+        if (sinks->close) {
+            sinks->close(sinks->context);
+        }
+        free(sinks);
+    }
+}
@@ -0,0 +1,551 @@
+/**
+ * External merge sort.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "key.h"
+#include "lz4.h"
+#include "sort.h"
+
+/**
+ * Run block header : uncompressed length, compressed length (0 if stored).
+ */
+#define SORT_BLOCK_HEADER_SIZE      (2 * sizeof(uint32_t))
+
+/**
+ * Record header : key length, value length.
+ */
+#define SORT_RECORD_HEADER_SIZE     (2 * sizeof(uint32_t))
+
+/**
+ * Compares in memory records, ties broken on arena position (insertion order).
+ *
+ * \param first  First record.
+ * \param second Second record.
+ *
+ * \return <0, 0, >0 like memcmp().
+ */
+int _sorterCompareItems(const void* first, const void* second) {
+    const sortRecord* firstRecord = first;
+    const sortRecord* secondRecord = second;
+    int result;
+
+    result = keyCompare(
+        firstRecord->key,
+        firstRecord->keyLength,
+        secondRecord->key,
+        secondRecord->keyLength
+    );
+    if (result) {
+        return(result);
+    }
+    return((firstRecord->key > secondRecord->key) - (firstRecord->key < secondRecord->key));
+}
+
+/**
+ * Compares current records of two runs, ties broken on run order.
+ *
+ * \param sorter Sorter instance.
+ * \param first  First run index.
+ * \param second Second run index.
+ *
+ * \return True if first run record comes before second run record.
+ */
+bool _sorterRunBefore(externalSorter* sorter, size_t first, size_t second) {
+    int result;
+
+    result = keyCompare(
+        sorter->runs[first]->current.key,
+        sorter->runs[first]->current.keyLength,
+        sorter->runs[second]->current.key,
+        sorter->runs[second]->current.keyLength
+    );
+    return((result < 0) || (!result && (first < second)));
+}
+
+/**
+ * Grows a buffer to hold at least given size.
+ *
+ * \param buffer    Buffer.
+ * \param allocated Buffer allocated size.
+ * \param needed    Needed size.
+ */
+void _sorterReserve(unsigned char** buffer, size_t* allocated, size_t needed) {
+    if (needed <= *allocated) {
+        return;
+    }
+    while (needed > *allocated) {
+        *allocated = *allocated ? *allocated * 2 : SORT_BLOCK_SIZE;
+    }
+    *buffer = realloc(*buffer, *allocated);
+    if (!*buffer) {
+        error("Cannot allocate memory for sort");
+    }
+}
+
+/**
+ * Creates an empty run backed by an unlinked temporary file.
+ *
+ * \param sorter Sorter instance.
+ *
+ * \return Run.
+ */
+sortRun* _sorterCreateRun(externalSorter* sorter) {
+    sortRun* run;
+    char* path;
+    int fd;
+
+    run = calloc(1, sizeof(sortRun));
+    path = calloc(strlen(sorter->tempDir) + 32, sizeof(char));
+    if (!run || !path) {
+        error("Cannot allocate memory for sort");
+    }
+    sprintf(path, "%s/.EPF2Bson-sort-XXXXXX", sorter->tempDir);
+    fd = mkstemp(path);
+    if (fd == -1) {
+        error("Could not create sort temporary file (%s) : %s", strerror(errno), path);
+    }
+    unlink(path);
+    free(path);
+    run->fp = fdopen(fd, "w+");
+    if (!run->fp) {
+        error("Could not open sort temporary file : %s", strerror(errno));
+    }
+    sorter->spilledRuns++;
+    return(run);
+}
+
+/**
+ * Compresses and writes run current block.
+ *
+ * \param run Run.
+ */
+void _sorterFlushBlock(sortRun* run) {
+    uint32_t header[2];
+    size_t compressedLength;
+
+    if (!run->blockLength) {
+        return;
+    }
+    _sorterReserve(&run->compressed, &run->compressedAllocated, lz4CompressBound(run->blockLength));
+    compressedLength = lz4Compress(run->block, run->blockLength, run->compressed);
+    header[0] = run->blockLength;
+    header[1] = (compressedLength < run->blockLength) ? compressedLength : 0;
+    if (
+        (fwrite(header, 1, SORT_BLOCK_HEADER_SIZE, run->fp) != SORT_BLOCK_HEADER_SIZE) ||
+        (fwrite(
+            header[1] ? run->compressed : run->block,
+            1,
+            header[1] ? header[1] : header[0],
+            run->fp
+        ) != (header[1] ? header[1] : header[0]))
+    ) {
+        error("Could not write sort temporary file : %s", strerror(errno));
+    }
+    run->blockLength = 0;
+}
+
+/**
+ * Appends a record to a run being written.
+ *
+ * \param run    Run.
+ * \param record Record.
+ */
+void _sorterWriteRecord(sortRun* run, sortRecord* record) {
+    size_t recordLength = SORT_RECORD_HEADER_SIZE + record->keyLength + record->valueLength;
+    uint32_t header[2];
+
+    if (run->blockLength && (run->blockLength + recordLength > SORT_BLOCK_SIZE)) {
+        _sorterFlushBlock(run);
+    }
+    _sorterReserve(&run->block, &run->blockAllocated, run->blockLength + recordLength);
+    header[0] = record->keyLength;
+    header[1] = record->valueLength;
+    memcpy(run->block + run->blockLength, header, SORT_RECORD_HEADER_SIZE);
+    memcpy(run->block + run->blockLength + SORT_RECORD_HEADER_SIZE, record->key, record->keyLength);
+    memcpy(
+        run->block + run->blockLength + SORT_RECORD_HEADER_SIZE + record->keyLength,
+        record->value,
+        record->valueLength
+    );
+    run->blockLength += recordLength;
+}
+
+/**
+ * Ends run writing and rewinds it for reading.
+ *
+ * \param run Run.
+ */
+void _sorterCloseRun(sortRun* run) {
+    _sorterFlushBlock(run);
+    if (fflush(run->fp) || fseek(run->fp, 0, SEEK_SET)) {
+        error("Could not write sort temporary file : %s", strerror(errno));
+    }
+    free(run->compressed);
+    run->compressed = NULL;
+    run->compressedAllocated = 0;
+    run->blockLength = run->blockPosition = 0;
+}
+
+/**
+ * Loads next record of a run being read.
+ *
+ * \param run Run.
+ *
+ * \return False at end of run.
+ */
+bool _sorterAdvanceRun(sortRun* run) {
+    uint32_t header[2];
+
+    if (run->blockPosition >= run->blockLength) {
+        size_t read = fread(header, 1, SORT_BLOCK_HEADER_SIZE, run->fp);
+
+        if (!read) {
+            return(false);
+        }
+        if (read != SORT_BLOCK_HEADER_SIZE) {
+            error("Corrupted sort temporary file");
+        }
+        _sorterReserve(&run->block, &run->blockAllocated, header[0]);
+        if (header[1]) {
+            _sorterReserve(&run->compressed, &run->compressedAllocated, header[1]);
+            if (
+                (fread(run->compressed, 1, header[1], run->fp) != header[1]) ||
+                (lz4Decompress(run->compressed, header[1], run->block, header[0]) != header[0])
+            ) {
+                error("Corrupted sort temporary file");
+            }
+        } else if (fread(run->block, 1, header[0], run->fp) != header[0]) {
+            error("Corrupted sort temporary file");
+        }
+        run->blockLength = header[0];
+        run->blockPosition = 0;
+    }
+    memcpy(header, run->block + run->blockPosition, SORT_RECORD_HEADER_SIZE);
+    run->current.keyLength = header[0];
+    run->current.valueLength = header[1];
+    run->current.key = run->block + run->blockPosition + SORT_RECORD_HEADER_SIZE;
+    run->current.value = run->current.key + header[0];
+    run->blockPosition += SORT_RECORD_HEADER_SIZE + header[0] + header[1];
+    return(true);
+}
+
+/**
+ * Destroys a run.
+ *
+ * \param run Run.
+ */
+void _sorterDestroyRun(sortRun* run) {
+    fclose(run->fp);
+    free(run->block);
+    free(run->compressed);
+    free(run);
+}
+
+/**
+ * Restores heap order downward from a position.
+ *
+ * \param sorter   Sorter instance.
+ * \param position Heap position.
+ */
+void _sorterSiftDown(externalSorter* sorter, size_t position) {
+    while (true) {
+        size_t smallest = position;
+        size_t left = (2 * position) + 1;
+        size_t right = left + 1;
+        size_t swap;
+
+        if ((left < sorter->heapCount) && _sorterRunBefore(sorter, sorter->heap[left], sorter->heap[smallest])) {
+            smallest = left;
+        }
+        if ((right < sorter->heapCount) && _sorterRunBefore(sorter, sorter->heap[right], sorter->heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == position) {
+            return;
+        }
+        swap = sorter->heap[position];
+        sorter->heap[position] = sorter->heap[smallest];
+        sorter->heap[smallest] = swap;
+        position = smallest;
+    }
+}
+
+/**
+ * Loads first record of runs and builds merge heap.
+ *
+ * \param sorter Sorter instance.
+ * \param first  First run to merge (up to last run).
+ */
+void _sorterStartMerge(externalSorter* sorter, size_t first) {
+    free(sorter->heap);
+    sorter->heap = calloc(sorter->runsCount - first, sizeof(size_t));
+    if (!sorter->heap) {
+        error("Cannot allocate memory for sort");
+    }
+    sorter->heapCount = 0;
+    for (size_t i = first; i < sorter->runsCount; i++) {
+        if (_sorterAdvanceRun(sorter->runs[i])) {
+            sorter->heap[sorter->heapCount++] = i;
+        }
+    }
+    for (size_t i = sorter->heapCount; i > 0; i--) {
+        _sorterSiftDown(sorter, i - 1);
+    }
+    sorter->pendingRun = -1;
+}
+
+/**
+ * Gets next merged record.
+ *
+ * \param sorter Sorter instance.
+ * \param record Record (valid until next call).
+ *
+ * \return False when all runs are exhausted.
+ */
+bool _sorterMergeNext(externalSorter* sorter, sortRecord* record) {
+    if (sorter->pendingRun >= 0) {
+        if (!_sorterAdvanceRun(sorter->runs[sorter->pendingRun])) {
+            sorter->heap[0] = sorter->heap[--sorter->heapCount];
+        }
+        _sorterSiftDown(sorter, 0);
+        sorter->pendingRun = -1;
+    }
+    if (!sorter->heapCount) {
+        return(false);
+    }
+    sorter->pendingRun = sorter->heap[0];
+    *record = sorter->runs[sorter->pendingRun]->current;
+    return(true);
+}
+
+/**
+ * Merges last runs into a single one, in place of the first of them (runs
+ * stay in insertion order).
+ *
+ * \param sorter Sorter instance.
+ * \param first  First run to merge (up to last run).
+ */
+void _sorterMergeRuns(externalSorter* sorter, size_t first) {
+    sortRun* merged = _sorterCreateRun(sorter);
+    sortRecord record;
+
+    merged->level = sorter->runs[first]->level + 1;
+    _sorterStartMerge(sorter, first);
+    while (_sorterMergeNext(sorter, &record)) {
+        _sorterWriteRecord(merged, &record);
+    }
+    _sorterCloseRun(merged);
+    for (size_t i = first; i < sorter->runsCount; i++) {
+        _sorterDestroyRun(sorter->runs[i]);
+    }
+    sorter->runs[first] = merged;
+    sorter->runsCount = first + 1;
+    sorter->pendingRun = -1;
+}
+
+/**
+ * Appends a spilled run, then merges every SORT_MAX_RUNS runs of a level
+ * into one run of next level (levels decrease from first to last run).
+ *
+ * \param sorter Sorter instance.
+ * \param run    Run (level 0).
+ */
+void _sorterAddRun(externalSorter* sorter, sortRun* run) {
+    size_t first;
+
+    if (sorter->runsCount >= sorter->runsAllocated) {
+        sorter->runsAllocated = sorter->runsAllocated ? sorter->runsAllocated * 2 : SORT_MAX_RUNS;
+        sorter->runs = realloc(sorter->runs, sorter->runsAllocated * sizeof(sortRun*));
+        if (!sorter->runs) {
+            error("Cannot allocate memory for sort");
+        }
+    }
+    sorter->runs[sorter->runsCount++] = run;
+    while (sorter->runsCount >= SORT_MAX_RUNS) {
+        first = sorter->runsCount - SORT_MAX_RUNS;
+        if (sorter->runs[first]->level != sorter->runs[sorter->runsCount - 1]->level) {
+            break;
+        }
+        _sorterMergeRuns(sorter, first);
+    }
+}
+
+/**
+ * Sorts in memory records and spills them as a new run.
+ *
+ * \param sorter Sorter instance.
+ */
+void _sorterSpill(externalSorter* sorter) {
+    sortRun* run;
+
+    if (!sorter->itemsCount) {
+        return;
+    }
+    qsort(sorter->items, sorter->itemsCount, sizeof(sortRecord), _sorterCompareItems);
+    run = _sorterCreateRun(sorter);
+    for (size_t i = 0; i < sorter->itemsCount; i++) {
+        _sorterWriteRecord(run, &sorter->items[i]);
+    }
+    _sorterCloseRun(run);
+    _sorterAddRun(sorter, run);
+    sorter->itemsCount = 0;
+    sorter->arenaLength = 0;
+}
+
+
+/**
+ * Creates a new external sorter.
+ *
+ * \param tempDir      Temporary files directory.
+ * \param memoryBudget Memory budget (bytes).
+ *
+ * \return Sorter.
+ */
+externalSorter* sorterInit(char* tempDir, size_t memoryBudget) {
+    externalSorter* sorter;
+
+    sorter = calloc(1, sizeof(externalSorter));
+    if (!sorter) {
+        error("Cannot allocate memory for sort");
+    }
+    sorter->tempDir = tempDir;
+    sorter->memoryBudget = memoryBudget;
+    sorter->pendingRun = -1;
+    return(sorter);
+}
+
+/**
+ * Adds a record to sorter.
+ *
+ * Budget is split between the records arena (7/8) and their index (1/8).
+ * Arena is allocated at its budget at once (only touched pages are used) :
+ * it is only replaced, after a spill, by a record larger than it.
+ *
+ * \param sorter      Sorter instance.
+ * \param key         Key.
+ * \param keyLength   Key length.
+ * \param value       Value.
+ * \param valueLength Value length.
+ */
+void sorterAdd(externalSorter* sorter, const void* key, size_t keyLength, const void* value, size_t valueLength) {
+    size_t arenaBudget = sorter->memoryBudget - (sorter->memoryBudget / 8);
+    size_t itemsBudget = (sorter->memoryBudget / 8) / sizeof(sortRecord);
+    sortRecord* item;
+
+    if (sorter->finished) {
+        error("Cannot add records to a sorter being read");
+    }
+    if (
+        sorter->itemsCount &&
+        (
+            (sorter->arenaLength + keyLength + valueLength > arenaBudget) ||
+            (sorter->itemsCount >= itemsBudget)
+        )
+    ) {
+        _sorterSpill(sorter);
+    }
+    if (sorter->arenaLength + keyLength + valueLength > sorter->arenaAllocated) {
+        size_t allocated = (keyLength + valueLength > arenaBudget) ? keyLength + valueLength : arenaBudget;
+
+        //Records point into the arena : spill first rather than moving it.
+        if (sorter->itemsCount) {
+            _sorterSpill(sorter);
+        }
+        free(sorter->arena);
+        sorter->arena = malloc(allocated);
+        if (!sorter->arena) {
+            error("Cannot allocate memory for sort");
+        }
+        sorter->arenaAllocated = allocated;
+    }
+    if (sorter->itemsCount >= sorter->itemsAllocated) {
+        sorter->itemsAllocated = sorter->itemsAllocated ? sorter->itemsAllocated * 2 : 1024;
+        sorter->items = realloc(sorter->items, sorter->itemsAllocated * sizeof(sortRecord));
+        if (!sorter->items) {
+            error("Cannot allocate memory for sort");
+        }
+    }
+    item = &sorter->items[sorter->itemsCount++];
+    item->key = sorter->arena + sorter->arenaLength;
+    item->keyLength = keyLength;
+    item->value = item->key + keyLength;
+    item->valueLength = valueLength;
+    memcpy(item->key, key, keyLength);
+    memcpy(item->value, value, valueLength);
+    sorter->arenaLength += keyLength + valueLength;
+}
+
+/**
+ * Gets next record in key order.
+ *
+ * \param sorter Sorter instance.
+ * \param record Record (valid until next call).
+ *
+ * \return False when all records were read.
+ */
+bool sorterNext(externalSorter* sorter, sortRecord* record) {
+    if (!sorter->finished) {
+        sorter->finished = true;
+        if (sorter->runsCount) {
+            _sorterSpill(sorter);
+            free(sorter->arena);
+            free(sorter->items);
+            sorter->arena = NULL;
+            sorter->items = NULL;
+            sorter->arenaAllocated = sorter->itemsAllocated = 0;
+            //Smallest (last) runs are merged first, to merge at most SORT_MAX_RUNS runs.
+            if (sorter->runsCount > SORT_MAX_RUNS) {
+                _sorterMergeRuns(sorter, SORT_MAX_RUNS - 1);
+            }
+            _sorterStartMerge(sorter, 0);
+        } else {
+            qsort(sorter->items, sorter->itemsCount, sizeof(sortRecord), _sorterCompareItems);
+        }
+    }
+    if (sorter->runsCount) {
+        return(_sorterMergeNext(sorter, record));
+    }
+    if (sorter->nextItem >= sorter->itemsCount) {
+        return(false);
+    }
+    *record = sorter->items[sorter->nextItem++];
+    return(true);
+}
+
+/**
+ * Destroy a sorter, its temporary files and release memory.
+ *
+ * \param sorter Sorter instance.
+ */
+void sorterDestroy(externalSorter* sorter) {
+    for (size_t i = 0; i < sorter->runsCount; i++) {
+        _sorterDestroyRun(sorter->runs[i]);
+    }
+    free(sorter->runs);
+    free(sorter->heap);
+    free(sorter->arena);
+    free(sorter->items);
+    free(sorter);
+}
@@ -0,0 +1,329 @@
+/**
+ * Per column statistics : null counts, ranges, strings lengths and
+ * HyperLogLog distinct counts, in a single pass.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "error.h"
+#include "hash.h"
+#include "stats.h"
+#include "sink.h"
+
+#include <math.h>
+
+/**
+ * EPF field types names, by EPF_FIELDTYPE_*.
+ */
+const char* _statsTypeNames[] = {
+    "UNKNOWN", "BIGINT", "INTEGER", "BOOLEAN", "VARCHAR", "DATETIME", "LONGTEXT", "DECIMAL"
+};
+
+/**
+ * Adds a value hash to HyperLogLog registers.
+ *
+ * \param registers Registers.
+ * \param hash      Value hash.
+ */
+void _statsHllAdd(unsigned char* registers, uint64_t hash) {
+    size_t index = hash >> (64 - STATS_HLL_BITS);
+    unsigned char rank = 1;
+
+    //Rank : position of the first set bit after index bits.
+    hash <<= STATS_HLL_BITS;
+    while (!(hash & 0x8000000000000000ULL) && (rank <= 64 - STATS_HLL_BITS)) {
+        hash <<= 1;
+        rank++;
+    }
+    if (rank > registers[index]) {
+        registers[index] = rank;
+    }
+}
+
+/**
+ * Writes a DATETIME value (UTC milliseconds) as an ISO 8601 json string.
+ *
+ * \param json         JSON file.
+ * \param milliseconds Milliseconds since the Unix epoch.
+ */
+void _statsWriteDate(FILE* json, int64_t milliseconds) {
+    int64_t remainder = milliseconds % 1000;
+    time_t seconds;
+    struct tm date;
+    char formatted[64];
+
+    if (remainder < 0) {
+        remainder += 1000;
+    }
+    seconds = (milliseconds - remainder) / 1000;
+    if (!gmtime_r(&seconds, &date)) {
+        fprintf(json, "null");
+        return;
+    }
+    strftime(formatted, sizeof(formatted), "%Y-%m-%dT%H:%M:%S", &date);
+    fprintf(json, "\"%s.%03dZ\"", formatted, (int)remainder);
+}
+
+/**
+ * Sink entries consumer : adds an entry.
+ *
+ * \param context Statistics.
+ * \param values  Typed values.
+ */
+void _statsSinkWrite(void* context, EPFValue* values) {
+    statsAdd(context, values);
+}
+
+/**
+ * Sink finisher : writes json file and destroys statistics.
+ *
+ * \param context Statistics.
+ */
+void _statsSinkClose(void* context) {
+    statsCollector* stats = context;
+
+    statsWrite(stats, stats->collection, stats->path);
+    statsDestroy(stats);
+}
+
+
+/**
+ * Creates statistics of an EPF file.
+ *
+ * \param file EPFFile instance (header parsed).
+ *
+ * \return Statistics.
+ */
+statsCollector* statsInit(EPFFile* file) {
+    statsCollector* stats;
+
+    stats = calloc(1, sizeof(statsCollector));
+    if (!stats) {
+        error("Cannot allocate memory");
+    }
+    stats->file = file;
+    stats->columns = calloc(file->fieldsCount, sizeof(statsColumn));
+    if (!stats->columns) {
+        error("Cannot allocate memory");
+    }
+    for (size_t i = 0; i < file->fieldsCount; i++) {
+        stats->columns[i].registers = calloc(STATS_HLL_REGISTERS, sizeof(unsigned char));
+        if (!stats->columns[i].registers) {
+            error("Cannot allocate memory");
+        }
+    }
+    return(stats);
+}
+
+/**
+ * Adds an entry to statistics.
+ *
+ * \param stats  Statistics.
+ * \param values Typed values (fieldsCount values).
+ */
+void statsAdd(statsCollector* stats, EPFValue* values) {
+    statsColumn* column;
+    EPFValue* value;
+    double decimal;
+
+    stats->entries++;
+    for (size_t i = 0; i < stats->file->fieldsCount; i++) {
+        column = stats->columns + i;
+        value = values + i;
+        if (value->isNull) {
+            column->nulls++;
+            continue;
+        }
+        switch (stats->file->fields[i]->fieldType) {
+            case EPF_FIELDTYPE_BIGINT :
+            case EPF_FIELDTYPE_INTEGER :
+            case EPF_FIELDTYPE_BOOLEAN :
+            case EPF_FIELDTYPE_DATETIME :
+                if (!column->hasRange || (value->integer < column->minInteger)) {
+                    column->minInteger = value->integer;
+                }
+                if (!column->hasRange || (value->integer > column->maxInteger)) {
+                    column->maxInteger = value->integer;
+                }
+                column->hasRange = true;
+                _statsHllAdd(column->registers, hashBytes(&value->integer, sizeof(int64_t), 0));
+                break;
+            case EPF_FIELDTYPE_DECIMAL :
+                //-0.0 and 0.0 are the same value.
+                decimal = value->decimal ? value->decimal : 0.0;
+                if (isfinite(decimal)) {
+                    if (!column->hasRange || (decimal < column->minDecimal)) {
+                        column->minDecimal = decimal;
+                    }
+                    if (!column->hasRange || (decimal > column->maxDecimal)) {
+                        column->maxDecimal = decimal;
+                    }
+                    column->hasRange = true;
+                }
+                _statsHllAdd(column->registers, hashBytes(&decimal, sizeof(double), 0));
+                break;
+            case EPF_FIELDTYPE_VARCHAR :
+            case EPF_FIELDTYPE_LONGTEXT :
+                if (!column->hasRange || (value->length < column->minLength)) {
+                    column->minLength = value->length;
+                }
+                if (!column->hasRange || (value->length > column->maxLength)) {
+                    column->maxLength = value->length;
+                }
+                column->hasRange = true;
+                column->totalLength += value->length;
+                _statsHllAdd(column->registers, hashBytes(value->string, value->length, 0));
+                break;
+        }
+    }
+}
+
+/**
+ * Estimates distinct non null values count of a field.
+ *
+ * \param stats Statistics.
+ * \param field Field index.
+ *
+ * \return Estimated distinct values count.
+ */
+unsigned long statsDistinct(statsCollector* stats, size_t field) {
+    statsColumn* column = stats->columns + field;
+    double registers = STATS_HLL_REGISTERS;
+    double sum = 0;
+    double estimate;
+    size_t zeros = 0;
+
+    for (size_t i = 0; i < STATS_HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -column->registers[i]);
+        if (!column->registers[i]) {
+            zeros++;
+        }
+    }
+    estimate = 0.7213 / (1.0 + 1.079 / registers) * registers * registers / sum;
+    //Small cardinalities : linear counting of empty registers is more accurate.
+    if ((estimate <= 2.5 * registers) && zeros) {
+        estimate = registers * log(registers / zeros);
+    }
+    estimate = round(estimate);
+    if (estimate > stats->entries - column->nulls) {
+        return(stats->entries - column->nulls);
+    }
+    return((unsigned long)estimate);
+}
+
+/**
+ * Writes statistics as a json file.
+ *
+ * \param stats      Statistics.
+ * \param collection Collection name.
+ * \param path       JSON file path.
+ */
+void statsWrite(statsCollector* stats, char* collection, char* path) {
+    FILE* json;
+    EPFField* field;
+    statsColumn* column;
+
+    json = fopen(path, "w");
+    if (!json) {
+        error("Could not create file (%s) : %s", strerror(errno), path);
+    }
+    fprintf(json, "{\"collection\" : \"%s\", \"entries\" : %lu, \"fields\" : [", collection, stats->entries);
+    for (size_t i = 0; i < stats->file->fieldsCount; i++) {
+        field = stats->file->fields[i];
+        column = stats->columns + i;
+        fprintf(
+            json,
+            "%s\n  {\"name\" : \"%s\", \"type\" : \"%s\", \"nulls\" : %lu, \"distinct\" : %lu",
+            i ? "," : "",
+            field->fieldName,
+            _statsTypeNames[field->fieldType <= EPF_FIELDTYPE_DECIMAL ? field->fieldType : 0],
+            column->nulls,
+            statsDistinct(stats, i)
+        );
+        if (column->hasRange) {
+            switch (field->fieldType) {
+                case EPF_FIELDTYPE_BIGINT :
+                case EPF_FIELDTYPE_INTEGER :
+                case EPF_FIELDTYPE_BOOLEAN :
+                    fprintf(json, ", \"min\" : %" PRId64 ", \"max\" : %" PRId64, column->minInteger, column->maxInteger);
+                    break;
+                case EPF_FIELDTYPE_DATETIME :
+                    fprintf(json, ", \"min\" : ");
+                    _statsWriteDate(json, column->minInteger);
+                    fprintf(json, ", \"max\" : ");
+                    _statsWriteDate(json, column->maxInteger);
+                    break;
+                case EPF_FIELDTYPE_DECIMAL :
+                    fprintf(json, ", \"min\" : %.17g, \"max\" : %.17g", column->minDecimal, column->maxDecimal);
+                    break;
+                case EPF_FIELDTYPE_VARCHAR :
+                case EPF_FIELDTYPE_LONGTEXT :
+                    fprintf(
+                        json,
+                        ", \"minLength\" : %zu, \"maxLength\" : %zu, \"avgLength\" : %.2f",
+                        column->minLength,
+                        column->maxLength,
+                        (double)column->totalLength / (stats->entries - column->nulls)
+                    );
+                    break;
+            }
+        }
+        fprintf(json, "}");
+    }
+    fprintf(json, "\n] }\n");
+    if (fclose(json)) {
+        error("Could not write file (%s) : %s", strerror(errno), path);
+    }
+}
+
+/**
+ * Destroy statistics and release memory.
+ *
+ * \param stats Statistics.
+ */
+void statsDestroy(statsCollector* stats) {
+    for (size_t i = 0; i < stats->file->fieldsCount; i++) {
+        free(stats->columns[i].registers);
+    }
+    free(stats->columns);
+    free(stats->collection);
+    free(stats->path);
+    free(stats);
+}
+
+/**
+ * Creates a sink gathering statistics, written as a json file when done.
+ *
+ * \param stats      Statistics (destroyed with sink).
+ * \param collection Collection name.
+ * \param path       JSON file path.
+ *
+ * \return Sink.
+ */
+rowSink* statsSink(statsCollector* stats, char* collection, char* path) {
+    stats->collection = strdup(collection);
+    stats->path = strdup(path);
+    if (!stats->collection || !stats->path) {
+        error("Cannot allocate memory");
+    }
+    return(sinkCreate(stats, _statsSinkWrite, _statsSinkClose));
+}
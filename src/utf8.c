@@ -0,0 +1,191 @@
+/**
+ * UTF-8 validation and repair.
+ *
+ * ASCII runs are skipped 16 bytes at a time (SSE2, 8 bytes at a time
+ * elsewhere), only the non ASCII sequences go through the scalar decoder
+ * following the well-formed byte sequences table of Unicode chapter 3.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EPF2Bson.h"
+#include "utf8.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * U+FFFD REPLACEMENT CHARACTER.
+ */
+#define UTF8_REPLACEMENT            "\xEF\xBF\xBD"
+
+/**
+ * Skips ASCII bytes.
+ *
+ * \param data   Data.
+ * \param length Data length.
+ *
+ * \return Offset of the first non ASCII byte (or length).
+ */
+size_t _utf8SkipAscii(const unsigned char* data, size_t length) {
+    size_t position = 0;
+
+#ifdef __SSE2__
+    while (
+        (position + 16 <= length) &&
+        !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data + position)))
+    ) {
+        position += 16;
+    }
+#else
+    uint64_t word;
+
+    while (position + 8 <= length) {
+        memcpy(&word, data + position, sizeof(uint64_t));
+        if (word & 0x8080808080808080ULL) {
+            break;
+        }
+        position += 8;
+    }
+#endif
+    while ((position < length) && (data[position] < 0x80)) {
+        position++;
+    }
+    return(position);
+}
+
+/**
+ * Decodes the non ASCII sequence starting a buffer.
+ *
+ * \param data      Data (first byte is not ASCII).
+ * \param length    Data length.
+ * \param consumed  Sequence length if valid, maximal invalid subpart length
+ *                  (at least 1) otherwise.
+ *
+ * \return True if sequence is valid.
+ */
+bool _utf8Decode(const unsigned char* data, size_t length, size_t* consumed) {
+    unsigned char lower = 0x80;
+    unsigned char upper = 0xBF;
+    size_t sequence;
+
+    *consumed = 1;
+    if ((data[0] >= 0xC2) && (data[0] <= 0xDF)) {
+        sequence = 2;
+    } else if ((data[0] >= 0xE0) && (data[0] <= 0xEF)) {
+        sequence = 3;
+        if (data[0] == 0xE0) {
+            lower = 0xA0;
+        } else if (data[0] == 0xED) {
+            upper = 0x9F;
+        }
+    } else if ((data[0] >= 0xF0) && (data[0] <= 0xF4)) {
+        sequence = 4;
+        if (data[0] == 0xF0) {
+            lower = 0x90;
+        } else if (data[0] == 0xF4) {
+            upper = 0x8F;
+        }
+    } else {
+        return(false);
+    }
+    for (size_t i = 1; i < sequence; i++) {
+        if ((i >= length) || (data[i] < lower) || (data[i] > upper)) {
+            return(false);
+        }
+        (*consumed)++;
+        lower = 0x80;
+        upper = 0xBF;
+    }
+    return(true);
+}
+
+
+/**
+ * Checks a byte sequence is valid UTF-8.
+ *
+ * \param data   Data.
+ * \param length Data length.
+ *
+ * \return True if valid.
+ */
+bool utf8Validate(const char* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t position = 0;
+    size_t consumed;
+
+    while ((position += _utf8SkipAscii(bytes + position, length - position)) < length) {
+        if (!_utf8Decode(bytes + position, length - position, &consumed)) {
+            return(false);
+        }
+        position += consumed;
+    }
+    return(true);
+}
+
+/**
+ * Maximum repaired length of a byte sequence.
+ *
+ * \param length Data length.
+ *
+ * \return Repaired length upper bound (0 terminator included).
+ */
+size_t utf8RepairBound(size_t length) {
+    return(length * 3 + 1);
+}
+
+/**
+ * Copies a byte sequence, replacing each maximal invalid subpart by U+FFFD.
+ *
+ * \param data   Data.
+ * \param length Data length.
+ * \param output Output buffer (at least utf8RepairBound(length) bytes), 0 terminated.
+ *
+ * \return Repaired length.
+ */
+size_t utf8Repair(const char* data, size_t length, char* output) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t position = 0;
+    size_t written = 0;
+    size_t ascii;
+    size_t consumed;
+
+    while (position < length) {
+        ascii = _utf8SkipAscii(bytes + position, length - position);
+        memcpy(output + written, data + position, ascii);
+        written += ascii;
+        position += ascii;
+        if (position == length) {
+            break;
+        }
+        if (_utf8Decode(bytes + position, length - position, &consumed)) {
+            memcpy(output + written, data + position, consumed);
+            written += consumed;
+        } else {
+            memcpy(output + written, UTF8_REPLACEMENT, 3);
+            written += 3;
+        }
+        position += consumed;
+    }
+    output[written] = 0;
+    return(written);
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Checks that converting a row does no heap allocation once warmed up :
+# allocations counted on a small and a large EPF file must be the same
+# (up to a few geometric buffers growths).
+#
+# Usage: allocations.sh <EPF2Bson binary> <malloccount.so>
+#
+
+BINARY=$1
+PRELOAD=$2
+SLACK=32
+WORKDIR=$(mktemp -d "${TMPDIR:-/tmp}/EPF2Bson-test-XXXXXX")
+STATUS=0
+
+. "$(dirname "$0")/common.sh"
+
+trap 'rm -rf "$WORKDIR"' EXIT
+
+# _count <EPF directory> <options...> : allocations count in $COUNT
+_count() {
+    directory=$1
+    shift
+    rm -rf "$WORKDIR/dump" "$WORKDIR/count"
+    if ! MALLOC_COUNT_FILE="$WORKDIR/count" LD_PRELOAD="$PRELOAD" "$BINARY" -e "$directory" -n test -d "$WORKDIR/dump" "$@" > /dev/null 2>&1; then
+        echo "FAILED [$*] : EPF2Bson exited with an error"
+        exit 1
+    fi
+    COUNT=$(cat "$WORKDIR/count")
+}
+
+_generate 1000 "$WORKDIR/small" 40
+_generate 20000 "$WORKDIR/large" 40
+
+for options in "" "--batch-rows 0" "--pk-id" "--where flag=1" "--arrow --stats --ndjson"; do
+    _count "$WORKDIR/small" $options
+    small=$COUNT
+    _count "$WORKDIR/large" $options
+    large=$COUNT
+    if [ $((large - small)) -gt $SLACK ]; then
+        echo "FAILED [$options] : $small allocations for 1000 rows, $large for 20000 rows"
+        STATUS=1
+    else
+        echo "OK     [$options] : $small allocations for 1000 rows, $large for 20000 rows"
+    fi
+done
+exit $STATUS
@@ -0,0 +1,26 @@
+#
+# Helpers shared by tests drivers (sourced).
+#
+
+FS=$(printf '\001')
+RS=$(printf '\002')
+
+# _generate <rows> <directory> <description words> : writes <directory>/application
+_generate() {
+    mkdir -p "$2"
+    awk -v rows="$1" -v words="$3" -v FS_="$FS" -v RS_="$RS" 'BEGIN {
+        printf "#export_date%sapplication_id%sname%sdescription%sprice%sreleased%sflag%s\n", FS_, FS_, FS_, FS_, FS_, FS_, RS_
+        printf "#primaryKey:application_id%s\n", RS_
+        printf "#dbTypes:BIGINT%sINTEGER%sVARCHAR(200)%sLONGTEXT%sDECIMAL(9,3)%sDATETIME%sBOOLEAN%s\n", FS_, FS_, FS_, FS_, FS_, FS_, RS_
+        printf "#exportMode:FULL%s\n", RS_
+        for (i = 0; i < rows; i++) {
+            description = ""
+            for (j = 0; j < i % words; j++) {
+                description = description "Lorem \"ipsum\" dolor sit amet "
+            }
+            printf "1220000000000%s%d%sApplication %d%s%s%s%d.%03d%s20%02d-%02d-%02d 12:%02d:00%s%d%s\n", \
+                FS_, i, FS_, i, FS_, description, FS_, i % 100, i % 1000, FS_, i % 30, i % 12 + 1, i % 28 + 1, i % 60, FS_, i % 2, RS_
+        }
+        printf "#recordsWritten:%d%s\n", rows, RS_
+    }' > "$2/application"
+}
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Checks --dedup : one entry kept per primary key (the first or the last one),
+# entries in input order without --sort-by-pk, and NDJSON output holding the
+# same entries as BSON files.
+#
+# Usage: dedup.sh <EPF2Bson binary>
+#
+
+BINARY=$1
+WORKDIR=$(mktemp -d "${TMPDIR:-/tmp}/EPF2Bson-test-XXXXXX")
+STATUS=0
+
+. "$(dirname "$0")/common.sh"
+
+trap 'rm -rf "$WORKDIR"' EXIT
+
+# _check <description> <condition...>
+_check() {
+    description=$1
+    shift
+    if "$@"; then
+        echo "OK     $description"
+    else
+        echo "FAILED $description"
+        STATUS=1
+    fi
+}
+
+# _duplicate <source directory> <target directory> <input|first|last> : writes
+# the source application file with a copy of every 7th entry and another one of
+# every 21st entry appended (input), or the entries deduplication keeps.
+_duplicate() {
+    mkdir -p "$2"
+    awk -v mode="$3" -v FS_="$FS" -v RS_="$RS" 'BEGIN {
+        RS = RS_ "\n"
+        FS = FS_
+    }
+    /^#recordsWritten:/ {
+        next
+    }
+    /^#/ {
+        printf "%s%s\n", $0, RS_
+        next
+    }
+    {
+        rows[count++] = $0
+    }
+    function copy(row, name) {
+        split(row, fields, FS_)
+        fields[3] = name " " fields[2]
+        row = fields[1]
+        for (f = 2; f <= 7; f++) {
+            row = row FS_ fields[f]
+        }
+        printf "%s%s\n", row, RS_
+        written++
+    }
+    END {
+        for (i = 0; i < count; i++) {
+            if ((mode != "last") || (i % 7)) {
+                printf "%s%s\n", rows[i], RS_
+                written++
+            }
+        }
+        for (i = 0; (mode != "first") && (i < count); i += 7) {
+            if ((mode == "input") || (i % 21)) {
+                copy(rows[i], "Copy")
+            }
+        }
+        for (i = 0; (mode != "first") && (i < count); i += 21) {
+            copy(rows[i], "Again")
+        }
+        printf "#recordsWritten:%d%s\n", written, RS_
+    }' "$1/application" > "$2/application"
+}
+
+# _convert <EPF directory> <dump directory> <options...>
+_convert() {
+    epf=$1
+    dump=$2
+    shift 2
+    if ! "$BINARY" -e "$epf" -n test -d "$dump" "$@" > /dev/null 2>&1; then
+        echo "FAILED [$*] : EPF2Bson exited with an error"
+        exit 1
+    fi
+}
+
+_generate 5000 "$WORKDIR/unique" 4
+for mode in input first last; do
+    _duplicate "$WORKDIR/unique" "$WORKDIR/$mode" $mode
+    _convert "$WORKDIR/$mode" "$WORKDIR/$mode.dump" --pk-id --ndjson
+    _convert "$WORKDIR/$mode" "$WORKDIR/$mode.sorted" --pk-id --ndjson --sort-by-pk
+done
+
+for mode in first last; do
+    _convert "$WORKDIR/input" "$WORKDIR/dedup-$mode" --pk-id --ndjson --dedup $mode
+    _check "--dedup $mode keeps the $mode entries in input order" cmp -s "$WORKDIR/dedup-$mode/test/application.bson" "$WORKDIR/$mode.dump/test/application.bson"
+    _check "--dedup $mode NDJSON has the same entries" cmp -s "$WORKDIR/dedup-$mode/test/application.ndjson" "$WORKDIR/$mode.dump/test/application.ndjson"
+    _check "--dedup $mode NDJSON has no duplicate _id" test -z "$(cut -d, -f1 "$WORKDIR/dedup-$mode/test/application.ndjson" | sort | uniq -d)"
+    _convert "$WORKDIR/input" "$WORKDIR/sorted-$mode" --pk-id --ndjson --sort-by-pk --dedup $mode
+    _check "--sort-by-pk --dedup $mode keeps the $mode entries" cmp -s "$WORKDIR/sorted-$mode/test/application.bson" "$WORKDIR/$mode.sorted/test/application.bson"
+    _check "--sort-by-pk --dedup $mode NDJSON has the same entries" cmp -s "$WORKDIR/sorted-$mode/test/application.ndjson" "$WORKDIR/$mode.sorted/test/application.ndjson"
+done
+
+exit $STATUS
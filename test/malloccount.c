@@ -0,0 +1,69 @@
+/**
+ * Heap allocations counter, preloaded (LD_PRELOAD) by allocations tests.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+/**
+ * glibc allocator entry points (the preloaded ones wrap them).
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pointer, size_t size);
+
+/**
+ * Allocations count (malloc, calloc and realloc calls).
+ */
+static uint64_t allocations = 0;
+
+void* malloc(size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return(__libc_malloc(size));
+}
+
+void* calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return(__libc_calloc(count, size));
+}
+
+void* realloc(void* pointer, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return(__libc_realloc(pointer, size));
+}
+
+/**
+ * Writes allocations count in $MALLOC_COUNT_FILE at exit.
+ */
+__attribute__((destructor)) void _mallocCountReport() {
+    char* path = getenv("MALLOC_COUNT_FILE");
+    FILE* fp;
+
+    if (!path || !(fp = fopen(path, "w"))) {
+        return;
+    }
+    fprintf(fp, "%" PRIu64 "\n", __atomic_load_n(&allocations, __ATOMIC_RELAXED));
+    fclose(fp);
+}
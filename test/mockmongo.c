@@ -0,0 +1,385 @@
+/**
+ * Mock MongoDB server (OP_MSG) for MongoDB sink tests.
+ *
+ * @author              Julien CROUZET <contact@juliencrouzet.fr>
+ * @copyright           Julien CROUZET <contact@juliencrouzet.fr>
+ */
+
+/**
+    This file is part of EPF2Bson.
+
+    EPF2Bson is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    EPF2Bson is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with EPF2Bson. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/**
+ * Listens on 127.0.0.1 (random port, written to <port file>), acknowledges
+ * every command with {ok: 1, n: <documents>}, logs one line per command in
+ * <log file> and appends inserted documents to <documents file>. Exits once
+ * all clients are disconnected.
+ *
+ * Usage: mockmongo <port file> <log file> <documents file>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <endian.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MOCK_OP_MSG                 2013
+#define MOCK_MAX_CONNECTIONS        64
+#define MOCK_MAX_MESSAGE            50331648
+
+/**
+ * Aborts with a message.
+ *
+ * \param message Message.
+ */
+void _mockFail(const char* message) {
+    fprintf(stderr, "mockmongo : %s (%s)\n", message, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Reads a little endian int32.
+ *
+ * \param data Data.
+ *
+ * \return Value.
+ */
+int32_t _mockInt32(const char* data) {
+    int32_t value;
+
+    memcpy(&value, data, sizeof(int32_t));
+    return(le32toh(value));
+}
+
+/**
+ * Finds a field of a BSON document.
+ *
+ * \param document Document.
+ * \param name     Field name (NULL for first field).
+ * \param type     Field type (output).
+ * \param key      Field name (output, may be NULL).
+ *
+ * \return Field value, NULL if missing.
+ */
+const char* _mockFind(const char* document, const char* name, char* type, const char** key) {
+    const char* end = document + _mockInt32(document) - 1;
+    const char* position = document + 4;
+    const char* field;
+    const char* value;
+
+    while (position < end) {
+        *type = *position++;
+        field = position;
+        value = field + strlen(field) + 1;
+        if (!name || !strcmp(field, name)) {
+            if (key) {
+                *key = field;
+            }
+            return(value);
+        }
+        switch (*type) {
+            case 0x01 :
+            case 0x09 :
+            case 0x11 :
+            case 0x12 :
+                position = value + 8;
+                break;
+            case 0x02 :
+                position = value + 4 + _mockInt32(value);
+                break;
+            case 0x03 :
+            case 0x04 :
+                position = value + _mockInt32(value);
+                break;
+            case 0x05 :
+                position = value + 5 + _mockInt32(value);
+                break;
+            case 0x07 :
+                position = value + 12;
+                break;
+            case 0x08 :
+                position = value + 1;
+                break;
+            case 0x0A :
+                position = value;
+                break;
+            case 0x10 :
+                position = value + 4;
+                break;
+            default :
+                return(NULL);
+        }
+    }
+    return(NULL);
+}
+
+/**
+ * Reads exactly length bytes.
+ *
+ * \param fd     Socket.
+ * \param data   Buffer.
+ * \param length Bytes to read.
+ *
+ * \return False if connection was closed before the first byte.
+ */
+bool _mockRead(int fd, char* data, size_t length) {
+    ssize_t received;
+    bool started = false;
+
+    while (length) {
+        received = recv(fd, data, length, 0);
+        if ((received < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (received <= 0) {
+            if (!started && !received) {
+                return(false);
+            }
+            _mockFail("cannot read message");
+        }
+        started = true;
+        data += received;
+        length -= received;
+    }
+    return(true);
+}
+
+/**
+ * Sends a {ok: 1.0, n: <documents>} reply.
+ *
+ * \param fd        Socket.
+ * \param requestId Request id.
+ * \param documents Documents count.
+ */
+void _mockReply(int fd, int32_t requestId, int32_t documents) {
+    char reply[16 + 4 + 1 + 4 + 12 + 7 + 1];
+    int32_t value;
+    double ok = 1.0;
+    uint64_t okBits;
+    char* position = reply;
+
+    value = htole32(sizeof(reply));
+    memcpy(position, &value, 4);
+    value = htole32(requestId + 1000000);
+    memcpy(position + 4, &value, 4);
+    value = htole32(requestId);
+    memcpy(position + 8, &value, 4);
+    value = htole32(MOCK_OP_MSG);
+    memcpy(position + 12, &value, 4);
+    memset(position + 16, 0, 5);
+    position += 21;
+    value = htole32(4 + 12 + 7 + 1);
+    memcpy(position, &value, 4);
+    position += 4;
+    memcpy(&okBits, &ok, sizeof(double));
+    okBits = htole64(okBits);
+    memcpy(position, "\x01ok", 4);
+    memcpy(position + 4, &okBits, 8);
+    position += 12;
+    memcpy(position, "\x10n", 3);
+    value = htole32(documents);
+    memcpy(position + 3, &value, 4);
+    position[7] = 0;
+    if (send(fd, reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        _mockFail("cannot send reply");
+    }
+}
+
+/**
+ * Reads a command and acknowledges it.
+ *
+ * \param fd         Socket.
+ * \param connection Connection number.
+ * \param log        Log file.
+ * \param output     Inserted documents file.
+ *
+ * \return False if connection was closed.
+ */
+bool _mockServe(int fd, int connection, FILE* log, FILE* output) {
+    static char* message = NULL;
+    static size_t allocated = 0;
+    char header[16];
+    size_t length;
+    const char* body = NULL;
+    const char* position;
+    const char* end;
+    const char* command;
+    const char* value;
+    const char* field;
+    const char* index;
+    char type;
+    int32_t documents = 0;
+    int ordered = -1;
+
+    if (!_mockRead(fd, header, 16)) {
+        return(false);
+    }
+    length = _mockInt32(header);
+    if ((length < 21) || (length > MOCK_MAX_MESSAGE) || (_mockInt32(header + 12) != MOCK_OP_MSG)) {
+        _mockFail("invalid OP_MSG header");
+    }
+    length -= 16;
+    if (length > allocated) {
+        allocated = length;
+        if (!(message = realloc(message, allocated))) {
+            _mockFail("cannot allocate memory");
+        }
+    }
+    _mockRead(fd, message, length);
+    position = message + 4;
+    end = message + length;
+    while (position < end) {
+        if (*position == 0) {
+            body = position + 1;
+            position = body + _mockInt32(body);
+        } else if (*position == 1) {
+            field = position + 5;
+            value = field + strlen(field) + 1;
+            position = position + 1 + _mockInt32(position + 1);
+            for (; value < position; value += _mockInt32(value)) {
+                if (fwrite(value, 1, _mockInt32(value), output) != (size_t)_mockInt32(value)) {
+                    _mockFail("cannot write documents");
+                }
+                documents++;
+            }
+        } else {
+            _mockFail("invalid OP_MSG section");
+        }
+    }
+    if (!body || !(value = _mockFind(body, NULL, &type, &command)) || (type != 0x02)) {
+        _mockFail("invalid command");
+    }
+    if (!strcmp(command, "insert")) {
+        if ((field = _mockFind(body, "ordered", &type, NULL)) && (type == 0x08)) {
+            ordered = *field;
+        }
+        fprintf(
+            log,
+            "insert %s.%s documents=%" PRId32 " bytes=%zu ordered=%d connection=%d\n",
+            _mockFind(body, "$db", &type, NULL) + 4,
+            value + 4,
+            documents,
+            length + 16,
+            ordered,
+            connection
+        );
+    } else if (!strcmp(command, "createIndexes")) {
+        index = _mockFind(body, "indexes", &type, NULL);
+        index = index ? _mockFind(index, "0", &type, NULL) : NULL;
+        field = index ? _mockFind(index, "key", &type, NULL) : NULL;
+        if (!field || !_mockFind(field, NULL, &type, &field)) {
+            _mockFail("invalid createIndexes command");
+        }
+        fprintf(
+            log,
+            "createIndexes %s.%s key=%s name=%s\n",
+            _mockFind(body, "$db", &type, NULL) + 4,
+            value + 4,
+            field,
+            _mockFind(index, "name", &type, NULL) + 4
+        );
+    } else {
+        fprintf(log, "%s\n", command);
+    }
+    _mockReply(fd, _mockInt32(header + 4), documents);
+    return(true);
+}
+
+
+int main(int argc, char** argv) {
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    struct pollfd fds[MOCK_MAX_CONNECTIONS + 1];
+    int numbers[MOCK_MAX_CONNECTIONS + 1];
+    size_t count = 1;
+    int accepted = 0;
+    FILE* fp;
+    FILE* log;
+    FILE* output;
+
+    if (argc != 4) {
+        fputs("Usage: mockmongo <port file> <log file> <documents file>\n", stderr);
+        return(EXIT_FAILURE);
+    }
+    if (!(log = fopen(argv[2], "w")) || !(output = fopen(argv[3], "w"))) {
+        _mockFail("cannot open output files");
+    }
+    fds[0].fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (
+        (fds[0].fd == -1) ||
+        bind(fds[0].fd, (struct sockaddr*)&address, sizeof(address)) ||
+        listen(fds[0].fd, MOCK_MAX_CONNECTIONS) ||
+        getsockname(fds[0].fd, (struct sockaddr*)&address, &addressLength)
+    ) {
+        _mockFail("cannot listen");
+    }
+    fds[0].events = POLLIN;
+    //Port file is written last : it tells the server is ready.
+    if (!(fp = fopen(argv[1], "w"))) {
+        _mockFail("cannot write port file");
+    }
+    fprintf(fp, "%d\n", ntohs(address.sin_port));
+    fclose(fp);
+    while (!accepted || (count > 1)) {
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _mockFail("poll() failed");
+        }
+        if ((fds[0].revents & POLLIN) && (count <= MOCK_MAX_CONNECTIONS)) {
+            fds[count].fd = accept(fds[0].fd, NULL, NULL);
+            if (fds[count].fd == -1) {
+                _mockFail("cannot accept connection");
+            }
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            numbers[count++] = accepted++;
+        }
+        for (size_t i = 1; i < count; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (!_mockServe(fds[i].fd, numbers[i], log, output)) {
+                close(fds[i].fd);
+                fds[i] = fds[count - 1];
+                numbers[i] = numbers[count - 1];
+                fds[i].revents = 0;
+                count--;
+                i--;
+            }
+        }
+    }
+    fprintf(log, "connections %d\n", accepted);
+    fclose(log);
+    fclose(output);
+    close(fds[0].fd);
+    return(EXIT_SUCCESS);
+}
@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# Checks MongoDB sink against a mock OP_MSG server : insert batches,
+# unordered writes, connections, createIndexes commands and inserted
+# documents (same as the BSON dump).
+#
+# Usage: mongo.sh <EPF2Bson binary> <mockmongo binary>
+#
+
+# Absolute paths : EPF2Bson runs from the work directory.
+BINARY=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+MOCK=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+WORKDIR=$(mktemp -d "${TMPDIR:-/tmp}/EPF2Bson-test-XXXXXX")
+STATUS=0
+
+. "$(dirname "$0")/common.sh"
+
+trap 'rm -rf "$WORKDIR"' EXIT
+
+# _check <description> <condition...>
+_check() {
+    description=$1
+    shift
+    if "$@"; then
+        echo "OK     $description"
+    else
+        echo "FAILED $description"
+        STATUS=1
+    fi
+}
+
+# _insert <options...> : runs EPF2Bson against a new mock server
+_insert() {
+    rm -f "$WORKDIR/port" "$WORKDIR/log" "$WORKDIR/documents"
+    "$MOCK" "$WORKDIR/port" "$WORKDIR/log" "$WORKDIR/documents" &
+    mock=$!
+    tries=0
+    while [ ! -s "$WORKDIR/port" ]; do
+        tries=$((tries + 1))
+        if [ $tries -gt 100 ]; then
+            echo "FAILED mock server did not start"
+            exit 1
+        fi
+        sleep 0.1
+    done
+    if ! (cd "$WORKDIR" && "$BINARY" -e "$WORKDIR/epf" -n test --mongo-uri "mongodb://127.0.0.1:$(cat "$WORKDIR/port")" "$@" > /dev/null 2>&1); then
+        kill $mock 2> /dev/null
+        echo "FAILED [$*] : EPF2Bson exited with an error"
+        exit 1
+    fi
+    wait $mock
+}
+
+# _documents : documents inserted (all batches)
+_documents() {
+    sed -n 's/^insert .* documents=\([0-9]*\) .*/\1/p' "$WORKDIR/log" | awk '{ total += $1 } END { print total }'
+}
+
+_generate 120000 "$WORKDIR/epf" 4
+
+# Batches of MONGO_BATCH_DOCUMENTS documents, without dump directory.
+_insert --mongo-connections 1 --pk-id
+_check "no dump directory is created" test ! -e "$WORKDIR/dump"
+_check "120000 documents are inserted" test "$(_documents)" = 120000
+_check "batches of 100000 documents" test "$(sed -n 's/^insert .* documents=\([0-9]*\) .*/\1/p' "$WORKDIR/log" | tr '\n' ' ')" = "100000 20000 "
+_check "writes are unordered" test "$(grep -c 'ordered=0' "$WORKDIR/log")" = 2
+mv "$WORKDIR/documents" "$WORKDIR/inserted.bson"
+"$BINARY" -e "$WORKDIR/epf" -n test -d "$WORKDIR/dump" --pk-id > /dev/null 2>&1
+_check "inserted documents are the BSON dump ones" cmp -s "$WORKDIR/inserted.bson" "$WORKDIR/dump/test/application.bson"
+
+# Batches bounded by writers buffers (--max-memory 64 : 8 MB), several connections.
+_insert --mongo-connections 3 --invalid-utf8 replace --max-memory 64
+_check "3 connections are opened" test "$(sed -n 's/^connections //p' "$WORKDIR/log")" = 3
+_check "120000 documents are inserted" test "$(_documents)" = 120000
+_check "batches are at most 8 MB" test "$(sed -n 's/^insert .* bytes=\([0-9]*\) .*/\1/p' "$WORKDIR/log" | awk '$1 > 8388608' | wc -l)" = 0
+_check "batches are sent on every connection" test "$(sed -n 's/^insert .* connection=\([0-9]*\)$/\1/p' "$WORKDIR/log" | sort -u | wc -l)" = 3
+_check "primary key index is created" grep -q '^createIndexes test.application key=application_id name=_EPF2Bson_application_id_$' "$WORKDIR/log"
+
+exit $STATUS